@@ -1968,7 +1968,7 @@ void C_BaseAnimating::StandardBlendingRules( CStudioHdr *hdr, Vector pos[], Quat
 #endif
 
 	IBoneSetup boneSetup( hdr, boneMask, poseparam );
-	boneSetup.InitPose( pos, q );
+	boneSetup.InitPoseSoA( pos, q );
 	boneSetup.AccumulatePose( pos, q, GetSequence(), fCycle, 1.0, currentTime, m_pIk );
 
 	// debugoverlay->AddTextOverlay( GetAbsOrigin() + Vector( 0, 0, 64 ), 0, 0, "%30s %6.2f : %6.2f", hdr->pSeqdesc( GetSequence() )->pszLabel( ), fCycle, 1.0 );
@@ -1988,6 +1988,8 @@ void C_BaseAnimating::StandardBlendingRules( CStudioHdr *hdr, Vector pos[], Quat
 		boneSetup.CalcBoneAdj( pos, q, controllers );
 	}
 
+	boneSetup.StorePose( pos, q );
+
 	ChildLayerBlend( pos, q, currentTime, boneMask );
 
 	UnragdollBlend( hdr, pos, q, currentTime );
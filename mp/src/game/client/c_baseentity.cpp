@@ -76,6 +76,7 @@ void cc_cl_interp_all_changed( IConVar *pConVar, const char *pOldString, float f
 static ConVar  cl_extrapolate( "cl_extrapolate", "1", FCVAR_CHEAT, "Enable/disable extrapolation if interpolation history runs out." );
 static ConVar  cl_interp_npcs( "cl_interp_npcs", "0.0", FCVAR_USERINFO, "Interpolate NPC positions starting this many seconds in past (or cl_interp, if greater)" );  
 static ConVar  cl_interp_all( "cl_interp_all", "0", 0, "Disable interpolation list optimizations.", 0, 0, 0, 0, cc_cl_interp_all_changed );
+static ConVar  cl_interp_batch( "cl_interp_batch", "1", 0, "Interpolate float and vector vars of all entities together in SIMD batches." );
 ConVar  r_drawmodeldecals( "r_drawmodeldecals", "1" );
 extern ConVar	cl_showerror;
 int C_BaseEntity::m_nPredictionRandomSeed = -1;
@@ -95,6 +96,19 @@ static unsigned short g_iAbsRecomputationStackPos = 0;
 static CUtlLinkedList<C_BaseEntity*, unsigned short> g_InterpolationList;
 static CUtlLinkedList<C_BaseEntity*, unsigned short> g_TeleportList;
 
+// While interpolated vars are being batched, their values aren't written until the
+// batch is flushed, so change detection in BaseInterpolatePart2 has to wait until then.
+struct DeferredInterpolationChange_t
+{
+	C_BaseEntity *m_pEntity;
+	Vector m_vecOldOrigin;
+	QAngle m_angOldAngles;
+	Vector m_vecOldVel;
+	int m_nChangeFlags;
+};
+static CInterpolatedVarBatch g_InterpolatedVarBatch;
+static CUtlVector<DeferredInterpolationChange_t> g_DeferredInterpolationChanges;
+
 #if !defined( NO_ENTITY_PREDICTION )
 //-----------------------------------------------------------------------------
 // Purpose: Maintains a list of predicted or client created entities
@@ -2844,6 +2858,17 @@ static ConVar cl_watchplayer( "cl_watchplayer", "-1", 0 );
 
 void C_BaseEntity::BaseInterpolatePart2( Vector &oldOrigin, QAngle &oldAngles, Vector &oldVel, int nChangeFlags )
 {
+	if ( g_pInterpolatedVarBatch )
+	{
+		DeferredInterpolationChange_t &change = g_DeferredInterpolationChanges[ g_DeferredInterpolationChanges.AddToTail() ];
+		change.m_pEntity = this;
+		change.m_vecOldOrigin = oldOrigin;
+		change.m_angOldAngles = oldAngles;
+		change.m_vecOldVel = oldVel;
+		change.m_nChangeFlags = nChangeFlags;
+		return;
+	}
+
 	if ( m_vecOrigin != oldOrigin )
 	{
 		nChangeFlags |= POSITION_CHANGED;
@@ -3090,6 +3115,16 @@ void C_BaseEntity::ProcessInterpolatedList()
 {
 	CheckInterpolatedVarParanoidMeasurement();
 
+	// Float and vector vars are gathered into one batch and written out together
+	// once every entity has been through Interpolate(); see CInterpolatedVarBatch.
+	bool bBatch = cl_interp_batch.GetBool();
+	if ( bBatch )
+	{
+		g_InterpolatedVarBatch.Begin();
+		g_DeferredInterpolationChanges.RemoveAll();
+		g_pInterpolatedVarBatch = &g_InterpolatedVarBatch;
+	}
+
 	// Interpolate the minimal set of entities that need it.
 	int iNext;
 	for ( int iCur=g_InterpolationList.Head(); iCur != g_InterpolationList.InvalidIndex(); iCur=iNext )
@@ -3099,6 +3134,19 @@ void C_BaseEntity::ProcessInterpolatedList()
 		
 		pCur->m_bReadyToDraw = pCur->Interpolate( gpGlobals->curtime );
 	}
+
+	if ( bBatch )
+	{
+		g_pInterpolatedVarBatch = NULL;
+		g_InterpolatedVarBatch.Flush();
+
+		for ( int i = 0; i < g_DeferredInterpolationChanges.Count(); ++i )
+		{
+			DeferredInterpolationChange_t &change = g_DeferredInterpolationChanges[i];
+			change.m_pEntity->BaseInterpolatePart2( change.m_vecOldOrigin, change.m_angOldAngles, change.m_vecOldVel, change.m_nChangeFlags );
+		}
+		g_DeferredInterpolationChanges.RemoveAll();
+	}
 }
 
 
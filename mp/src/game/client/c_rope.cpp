@@ -87,6 +87,9 @@ static ConVar r_rope_holiday_light_scale( "r_rope_holiday_light_scale", "0.055",
 static ConVar r_ropes_holiday_lights_allowed( "r_ropes_holiday_lights_allowed", "1", FCVAR_DEVELOPMENTONLY );
 
 static ConVar rope_wind_dist( "rope_wind_dist", "1000", 0, "Don't use CPU applying small wind gusts to ropes when they're past this distance." );
+static ConVar rope_batch_simulate( "rope_batch_simulate", "1", 0, "Simulate all visible ropes together, four at a time with SIMD." );
+static ConVar rope_freeze_dist( "rope_freeze_dist", "3000", 0, "Stop simulating ropes when they're past this distance (0 = never)." );
+static ConVar rope_freeze_outside_pvs( "rope_freeze_outside_pvs", "1", 0, "Stop simulating ropes that aren't in the view's PVS." );
 static ConVar rope_averagelight( "rope_averagelight", "1", 0, "Makes ropes use average of cubemap lighting instead of max intensity." );
 
 
@@ -250,6 +253,10 @@ public:
 	enum { MAX_ROPE_RENDERCACHE	= 128 };
 
 	void RemoveRopeFromQueuedRenderCaches( C_RopeKeyframe *pRope );
+
+	void QueueRopeSimulation( C_RopeKeyframe *pRope );
+	void RemoveRopeFromSimulationQueue( C_RopeKeyframe *pRope );
+	void SimulateRopes( void );
 	
 private:
 
@@ -289,6 +296,10 @@ private:
 	bool m_bDrawHolidayLights;
 	bool m_bHolidayInitialized;
 	int m_nHolidayLightsStyle;
+
+	// Ropes waiting to be stepped by SimulateRopes this frame.
+	CUtlVector<C_RopeKeyframe*>		m_SimulateQueue;
+	CUtlVector<CBaseRopePhysics*>	m_SimulatePhysics;
 };
 
 static CRopeManager s_RopeManager;
@@ -831,6 +842,51 @@ void CRopeManager::RemoveRopeFromQueuedRenderCaches( C_RopeKeyframe *pRope )
 	}	
 }
 
+void CRopeManager::QueueRopeSimulation( C_RopeKeyframe *pRope )
+{
+	m_SimulateQueue.AddToTail( pRope );
+}
+
+void CRopeManager::RemoveRopeFromSimulationQueue( C_RopeKeyframe *pRope )
+{
+	m_SimulateQueue.FindAndRemove( pRope );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Steps every rope that was queued by ClientThink this frame. The
+//			solver runs four ropes at a time, one per SIMD lane.
+//-----------------------------------------------------------------------------
+void CRopeManager::SimulateRopes( void )
+{
+	int nRopes = m_SimulateQueue.Count();
+	if ( nRopes == 0 )
+		return;
+
+	VPROF_BUDGET( "CRopeManager::SimulateRopes", VPROF_BUDGETGROUP_CLIENT_SIM );
+
+	m_SimulatePhysics.SetCount( nRopes );
+	for ( int i = 0; i < nRopes; ++i )
+	{
+		C_RopeKeyframe *pRope = m_SimulateQueue[i];
+		pRope->PreRopeSimulation();
+		m_SimulatePhysics[i] = &pRope->m_RopePhysics;
+	}
+
+	{
+		CTimeAdder adder( &g_RopeSimulateTicks );
+		CBaseRopePhysics::SimulateBatch( m_SimulatePhysics.Base(), nRopes, gpGlobals->frametime );
+	}
+
+	for ( int i = 0; i < nRopes; ++i )
+	{
+		C_RopeKeyframe *pRope = m_SimulateQueue[i];
+		pRope->PostRopeSimulation();
+		pRope->FinishSimulationStep();
+	}
+
+	m_SimulateQueue.RemoveAll();
+}
+
 //=============================================================================
 
 // ------------------------------------------------------------------------------------ //
@@ -1062,6 +1118,7 @@ C_RopeKeyframe::C_RopeKeyframe()
 C_RopeKeyframe::~C_RopeKeyframe()
 {
 	s_RopeManager.RemoveRopeFromQueuedRenderCaches( this );	
+	s_RopeManager.RemoveRopeFromSimulationQueue( this );
 	g_Ropes.FindAndRemove( this );
 
 	if ( m_pBackMaterial )
@@ -1337,13 +1394,23 @@ void C_RopeKeyframe::FinishInit( const char *pMaterialName )
 
 void C_RopeKeyframe::RunRopeSimulation( float flSeconds )
 {
-	// First, forget about links touching things.
-	for ( int i=0; i < m_nSegments; i++ )
-		m_LinksTouchingSomething[i] = false;
+	PreRopeSimulation();
 
 	// Simulate, and it will mark which links touched things.
 	m_RopePhysics.Simulate( flSeconds );
 
+	PostRopeSimulation();
+}
+
+void C_RopeKeyframe::PreRopeSimulation()
+{
+	// First, forget about links touching things.
+	for ( int i=0; i < m_nSegments; i++ )
+		m_LinksTouchingSomething[i] = false;
+}
+
+void C_RopeKeyframe::PostRopeSimulation()
+{
 	// Now count how many links touched something.
 	m_nLinksTouchingSomething = 0;
 	for ( int i=0; i < m_nSegments; i++ )
@@ -1353,6 +1420,46 @@ void C_RopeKeyframe::RunRopeSimulation( float flSeconds )
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Ropes that can't be seen don't need to move. They pick up where
+//			they left off once they come back into view.
+//-----------------------------------------------------------------------------
+bool C_RopeKeyframe::ShouldFreezeSimulation()
+{
+	// New data from the server always gets simulated so the endpoints catch up.
+	if ( m_bNewDataThisFrame )
+		return false;
+
+	// Test where the endpoints are now, not where the (possibly frozen) nodes were left,
+	// so a rope whose attachments moved back into view starts simulating again.
+	Vector vStart, vEnd;
+	GetEndPointPos( 0, vStart );
+	GetEndPointPos( 1, vEnd );
+
+	float flFreezeDist = rope_freeze_dist.GetFloat();
+	if ( flFreezeDist > 0 )
+	{
+		float flDist = CalcDistanceToLineSegment( MainViewOrigin(), vStart, vEnd );
+		if ( flDist > flFreezeDist )
+			return true;
+	}
+
+	if ( rope_freeze_outside_pvs.GetBool() )
+	{
+		// Every node is within half the rope's length of one of the endpoints
+		float flReach = MAX( m_RopeLength + m_Slack, 0 ) * 0.5f;
+		Vector vMins, vMaxs;
+		VectorMin( vStart, vEnd, vMins );
+		VectorMax( vStart, vEnd, vMaxs );
+		vMins -= Vector( flReach, flReach, flReach );
+		vMaxs += Vector( flReach, flReach, flReach );
+		if ( !engine->IsBoxInViewCluster( vMins, vMaxs ) )
+			return true;
+	}
+
+	return false;
+}
+
 Vector C_RopeKeyframe::ConstrainNode( const Vector &vNormal, const Vector &vNodePosition, const Vector &vMidpiont, float fNormalLength )
 {
 	// Get triangle edges formed
@@ -1402,37 +1509,53 @@ void C_RopeKeyframe::ClientThink()
 	if( !InitRopePhysics() ) // init if not already
 		return;
 
+	if( ShouldFreezeSimulation() )
+		return;
+
 	if( !DetectRestingState( m_bApplyWind ) )
 	{
+		if ( rope_batch_simulate.GetBool() )
+		{
+			// CRopeManager::SimulateRopes steps us along with everyone else once the thinks are done.
+			s_RopeManager.QueueRopeSimulation( this );
+			return;
+		}
+
 		// Update the simulation.
-		CTimeAdder adder( &g_RopeSimulateTicks );
-		
-		RunRopeSimulation( gpGlobals->frametime );
+		{
+			CTimeAdder adder( &g_RopeSimulateTicks );
+			RunRopeSimulation( gpGlobals->frametime );
+		}
 
-		g_nRopePointsSimulated += m_RopePhysics.NumNodes();
+		FinishSimulationStep();
+	}
+}
 
-		m_bNewDataThisFrame = false;
+void C_RopeKeyframe::FinishSimulationStep()
+{
+	g_nRopePointsSimulated += m_RopePhysics.NumNodes();
 
-		// Setup a new wind gust?
-		m_flCurrentGustTimer += gpGlobals->frametime;
-		m_flTimeToNextGust -= gpGlobals->frametime;
-		if( m_flTimeToNextGust <= 0 )
-		{
-			m_vWindDir = RandomVector( -1, 1 );
-			VectorNormalize( m_vWindDir );
+	m_bNewDataThisFrame = false;
 
-			static float basicScale = 50;
-			m_vWindDir *= basicScale;
-			m_vWindDir *= RandomFloat( -1.0f, 1.0f );
-			
-			m_flCurrentGustTimer = 0;
-			m_flCurrentGustLifetime = RandomFloat( 2.0f, 3.0f );
+	// Setup a new wind gust?
+	m_flCurrentGustTimer += gpGlobals->frametime;
+	m_flTimeToNextGust -= gpGlobals->frametime;
+	if( m_flTimeToNextGust <= 0 )
+	{
+		m_vWindDir = RandomVector( -1, 1 );
+		VectorNormalize( m_vWindDir );
 
-			m_flTimeToNextGust = RandomFloat( 3.0f, 4.0f );
-		}
+		static float basicScale = 50;
+		m_vWindDir *= basicScale;
+		m_vWindDir *= RandomFloat( -1.0f, 1.0f );
+		
+		m_flCurrentGustTimer = 0;
+		m_flCurrentGustLifetime = RandomFloat( 2.0f, 3.0f );
 
-		UpdateBBox();
+		m_flTimeToNextGust = RandomFloat( 3.0f, 4.0f );
 	}
+
+	UpdateBBox();
 }
 
 
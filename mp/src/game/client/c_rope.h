@@ -141,6 +141,10 @@ private:
 	void			FinishInit( const char *pMaterialName );
 
 	void			RunRopeSimulation( float flSeconds );
+	void			PreRopeSimulation();
+	void			PostRopeSimulation();
+	bool			ShouldFreezeSimulation();
+	void			FinishSimulationStep();
 	Vector			ConstrainNode( const Vector &vNormal, const Vector &vNodePosition, const Vector &vMidpiont, float fNormalLength );
 	void			ConstrainNodesBetweenEndpoints( void );
 
@@ -254,6 +258,9 @@ public:
 	virtual void				SetHolidayLightMode( bool bHoliday ) = 0;
 	virtual bool				IsHolidayLightMode( void ) = 0;
 	virtual int					GetHolidayLightStyle( void ) = 0;
+
+	// Steps every rope queued by ClientThink this frame in one batch.
+	virtual void				SimulateRopes( void ) = 0;
 };
 
 IRopeManager *RopeManager();
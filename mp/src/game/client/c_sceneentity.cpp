@@ -19,6 +19,7 @@
 #include "tier0/icommandline.h"
 
 #include "c_sceneentity.h"
+#include "scenebuffercache.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -811,17 +812,13 @@ CChoreoScene *C_SceneEntity::LoadScene( const char *filename )
 	Q_SetExtension( loadfile, ".vcd", sizeof( loadfile ) );
 	Q_FixSlashes( loadfile );
 
-	char *pBuffer = NULL;
-	size_t bufsize = scenefilecache->GetSceneBufferSize( loadfile );
-	if ( bufsize <= 0 )
+	const byte *pSceneData;
+	int bufsize;
+	if ( !GetCachedSceneBuffer( loadfile, &pSceneData, &bufsize ) )
 		return NULL;
 
-	pBuffer = new char[ bufsize ];
-	if ( !scenefilecache->GetSceneData( filename, (byte *)pBuffer, bufsize ) )
-	{
-		delete[] pBuffer;
-		return NULL;
-	}
+	// Parsed in place, the cache owns the buffer
+	char *pBuffer = (char *)pSceneData;
 
 	CChoreoScene *pScene;
 	if ( IsBufferBinaryVCD( pBuffer, bufsize ) )
@@ -846,7 +843,6 @@ CChoreoScene *C_SceneEntity::LoadScene( const char *filename )
 		pScene = ChoreoLoadScene( loadfile, this, &g_TokenProcessor, Scene_Printf );
 	}
 
-	delete[] pBuffer;
 	return pScene;
 }
 
@@ -170,6 +170,8 @@ extern vgui::IInputInternal *g_InputInternal;
 #include "sixense/in_sixense.h"
 #endif
 
+#include "loadprofiler.h"
+
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -1576,6 +1578,10 @@ void CHLClient::LevelInitPreEntity( char const* pMapName )
 		return;
 	g_bLevelInitialized = true;
 
+	// Runs until the end of LevelInitPostEntity
+	g_LoadProfiler.BeginSession( pMapName );
+	LOAD_PROFILE_SCOPE( "CHLClient::LevelInitPreEntity" );
+
 	input->LevelInit();
 
 	vieweffects->LevelInit();
@@ -1646,9 +1652,17 @@ void CHLClient::LevelInitPreEntity( char const* pMapName )
 //-----------------------------------------------------------------------------
 void CHLClient::LevelInitPostEntity( )
 {
-	IGameSystem::LevelInitPostEntityAllSystems();
-	C_PhysPropClientside::RecreateAll();
-	internalCenterPrint->Clear();
+	{
+		LOAD_PROFILE_SCOPE( "CHLClient::LevelInitPostEntity" );
+		IGameSystem::LevelInitPostEntityAllSystems();
+		{
+			LOAD_PROFILE_SCOPE( "C_PhysPropClientside::RecreateAll" );
+			C_PhysPropClientside::RecreateAll();
+		}
+		internalCenterPrint->Clear();
+	}
+
+	g_LoadProfiler.EndSession();
 }
 
 //-----------------------------------------------------------------------------
@@ -1969,6 +1983,9 @@ void SimulateEntities()
 	// Service timer events (think functions).
   	ClientThinkList()->PerformThinkFunctions();
 
+	// Ropes queue themselves up in their think functions, step them all together.
+	RopeManager()->SimulateRopes();
+
 	// TODO: make an ISimulateable interface so C_BaseNetworkables can simulate?
 	{
 		VPROF_("C_BaseEntity::Simulate", 1, VPROF_BUDGETGROUP_CLIENT_SIM, false, BUDGETFLAG_CLIENT);
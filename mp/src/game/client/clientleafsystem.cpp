@@ -23,6 +23,7 @@
 #include "datacache/imdlcache.h"
 #include "view.h"
 #include "viewrender.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -33,6 +34,10 @@ static ConVar cl_drawleaf("cl_drawleaf", "-1", FCVAR_CHEAT );
 static ConVar r_PortalTestEnts( "r_PortalTestEnts", "1", FCVAR_CHEAT, "Clip entities against portal frustums." );
 static ConVar r_portalsopenall( "r_portalsopenall", "0", FCVAR_CHEAT, "Open all portals" );
 static ConVar cl_threaded_client_leaf_system("cl_threaded_client_leaf_system", "0"  );
+static ConVar cl_leafsystem_simd_cull( "cl_leafsystem_simd_cull", "1", 0, "Frustum cull renderables four at a time in the leaf system instead of one engine call each" );
+
+// Renderables per job when building the renderable lists in parallel.
+#define COLLATE_JOB_SIZE	128
 
 
 DEFINE_FIXEDSIZE_ALLOCATOR( CClientRenderablesList, 1, CUtlMemoryPool::GROW_SLOW );
@@ -111,7 +116,6 @@ public:
 	virtual void ComputeTranslucentRenderLeaf( int count, const LeafIndex_t *pLeafList, const LeafFogVolume_t *pLeafFogVolumeList, int frameNumber, int viewID );
 	virtual void CollateViewModelRenderables( CUtlVector< IClientRenderable * >& opaque, CUtlVector< IClientRenderable * >& translucent );
 	virtual void BuildRenderablesList( const SetupRenderInfo_t &info );
-			void CollateRenderablesInLeaf( int leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
 	virtual void DrawStaticProps( bool enable );
 	virtual void DrawSmallEntities( bool enable );
 	virtual void EnableAlternateSorting( ClientRenderHandle_t handle, bool bEnable );
@@ -154,6 +158,13 @@ private:
 	// Adds a renderable to the list of renderables
 	void AddRenderableToLeaf( int leaf, ClientRenderHandle_t handle );
 
+	// BuildRenderablesList passes, see the comment there
+	struct CollateLeaf_t;
+	struct CollateJob_t;
+	void GatherRenderablesInLeaf( int leaf, const SetupRenderInfo_t &info );
+	void CollateRenderableBounds( CollateJob_t &job );
+	void CollateRenderablesInLeaf( const CollateLeaf_t &leaf, int worldListLeafIndex, const SetupRenderInfo_t &info );
+
 	void SortEntities(  const Vector &vecRenderOrigin, const Vector &vecRenderForward, CClientRenderablesList::CEntry *pEntities, int nEntities );
 
 	// Returns -1 if the renderable spans more than one area. If it's totally in one area, then this returns the leaf.
@@ -324,6 +335,49 @@ private:
 	int	m_ShadowEnum;
 
 	CTSList<EnumResultList_t> m_DeferredInserts;
+
+	// Scratch data for BuildRenderablesList. The renderables that pass the per leaf
+	// tests are stored in leaf order, their world bounds in blocks of four for SIMD.
+	struct CollateLeaf_t
+	{
+		int	m_nLeaf;
+		int	m_nFirstCandidate;
+		int	m_nCandidateCount;
+	};
+
+	// A range of leaves, starts on a block of four candidates
+	struct CollateJob_t
+	{
+		int	m_nFirstCandidate;
+		int	m_nCandidateCount;
+	};
+
+	enum CollateState_t
+	{
+		COLLATE_CULLED = 0,
+		COLLATE_NEEDS_FRUSTUM_TEST,	// The engine still has to test it (area frustums, no SIMD cull)
+		COLLATE_IN_FRUSTUM,
+	};
+
+	struct CollateFrustum_t
+	{
+		fltx4	m_Normal[FRUSTUM_NUMPLANES][3];
+		fltx4	m_Dist[FRUSTUM_NUMPLANES];
+		bool	m_bNegative[FRUSTUM_NUMPLANES][3];
+		int		m_nPlanes;
+	};
+
+	const SetupRenderInfo_t *m_pCollateInfo;
+	bool m_bCollatePortalTest;
+	bool m_bCollateSIMDCull;
+	CollateFrustum_t m_CollateFrustum;
+	CUtlVector< CollateLeaf_t > m_CollateLeaves;
+	CUtlVector< CollateJob_t > m_CollateJobs;
+	CUtlVector< ClientRenderHandle_t > m_CollateHandles;
+	CUtlVector< unsigned char > m_CollateAlpha;
+	CUtlVector< unsigned char > m_CollateState;
+	CUtlVector< FourVectors, CUtlMemoryAligned< FourVectors, 16 > > m_CollateMins;
+	CUtlVector< FourVectors, CUtlMemoryAligned< FourVectors, 16 > > m_CollateMaxs;
 };
 
 
@@ -438,6 +492,10 @@ void CalcRenderableWorldSpaceAABB_Fast( IClientRenderable *pRenderable, Vector &
 //-----------------------------------------------------------------------------
 CClientLeafSystem::CClientLeafSystem() : m_DrawStaticProps(true), m_DrawSmallObjects(true)
 {
+	m_pCollateInfo = NULL;
+	m_bCollatePortalTest = false;
+	m_bCollateSIMDCull = false;
+
 	// Set up the bi-directional lists...
 	m_RenderablesInLeaf.Init( FirstRenderableInLeaf, FirstLeafInRenderable );
 	m_ShadowsInLeaf.Init( FirstShadowInLeaf, FirstLeafInShadow ); 
@@ -1551,15 +1609,17 @@ static RenderGroup_t DetectBucketedRenderGroup( RenderGroup_t group, float fDime
 	return bucketedGroup;
 }
 
-void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafIndex,	const SetupRenderInfo_t &info )
+//-----------------------------------------------------------------------------
+// Pass one of BuildRenderablesList: pick out the renderables of a leaf that
+// should be collated. This touches the per frame flags that stop a renderable
+// from being added by more than one leaf, so it always runs in leaf order.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::GatherRenderablesInLeaf( int leaf, const SetupRenderInfo_t &info )
 {
-	bool portalTestEnts = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
-	
-	// Place a fake entity for static/opaque ents in this leaf
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
-	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+	CollateLeaf_t &collateLeaf = m_CollateLeaves[ m_CollateLeaves.AddToTail() ];
+	collateLeaf.m_nLeaf = leaf;
+	collateLeaf.m_nFirstCandidate = m_CollateHandles.Count();
 
-	// Collate everything.
 	unsigned int idx = m_RenderablesInLeaf.FirstElement(leaf);
 	for ( ;idx != m_RenderablesInLeaf.InvalidIndex(); idx = m_RenderablesInLeaf.NextElement(idx) )
 	{
@@ -1601,6 +1661,60 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 				continue;
 		}
 
+		m_CollateHandles.AddToTail( handle );
+	}
+
+	collateLeaf.m_nCandidateCount = m_CollateHandles.Count() - collateLeaf.m_nFirstCandidate;
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns a mask of which of the four boxes are completely outside the frustum.
+// Same plane test as R_CullBox, minus the near plane.
+//-----------------------------------------------------------------------------
+static inline int CullBoxesSIMD( const FourVectors &mins, const FourVectors &maxs, const fltx4 normal[][3], const fltx4 *pDist, const bool negative[][3], int nPlanes )
+{
+	fltx4 fl4Outside = Four_Zeros;
+	for ( int i = 0; i < nPlanes; i++ )
+	{
+		// Test the corner furthest along the plane normal
+		const fltx4 &x = negative[i][0] ? mins.x : maxs.x;
+		const fltx4 &y = negative[i][1] ? mins.y : maxs.y;
+		const fltx4 &z = negative[i][2] ? mins.z : maxs.z;
+		fltx4 fl4Dist = AddSIMD( AddSIMD( MulSIMD( x, normal[i][0] ), MulSIMD( y, normal[i][1] ) ), MulSIMD( z, normal[i][2] ) );
+		fl4Outside = OrSIMD( fl4Outside, CmpLtSIMD( fl4Dist, pDist[i] ) );
+	}
+	return TestSignSIMD( fl4Outside );
+}
+
+
+//-----------------------------------------------------------------------------
+// Pass two of BuildRenderablesList: fetch alpha and world space bounds of a
+// range of candidates and frustum cull them four at a time. Jobs only write
+// their own candidates so they can run in parallel.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateRenderableBounds( CollateJob_t &job )
+{
+	const SetupRenderInfo_t &info = *m_pCollateInfo;
+
+	int nEnd = job.m_nFirstCandidate + job.m_nCandidateCount;
+	for ( int i = job.m_nFirstCandidate; i < nEnd; ++i )
+	{
+		FourVectors &mins = m_CollateMins[ i >> 2 ];
+		FourVectors &maxs = m_CollateMaxs[ i >> 2 ];
+		int nLane = i & 3;
+
+		m_CollateState[i] = COLLATE_CULLED;
+		mins.X( nLane ) = mins.Y( nLane ) = mins.Z( nLane ) = 0.0f;
+		maxs.X( nLane ) = maxs.Y( nLane ) = maxs.Z( nLane ) = 0.0f;
+
+		// Padding between jobs
+		ClientRenderHandle_t handle = m_CollateHandles[i];
+		if ( handle == INVALID_CLIENT_RENDER_HANDLE )
+			continue;
+
+		RenderableInfo_t& renderable = m_Renderables[handle];
+
 		unsigned char nAlpha = 255;
 		if ( info.m_bDrawTranslucentObjects ) 
 		{
@@ -1611,21 +1725,90 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 			if ( nAlpha == 0 )
 				continue;
 		}
+		m_CollateAlpha[i] = nAlpha;
 
 		Vector absMins, absMaxs;
 		CalcRenderableWorldSpaceAABB( renderable.m_pRenderable, absMins, absMaxs );
-		// If the renderable is inside an area, cull it using the frustum for that area.
-		if ( portalTestEnts && renderable.m_Area != -1 )
+		mins.X( nLane ) = absMins.x;
+		mins.Y( nLane ) = absMins.y;
+		mins.Z( nLane ) = absMins.z;
+		maxs.X( nLane ) = absMaxs.x;
+		maxs.Y( nLane ) = absMaxs.y;
+		maxs.Z( nLane ) = absMaxs.z;
+
+		m_CollateState[i] = COLLATE_NEEDS_FRUSTUM_TEST;
+	}
+
+	if ( !m_bCollateSIMDCull )
+		return;
+
+	// Jobs start on a block of four and are padded out to one.
+	Assert( ( job.m_nFirstCandidate & 3 ) == 0 && ( job.m_nCandidateCount & 3 ) == 0 );
+	const CollateFrustum_t &frustum = m_CollateFrustum;
+	for ( int i = job.m_nFirstCandidate; i < nEnd; i += 4 )
+	{
+		int nCulled = CullBoxesSIMD( m_CollateMins[ i >> 2 ], m_CollateMaxs[ i >> 2 ], frustum.m_Normal, frustum.m_Dist, frustum.m_bNegative, frustum.m_nPlanes );
+		for ( int nLane = 0; nLane < 4; ++nLane )
 		{
-			VPROF( "r_PortalTestEnts" );
-			if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
+			if ( m_CollateState[i + nLane] == COLLATE_CULLED )
 				continue;
+
+			if ( nCulled & ( 1 << nLane ) )
+			{
+				// Area frustums are inside the view frustum, so this is safe for those too
+				m_CollateState[i + nLane] = COLLATE_CULLED;
+			}
+			else if ( !m_bCollatePortalTest || m_Renderables[ m_CollateHandles[i + nLane] ].m_Area == -1 )
+			{
+				m_CollateState[i + nLane] = COLLATE_IN_FRUSTUM;
+			}
 		}
-		else
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Pass three of BuildRenderablesList: add the surviving renderables of a leaf
+// to the render list. Runs in leaf order so the output is the same no matter
+// how pass two was split up.
+//-----------------------------------------------------------------------------
+void CClientLeafSystem::CollateRenderablesInLeaf( const CollateLeaf_t &collateLeaf, int worldListLeafIndex, const SetupRenderInfo_t &info )
+{
+	int leaf = collateLeaf.m_nLeaf;
+
+	// Place a fake entity for static/opaque ents in this leaf
+	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_STATIC, NULL );
+	AddRenderableToRenderList( *info.m_pRenderList, NULL, worldListLeafIndex, RENDER_GROUP_OPAQUE_ENTITY, NULL );
+
+	// Collate everything.
+	int nEnd = collateLeaf.m_nFirstCandidate + collateLeaf.m_nCandidateCount;
+	for ( int i = collateLeaf.m_nFirstCandidate; i < nEnd; ++i )
+	{
+		int nState = m_CollateState[i];
+		if ( nState == COLLATE_CULLED )
+			continue;
+
+		ClientRenderHandle_t handle = m_CollateHandles[i];
+		RenderableInfo_t& renderable = m_Renderables[handle];
+		unsigned char nAlpha = m_CollateAlpha[i];
+
+		Vector absMins = m_CollateMins[ i >> 2 ].Vec( i & 3 );
+		Vector absMaxs = m_CollateMaxs[ i >> 2 ].Vec( i & 3 );
+		if ( nState == COLLATE_NEEDS_FRUSTUM_TEST )
 		{
-			// cull with main frustum
-			if ( engine->CullBox( absMins, absMaxs ) )
-				continue;
+			// If the renderable is inside an area, cull it using the frustum for that area.
+			if ( m_bCollatePortalTest && renderable.m_Area != -1 )
+			{
+				VPROF( "r_PortalTestEnts" );
+				if ( !engine->DoesBoxTouchAreaFrustum( absMins, absMaxs, renderable.m_Area ) )
+					continue;
+			}
+			else
+			{
+				// cull with main frustum
+				if ( engine->CullBox( absMins, absMaxs ) )
+					continue;
+			}
 		}
 
 		// UNDONE: Investigate speed tradeoffs of occlusion culling brush models too?
@@ -1699,7 +1882,7 @@ void CClientLeafSystem::CollateRenderablesInLeaf( int leaf, int worldListLeafInd
 	// These don't have render handles!
 	if ( info.m_bDrawDetailObjects && ShouldDrawDetailObjectsInLeaf( leaf, info.m_nDetailBuildFrame ) )
 	{
-		idx = m_Leaf[leaf].m_FirstDetailProp;
+		int idx = m_Leaf[leaf].m_FirstDetailProp;
 		int count = m_Leaf[leaf].m_DetailPropCount;
 		while( --count >= 0 )
 		{
@@ -1790,6 +1973,13 @@ void CClientLeafSystem::SortEntities( const Vector &vecRenderOrigin, const Vecto
 }
 
 
+//-----------------------------------------------------------------------------
+// Builds the renderable lists for a view in three passes:
+//  1) in leaf order, gather the renderables each leaf contributes
+//  2) for ranges of leaves, get their bounds and frustum cull them four at a
+//     time; the ranges are run as parallel jobs with cl_threaded_client_leaf_system
+//  3) in leaf order, run the remaining engine tests and add them to the lists
+//-----------------------------------------------------------------------------
 void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 {
 	VPROF_BUDGET( "BuildRenderablesList", "BuildRenderablesList" );
@@ -1799,12 +1989,90 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 	CClientRenderablesList::CEntry *pTranslucentEntries = info.m_pRenderList->m_RenderGroups[RENDER_GROUP_TRANSLUCENT_ENTITY];
 	int &nTranslucentEntries = info.m_pRenderList->m_RenderGroupCounts[RENDER_GROUP_TRANSLUCENT_ENTITY];
 
+	m_pCollateInfo = &info;
+	m_bCollatePortalTest = r_PortalTestEnts.GetBool() && !r_portalsopenall.GetBool();
+	m_bCollateSIMDCull = cl_leafsystem_simd_cull.GetBool() && ( info.m_pFrustum != NULL );
+	if ( m_bCollateSIMDCull )
+	{
+		// Skip the near plane like the engine does
+		static const int s_nPlanes[] = { FRUSTUM_RIGHT, FRUSTUM_LEFT, FRUSTUM_TOP, FRUSTUM_BOTTOM, FRUSTUM_FARZ };
+		m_CollateFrustum.m_nPlanes = ARRAYSIZE( s_nPlanes );
+		for ( int i = 0; i < m_CollateFrustum.m_nPlanes; i++ )
+		{
+			const VPlane &plane = info.m_pFrustum[ s_nPlanes[i] ];
+			for ( int j = 0; j < 3; j++ )
+			{
+				m_CollateFrustum.m_Normal[i][j] = ReplicateX4( plane.m_Normal[j] );
+				m_CollateFrustum.m_bNegative[i][j] = ( plane.m_Normal[j] < 0.0f );
+			}
+			m_CollateFrustum.m_Dist[i] = ReplicateX4( plane.m_Dist );
+		}
+	}
+
+	// Pass 1
+	{
+		VPROF( "BuildRenderablesList - Gather" );
+
+		m_CollateLeaves.RemoveAll();
+		m_CollateJobs.RemoveAll();
+		m_CollateHandles.RemoveAll();
+
+		int nJobStart = 0;
+		for( int i = 0; i < leafCount; i++ )
+		{
+			GatherRenderablesInLeaf( info.m_pWorldListInfo->m_pLeafList[i], info );
+
+			if ( ( m_CollateHandles.Count() - nJobStart >= COLLATE_JOB_SIZE ) || ( i == leafCount - 1 ) )
+			{
+				// Pad to a block of four so each job owns its blocks
+				while ( m_CollateHandles.Count() & 3 )
+				{
+					m_CollateHandles.AddToTail( INVALID_CLIENT_RENDER_HANDLE );
+				}
+
+				if ( m_CollateHandles.Count() > nJobStart )
+				{
+					CollateJob_t &job = m_CollateJobs[ m_CollateJobs.AddToTail() ];
+					job.m_nFirstCandidate = nJobStart;
+					job.m_nCandidateCount = m_CollateHandles.Count() - nJobStart;
+					nJobStart = m_CollateHandles.Count();
+				}
+			}
+		}
+
+		int nCandidates = m_CollateHandles.Count();
+		m_CollateAlpha.SetCount( nCandidates );
+		m_CollateState.SetCount( nCandidates );
+		m_CollateMins.SetCount( nCandidates >> 2 );
+		m_CollateMaxs.SetCount( nCandidates >> 2 );
+	}
+
+	// Pass 2
+	{
+		VPROF( "BuildRenderablesList - Bounds" );
+
+		bool bThreaded = ( m_CollateJobs.Count() > 1 && cl_threaded_client_leaf_system.GetBool() && g_pThreadPool->NumThreads() );
+		if ( bThreaded )
+		{
+			ParallelProcess( "CClientLeafSystem::BuildRenderablesList", m_CollateJobs.Base(), m_CollateJobs.Count(), this, &CClientLeafSystem::CollateRenderableBounds, &CClientLeafSystem::FrameLock, &CClientLeafSystem::FrameUnlock );
+		}
+		else
+		{
+			for ( int i = 0; i < m_CollateJobs.Count(); i++ )
+			{
+				CollateRenderableBounds( m_CollateJobs[i] );
+			}
+		}
+	}
+
+	// Pass 3
+	VPROF( "BuildRenderablesList - Collate" );
 	for( int i = 0; i < leafCount; i++ )
 	{
 		int nTranslucent = nTranslucentEntries;
 
 		// Add renderables from this leaf...
-		CollateRenderablesInLeaf( info.m_pWorldListInfo->m_pLeafList[i], i, info );
+		CollateRenderablesInLeaf( m_CollateLeaves[i], i, info );
 
 		int nNewTranslucent = nTranslucentEntries - nTranslucent;
 		if( (nNewTranslucent != 0 ) && info.m_bDrawTranslucentObjects )
@@ -1813,4 +2081,6 @@ void CClientLeafSystem::BuildRenderablesList( const SetupRenderInfo_t &info )
 			SortEntities( vecRenderOrigin, vecRenderForward, &pTranslucentEntries[nTranslucent], nNewTranslucent );
 		}
 	}
+
+	m_pCollateInfo = NULL;
 }
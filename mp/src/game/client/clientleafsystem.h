@@ -34,6 +34,7 @@ typedef CGameTrace trace_t;
 struct Ray_t;
 class Vector2D;
 class CStaticProp;
+class VPlane;
 
 
 //-----------------------------------------------------------------------------
@@ -81,11 +82,13 @@ struct SetupRenderInfo_t
 	int m_nRenderFrame;
 	int m_nDetailBuildFrame;	// The "render frame" for detail objects
 	float m_flRenderDistSq;
+	const VPlane *m_pFrustum;	// Planes of the view being built (FRUSTUM_NUMPLANES), lets the leaf system cull without the engine.
 	bool m_bDrawDetailObjects : 1;
 	bool m_bDrawTranslucentObjects : 1;
 
 	SetupRenderInfo_t()
 	{
+		m_pFrustum = NULL;
 		m_bDrawDetailObjects = true;
 		m_bDrawTranslucentObjects = true;
 	}
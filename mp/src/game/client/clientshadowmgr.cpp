@@ -100,6 +100,9 @@ ConVar r_flashlightdepthres( "r_flashlightdepthres", "1024" );
 #endif
 
 ConVar r_threaded_client_shadow_manager( "r_threaded_client_shadow_manager", "0" );
+static ConVar r_shadow_update_threshold( "r_shadow_update_threshold", "0.1", 0, "Distance a shadow caster must move before its shadow is re-projected" );
+static ConVar r_shadow_update_angle_threshold( "r_shadow_update_angle_threshold", "0.1", 0, "Angle (in degrees) a shadow caster must rotate before its shadow is re-projected" );
+static ConVar r_shadow_projection_jobs_min( "r_shadow_projection_jobs_min", "8", 0, "Minimum number of dirty shadows before projection is split into parallel jobs" );
 
 #ifdef _WIN32
 #pragma warning( disable: 4701 )
@@ -107,6 +110,7 @@ ConVar r_threaded_client_shadow_manager( "r_threaded_client_shadow_manager", "0"
 
 // forward declarations
 void ToolFramework_RecordMaterialParams( IMaterial *pMaterial );
+struct ShadowProjectionJob_t;
 
 
 //-----------------------------------------------------------------------------
@@ -863,6 +867,23 @@ private:
 	void BuildRenderToTextureShadow( IClientRenderable* pRenderable, 
 			ClientShadowHandle_t handle, const Vector& mins, const Vector& maxs );
 
+	// Projects a blobby or render-to-texture shadow, either immediately or
+	// deferred until the end of PreRender
+	void BuildShadowProjection( IClientRenderable* pRenderable, 
+			ClientShadowHandle_t handle, const Vector& mins, const Vector& maxs, bool bRenderToTexture );
+
+	// Shadow projection is split into a snapshot (main thread), a compute
+	// step which only touches the job (safe to run in parallel), and an apply
+	// step which hands the results to the engine (main thread)
+	void SnapshotShadowProjection( IClientRenderable* pRenderable, ClientShadowHandle_t handle,
+			const Vector& mins, const Vector& maxs, bool bRenderToTexture, ShadowProjectionJob_t &job );
+	void ComputeShadowProjection( ShadowProjectionJob_t &job );
+	void ApplyShadowProjection( ShadowProjectionJob_t &job );
+	void ProcessShadowProjectionJobs();
+
+	// Has the caster moved far enough to warrant re-projecting its shadow?
+	bool ShouldReprojectShadow( const ClientShadow_t &shadow, const Vector &origin, const QAngle &angles ) const;
+
 	// Build a projected-texture flashlight
 	void BuildFlashlight( ClientShadowHandle_t handle );
 
@@ -957,6 +978,7 @@ private:
 	bool m_RenderToTextureActive;
 	bool m_bRenderTargetNeedsClear;
 	bool m_bUpdatingDirtyShadows;
+	bool m_bDeferShadowProjection;
 	bool m_bThreaded;
 	float m_flShadowCastDist;
 	float m_flMinShadowArea;
@@ -1171,6 +1193,7 @@ CClientShadowMgr::CClientShadowMgr() :
 	m_bDepthTextureActive( false )
 {
 	m_nDepthTextureResolution = r_flashlightdepthres.GetInt();
+	m_bDeferShadowProjection = false;
 	m_bThreaded = false;
 }
 
@@ -2257,10 +2280,63 @@ public:
 };
 
 
+//-----------------------------------------------------------------------------
+// Same as above, but appends to a leaf list owned by a shadow projection job
+//-----------------------------------------------------------------------------
+class CShadowJobLeafEnum : public ISpatialLeafEnumerator
+{
+public:
+	CShadowJobLeafEnum( CUtlVector< int > &leafList ) : m_LeafList( leafList ) {}
+
+	bool EnumerateLeaf( int leaf, int context )
+	{
+		m_LeafList.AddToTail( leaf );
+		return true;
+	}
+
+	CUtlVector< int > &m_LeafList;
+};
+
+
+//-----------------------------------------------------------------------------
+// Everything needed to project one blobby or render-to-texture shadow.
+// The snapshot is captured on the main thread so that the compute step
+// never has to call back into the renderable.
+//-----------------------------------------------------------------------------
+struct ShadowProjectionJob_t
+{
+	// Snapshot
+	IClientRenderable		*m_pRenderable;	// Only touched on the main thread
+	ClientShadowHandle_t	m_hShadow;
+	bool					m_bRenderToTexture;
+	Vector					m_vecBasis[3];
+	Vector					m_vecRenderOrigin;
+	Vector					m_vecShadowDir;
+	Vector					m_vecMins;
+	Vector					m_vecMaxs;
+	float					m_flCastDistance;
+
+	// Results
+	VMatrix					m_WorldToShadow;
+	VMatrix					m_WorldToTexture;
+	Vector2D				m_Size;
+	Vector					m_vecWorldOrigin;
+	Vector					m_vecLocalShadowDir;
+	float					m_flFalloffStart;
+	float					m_flMaxHeight;
+	CUtlVector< int >		m_LeafList;
+};
+
+// Jobs queued up during PreRender. The vector is never shrunk so the
+// per-job leaf lists keep their memory from frame to frame.
+static CUtlVector< ShadowProjectionJob_t > s_ShadowProjectionJobs;
+static int s_nShadowProjectionJobs = 0;
+
+
 //-----------------------------------------------------------------------------
 // Builds a list of leaves inside the shadow volume
 //-----------------------------------------------------------------------------
-static void BuildShadowLeafList( CShadowLeafEnum *pEnum, const Vector& origin, 
+static void BuildShadowLeafList( ISpatialLeafEnumerator *pEnum, const Vector& origin, 
 	const Vector& dir, const Vector2D& size, float maxDist )
 {
 	Ray_t ray;
@@ -2284,102 +2360,271 @@ static void BuildShadowLeafList( CShadowLeafEnum *pEnum, const Vector& origin,
 void CClientShadowMgr::BuildOrthoShadow( IClientRenderable* pRenderable, 
 		ClientShadowHandle_t handle, const Vector& mins, const Vector& maxs)
 {
+	BuildShadowProjection( pRenderable, handle, mins, maxs, false );
+}
+
+
+//-----------------------------------------------------------------------------
+// Projects a shadow now, or queues it up if PreRender is batching projections
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::BuildShadowProjection( IClientRenderable* pRenderable, 
+		ClientShadowHandle_t handle, const Vector& mins, const Vector& maxs, bool bRenderToTexture )
+{
+	if ( m_bDeferShadowProjection )
+	{
+		if ( s_nShadowProjectionJobs == s_ShadowProjectionJobs.Count() )
+		{
+			s_ShadowProjectionJobs.AddToTail();
+		}
+		SnapshotShadowProjection( pRenderable, handle, mins, maxs, bRenderToTexture, s_ShadowProjectionJobs[ s_nShadowProjectionJobs++ ] );
+		return;
+	}
+
+	ShadowProjectionJob_t job;
+	SnapshotShadowProjection( pRenderable, handle, mins, maxs, bRenderToTexture, job );
+	ComputeShadowProjection( job );
+	ApplyShadowProjection( job );
+}
+
+
+//-----------------------------------------------------------------------------
+// Captures everything the compute step needs from the renderable
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::SnapshotShadowProjection( IClientRenderable* pRenderable, ClientShadowHandle_t handle,
+		const Vector& mins, const Vector& maxs, bool bRenderToTexture, ShadowProjectionJob_t &job )
+{
+	job.m_pRenderable = pRenderable;
+	job.m_hShadow = handle;
+	job.m_bRenderToTexture = bRenderToTexture;
+
 	// Get the object's basis
-	Vector vec[3];
-	AngleVectors( pRenderable->GetRenderAngles(), &vec[0], &vec[1], &vec[2] );
-	vec[1] *= -1.0f;
+	AngleVectors( pRenderable->GetRenderAngles(), &job.m_vecBasis[0], &job.m_vecBasis[1], &job.m_vecBasis[2] );
+	job.m_vecBasis[1] *= -1.0f;
 
-	Vector vecShadowDir = GetShadowDirection( pRenderable );
+	job.m_vecRenderOrigin = pRenderable->GetRenderOrigin();
+	job.m_vecShadowDir = GetShadowDirection( pRenderable );
+	job.m_vecMins = mins;
+	job.m_vecMaxs = maxs;
+
+	// The entity may be overriding our shadow cast distance
+	job.m_flCastDistance = GetShadowDistance( pRenderable );
+}
+
+
+//-----------------------------------------------------------------------------
+// Computes the shadow matrices and the leaves it touches. Only reads and
+// writes the job (plus the BSP tree), so it may run on a worker thread.
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::ComputeShadowProjection( ShadowProjectionJob_t &job )
+{
+	const Vector *vec = job.m_vecBasis;
+	const Vector &vecShadowDir = job.m_vecShadowDir;
 
 	// Project the shadow casting direction into the space of the object
-	Vector localShadowDir;
+	Vector &localShadowDir = job.m_vecLocalShadowDir;
 	localShadowDir[0] = DotProduct( vec[0], vecShadowDir );
 	localShadowDir[1] = DotProduct( vec[1], vecShadowDir );
 	localShadowDir[2] = DotProduct( vec[2], vecShadowDir );
 
-	// Figure out which vector has the largest component perpendicular
-	// to the shadow handle...
-	// Sort by how perpendicular it is
-	int vecIdx[3];
-	SortAbsVectorComponents( localShadowDir, vecIdx );
+	// Compute the box size
+	Vector boxSize;
+	VectorSubtract( job.m_vecMaxs, job.m_vecMins, boxSize );
+
+	Vector2D size;
+	Vector org;
+	Vector &worldOrigin = job.m_vecWorldOrigin;
+	float falloffStart;
+
+	if ( !job.m_bRenderToTexture )
+	{
+		// Figure out which vector has the largest component perpendicular
+		// to the shadow handle...
+		// Sort by how perpendicular it is
+		int vecIdx[3];
+		SortAbsVectorComponents( localShadowDir, vecIdx );
+
+		// Here's our shadow basis vectors; namely the ones that are
+		// most perpendicular to the shadow casting direction
+		Vector xvec = vec[vecIdx[0]];
+		Vector yvec = vec[vecIdx[1]];
+
+		// Project them into a plane perpendicular to the shadow direction
+		xvec -= vecShadowDir * DotProduct( vecShadowDir, xvec );
+		yvec -= vecShadowDir * DotProduct( vecShadowDir, yvec );
+		VectorNormalize( xvec );
+		VectorNormalize( yvec );
+
+		// We project the two longest sides into the vectors perpendicular
+		// to the projection direction, then add in the projection of the perp direction
+		size.Init( boxSize[vecIdx[0]], boxSize[vecIdx[1]] );
+		size.x *= fabs( DotProduct( vec[vecIdx[0]], xvec ) );
+		size.y *= fabs( DotProduct( vec[vecIdx[1]], yvec ) );
+
+		// Add the third component into x and y
+		size.x += boxSize[vecIdx[2]] * fabs( DotProduct( vec[vecIdx[2]], xvec ) );
+		size.y += boxSize[vecIdx[2]] * fabs( DotProduct( vec[vecIdx[2]], yvec ) );
+
+		// Bloat a bit, since the shadow wants to extend outside the model a bit
+		size.x += 10.0f;
+		size.y += 10.0f;
+
+		// Clamp the minimum size
+		Vector2DMax( size, Vector2D(10.0f, 10.0f), size );
+
+		// Place the origin at the point with min dot product with shadow dir
+		falloffStart = ComputeLocalShadowOrigin( job.m_pRenderable, job.m_vecMins, job.m_vecMaxs, localShadowDir, 2.0f, org );
+
+		// Transform the local origin into world coordinates
+		worldOrigin = job.m_vecRenderOrigin;
+		VectorMA( worldOrigin, org.x, vec[0], worldOrigin );
+		VectorMA( worldOrigin, org.y, vec[1], worldOrigin );
+		VectorMA( worldOrigin, org.z, vec[2], worldOrigin );
+
+		// FUNKY: A trick to reduce annoying texelization artifacts!?
+		float dx = 1.0f / TEXEL_SIZE_PER_CASTER_SIZE;
+		worldOrigin.x = (int)(worldOrigin.x / dx) * dx;
+		worldOrigin.y = (int)(worldOrigin.y / dx) * dx;
+		worldOrigin.z = (int)(worldOrigin.z / dx) * dx;
+
+		// NOTE: We gotta use the general matrix because xvec and yvec aren't perp
+		BuildGeneralWorldToShadowMatrix( job.m_WorldToShadow, worldOrigin, vecShadowDir, xvec, yvec );
+	}
+	else
+	{
+		Vector yvec;
+		float fProjMax = 0.0f;
+		for( int i = 0; i != 3; ++i )
+		{
+			Vector test = vec[i] - ( vecShadowDir * DotProduct( vecShadowDir, vec[i] ) );
+			test *= boxSize[i]; //doing after the projection to simplify projection math
+			float fLengthSqr = test.LengthSqr();
+			if( fLengthSqr > fProjMax )
+			{
+				fProjMax = fLengthSqr;
+				yvec = test;
+			}
+		}		
+
+		VectorNormalize( yvec );
 
-	// Here's our shadow basis vectors; namely the ones that are
-	// most perpendicular to the shadow casting direction
-	Vector xvec = vec[vecIdx[0]];
-	Vector yvec = vec[vecIdx[1]];
+		// Compute the x vector
+		Vector xvec;
+		CrossProduct( yvec, vecShadowDir, xvec );
 
-	// Project them into a plane perpendicular to the shadow direction
-	xvec -= vecShadowDir * DotProduct( vecShadowDir, xvec );
-	yvec -= vecShadowDir * DotProduct( vecShadowDir, yvec );
-	VectorNormalize( xvec );
-	VectorNormalize( yvec );
+		// We project the two longest sides into the vectors perpendicular
+		// to the projection direction, then add in the projection of the perp direction
+		size.x = boxSize.x * fabs( DotProduct( vec[0], xvec ) ) + 
+			boxSize.y * fabs( DotProduct( vec[1], xvec ) ) + 
+			boxSize.z * fabs( DotProduct( vec[2], xvec ) );
+		size.y = boxSize.x * fabs( DotProduct( vec[0], yvec ) ) + 
+			boxSize.y * fabs( DotProduct( vec[1], yvec ) ) + 
+			boxSize.z * fabs( DotProduct( vec[2], yvec ) );
 
-	// Compute the box size
-	Vector boxSize;
-	VectorSubtract( maxs, mins, boxSize );
+		size.x += 2.0f * TEXEL_SIZE_PER_CASTER_SIZE;
+		size.y += 2.0f * TEXEL_SIZE_PER_CASTER_SIZE;
 
-	// We project the two longest sides into the vectors perpendicular
-	// to the projection direction, then add in the projection of the perp direction
-	Vector2D size( boxSize[vecIdx[0]], boxSize[vecIdx[1]] );
-	size.x *= fabs( DotProduct( vec[vecIdx[0]], xvec ) );
-	size.y *= fabs( DotProduct( vec[vecIdx[1]], yvec ) );
+		// Place the origin at the point with min dot product with shadow dir
+		falloffStart = ComputeLocalShadowOrigin( job.m_pRenderable, job.m_vecMins, job.m_vecMaxs, localShadowDir, 1.0f, org );
 
-	// Add the third component into x and y
-	size.x += boxSize[vecIdx[2]] * fabs( DotProduct( vec[vecIdx[2]], xvec ) );
-	size.y += boxSize[vecIdx[2]] * fabs( DotProduct( vec[vecIdx[2]], yvec ) );
+		// Transform the local origin into world coordinates
+		worldOrigin = job.m_vecRenderOrigin;
+		VectorMA( worldOrigin, org.x, vec[0], worldOrigin );
+		VectorMA( worldOrigin, org.y, vec[1], worldOrigin );
+		VectorMA( worldOrigin, org.z, vec[2], worldOrigin );
 
-	// Bloat a bit, since the shadow wants to extend outside the model a bit
-	size.x += 10.0f;
-	size.y += 10.0f;
+		BuildOrthoWorldToShadowMatrix( job.m_WorldToShadow, worldOrigin, vecShadowDir, xvec, yvec );
+	}
 
-	// Clamp the minimum size
-	Vector2DMax( size, Vector2D(10.0f, 10.0f), size );
+	BuildWorldToTextureMatrix( job.m_WorldToShadow, size, job.m_WorldToTexture );
+	Vector2DCopy( size, job.m_Size );
 
-	// Place the origin at the point with min dot product with shadow dir
-	Vector org;
-	float falloffStart = ComputeLocalShadowOrigin( pRenderable, mins, maxs, localShadowDir, 2.0f, org );
-
-	// Transform the local origin into world coordinates
-	Vector worldOrigin = pRenderable->GetRenderOrigin( );
-	VectorMA( worldOrigin, org.x, vec[0], worldOrigin );
-	VectorMA( worldOrigin, org.y, vec[1], worldOrigin );
-	VectorMA( worldOrigin, org.z, vec[2], worldOrigin );
-
-	// FUNKY: A trick to reduce annoying texelization artifacts!?
-	float dx = 1.0f / TEXEL_SIZE_PER_CASTER_SIZE;
-	worldOrigin.x = (int)(worldOrigin.x / dx) * dx;
-	worldOrigin.y = (int)(worldOrigin.y / dx) * dx;
-	worldOrigin.z = (int)(worldOrigin.z / dx) * dx;
-
-	// NOTE: We gotta use the general matrix because xvec and yvec aren't perp
-	VMatrix matWorldToShadow, matWorldToTexture;
-	BuildGeneralWorldToShadowMatrix( m_Shadows[handle].m_WorldToShadow, worldOrigin, vecShadowDir, xvec, yvec );
-	BuildWorldToTextureMatrix( m_Shadows[handle].m_WorldToShadow, size, matWorldToTexture );
-	Vector2DCopy( size, m_Shadows[handle].m_WorldSize );
-	
 	// Compute the falloff attenuation
 	// Area computation isn't exact since xvec is not perp to yvec, but close enough
 //	float shadowArea = size.x * size.y;	
+	job.m_flFalloffStart = falloffStart;
+	job.m_flMaxHeight = job.m_flCastDistance + falloffStart; //3.0f * sqrt( shadowArea );
 
-	// The entity may be overriding our shadow cast distance
-	float flShadowCastDistance = GetShadowDistance( pRenderable );
-	float maxHeight = flShadowCastDistance + falloffStart; //3.0f * sqrt( shadowArea );
+	job.m_LeafList.RemoveAll();
+	CShadowJobLeafEnum leafEnum( job.m_LeafList );
+	BuildShadowLeafList( &leafEnum, worldOrigin, vecShadowDir, size, job.m_flMaxHeight );
+}
 
-	CShadowLeafEnum leafList;
-	BuildShadowLeafList( &leafList, worldOrigin, vecShadowDir, size, maxHeight );
-	int nCount = leafList.m_LeafList.Count();
-	const int *pLeafList = leafList.m_LeafList.Base();
 
-	shadowmgr->ProjectShadow( m_Shadows[handle].m_ShadowHandle, worldOrigin,
-		vecShadowDir, matWorldToTexture, size, nCount, pLeafList, maxHeight, falloffStart, MAX_FALLOFF_AMOUNT, pRenderable->GetRenderOrigin() );
+//-----------------------------------------------------------------------------
+// Hands a computed projection over to the engine + client leaf system
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::ApplyShadowProjection( ShadowProjectionJob_t &job )
+{
+	ClientShadow_t &shadow = m_Shadows[job.m_hShadow];
+	shadow.m_WorldToShadow = job.m_WorldToShadow;
+	Vector2DCopy( job.m_Size, shadow.m_WorldSize );
+
+	int nCount = job.m_LeafList.Count();
+	const int *pLeafList = job.m_LeafList.Base();
+
+	shadowmgr->ProjectShadow( shadow.m_ShadowHandle, job.m_vecWorldOrigin, job.m_vecShadowDir, job.m_WorldToTexture, 
+		job.m_Size, nCount, pLeafList, job.m_flMaxHeight, job.m_flFalloffStart, MAX_FALLOFF_AMOUNT, job.m_vecRenderOrigin );
 
 	// Compute extra clip planes to prevent poke-thru
-// FIXME!!!!!!!!!!!!!!  Removing this for now since it seems to mess up the blobby shadows.
-//	ComputeExtraClipPlanes( pEnt, handle, vec, mins, maxs, localShadowDir );
+	// FIXME!!!!!!!!!!!!!!  Not done for blobby shadows since it seems to mess them up.
+	if ( job.m_bRenderToTexture )
+	{
+		ComputeExtraClipPlanes( job.m_pRenderable, job.m_hShadow, job.m_vecBasis, job.m_vecMins, job.m_vecMaxs, job.m_vecLocalShadowDir );
+	}
 
 	// Add the shadow to the client leaf system so it correctly marks 
 	// leafs as being affected by a particular shadow
-	ClientLeafSystem()->ProjectShadow( m_Shadows[handle].m_ClientLeafShadowHandle, nCount, pLeafList );
+	ClientLeafSystem()->ProjectShadow( shadow.m_ClientLeafShadowHandle, nCount, pLeafList );
+}
+
+
+//-----------------------------------------------------------------------------
+// Projects all the shadows queued up during PreRender. The compute step is
+// spread over the thread pool when threading is on; results are always
+// applied in queue order so the outcome doesn't depend on the job split.
+//-----------------------------------------------------------------------------
+void CClientShadowMgr::ProcessShadowProjectionJobs()
+{
+	int nJobs = s_nShadowProjectionJobs;
+	s_nShadowProjectionJobs = 0;
+	if ( nJobs == 0 )
+		return;
+
+	VPROF_BUDGET( "CClientShadowMgr::ProcessShadowProjectionJobs", VPROF_BUDGETGROUP_SHADOW_RENDERING );
+	VPROF_INCREMENT_COUNTER( "Shadow projections", nJobs );
+
+	ShadowProjectionJob_t *pJobs = s_ShadowProjectionJobs.Base();
+
+	{
+		VPROF( "CClientShadowMgr::ProcessShadowProjectionJobs compute" );
+		if ( r_threaded_client_shadow_manager.GetBool() && nJobs >= r_shadow_projection_jobs_min.GetInt() && g_pThreadPool->NumIdleThreads() )
+		{
+			ParallelProcess( "CClientShadowMgr::ComputeShadowProjection", pJobs, nJobs, this, &CClientShadowMgr::ComputeShadowProjection );
+		}
+		else
+		{
+			for ( int i = 0; i < nJobs; ++i )
+			{
+				ComputeShadowProjection( pJobs[i] );
+			}
+		}
+	}
+
+	{
+		VPROF( "CClientShadowMgr::ProcessShadowProjectionJobs apply" );
+		CMatRenderContextPtr pRenderContext( materials );
+		MaterialFogMode_t fogMode = pRenderContext->GetFogMode();
+		pRenderContext->FogMode( MATERIAL_FOG_NONE );
+		for ( int i = 0; i < nJobs; ++i )
+		{
+			// The shadow may have been destroyed by a later update this frame
+			if ( !m_Shadows.IsValidIndex( pJobs[i].m_hShadow ) )
+				continue;
+
+			ApplyShadowProjection( pJobs[i] );
+		}
+		pRenderContext->FogMode( fogMode );
+	}
 }
 
 
@@ -2467,98 +2712,11 @@ void CClientShadowMgr::BuildRenderToTextureShadow( IClientRenderable* pRenderabl
 		DrawRenderToTextureDebugInfo( pRenderable, mins, maxs );
 	}
 
-	// Get the object's basis
-	Vector vec[3];
-	AngleVectors( pRenderable->GetRenderAngles(), &vec[0], &vec[1], &vec[2] );
-	vec[1] *= -1.0f;
-
-	Vector vecShadowDir = GetShadowDirection( pRenderable );
-
 //	Debugging aid
 //	const model_t *pModel = pRenderable->GetModel();
 //	const char *pDebugName = modelinfo->GetModelName( pModel );
 
-	// Project the shadow casting direction into the space of the object
-	Vector localShadowDir;
-	localShadowDir[0] = DotProduct( vec[0], vecShadowDir );
-	localShadowDir[1] = DotProduct( vec[1], vecShadowDir );
-	localShadowDir[2] = DotProduct( vec[2], vecShadowDir );
-
-	// Compute the box size
-	Vector boxSize;
-	VectorSubtract( maxs, mins, boxSize );
-	
-	Vector yvec;
-	float fProjMax = 0.0f;
-	for( int i = 0; i != 3; ++i )
-	{
-		Vector test = vec[i] - ( vecShadowDir * DotProduct( vecShadowDir, vec[i] ) );
-		test *= boxSize[i]; //doing after the projection to simplify projection math
-		float fLengthSqr = test.LengthSqr();
-		if( fLengthSqr > fProjMax )
-		{
-			fProjMax = fLengthSqr;
-			yvec = test;
-		}
-	}		
-
-	VectorNormalize( yvec );
-
-	// Compute the x vector
-	Vector xvec;
-	CrossProduct( yvec, vecShadowDir, xvec );
-
-	// We project the two longest sides into the vectors perpendicular
-	// to the projection direction, then add in the projection of the perp direction
-	Vector2D size;
-	size.x = boxSize.x * fabs( DotProduct( vec[0], xvec ) ) + 
-		boxSize.y * fabs( DotProduct( vec[1], xvec ) ) + 
-		boxSize.z * fabs( DotProduct( vec[2], xvec ) );
-	size.y = boxSize.x * fabs( DotProduct( vec[0], yvec ) ) + 
-		boxSize.y * fabs( DotProduct( vec[1], yvec ) ) + 
-		boxSize.z * fabs( DotProduct( vec[2], yvec ) );
-
-	size.x += 2.0f * TEXEL_SIZE_PER_CASTER_SIZE;
-	size.y += 2.0f * TEXEL_SIZE_PER_CASTER_SIZE;
-
-	// Place the origin at the point with min dot product with shadow dir
-	Vector org;
-	float falloffStart = ComputeLocalShadowOrigin( pRenderable, mins, maxs, localShadowDir, 1.0f, org );
-
-	// Transform the local origin into world coordinates
-	Vector worldOrigin = pRenderable->GetRenderOrigin( );
-	VectorMA( worldOrigin, org.x, vec[0], worldOrigin );
-	VectorMA( worldOrigin, org.y, vec[1], worldOrigin );
-	VectorMA( worldOrigin, org.z, vec[2], worldOrigin );
-
-	VMatrix matWorldToTexture;
-	BuildOrthoWorldToShadowMatrix( m_Shadows[handle].m_WorldToShadow, worldOrigin, vecShadowDir, xvec, yvec );
-	BuildWorldToTextureMatrix( m_Shadows[handle].m_WorldToShadow, size, matWorldToTexture );
-	Vector2DCopy( size, m_Shadows[handle].m_WorldSize );
-
-	// Compute the falloff attenuation
-	// Area computation isn't exact since xvec is not perp to yvec, but close enough
-	// Extra factor of 4 in the maxHeight due to the size being half as big
-//	float shadowArea = size.x * size.y;	
-
-	// The entity may be overriding our shadow cast distance
-	float flShadowCastDistance = GetShadowDistance( pRenderable );
-	float maxHeight = flShadowCastDistance + falloffStart; //3.0f * sqrt( shadowArea );
-
-	CShadowLeafEnum leafList;
-	BuildShadowLeafList( &leafList, worldOrigin, vecShadowDir, size, maxHeight );
-	int nCount = leafList.m_LeafList.Count();
-	const int *pLeafList = leafList.m_LeafList.Base();
-
-	shadowmgr->ProjectShadow( m_Shadows[handle].m_ShadowHandle, worldOrigin, 
-		vecShadowDir, matWorldToTexture, size, nCount, pLeafList, maxHeight, falloffStart, MAX_FALLOFF_AMOUNT, pRenderable->GetRenderOrigin() );
-
-	// Compute extra clip planes to prevent poke-thru
-	ComputeExtraClipPlanes( pRenderable, handle, vec, mins, maxs, localShadowDir );
-
-	// Add the shadow to the client leaf system so it correctly marks 
-	// leafs as being affected by a particular shadow
-	ClientLeafSystem()->ProjectShadow( m_Shadows[handle].m_ClientLeafShadowHandle, nCount, pLeafList );
+	BuildShadowProjection( pRenderable, handle, mins, maxs, true );
 }
 
 static void LineDrawHelper( const Vector &startShadowSpace, const Vector &endShadowSpace, 
@@ -2931,6 +3089,10 @@ void CClientShadowMgr::PreRender()
 
 	m_bUpdatingDirtyShadows = true;
 
+	// Blobby + render-to-texture shadow projections are queued up while walking
+	// the dirty list and projected together afterwards
+	m_bDeferShadowProjection = true;
+
 	unsigned short i = m_DirtyShadows.FirstInorder();
 	while ( i != m_DirtyShadows.InvalidIndex() )
 	{
@@ -2942,6 +3104,9 @@ void CClientShadowMgr::PreRender()
 	}
 	m_DirtyShadows.RemoveAll();
 
+	m_bDeferShadowProjection = false;
+	ProcessShadowProjectionJobs();
+
 	// Transparent shadows must remain dirty, since they were not re-projected
 	int nCount = m_TransparentShadows.Count();
 	for ( int i = 0; i < nCount; ++i )
@@ -3069,6 +3234,32 @@ void CClientShadowMgr::MarkRenderToTextureShadowDirty( ClientShadowHandle_t hand
 }
 
 
+//-----------------------------------------------------------------------------
+// Has the caster moved far enough to warrant re-projecting its shadow?
+// Movement is measured against the last *projected* position, so slow
+// drift still accumulates until it crosses the threshold.
+//-----------------------------------------------------------------------------
+bool CClientShadowMgr::ShouldReprojectShadow( const ClientShadow_t &shadow, const Vector &origin, const QAngle &angles ) const
+{
+	if ( ( origin == shadow.m_LastOrigin ) && ( angles == shadow.m_LastAngles ) )
+		return false;
+
+	float flMoveThreshold = r_shadow_update_threshold.GetFloat();
+	if ( origin.DistToSqr( shadow.m_LastOrigin ) > flMoveThreshold * flMoveThreshold )
+		return true;
+
+	float flAngleThreshold = r_shadow_update_angle_threshold.GetFloat();
+	for ( int i = 0; i < 3; ++i )
+	{
+		if ( fabs( angles[i] - shadow.m_LastAngles[i] ) > flAngleThreshold )
+			return true;
+	}
+
+	VPROF_INCREMENT_COUNTER( "Shadow projections skipped", 1 );
+	return false;
+}
+
+
 //-----------------------------------------------------------------------------
 // Update a shadow
 //-----------------------------------------------------------------------------
@@ -3127,7 +3318,7 @@ void CClientShadowMgr::UpdateShadow( ClientShadowHandle_t handle, bool force )
 	const Vector& origin = pRenderable->GetRenderOrigin();
 	const QAngle& angles = pRenderable->GetRenderAngles();
 
-	if (force || (origin != shadow.m_LastOrigin) || (angles != shadow.m_LastAngles))
+	if ( force || ShouldReprojectShadow( shadow, origin, angles ) )
 	{
 		// Store off the new pos/orientation
 		VectorCopy( origin, shadow.m_LastOrigin );
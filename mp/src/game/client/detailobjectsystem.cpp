@@ -36,6 +36,7 @@
 #endif
 
 #include "materialsystem/imaterialsystemhardwareconfig.h"
+#include "loadprofiler.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -50,6 +51,8 @@ struct model_t;
 
 ConVar cl_detaildist( "cl_detaildist", "1200", 0, "Distance at which detail props are no longer visible" );
 ConVar cl_detailfade( "cl_detailfade", "400", 0, "Distance across which detail props fade in" );
+ConVar cl_detail_sprite_cache( "cl_detail_sprite_cache", "0", 0, "Expand fast detail sprites into per-leaf vertex chunks and redraw them until the view moves too far" );
+ConVar cl_detail_sprite_cache_tolerance( "cl_detail_sprite_cache_tolerance", "0.02", 0, "How far the view can move, as a fraction of the distance to the nearest sprite in a leaf, before the leaf's cached sprites are rebuilt" );
 #if defined( USE_DETAIL_SHAPES ) 
 ConVar cl_detail_max_sway( "cl_detail_max_sway", "0", FCVAR_ARCHIVE, "Amplitude of the detail prop sway" );
 ConVar cl_detail_avoid_radius( "cl_detail_avoid_radius", "0", FCVAR_ARCHIVE, "radius around detail sprite to avoid players" );
@@ -326,6 +329,14 @@ struct FastSpriteQuadBuildoutBufferNonSIMDView_t
 };
 
 
+// One vertex of a prebuilt detail sprite quad, distance fade already baked into the alpha
+struct DetailSpriteCacheVertex_t
+{
+	Vector m_vecPos;
+	uint8 m_Color[4];
+	Vector2D m_TexCoord;
+};
+
 class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 {
 	friend class CDetailObjectSystem;
@@ -338,10 +349,20 @@ class CFastDetailLeafSpriteList : public CClientLeafSubSystemData
 	int m_nNumPendingSprites;
 	int m_nStartSpriteIndex;
 
+	// sorted, expanded quads for cl_detail_sprite_cache. Valid while the view stays
+	// within m_flCacheTolerance of the point they were built from.
+	CUtlVector<DetailSpriteCacheVertex_t> m_CachedVerts;
+	Vector m_vecCacheViewOrigin;
+	float m_flCacheTolerance;
+	float m_flCacheMaxSqDist;
+	float m_flCacheFadeSqDist;
+	bool m_bCacheValid;
+
 	CFastDetailLeafSpriteList( void )
 	{
 		m_nNumPendingSprites = 0;
 		m_nStartSpriteIndex = 0;
+		m_bCacheValid = false;
 	}
 
 };
@@ -432,7 +453,12 @@ private:
 							   Vector const &viewOrigin,
 							   Vector const &viewForward,
 							   Vector const &viewRight,
-							   Vector const &viewUp );
+							   Vector const &viewUp,
+							   bool bCullBehindView = true );
+
+	// Returns the number of quads in the leaf's vertex cache, rebuilding it if the view moved too far
+	int UpdateCachedLeafSprites( CFastDetailLeafSpriteList *pData, Vector const &viewOrigin, Vector const &viewForward,
+								 Vector const &viewRight, Vector const &viewUp );
 
 	void RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList );
 
@@ -1466,7 +1492,10 @@ void CDetailObjectSystem::LevelInitPreEntity()
 		{
 		case 4:
 			UnserializeDetailSprites( buf );
-			UnserializeModels( buf );
+			{
+				LOAD_PROFILE_SCOPE( "CDetailObjectSystem::UnserializeModels" );
+				UnserializeModels( buf );
+			}
 			break;
 		}
 	}
@@ -2132,7 +2161,8 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 												Vector const &viewOrigin,
 												Vector const &viewForward,
 												Vector const &viewRight,
-												Vector const &viewUp )
+												Vector const &viewUp,
+												bool bCullBehindView )
 {
 	// part 1 - do all vertex math, fading, etc into a buffer, using as much simd as we can
 	int nSIMDSprites = pData->m_nNumSIMDSprites;
@@ -2161,7 +2191,12 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 		ofs -= vecViewPos;
 		fltx4 ofsDotFwd = ofs * vecFwd;
 		fltx4 distanceSquared = ofs * ofs;
-		nLastBfMask = TestSignSIMD( OrSIMD( ofsDotFwd, CmpGtSIMD( distanceSquared, maxsqdist ) ) );		//  cull
+		fltx4 cullMask = CmpGtSIMD( distanceSquared, maxsqdist );
+		if ( bCullBehindView )
+		{
+			cullMask = OrSIMD( ofsDotFwd, cullMask );
+		}
+		nLastBfMask = TestSignSIMD( cullMask );		//  cull
 		if ( nLastBfMask != 0xf )
 		{
 			FourVectors dx1;
@@ -2232,6 +2267,87 @@ int CDetailObjectSystem::BuildOutSortedSprites( CFastDetailLeafSpriteList *pData
 }
 
 
+//-----------------------------------------------------------------------------
+// Fast sprites never sway or avoid the player, so the only thing that changes their
+// quads from frame to frame is where the view is. Expand a leaf's sprites once, sorted
+// and faded, and keep redrawing that until the view has moved far enough relative to
+// the nearest sprite that the billboards would visibly turn or the sort would change.
+//-----------------------------------------------------------------------------
+int CDetailObjectSystem::UpdateCachedLeafSprites( CFastDetailLeafSpriteList *pData, Vector const &viewOrigin, Vector const &viewForward,
+												  Vector const &viewRight, Vector const &viewUp )
+{
+	if ( pData->m_bCacheValid &&
+		 pData->m_flCacheMaxSqDist == m_flCurMaxSqDist &&
+		 pData->m_flCacheFadeSqDist == m_flCurFadeSqDist &&
+		 viewOrigin.DistToSqr( pData->m_vecCacheViewOrigin ) <= pData->m_flCacheTolerance * pData->m_flCacheTolerance )
+	{
+		return pData->m_CachedVerts.Count() / 4;
+	}
+
+	VPROF( "CDetailObjectSystem::UpdateCachedLeafSprites" );
+
+	// The cache has to stay valid while the view turns, so only distance cull it
+	int nCount = BuildOutSortedSprites( pData, viewOrigin, viewForward, viewRight, viewUp, false );
+
+	// we just stomped the shared sort buffer
+	m_nSortedFastLeaf = -1;
+
+	pData->m_CachedVerts.SetCount( nCount * 4 );
+	DetailSpriteCacheVertex_t *pVert = pData->m_CachedVerts.Base();
+	FastSpriteQuadBuildoutBufferNonSIMDView_t const *pQuadBuffer =
+		( FastSpriteQuadBuildoutBufferNonSIMDView_t const *) m_pBuildoutBuffer;
+	for ( int i = 0; i < nCount; i++ )
+	{
+		int nSIMDIdx = m_pFastSortInfo[i].m_nIndex >> 2;
+		int nSubIdx = m_pFastSortInfo[i].m_nIndex & 3;
+
+		FastSpriteQuadBuildoutBufferNonSIMDView_t const *pquad = pQuadBuffer+nSIMDIdx;
+		pquad = (FastSpriteQuadBuildoutBufferNonSIMDView_t const *) ( ( (int) ( pquad ) )+ ( nSubIdx << 2 ) );
+		uint8 const *pColorsCasted = reinterpret_cast<uint8 const *> ( pquad->m_Alpha );
+		DetailPropSpriteDict_t *pDict = pquad->m_pSpriteDefs[0];
+
+		for ( int j = 0; j < 4; j++ )
+		{
+			pVert[j].m_Color[0] = pquad->m_RGBColor[0][0];
+			pVert[j].m_Color[1] = pquad->m_RGBColor[0][1];
+			pVert[j].m_Color[2] = pquad->m_RGBColor[0][2];
+			pVert[j].m_Color[3] = pColorsCasted[MANTISSA_LSB_OFFSET];
+		}
+
+		pVert[0].m_vecPos.Init( pquad->m_flX0[0], pquad->m_flY0[0], pquad->m_flZ0[0] );
+		pVert[0].m_TexCoord.Init( pDict->m_TexLR.x, pDict->m_TexLR.y );
+		pVert[1].m_vecPos.Init( pquad->m_flX1[0], pquad->m_flY1[0], pquad->m_flZ1[0] );
+		pVert[1].m_TexCoord.Init( pDict->m_TexLR.x, pDict->m_TexUL.y );
+		pVert[2].m_vecPos.Init( pquad->m_flX2[0], pquad->m_flY2[0], pquad->m_flZ2[0] );
+		pVert[2].m_TexCoord.Init( pDict->m_TexUL.x, pDict->m_TexUL.y );
+		pVert[3].m_vecPos.Init( pquad->m_flX3[0], pquad->m_flY3[0], pquad->m_flZ3[0] );
+		pVert[3].m_TexCoord.Init( pDict->m_TexUL.x, pDict->m_TexLR.y );
+		pVert += 4;
+	}
+
+	// The closest sprite in the leaf decides how far we can move before things look wrong
+	FourVectors vecViewPos;
+	vecViewPos.DuplicateVector( viewOrigin );
+	fltx4 minDistSq = ReplicateX4( FLT_MAX );
+	FastSpriteX4_t const *pSprites = pData->m_pSprites;
+	for ( int i = 0; i < pData->m_nNumSIMDSprites; i++ )
+	{
+		FourVectors ofs = pSprites[i].m_Pos;
+		ofs -= vecViewPos;
+		minDistSq = MinSIMD( minDistSq, ofs * ofs );
+	}
+	float flMinDistSq = MIN( MIN( SubFloat( minDistSq, 0 ), SubFloat( minDistSq, 1 ) ), MIN( SubFloat( minDistSq, 2 ), SubFloat( minDistSq, 3 ) ) );
+
+	pData->m_vecCacheViewOrigin = viewOrigin;
+	pData->m_flCacheTolerance = cl_detail_sprite_cache_tolerance.GetFloat() * FastSqrt( flMinDistSq );
+	pData->m_flCacheMaxSqDist = m_flCurMaxSqDist;
+	pData->m_flCacheFadeSqDist = m_flCurFadeSqDist;
+	pData->m_bCacheValid = true;
+
+	return nCount;
+}
+
+
 void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vector &viewForward, const Vector &viewRight, const Vector &viewUp, int nLeafCount, LeafIndex_t const * pLeafList )
 {
 	// Here, we must draw all detail objects back-to-front
@@ -2277,7 +2393,7 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 
 	meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
 
-
+	bool bUseCache = cl_detail_sprite_cache.GetBool();
 
 	// Sort detail sprites in each leaf independently; then render them
 	for ( int i = 0; i < nLeafCount; ++i )
@@ -2287,7 +2403,34 @@ void CDetailObjectSystem::RenderFastSprites( const Vector &viewOrigin, const Vec
 		CFastDetailLeafSpriteList *pData = reinterpret_cast<CFastDetailLeafSpriteList *> (
 			ClientLeafSystem()->GetSubSystemDataInLeaf( nLeaf, CLSUBSYSTEM_DETAILOBJECTS ) );
 
-		if ( pData )
+		if ( pData && bUseCache )
+		{
+			Assert( pData->m_nNumSprites );					// ptr with no sprites?
+
+			int nCount = UpdateCachedLeafSprites( pData, viewOrigin, viewForward, viewRight, viewUp );
+			DetailSpriteCacheVertex_t const *pVert = pData->m_CachedVerts.Base();
+			while( nCount )
+			{
+				if ( ! nQuadsRemaining )					// no room left?
+				{
+					meshBuilder.End();
+					pMesh->Draw();
+					nQuadsRemaining = nQuadsToDraw;
+					meshBuilder.Begin( pMesh, MATERIAL_QUADS, nQuadsToDraw );
+				}
+				int nToDraw = MIN( nCount, nQuadsRemaining );
+				nCount -= nToDraw;
+				nQuadsRemaining -= nToDraw;
+				for ( int nVerts = nToDraw * 4; nVerts--; pVert++ )
+				{
+					meshBuilder.Position3fv( pVert->m_vecPos.Base() );
+					meshBuilder.Color4ubv( pVert->m_Color );
+					meshBuilder.TexCoord2fv( 0, pVert->m_TexCoord.Base() );
+					meshBuilder.AdvanceVertex();
+				}
+			}
+		}
+		else if ( pData )
 		{
 			Assert( pData->m_nNumSprites );					// ptr with no sprites?
 
@@ -6,6 +6,8 @@
 
 #include "cbase.h"
 #include "interpolatedvar.h"
+#include "mathlib/ssemath.h"
+#include "tier0/vprof.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -25,6 +27,108 @@ float CInterpolationContext::s_flLastTimeStamp = 0;
 
 float g_flLastPacketTimestamp = 0;
 
+CInterpolatedVarBatch *g_pInterpolatedVarBatch = NULL;
+
 
 ConVar cl_extrapolate_amount( "cl_extrapolate_amount", "0.25", FCVAR_CHEAT, "Set how many seconds the client will extrapolate entities for." );
 
+
+//-----------------------------------------------------------------------------
+// CInterpolatedVarBatch
+//-----------------------------------------------------------------------------
+void CInterpolatedVarBatch::Begin()
+{
+	m_pOut.RemoveAll();
+	m_P0.RemoveAll();
+	m_P1.RemoveAll();
+	m_P2.RemoveAll();
+	m_W0.RemoveAll();
+	m_W1.RemoveAll();
+	m_W2.RemoveAll();
+}
+
+void CInterpolatedVarBatch::Add( float *pOut, const float *p0, const float *p1, const float *p2, int nChannels, float w0, float w1, float w2 )
+{
+	int nFirst = m_pOut.AddMultipleToTail( nChannels );
+	m_P0.AddMultipleToTail( nChannels );
+	m_P1.AddMultipleToTail( nChannels, p1 );
+	m_P2.AddMultipleToTail( nChannels, p2 );
+	m_W0.AddMultipleToTail( nChannels );
+	m_W1.AddMultipleToTail( nChannels );
+	m_W2.AddMultipleToTail( nChannels );
+
+	for ( int i = 0; i < nChannels; ++i )
+	{
+		m_pOut[nFirst + i] = pOut + i;
+		m_P0[nFirst + i] = p0 ? p0[i] : 0.0f;
+		m_W0[nFirst + i] = w0;
+		m_W1[nFirst + i] = w1;
+		m_W2[nFirst + i] = w2;
+	}
+}
+
+void CInterpolatedVarBatch::AddLinear( float *pOut, const float *p1, const float *p2, int nChannels, float t )
+{
+	Add( pOut, NULL, p1, p2, nChannels, 0.0f, 1.0f - t, t );
+}
+
+void CInterpolatedVarBatch::AddHermite( float *pOut, const float *p0, const float *p1, const float *p2, int nChannels, float t )
+{
+	// Lerp_Hermite expanded into one weight per sample:
+	// p1 * h00 + p2 * h01 + (p1 - p0) * h10 + (p2 - p1) * h11
+	float tSqr = t*t;
+	float tCube = t*tSqr;
+	float h00 = 2*tCube - 3*tSqr + 1;
+	float h01 = -2*tCube + 3*tSqr;
+	float h10 = tCube - 2*tSqr + t;
+	float h11 = tCube - tSqr;
+
+	Add( pOut, p0, p1, p2, nChannels, -h10, h00 + h10 - h11, h01 + h11 );
+}
+
+void CInterpolatedVarBatch::Flush()
+{
+	int nCount = m_pOut.Count();
+	if ( nCount == 0 )
+		return;
+
+	VPROF( "CInterpolatedVarBatch::Flush" );
+	VPROF_INCREMENT_COUNTER( "Batched interpolation channels", nCount );
+
+	// Pad out to a whole number of SIMD lanes
+	int nPadded = ( nCount + 3 ) & ~3;
+	int nPad = nPadded - nCount;
+	m_P0.AddMultipleToTail( nPad );
+	m_P1.AddMultipleToTail( nPad );
+	m_P2.AddMultipleToTail( nPad );
+	m_W0.AddMultipleToTail( nPad );
+	m_W1.AddMultipleToTail( nPad );
+	m_W2.AddMultipleToTail( nPad );
+	for ( int i = nCount; i < nPadded; ++i )
+	{
+		m_P0[i] = m_P1[i] = m_P2[i] = 0.0f;
+		m_W0[i] = m_W1[i] = m_W2[i] = 0.0f;
+	}
+
+	// The results overwrite m_P0, which isn't needed afterwards
+	float *p0 = m_P0.Base();
+	const float *p1 = m_P1.Base();
+	const float *p2 = m_P2.Base();
+	const float *w0 = m_W0.Base();
+	const float *w1 = m_W1.Base();
+	const float *w2 = m_W2.Base();
+	for ( int i = 0; i < nPadded; i += 4 )
+	{
+		fltx4 result = MulSIMD( LoadUnalignedSIMD( p0 + i ), LoadUnalignedSIMD( w0 + i ) );
+		result = MaddSIMD( LoadUnalignedSIMD( p1 + i ), LoadUnalignedSIMD( w1 + i ), result );
+		result = MaddSIMD( LoadUnalignedSIMD( p2 + i ), LoadUnalignedSIMD( w2 + i ), result );
+		StoreUnalignedSIMD( p0 + i, result );
+	}
+
+	for ( int i = 0; i < nCount; ++i )
+	{
+		*m_pOut[i] = p0[i];
+	}
+
+	Begin();
+}
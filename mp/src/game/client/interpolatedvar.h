@@ -11,6 +11,7 @@
 #endif
 
 #include "tier1/utllinkedlist.h"
+#include "tier1/utlvector.h"
 #include "rangecheckedvar.h"
 #include "lerp_functions.h"
 #include "animationlayer.h"
@@ -145,6 +146,53 @@ inline QAngle ExtrapolateInterpolatedVarType( const QAngle &oldVal, const QAngle
 }
 
 
+// -------------------------------------------------------------------------------------------------------------- //
+// CInterpolatedVarBatch - structure of arrays pool for batched interpolation.
+//
+// While a batch is active (see C_BaseEntity::ProcessInterpolatedList), interpolated vars of the common
+// float-based types don't write their output directly. Instead they copy the samples they need into the
+// pool as individual float channels along with per-channel blend weights, and Flush() evaluates all of
+// them at once with SIMD and scatters the results back. Anything else (angles, animation layers,
+// range checked vars, looping values, extrapolation) still interpolates immediately.
+// -------------------------------------------------------------------------------------------------------------- //
+
+// Number of float channels per element for types the batch can handle, 0 for everything else.
+template< class T > struct InterpolatedVarBatchChannels { enum { COUNT = 0 }; };
+template<> struct InterpolatedVarBatchChannels<float> { enum { COUNT = 1 }; };
+template<> struct InterpolatedVarBatchChannels<Vector> { enum { COUNT = 3 }; };
+
+class CInterpolatedVarBatch
+{
+public:
+	void Begin();
+
+	// out = lerp( t, p1, p2 )
+	void AddLinear( float *pOut, const float *p1, const float *p2, int nChannels, float t );
+
+	// out = hermite( t, p0, p1, p2 ); see Lerp_Hermite
+	void AddHermite( float *pOut, const float *p0, const float *p1, const float *p2, int nChannels, float t );
+
+	// Evaluates everything queued since Begin() and writes the results out
+	void Flush();
+
+	int Count() const { return m_pOut.Count(); }
+
+private:
+	void Add( float *pOut, const float *p0, const float *p1, const float *p2, int nChannels, float w0, float w1, float w2 );
+
+	CUtlVector< float * >	m_pOut;
+	CUtlVector< float >		m_P0;
+	CUtlVector< float >		m_P1;
+	CUtlVector< float >		m_P2;
+	CUtlVector< float >		m_W0;
+	CUtlVector< float >		m_W1;
+	CUtlVector< float >		m_W2;
+};
+
+// Non-NULL only while a batch is being gathered
+extern CInterpolatedVarBatch *g_pInterpolatedVarBatch;
+
+
 // -------------------------------------------------------------------------------------------------------------- //
 // IInterpolatedVar interface.
 // -------------------------------------------------------------------------------------------------------------- //
@@ -552,6 +600,10 @@ protected:
 
 	void _Interpolate( Type *out, float frac, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
 	void _Interpolate_Hermite( Type *out, float frac, CInterpolatedVarEntry *pOriginalPrev, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end, bool looping = false );
+
+	// Queues the interpolation into g_pInterpolatedVarBatch. Returns false if the
+	// var has to be interpolated immediately instead.
+	bool _QueueBatchedInterpolate( const CInterpolationInfo &info );
 	
 	void _Derivative_Hermite( Type *out, float frac, CInterpolatedVarEntry *pOriginalPrev, CInterpolatedVarEntry *start, CInterpolatedVarEntry *end );
 	void _Derivative_Hermite_SmoothVelocity( Type *out, float frac, CInterpolatedVarEntry *b, CInterpolatedVarEntry *c, CInterpolatedVarEntry *d );
@@ -989,6 +1041,14 @@ inline int CInterpolatedVarArrayBase<Type, IS_ARRAY>::Interpolate( float current
 	memcpy( backupValues, m_pValue, sizeof( Type ) * m_nMaxCount );
 #endif
 
+#ifndef INTERPOLATEDVAR_PARANOID_MEASUREMENT
+	// The newer == older case may extrapolate, so it's always done immediately
+	if ( g_pInterpolatedVarBatch && ( info.m_bHermite || info.newer != info.older ) && _QueueBatchedInterpolate( info ) )
+	{
+		// Written out by g_pInterpolatedVarBatch->Flush()
+	}
+	else
+#endif
 	if ( info.m_bHermite )
 	{
 		// base cast, we have 3 valid sample point
@@ -1341,6 +1401,49 @@ inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Interpolate( Type *out,
 }
 
 
+template< typename Type, bool IS_ARRAY >
+inline bool CInterpolatedVarArrayBase<Type, IS_ARRAY>::_QueueBatchedInterpolate( const CInterpolationInfo &info )
+{
+	const int nChannelsPerElement = InterpolatedVarBatchChannels<Type>::COUNT;
+	if ( nChannelsPerElement == 0 )
+		return false;
+
+	// Looping values wrap around, which the batch doesn't know how to do
+	for ( int i = 0; i < m_nMaxCount; i++ )
+	{
+		if ( m_bLooping[ i ] )
+			return false;
+	}
+
+	int nChannels = nChannelsPerElement * m_nMaxCount;
+	CVarHistory &history = m_VarHistory;
+
+	if ( info.m_bHermite )
+	{
+		CInterpolatedVarEntry *prev = &history[info.oldest];
+		CInterpolatedVarEntry *start = &history[info.older];
+		CInterpolatedVarEntry *end = &history[info.newer];
+
+		CInterpolatedVarEntry fixup;
+		fixup.Init(m_nMaxCount);
+		TimeFixup_Hermite( fixup, prev, start, end );
+
+		g_pInterpolatedVarBatch->AddHermite( (float*)m_pValue, (const float*)prev->GetValue(), 
+			(const float*)start->GetValue(), (const float*)end->GetValue(), nChannels, info.frac );
+	}
+	else
+	{
+		CInterpolatedVarEntry *start = &history[info.older];
+		CInterpolatedVarEntry *end = &history[info.newer];
+
+		g_pInterpolatedVarBatch->AddLinear( (float*)m_pValue, (const float*)start->GetValue(), 
+			(const float*)end->GetValue(), nChannels, info.frac );
+	}
+
+	return true;
+}
+
+
 template< typename Type, bool IS_ARRAY >
 inline void CInterpolatedVarArrayBase<Type, IS_ARRAY>::_Extrapolate( 
 	Type *pOut,
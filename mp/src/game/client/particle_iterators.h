@@ -65,11 +65,9 @@ private:
 	ParticleDraw *m_pParticleDraw;
 	CMeshBuilder *m_pMeshBuilder;
 	IMesh *m_pMesh;
-	bool m_bBucketSort;
+	bool m_bDepthSort;
 	
 	// Output after rendering.
-	float m_MinZ;
-	float m_MaxZ;
 	float m_zCoords[MAX_TOTAL_PARTICLES];
 	int m_nZCoords;
 	
@@ -125,8 +123,6 @@ inline CParticleRenderIterator::CParticleRenderIterator()
 	m_bGotFirst = false;
 	m_flPrevZ = 0;
 	m_nParticlesInCurrentBatch = 0;
-	m_MinZ = 1e24;
-	m_MaxZ = -1e24;
 	m_nZCoords = 0;
 }
 
@@ -165,11 +161,8 @@ inline const Particle* CParticleRenderIterator::GetNext( float sortKey )
 	Particle *pNext = m_pCur->m_pNext;
 
 	// Update the incremental sort.
-	if( m_bBucketSort )
+	if( m_bDepthSort )
 	{
-		m_MinZ = MIN( sortKey, m_MinZ );
-		m_MaxZ = MAX( sortKey, m_MaxZ );
-		
 		m_zCoords[m_nZCoords] = sortKey;
 		++m_nZCoords;
 	}
@@ -7,6 +7,8 @@
 #include "cbase.h"
 #include "particle_litsmokeemitter.h"
 
+extern ConVar cl_particle_simd;
+
 
 //
 // CLitSmokeEmitter
@@ -123,6 +125,30 @@ void CLitSmokeEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 	Assert( m_bInitted );
 	
 	LitSmokeParticle *pParticle = (LitSmokeParticle*)pIterator->GetFirst();
+	if ( cl_particle_simd.GetBool() )
+	{
+		LitSmokeParticle *pBatch[PARTICLE_SIMD_BATCH];
+		bool bExpired[PARTICLE_SIMD_BATCH];
+		while ( pParticle )
+		{
+			int nBatch = 0;
+			while ( pParticle && nBatch < PARTICLE_SIMD_BATCH )
+			{
+				pBatch[nBatch++] = pParticle;
+				pParticle = (LitSmokeParticle*)pIterator->GetNext();
+			}
+
+			IntegrateParticlesSIMD( pBatch, nBatch, pIterator->GetTimeDelta(), bExpired );
+
+			for ( int i = 0; i < nBatch; i++ )
+			{
+				if ( bExpired[i] )
+					pIterator->RemoveParticle( pBatch[i] );
+			}
+		}
+		return;
+	}
+
 	while ( pParticle )
 	{
 		// Should this particle die?
@@ -14,6 +14,7 @@
 #include "particlemgr.h"
 #include "cdll_client_int.h"
 #include "timedevent.h"
+#include "mathlib/ssemath.h"
 
 // Lerp between two floating point numbers.
 inline float FLerp(float minVal, float maxVal, float t)
@@ -41,6 +42,57 @@ inline void PhysicallySimulate(Vector &pos, Vector &velocity, const Vector &acce
 }
 
 
+// Number of particles gathered per call to IntegrateParticlesSIMD by the simulators.
+#define PARTICLE_SIMD_BATCH		64
+
+// Advance a batch of particles by their velocity and age them by fTimeDelta, four
+// at a time.  T needs m_Pos, m_vecVelocity, m_flLifetime and m_flDieTime.
+// pExpired[i] is set when the particle has reached its die time.
+// This matches the scalar "m_Pos += m_vecVelocity * dt; m_flLifetime += dt" exactly.
+template< class T >
+inline void IntegrateParticlesSIMD( T **ppParticles, int nCount, const float fTimeDelta, bool *pExpired )
+{
+	fltx4 fl4TimeDelta = ReplicateX4( fTimeDelta );
+
+	int i = 0;
+	for ( ; i + 4 <= nCount; i += 4 )
+	{
+		T *p0 = ppParticles[i];
+		T *p1 = ppParticles[i+1];
+		T *p2 = ppParticles[i+2];
+		T *p3 = ppParticles[i+3];
+
+		FourVectors vPos, vVel;
+		vPos.LoadAndSwizzle( p0->m_Pos, p1->m_Pos, p2->m_Pos, p3->m_Pos );
+		vVel.LoadAndSwizzle( p0->m_vecVelocity, p1->m_vecVelocity, p2->m_vecVelocity, p3->m_vecVelocity );
+		vVel *= fl4TimeDelta;
+		vPos += vVel;
+
+		ALIGN16 float flLifetime[4] ALIGN16_POST = { p0->m_flLifetime, p1->m_flLifetime, p2->m_flLifetime, p3->m_flLifetime };
+		ALIGN16 float flDieTime[4] ALIGN16_POST = { p0->m_flDieTime, p1->m_flDieTime, p2->m_flDieTime, p3->m_flDieTime };
+		fltx4 fl4Lifetime = AddSIMD( LoadAlignedSIMD( flLifetime ), fl4TimeDelta );
+		int nExpired = TestSignSIMD( CmpGeSIMD( fl4Lifetime, LoadAlignedSIMD( flDieTime ) ) );
+		StoreAlignedSIMD( flLifetime, fl4Lifetime );
+
+		for ( int j = 0; j < 4; j++ )
+		{
+			T *pParticle = ppParticles[i+j];
+			pParticle->m_Pos.Init( vPos.X( j ), vPos.Y( j ), vPos.Z( j ) );
+			pParticle->m_flLifetime = flLifetime[j];
+			pExpired[i+j] = ( nExpired & ( 1 << j ) ) != 0;
+		}
+	}
+
+	for ( ; i < nCount; i++ )
+	{
+		T *pParticle = ppParticles[i];
+		pParticle->m_Pos += pParticle->m_vecVelocity * fTimeDelta;
+		pParticle->m_flLifetime += fTimeDelta;
+		pExpired[i] = ( pParticle->m_flLifetime >= pParticle->m_flDieTime );
+	}
+}
+
+
 inline Vector GetGravityVector()
 {
 	return Vector(0, 0, -150);
@@ -30,6 +30,7 @@
 #include "rtime.h"
 #endif
 #include "tier0/icommandline.h"
+#include "mathlib/ssemath.h"
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
@@ -43,6 +44,7 @@ static ConVar particle_simulateoverflow( "particle_simulateoverflow", "0", FCVAR
 ConVar cl_particleeffect_aabb_buffer( "cl_particleeffect_aabb_buffer", "2", FCVAR_CHEAT, "Add this amount to a particle effect's bbox in the leaf system so if it's growing slowly, it won't have to be reinserted as often." );
 ConVar cl_particle_show_bbox( "cl_particle_show_bbox", "0", FCVAR_CHEAT );
 ConVar cl_particle_show_bbox_cost( "cl_particle_show_bbox_cost", "0", FCVAR_CHEAT, "Show # of particles: green->blue->red. Use a negative number to show ALL particles even cheap ones" );
+ConVar cl_particle_simd( "cl_particle_simd", "1", 0, "Simulate the built in legacy particle emitters in batches with SIMD" );
 
 // These reflect the convars so we don't parse the string every particle!
 bool g_cl_particle_show_bbox = false;
@@ -58,7 +60,8 @@ static ConVar cl_particle_stats_trigger_count( "cl_particle_stats_trigger_count"
 
 
 
-#define BUCKET_SORT_EVERY_N		8			// It does a bucket sort for each material approximately every N times.
+#define DEPTH_SORT_EVERY_N		8			// It does a full depth sort for each material approximately every N times.
+#define NUM_DEPTH_SORT_BUCKETS	256			// Depth resolution of the full sort.
 #define BBOX_UPDATE_EVERY_N		8			// It does a full bbox update (checks all particles instead of every eighth one).
 
 //-----------------------------------------------------------------------------
@@ -330,7 +333,7 @@ int CParticleEffectBinding::DrawModel( int flags )
 	VMatrix mTempModel, mTempView;
 	RenderStart( mTempModel, mTempView );
 
-	bool bBucketSort = random->RandomInt( 0, BUCKET_SORT_EVERY_N ) == 0;
+	bool bDepthSort = random->RandomInt( 0, DEPTH_SORT_EVERY_N ) == 0;
 
 	// Set frametime to zero if we've already rendered this frame.
 	float flFrameTime = 0;
@@ -359,7 +362,7 @@ int CParticleEffectBinding::DrawModel( int flags )
 		}
 		
 		DrawMaterialParticles( 
-			bBucketSort,
+			bDepthSort,
 			pMaterial, 
 			flFrameTime,
 			bWireframe );
@@ -373,7 +376,7 @@ int CParticleEffectBinding::DrawModel( int flags )
 			CEffectMaterial *pMaterial = m_Materials[iDrawMaterial];
 			
 			DrawMaterialParticles( 
-				bBucketSort,
+				bDepthSort,
 				pMaterial, 
 				flFrameTime,
 				bWireframe );
@@ -765,7 +768,7 @@ int CParticleEffectBinding::GetActiveParticleList( int nCount, Particle **ppPart
 
 
 int CParticleEffectBinding::DrawMaterialParticles( 
-	bool bBucketSort,
+	bool bDepthSort,
 	CEffectMaterial *pMaterial, 
 	float flTimeDelta,
 	bool bWireframe
@@ -788,14 +791,14 @@ int CParticleEffectBinding::DrawMaterialParticles(
 	renderIterator.m_pParticleDraw = &particleDraw;
 	renderIterator.m_pMeshBuilder = &builder;
 	renderIterator.m_pMesh = pMesh;
-	renderIterator.m_bBucketSort = bBucketSort;
+	renderIterator.m_bDepthSort = bDepthSort;
 
 	m_pSim->RenderParticles( &renderIterator );
 	g_nParticlesDrawn += m_nActiveParticles;
 
-	if( bBucketSort )
+	if( bDepthSort )
 	{
-		DoBucketSort( pMaterial, renderIterator.m_zCoords, renderIterator.m_nZCoords, renderIterator.m_MinZ, renderIterator.m_MaxZ );
+		DoDepthSort( pMaterial, renderIterator.m_zCoords, renderIterator.m_nZCoords );
 	}
 
 	// Flush out any remaining particles.
@@ -867,57 +870,116 @@ void CParticleEffectBinding::RenderEnd( VMatrix &tempModel, VMatrix &tempView )
 }
 
 
-void CParticleEffectBinding::DoBucketSort( CEffectMaterial *pMaterial, float *zCoords, int nZCoords, float minZ, float maxZ )
+//-----------------------------------------------------------------------------
+// Sorts the material's particles by the depths the renderer reported, back to
+// front. The depth range and bucket keys are computed four particles at a time,
+// then a stable counting sort over the keys relinks the list in a single pass.
+//-----------------------------------------------------------------------------
+void CParticleEffectBinding::DoDepthSort( CEffectMaterial *pMaterial, const float *zCoords, int nZCoords )
 {
-	// Do an O(N) bucket sort. This helps the sort when there are lots of particles.
-	#define NUM_BUCKETS	32
-	Particle buckets[NUM_BUCKETS];
-	for( int iBucket=0; iBucket < NUM_BUCKETS; iBucket++ )
+	VPROF_BUDGET( "CParticleEffectBinding::DoDepthSort", VPROF_BUDGETGROUP_PARTICLE_RENDERING );
+
+	if ( nZCoords < 2 )
+		return;
+
+	// Find the depth range.
+	fltx4 fl4MinZ = ReplicateX4( zCoords[0] );
+	fltx4 fl4MaxZ = fl4MinZ;
+	int i;
+	for ( i = 0; i + 4 <= nZCoords; i += 4 )
 	{
-		buckets[iBucket].m_pPrev = buckets[iBucket].m_pNext = &buckets[iBucket];
+		fltx4 fl4Z = LoadUnalignedSIMD( &zCoords[i] );
+		fl4MinZ = MinSIMD( fl4MinZ, fl4Z );
+		fl4MaxZ = MaxSIMD( fl4MaxZ, fl4Z );
 	}
-	
-	// Sort into buckets.
-	int iCurParticle = 0;
-	Particle *pNext, *pCur;
-	for( pCur=pMaterial->m_Particles.m_pNext; pCur != &pMaterial->m_Particles; pCur=pNext )
+
+	float minZ = MIN( MIN( SubFloat( fl4MinZ, 0 ), SubFloat( fl4MinZ, 1 ) ), MIN( SubFloat( fl4MinZ, 2 ), SubFloat( fl4MinZ, 3 ) ) );
+	float maxZ = MAX( MAX( SubFloat( fl4MaxZ, 0 ), SubFloat( fl4MaxZ, 1 ) ), MAX( SubFloat( fl4MaxZ, 2 ), SubFloat( fl4MaxZ, 3 ) ) );
+	for ( ; i < nZCoords; i++ )
 	{
-		pNext = pCur->m_pNext;
-		if( iCurParticle >= nZCoords )
-			break;
+		minZ = MIN( zCoords[i], minZ );
+		maxZ = MAX( zCoords[i], maxZ );
+	}
 
-		// Remove it..
-		UnlinkParticle( pCur );
+	// Everything is at the same depth, the (stable) sort wouldn't change anything.
+	if ( maxZ == minZ )
+		return;
 
-		// Add it to the appropriate bucket.
-		float flPercent;
-		if (maxZ == minZ)
-			flPercent = 0;
+	// Quantize the depths into bucket keys.
+	int *pKeys = (int *)stackalloc( ( ( nZCoords + 3 ) & ~3 ) * sizeof( int ) );
+	fltx4 fl4Bias = ReplicateX4( minZ );
+	fltx4 fl4Scale = ReplicateX4( ( NUM_DEPTH_SORT_BUCKETS - 0.0001f ) / ( maxZ - minZ ) );
+	fltx4 fl4MaxKey = ReplicateX4( (float)( NUM_DEPTH_SORT_BUCKETS - 1 ) );
+	for ( i = 0; i < nZCoords; i += 4 )
+	{
+		fltx4 fl4Z;
+		if ( i + 4 <= nZCoords )
+		{
+			fl4Z = LoadUnalignedSIMD( &zCoords[i] );
+		}
 		else
-			flPercent = (zCoords[iCurParticle] - minZ) / (maxZ - minZ);
+		{
+			fl4Z = fl4Bias;
+			for ( int j = 0; i + j < nZCoords; j++ )
+			{
+				SubFloat( fl4Z, j ) = zCoords[i+j];
+			}
+		}
 
-		int iAddBucket = (int)( flPercent * (NUM_BUCKETS - 0.0001f) );
-		iAddBucket = NUM_BUCKETS - iAddBucket - 1;
-		Assert( iAddBucket >= 0 && iAddBucket < NUM_BUCKETS );
+		fltx4 fl4Key = MulSIMD( SubSIMD( fl4Z, fl4Bias ), fl4Scale );
+		fl4Key = MinSIMD( MaxSIMD( fl4Key, Four_Zeros ), fl4MaxKey );
 
-		InsertParticleAfter( pCur, &buckets[iAddBucket] );
+		intx4 nKeys;
+		ConvertStoreAsIntsSIMD( &nKeys, fl4Key );
+		pKeys[i] = nKeys[0];
+		pKeys[i+1] = nKeys[1];
+		pKeys[i+2] = nKeys[2];
+		pKeys[i+3] = nKeys[3];
+	}
 
-		++iCurParticle;
+	// Only the particles that were rendered have a depth. Anything after them
+	// (there shouldn't be) stays where it is, after the sorted ones.
+	Particle **ppParticles = (Particle **)stackalloc( nZCoords * sizeof( Particle * ) );
+	int nParticles = 0;
+	Particle *pCur = pMaterial->m_Particles.m_pNext;
+	for ( ; pCur != &pMaterial->m_Particles && nParticles < nZCoords; pCur = pCur->m_pNext )
+	{
+		ppParticles[nParticles++] = pCur;
 	}
+	Particle *pRest = pCur;
 
-	// Put the buckets back into the main list.
-	for( int iReAddBucket=0; iReAddBucket < NUM_BUCKETS; iReAddBucket++ )
+	// Counting sort, smallest depth (farthest away) first.
+	int nOffsets[NUM_DEPTH_SORT_BUCKETS];
+	memset( nOffsets, 0, sizeof( nOffsets ) );
+	for ( i = 0; i < nParticles; i++ )
 	{
-		Particle *pListHead = &buckets[iReAddBucket];
-		for( pCur=pListHead->m_pNext; pCur != pListHead; pCur=pNext )
-		{
-			pNext = pCur->m_pNext;
-			InsertParticleAfter( pCur, &pMaterial->m_Particles );
-			--iCurParticle;
-		}
+		++nOffsets[ pKeys[i] ];
 	}
 
-	Assert(iCurParticle==0);
+	int nTotal = 0;
+	for ( int iBucket = 0; iBucket < NUM_DEPTH_SORT_BUCKETS; iBucket++ )
+	{
+		int nCount = nOffsets[iBucket];
+		nOffsets[iBucket] = nTotal;
+		nTotal += nCount;
+	}
+
+	Particle **ppSorted = (Particle **)stackalloc( nParticles * sizeof( Particle * ) );
+	for ( i = 0; i < nParticles; i++ )
+	{
+		ppSorted[ nOffsets[ pKeys[i] ]++ ] = ppParticles[i];
+	}
+
+	// Relink the list in the new order.
+	Particle *pPrev = &pMaterial->m_Particles;
+	for ( i = 0; i < nParticles; i++ )
+	{
+		pPrev->m_pNext = ppSorted[i];
+		ppSorted[i]->m_pPrev = pPrev;
+		pPrev = ppSorted[i];
+	}
+	pPrev->m_pNext = pRest;
+	pRest->m_pPrev = pPrev;
 }
 
 
@@ -1034,7 +1096,7 @@ CEffectMaterial* CParticleEffectBinding::GetEffectMaterial( CParticleSubTexture
 //-----------------------------------------------------------------------------
 // CParticleMgr
 //-----------------------------------------------------------------------------
-CParticleMgr::CParticleMgr()
+CParticleMgr::CParticleMgr() : m_ParticlePool( PARTICLE_SIZE, MAX_TOTAL_PARTICLES / 8, UTLMEMORYPOOL_GROW_SLOW, "CParticleMgr::m_ParticlePool", 16 )
 {
 	m_nToolParticleEffectId = 0;
 	m_bUpdatingEffects = false;
@@ -1171,8 +1233,10 @@ Particle *CParticleMgr::AllocParticle( int size )
 	// Enforce max particle limit.
 	if ( m_nCurrentParticlesAllocated >= MAX_TOTAL_PARTICLES )
 		return NULL;
-		
-	Particle *pRet = (Particle *)malloc( size );
+
+	// All legacy particles come out of the same fixed size pool.
+	Assert( size <= PARTICLE_SIZE );
+	Particle *pRet = (Particle *)m_ParticlePool.Alloc();
 	if ( pRet )
 		++m_nCurrentParticlesAllocated;
 
@@ -1183,9 +1247,10 @@ void CParticleMgr::FreeParticle( Particle *pParticle )
 {
 	Assert( m_nCurrentParticlesAllocated > 0 );
 	if ( pParticle )
+	{
 		--m_nCurrentParticlesAllocated;
-	
-	free( pParticle );
+		m_ParticlePool.Free( pParticle );
+	}
 }
 
 
@@ -126,6 +126,7 @@ entities. Each one is useful under different conditions.
 #endif
 #include "tier1/utlintrusivelist.h"
 #include "tier1/utlstring.h"
+#include "tier1/mempool.h"
 
 
 //-----------------------------------------------------------------------------
@@ -137,7 +138,6 @@ class IClientParticleListener;
 struct Particle;
 class ParticleDraw;
 class CMeshBuilder;
-class CUtlMemoryPool;
 class CEffectMaterial;
 class CParticleSimulateIterator;
 class CParticleRenderIterator;
@@ -478,7 +478,7 @@ private:
 						bool bWireframe );
 
 	int				DrawMaterialParticles( 
-						bool bBucketSort,
+						bool bDepthSort,
 						CEffectMaterial *pMaterial, 
 						float flTimeDelta,
 						bool bWireframe
@@ -492,12 +492,10 @@ private:
 	void			BBoxCalcStart( Vector &bbMin, Vector &bbMax );
 	void			BBoxCalcEnd( bool bboxSet, Vector &bbMin, Vector &bbMax );
 	
-	void			DoBucketSort( 
+	void			DoDepthSort( 
 						CEffectMaterial *pMaterial, 
-						float *zCoords, 
-						int nZCoords,
-						float minZ,
-						float maxZ );
+						const float *zCoords, 
+						int nZCoords );
 
 	int				GetRemovalInProgressFlag()					{ return GetFlag( FLAGS_REMOVALINPROGRESS ); }
 	void			SetRemovalInProgressFlag()					{ SetFlag( FLAGS_REMOVALINPROGRESS, 1 ); }
@@ -731,6 +729,9 @@ private:
 
 	int m_nCurrentParticlesAllocated;
 
+	// Fixed size blocks for the legacy particles so effects stay packed together.
+	CUtlMemoryPool					m_ParticlePool;
+
 	// Directional lighting info.
 	CParticleLightInfo m_DirectionalLight;
 
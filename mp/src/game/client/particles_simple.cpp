@@ -15,6 +15,8 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+extern ConVar cl_particle_simd;
+
 
 // Used for debugging to make sure all particle effects get freed when we exit.
 CUtlLinkedList<CParticleEffect*,int> g_ParticleEffects;
@@ -367,6 +369,35 @@ void CSimpleEmitter::SimulateParticles( CParticleSimulateIterator *pIterator )
 	float timeDelta = pIterator->GetTimeDelta();
 
 	SimpleParticle *pParticle = (SimpleParticle*)pIterator->GetFirst();
+	if ( cl_particle_simd.GetBool() )
+	{
+		// Velocity and roll stay per particle since derived emitters override them,
+		// the integration in between is done for the whole batch at once.
+		SimpleParticle *pBatch[PARTICLE_SIMD_BATCH];
+		bool bExpired[PARTICLE_SIMD_BATCH];
+		while ( pParticle )
+		{
+			int nBatch = 0;
+			while ( pParticle && nBatch < PARTICLE_SIMD_BATCH )
+			{
+				UpdateVelocity( pParticle, timeDelta );
+				pBatch[nBatch++] = pParticle;
+				pParticle = (SimpleParticle*)pIterator->GetNext();
+			}
+
+			IntegrateParticlesSIMD( pBatch, nBatch, timeDelta, bExpired );
+
+			for ( int i = 0; i < nBatch; i++ )
+			{
+				UpdateRoll( pBatch[i], timeDelta );
+
+				if ( bExpired[i] )
+					pIterator->RemoveParticle( pBatch[i] );
+			}
+		}
+		return;
+	}
+
 	while ( pParticle )
 	{
 		//Update velocity
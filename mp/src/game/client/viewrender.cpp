@@ -3314,6 +3314,7 @@ void CRendering3dView::SetupRenderablesList( int viewID )
 
 		setupInfo.m_vecRenderOrigin = origin;
 		setupInfo.m_vecRenderForward = CurrentViewForward();
+		setupInfo.m_pFrustum = GetFrustum();
 
 		float fMaxDist = cl_maxrenderable_dist.GetFloat();
 
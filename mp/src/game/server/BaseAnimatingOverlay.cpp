@@ -448,7 +448,7 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 	}
 
 	IBoneSetup boneSetup( pStudioHdr, boneMask, GetPoseParameterArray() );
-	boneSetup.InitPose( pos, q );
+	boneSetup.InitPoseSoA( pos, q );
 
 	boneSetup.AccumulatePose( pos, q, GetSequence(), GetCycle(), 1.0, gpGlobals->curtime, m_pIk );
 
@@ -488,6 +488,7 @@ void CBaseAnimatingOverlay::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Q
 		boneSetup.CalcAutoplaySequences( pos, q, gpGlobals->curtime, NULL );
 	}
 	boneSetup.CalcBoneAdj( pos, q, GetEncodedControllerArray() );
+	boneSetup.StorePose( pos, q );
 }
 
 
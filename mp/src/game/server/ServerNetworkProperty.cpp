@@ -299,6 +299,8 @@ void CServerNetworkProperty::FireEvent()
 	// trigger a state change in the edict.
 	if ( m_bPendingStateChange )
 	{
+		if ( g_bTrackNetworkPropChanges )
+			NetworkPropChanges_MarkAll( this );
 		m_pPev->StateChanged();
 		m_bPendingStateChange = false;
 	}
@@ -16,6 +16,18 @@
 #include "edict.h"
 #include "timedeventmgr.h"
 
+class CServerNetworkProperty;
+
+// parallel_think.h
+extern bool g_bParallelThinkActive;
+bool ParallelThink_IsDeferring();
+void ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp, unsigned short offset );
+
+// networkpropchanges.h
+extern bool g_bTrackNetworkPropChanges;
+void NetworkPropChanges_Mark( CServerNetworkProperty *pProp, unsigned short nOffset );
+void NetworkPropChanges_MarkAll( CServerNetworkProperty *pProp );
+
 //
 // Lightweight base class for networkable data on the server.
 //
@@ -179,7 +191,11 @@ inline void CServerNetworkProperty::SetNetworkParent( EHANDLE hParent )
 inline void CServerNetworkProperty::NetworkStateForceUpdate()
 { 
 	if ( m_pPev )
+	{
+		if ( g_bTrackNetworkPropChanges )
+			NetworkPropChanges_MarkAll( this );
 		m_pPev->StateChanged();
+	}
 }
 
 inline void CServerNetworkProperty::NetworkStateChanged()
@@ -194,12 +210,23 @@ inline void CServerNetworkProperty::NetworkStateChanged()
 	else
 	{
 		if ( m_pPev )
+		{
+			if ( g_bTrackNetworkPropChanges )
+				NetworkPropChanges_MarkAll( this );
 			m_pPev->StateChanged();
+		}
 	}
 }
 
 inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffset )
 { 
+	// The shared change info isn't thread safe, parallel thinks queue their changes
+	if ( g_bParallelThinkActive && ParallelThink_IsDeferring() )
+	{
+		ParallelThink_DeferStateChanged( this, varOffset );
+		return;
+	}
+
 	// If we're using the timer, then ignore this call.
 	if ( m_TimerEvent.IsRegistered() )
 	{
@@ -210,7 +237,11 @@ inline void CServerNetworkProperty::NetworkStateChanged( unsigned short varOffse
 	else
 	{
 		if ( m_pPev )
+		{
+			if ( g_bTrackNetworkPropChanges )
+				NetworkPropChanges_Mark( this, varOffset );
 			m_pPev->StateChanged( varOffset );
+		}
 	}
 }
 
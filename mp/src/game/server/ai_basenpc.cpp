@@ -222,6 +222,7 @@ CFastTimer g_AIMoveTimer;
 
 CFastTimer g_AIConditionsTimer;
 CFastTimer g_AIPrescheduleThinkTimer;
+extern CFastTimer g_AIListenTimer;
 CFastTimer g_AIMaintainScheduleTimer;
 
 //-----------------------------------------------------------------------------
@@ -3202,28 +3203,8 @@ void CAI_BaseNPC::UpdateEfficiency( bool bInPVS )
 	
 	if ( GetSoundInterests() & SOUND_DANGER )
 	{
-		int	iSound = CSoundEnt::ActiveList();
-		
-		while ( iSound != SOUNDLIST_EMPTY )
-		{
-			CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
-
-			float hearingSensitivity = HearingSensitivity();
-			Vector vEarPosition = EarPosition();
-
-			if ( pCurrentSound && (SOUND_DANGER & pCurrentSound->SoundType()) )
-			{
-				float flHearDistanceSq = pCurrentSound->Volume() * hearingSensitivity;
-				flHearDistanceSq *= flHearDistanceSq;
-				if ( pCurrentSound->GetSoundOrigin().DistToSqr( vEarPosition ) <= flHearDistanceSq )
-				{
-					bPotentialDanger = true;
-					break;
-				}
-			}
-			
-			iSound = pCurrentSound->NextSound();
-		}
+		int iSound;
+		bPotentialDanger = ( CSoundEnt::GetSoundsAtPoint( EarPosition(), SOUND_DANGER, HearingSensitivity(), &iSound, 1 ) != 0 );
 	}
 
 	if ( bPotentialDanger )
@@ -3394,22 +3375,20 @@ void CAI_BaseNPC::UpdateSleepState( bool bInPVS )
 				// Should check for visible danger sounds
 				if ( (GetSoundInterests() & SOUND_DANGER) && !(HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) )
 				{
-					int	iSound = CSoundEnt::ActiveList();
+					int sounds[MAX_WORLD_SOUNDS_MP];
+					int nSounds = CSoundEnt::GetSoundsAtPoint( EarPosition(), SOUND_DANGER, HearingSensitivity(), sounds, ARRAYSIZE( sounds ) );
 					
-					while ( iSound != SOUNDLIST_EMPTY )
+					for ( int i = 0; i < nSounds; i++ )
 					{
-						CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
+						CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( sounds[i] );
 						Assert( pCurrentSound );
 
-						if ( (pCurrentSound->SoundType() & SOUND_DANGER) && 
-							 GetSenses()->CanHearSound( pCurrentSound ) &&
+						if ( GetSenses()->CanHearSound( pCurrentSound ) &&
 							 SoundIsVisible( pCurrentSound ))
 						{
 							Wake();
 							break;
 						}
-
-						iSound = pCurrentSound->NextSound();
 					}
 				}
 			}
@@ -9346,10 +9325,12 @@ ConVar ai_think_limit_label( "ai_think_limit_label", "0", FCVAR_ARCHIVE );
 
 void CAI_BaseNPC::ReportOverThinkLimit( float time )
 {
-	DevMsg( "%s thinking for %.02fms!!! (%s); r%.2f (c%.2f, pst%.2f, ms%.2f), p-r%.2f, m%.2f\n",
+	DevMsg( "%s thinking for %.02fms!!! (%s); r%.2f (c%.2f [l%.2f, %d snd], pst%.2f, ms%.2f), p-r%.2f, m%.2f\n",
 		 GetDebugName(), time, GetCurSchedule()->GetName(),
 		 g_AIRunTimer.GetDuration().GetMillisecondsF(),
 		 g_AIConditionsTimer.GetDuration().GetMillisecondsF(),
+		 g_AIListenTimer.GetDuration().GetMillisecondsF(),
+		 GetSenses() ? GetSenses()->GetListenSoundsTested() : 0,
 		 g_AIPrescheduleThinkTimer.GetDuration().GetMillisecondsF(),
 		 g_AIMaintainScheduleTimer.GetDuration().GetMillisecondsF(),
 		 g_AIPostRunTimer.GetDuration().GetMillisecondsF(),
@@ -502,6 +502,7 @@ public:
 
 	virtual int			Save( ISave &save ); 
 	virtual int			Restore( IRestore &restore );
+	virtual bool		IsSaveThreadSafe() const { return false; }
 	virtual void		OnRestore();
 	void				SaveConditions( ISave &save, const CAI_ScheduleBits &conditions );
 	void				RestoreConditions( IRestore &restore, CAI_ScheduleBits *pConditions );
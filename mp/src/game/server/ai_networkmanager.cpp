@@ -25,6 +25,7 @@
 #include "ndebugoverlay.h"
 #include "ai_hint.h"
 #include "tier0/icommandline.h"
+#include "loadprofiler.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -474,6 +475,8 @@ void CAI_NetworkManager::SaveNetworkGraph( void )
 
 void CAI_NetworkManager::LoadNetworkGraph( void )
 {
+	LOAD_PROFILE_SCOPE( "CAI_NetworkManager::LoadNetworkGraph" );
+
 	// ---------------------------------------------------
 	// If I'm in edit mode don't load, always recalculate
 	// ---------------------------------------------------
@@ -924,6 +927,8 @@ bool g_bAIDisabledByUser = false;
 
 void CAI_NetworkManager::InitializeAINetworks()
 {
+	LOAD_PROFILE_SCOPE( "CAI_NetworkManager::InitializeAINetworks" );
+
 	// For not just create a single AI Network called "BigNet"
 	// At some later point we may have mulitple AI networks
 	CAI_NetworkManager *pNetwork;
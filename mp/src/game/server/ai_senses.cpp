@@ -38,6 +38,7 @@ const float AI_MISC_SEARCH_TIME  = 0.45;
 //-----------------------------------------------------------------------------
 
 CAI_SensedObjectsManager g_AI_SensedObjectsManager;
+CFastTimer g_AIListenTimer;
 
 //-----------------------------------------------------------------------------
 
@@ -114,28 +115,34 @@ bool CAI_Senses::CanHearSound( CSound *pSound )
 
 void CAI_Senses::Listen( void )
 {
+	g_AIListenTimer.Start();
+
 	m_iAudibleList = SOUNDLIST_EMPTY; 
+	m_nListenSoundsTested = 0;
 
 	int iSoundMask = GetOuter()->GetSoundInterests();
 	
 	if ( iSoundMask != SOUND_NONE && !(GetOuter()->HasSpawnFlags(SF_NPC_WAIT_TILL_SEEN)) )
 	{
-		int	iSound = CSoundEnt::ActiveList();
-		
-		while ( iSound != SOUNDLIST_EMPTY )
+		// Only the sounds that reach our ears, in active list order
+		int sounds[MAX_WORLD_SOUNDS_MP];
+		int nSounds = CSoundEnt::GetSoundsAtPoint( GetOuter()->EarPosition(), iSoundMask, GetOuter()->HearingSensitivity(), sounds, ARRAYSIZE( sounds ), &m_nListenSoundsTested );
+
+		for ( int i = 0; i < nSounds; i++ )
 		{
+			int iSound = sounds[i];
 			CSound *pCurrentSound = CSoundEnt::SoundPointerForIndex( iSound );
 
-			if ( pCurrentSound	&& (iSoundMask & pCurrentSound->SoundType()) && CanHearSound( pCurrentSound ) )
+			if ( pCurrentSound && CanHearSound( pCurrentSound ) )
 			{
 	 			// the npc cares about this sound, and it's close enough to hear.
 				pCurrentSound->m_iNextAudible = m_iAudibleList;
 				m_iAudibleList = iSound;
 			}
-
-			iSound = pCurrentSound->NextSound();
 		}
 	}
+
+	g_AIListenTimer.End();
 	
 	GetOuter()->OnListened();
 }
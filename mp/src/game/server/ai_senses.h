@@ -54,6 +54,7 @@ public:
 		m_LastLookDist(-1),
 		m_TimeLastLook(-1),
 		m_iAudibleList(0),
+		m_nListenSoundsTested(0),
 		m_TimeLastLookHighPriority( -1 ),
 		m_TimeLastLookNPCs( -1 ),
 		m_TimeLastLookMisc( -1 )
@@ -88,6 +89,7 @@ public:
 	CSound *		GetClosestSound( bool fScent = false, int validTypes = ALL_SOUNDS | ALL_SCENTS, bool bUsePriority = true );
 
 	bool 			CanHearSound( CSound *pSound );
+	int				GetListenSoundsTested() const { return m_nListenSoundsTested; }	// sounds distance tested by the last Listen()
 
 	//---------------------------------
 	
@@ -126,6 +128,7 @@ private:
 	float			m_TimeLastLook;
 	
 	int				m_iAudibleList;				// first index of a linked list of sounds that the npc can hear.
+	int				m_nListenSoundsTested;
 	
 	CUtlVector<EHANDLE> m_SeenHighPriority;
 	CUtlVector<EHANDLE> m_SeenNPCs;
@@ -27,6 +27,7 @@
 #include "datacache/idatacache.h"
 #include "smoke_trail.h"
 #include "props.h"
+#include "vstdlib/jobthread.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2583,51 +2584,57 @@ void CBaseAnimating::UnlockStudioHdr()
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: return the index to the shared bone cache
-// Output :
+// Purpose: bones kept in the shared bone cache: everything that drives a hitbox
+//			or an attachment
 //-----------------------------------------------------------------------------
-CBoneCache *CBaseAnimating::GetBoneCache( void )
+static int GetBoneCacheMask()
 {
-	CStudioHdr *pStudioHdr = GetModelPtr( );
-	Assert(pStudioHdr);
-
-	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
 	int boneMask = BONE_USED_BY_HITBOX | BONE_USED_BY_ATTACHMENT;
 
 	// TF queries these bones to position weapons when players are killed
 #if defined( TF_DLL )
 	boneMask |= BONE_USED_BY_BONE_MERGE;
 #endif
-	if ( pcache )
+	return boneMask;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: is the shared bone cache good enough for GetBoneCache to return as is?
+//-----------------------------------------------------------------------------
+bool CBaseAnimating::IsBoneCacheValid( void )
+{
+	int boneMask = GetBoneCacheMask();
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+	return pcache && pcache->IsValid( gpGlobals->curtime ) && (pcache->m_boneMask & boneMask) == boneMask && pcache->m_timeValid <= gpGlobals->curtime;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: store freshly set up bones in the shared bone cache
+//-----------------------------------------------------------------------------
+CBoneCache *CBaseAnimating::UpdateBoneCache( const matrix3x4_t *pBoneToWorld, int boneMask )
+{
+	CStudioHdr *pStudioHdr = GetModelPtr( );
+
+	CBoneCache *pcache = Studio_GetBoneCache( m_boneCacheHandle );
+
+	// in memory, but missing some of the bone masks
+	if ( pcache && (pcache->m_boneMask & boneMask) != boneMask )
 	{
-		if ( pcache->IsValid( gpGlobals->curtime ) && (pcache->m_boneMask & boneMask) == boneMask && pcache->m_timeValid <= gpGlobals->curtime)
-		{
-			// Msg("%s:%s:%s (%x:%x:%8.4f) cache\n", GetClassname(), GetDebugName(), STRING(GetModelName()), boneMask, pcache->m_boneMask, pcache->m_timeValid );
-			// in memory and still valid, use it!
-			return pcache;
-		}
-		// in memory, but missing some of the bone masks
-		if ( (pcache->m_boneMask & boneMask) != boneMask )
-		{
-			Studio_DestroyBoneCache( m_boneCacheHandle );
-			m_boneCacheHandle = 0;
-			pcache = NULL;
-		}
+		Studio_DestroyBoneCache( m_boneCacheHandle );
+		m_boneCacheHandle = 0;
+		pcache = NULL;
 	}
 
-	matrix3x4_t bonetoworld[MAXSTUDIOBONES];
-	SetupBones( bonetoworld, boneMask );
-
 	if ( pcache )
 	{
 		// still in memory but out of date, refresh the bones.
-		pcache->UpdateBones( bonetoworld, pStudioHdr->numbones(), gpGlobals->curtime );
+		pcache->UpdateBones( pBoneToWorld, pStudioHdr->numbones(), gpGlobals->curtime );
 	}
 	else
 	{
 		bonecacheparams_t params;
 		params.pStudioHdr = pStudioHdr;
-		params.pBoneToWorld = bonetoworld;
+		params.pBoneToWorld = const_cast<matrix3x4_t *>( pBoneToWorld );
 		params.curtime = gpGlobals->curtime;
 		params.boneMask = boneMask;
 
@@ -2638,6 +2645,140 @@ CBoneCache *CBaseAnimating::GetBoneCache( void )
 	return pcache;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: return the index to the shared bone cache
+// Output :
+//-----------------------------------------------------------------------------
+CBoneCache *CBaseAnimating::GetBoneCache( void )
+{
+	CStudioHdr *pStudioHdr = GetModelPtr( );
+	Assert(pStudioHdr);
+
+	if ( IsBoneCacheValid() )
+	{
+		// in memory and still valid, use it!
+		return Studio_GetBoneCache( m_boneCacheHandle );
+	}
+
+	int boneMask = GetBoneCacheMask();
+	matrix3x4_t bonetoworld[MAXSTUDIOBONES];
+	SetupBones( bonetoworld, boneMask );
+
+	return UpdateBoneCache( bonetoworld, boneMask );
+}
+
+//-----------------------------------------------------------------------------
+// Batched hitbox bone setup.  Instead of each hitbox trace setting up the
+// bones of whatever it touches, callers that know which entities are about to
+// be traced against (lag compensation) set them all up at once.  Entities
+// whose SetupBones only reads their own state run as parallel jobs.
+//-----------------------------------------------------------------------------
+ConVar sv_threaded_bone_setup( "sv_threaded_bone_setup", "1", 0, "Set up the hitbox bones of lag compensated entities as a parallel batch before the shot is traced" );
+ConVar sv_threaded_bone_setup_min_entities( "sv_threaded_bone_setup_min_entities", "2", 0, "Set up bones serially when fewer than this many entities need them" );
+
+struct HitboxBoneSetupJob_t
+{
+	CBaseAnimating	*m_pEntity;
+	matrix3x4_t		*m_pBoneToWorld;
+	int				m_nFirstMatrix;
+	int				m_nBoneMask;
+};
+
+static CUtlVector< HitboxBoneSetupJob_t > s_HitboxBoneSetupJobs;
+static CUtlVector< matrix3x4_t > s_HitboxBoneSetupMatrices;
+
+static void SetupHitboxBonesJob( HitboxBoneSetupJob_t &job )
+{
+	job.m_pEntity->SetupBones( job.m_pBoneToWorld, job.m_nBoneMask );
+}
+
+static void PreHitboxBoneSetup()
+{
+	mdlcache->BeginLock();
+}
+
+static void PostHitboxBoneSetup()
+{
+	mdlcache->EndLock();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: bring the bone caches of the given entities up to date, as though
+//			GetBoneCache had been called on each.
+//-----------------------------------------------------------------------------
+void CBaseAnimating::SetupHitboxBonesBatch( CBaseAnimating **ppEntities, int nCount )
+{
+	VPROF_BUDGET( "CBaseAnimating::SetupHitboxBonesBatch", VPROF_BUDGETGROUP_SERVER_ANIM );
+
+	if ( !sv_threaded_bone_setup.GetBool() )
+		return;
+
+	MDLCACHE_CRITICAL_SECTION();
+
+	int boneMask = GetBoneCacheMask();
+
+	// Decide who needs new bones, and settle everything the jobs would otherwise
+	// compute lazily (model pointer, absolute transform) on the main thread
+	s_HitboxBoneSetupJobs.RemoveAll();
+	int nMatrices = 0;
+	for ( int i = 0; i < nCount; i++ )
+	{
+		CBaseAnimating *pEntity = ppEntities[i];
+		CStudioHdr *pStudioHdr = pEntity->GetModelPtr();
+		if ( !pStudioHdr || pEntity->IsBoneCacheValid() )
+			continue;
+
+		mstudiohitboxset_t *set = pStudioHdr->pHitboxSet( pEntity->m_nHitboxSet );
+		if ( !set || !set->numhitboxes )
+			continue;
+
+		// IK traces the world, bone merging reads the parent's cache and the debug
+		// overlay isn't thread safe; leave those to the lazy path
+		if ( pEntity->m_pIk || pEntity->GetMoveParent() || ai_setupbones_debug.GetBool() )
+			continue;
+
+		pEntity->GetAbsOrigin();
+		pEntity->GetAbsAngles();
+
+		HitboxBoneSetupJob_t &job = s_HitboxBoneSetupJobs[ s_HitboxBoneSetupJobs.AddToTail() ];
+		job.m_pEntity = pEntity;
+		job.m_pBoneToWorld = NULL;
+		job.m_nFirstMatrix = nMatrices;
+		job.m_nBoneMask = boneMask;
+		nMatrices += pStudioHdr->numbones();
+	}
+
+	int nJobs = s_HitboxBoneSetupJobs.Count();
+	if ( !nJobs )
+		return;
+
+	s_HitboxBoneSetupMatrices.EnsureCount( nMatrices );
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		s_HitboxBoneSetupJobs[i].m_pBoneToWorld = s_HitboxBoneSetupMatrices.Base() + s_HitboxBoneSetupJobs[i].m_nFirstMatrix;
+	}
+
+	if ( nJobs >= sv_threaded_bone_setup_min_entities.GetInt() )
+	{
+		ParallelProcess( "CBaseAnimating::SetupHitboxBonesBatch", s_HitboxBoneSetupJobs.Base(), nJobs, &SetupHitboxBonesJob, &PreHitboxBoneSetup, &PostHitboxBoneSetup );
+	}
+	else
+	{
+		for ( int i = 0; i < nJobs; i++ )
+		{
+			SetupHitboxBonesJob( s_HitboxBoneSetupJobs[i] );
+		}
+	}
+
+	// The shared bone cache is an LRU, fill it from the main thread only
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		HitboxBoneSetupJob_t &job = s_HitboxBoneSetupJobs[i];
+		job.m_pEntity->UpdateBoneCache( job.m_pBoneToWorld, job.m_nBoneMask );
+	}
+	VPROF_INCREMENT_COUNTER( "Batched hitbox bone setups", nJobs );
+}
+
 
 void CBaseAnimating::InvalidateBoneCache( void )
 {
@@ -2813,7 +2954,7 @@ void CBaseAnimating::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaterni
 	}
 
 	IBoneSetup boneSetup( pStudioHdr, boneMask, GetPoseParameterArray() );
-	boneSetup.InitPose( pos, q );
+	boneSetup.InitPoseSoA( pos, q );
 
 	boneSetup.AccumulatePose( pos, q, GetSequence(), GetCycle(), 1.0, gpGlobals->curtime, m_pIk );
 
@@ -2828,6 +2969,7 @@ void CBaseAnimating::GetSkeleton( CStudioHdr *pStudioHdr, Vector pos[], Quaterni
 		boneSetup.CalcAutoplaySequences( pos, q, gpGlobals->curtime, NULL );
 	}
 	boneSetup.CalcBoneAdj( pos, q, GetEncodedControllerArray() );
+	boneSetup.StorePose( pos, q );
 }
 
 int CBaseAnimating::DrawDebugTextOverlays(void) 
@@ -259,6 +259,11 @@ public:
 	class CBoneCache *GetBoneCache( void );
 	void InvalidateBoneCache();
 	void InvalidateBoneCacheIfOlderThan( float deltaTime );
+	bool IsBoneCacheValid( void );
+
+	// Sets up the hitbox bones of all the entities whose bone cache is out of date, in
+	// parallel where that's safe.  Call before tracing against them.
+	static void SetupHitboxBonesBatch( CBaseAnimating **ppEntities, int nCount );
 	virtual int DrawDebugTextOverlays( void );
 	
 	// See note in code re: bandwidth usage!!!
@@ -342,6 +347,7 @@ private:
 	void InputSetModelScale( inputdata_t &inputdata );
 
 	bool CanSkipAnimation( void );
+	class CBoneCache *UpdateBoneCache( const matrix3x4_t *pBoneToWorld, int boneMask );
 
 public:
 	CNetworkVar( int, m_nForceBone );
@@ -1662,8 +1662,10 @@ CBaseEntity *CBaseEntity::GetNextTarget( void )
 	return gEntList.FindEntityByName( NULL, m_target );
 }
 
-class CThinkContextsSaveDataOps : public CDefSaveRestoreOps
+class CThinkContextsSaveDataOps : public CDefSaveRestoreOps, public IThreadSafeSaveOps
 {
+	virtual datamap_t *GetSaveDataMap() { return NULL; }
+
 	virtual void Save( const SaveRestoreFieldInfo_t &fieldInfo, ISave *pSave )
 	{
 		AssertMsg( fieldInfo.pTypeDesc->fieldSize == 1, "CThinkContextsSaveDataOps does not support arrays");
@@ -701,6 +701,10 @@ public:
 	virtual int	Restore( IRestore &restore );
 	virtual bool ShouldSavePhysics();
 
+	// Return false if an override of Save() writes anything beyond the datadesc or touches
+	// shared state, so the entity is always encoded on the main thread. See save_parallel_encode
+	virtual bool IsSaveThreadSafe() const { return true; }
+
 	// handler to reset stuff before you are restored
 	// NOTE: Always chain to base class when implementing this!
 	virtual void OnSave( IEntitySaveUtils *pSaveUtils );
@@ -752,6 +756,10 @@ public:
 	void (CBaseEntity::*m_pfnThink)(void);
 	virtual void Think( void ) { if (m_pfnThink) (this->*m_pfnThink)();};
 
+	// Return true if this class's thinks only touch the entity itself (plus reads) and may run as a
+	// parallel job. Shared-state side effects get deferred, see parallel_think.h
+	virtual bool IsThinkThreadSafe() const { return false; }
+
 	// Think functions with contexts
 	int		RegisterThinkContext( const char *szContext );
 	BASEPTR	ThinkSet( BASEPTR func, float flNextThinkTime = 0, const char *szContext = NULL );
@@ -84,6 +84,7 @@ OUTPUTS:
 #include "tier1/strtools.h"
 #include "datacache/imdlcache.h"
 #include "env_debughistory.h"
+#include "parallel_think.h"
 
 #include "tier0/vprof.h"
 
@@ -476,8 +477,10 @@ void CBaseEntityOutput::DeleteAllElements( void )
 
 /// EVENTS save/restore parsing wrapper
 
-class CEventsSaveDataOps : public ISaveRestoreOps
+class CEventsSaveDataOps : public ISaveRestoreOps, public IThreadSafeSaveOps
 {
+	virtual datamap_t *GetSaveDataMap() { return NULL; }
+
 	virtual void Save( const SaveRestoreFieldInfo_t &fieldInfo, ISave *pSave )
 	{
 		AssertMsg( fieldInfo.pTypeDesc->fieldSize == 1, "CEventsSaveDataOps does not support arrays");
@@ -802,11 +805,53 @@ void CEventQueue::Dump( void )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Holds an event fired from a parallel think until the queue can be touched
+//			from the main thread again.
+//-----------------------------------------------------------------------------
+class CEventQueueDeferredAdd : public IParallelThinkCommand
+{
+public:
+	CEventQueueDeferredAdd( const char *target, CBaseEntity *pTarget, const char *targetInput, variant_t Value, float fireDelay, CBaseEntity *pActivator, CBaseEntity *pCaller, int outputID ) :
+		m_pszTarget( target ), m_hTarget( pTarget ), m_pszTargetInput( targetInput ), m_VariantValue( Value ), m_flFireDelay( fireDelay ),
+		m_hActivator( pActivator ), m_hCaller( pCaller ), m_iOutputID( outputID )
+	{
+	}
+
+	virtual void Execute()
+	{
+		if ( m_pszTarget )
+		{
+			g_EventQueue.AddEvent( m_pszTarget, m_pszTargetInput, m_VariantValue, m_flFireDelay, m_hActivator, m_hCaller, m_iOutputID );
+		}
+		else if ( m_hTarget.Get() )
+		{
+			g_EventQueue.AddEvent( m_hTarget.Get(), m_pszTargetInput, m_VariantValue, m_flFireDelay, m_hActivator, m_hCaller, m_iOutputID );
+		}
+	}
+
+private:
+	const char	*m_pszTarget;
+	EHANDLE		m_hTarget;
+	const char	*m_pszTargetInput;
+	variant_t	m_VariantValue;
+	float		m_flFireDelay;
+	EHANDLE		m_hActivator;
+	EHANDLE		m_hCaller;
+	int			m_iOutputID;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: adds the action into the correct spot in the priority queue, targeting entity via string name
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( const char *target, const char *targetInput, variant_t Value, float fireDelay, CBaseEntity *pActivator, CBaseEntity *pCaller, int outputID )
 {
+	if ( ParallelThink_ShouldDefer() )
+	{
+		ParallelThink_Defer( new CEventQueueDeferredAdd( target, NULL, targetInput, Value, fireDelay, pActivator, pCaller, outputID ) );
+		return;
+	}
+
 	// build the new event
 	EventQueuePrioritizedEvent_t *newEvent = new EventQueuePrioritizedEvent_t;
 #ifdef TF_DLL
@@ -830,6 +875,12 @@ void CEventQueue::AddEvent( const char *target, const char *targetInput, variant
 //-----------------------------------------------------------------------------
 void CEventQueue::AddEvent( CBaseEntity *target, const char *targetInput, variant_t Value, float fireDelay, CBaseEntity *pActivator, CBaseEntity *pCaller, int outputID )
 {
+	if ( ParallelThink_ShouldDefer() )
+	{
+		ParallelThink_Defer( new CEventQueueDeferredAdd( NULL, target, targetInput, Value, fireDelay, pActivator, pCaller, outputID ) );
+		return;
+	}
+
 	// build the new event
 	EventQueuePrioritizedEvent_t *newEvent = new EventQueuePrioritizedEvent_t;
 #ifdef TF_DLL
@@ -1630,8 +1681,10 @@ typedescription_t variant_t::m_SaveMatrix3x4Worldspace[] =
 };
 #undef classNameTypedef
 
-class CVariantSaveDataOps : public CDefSaveRestoreOps
+class CVariantSaveDataOps : public CDefSaveRestoreOps, public IThreadSafeSaveOps
 {
+	virtual datamap_t *GetSaveDataMap() { return NULL; }
+
 	// saves the entire array of variables
 	virtual void Save( const SaveRestoreFieldInfo_t &fieldInfo, ISave *pSave )
 	{
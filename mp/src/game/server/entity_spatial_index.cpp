@@ -0,0 +1,606 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side copy of the engine's non-static edict partition list.
+//
+//			Entities live in a uniform 2D grid over the map.  Each cell keeps
+//			the bounds of the entities overlapping it in a flat array, which
+//			is tested four entries at a time.  Entities covering many cells go
+//			in a separate list that every query tests.  The bounds are the
+//			same ones CCollisionProperty hands to the engine partition, so
+//			queries find exactly the entities the engine would.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "entity_spatial_index.h"
+#include "collisionproperty.h"
+#include "ispatialpartition.h"
+#include "mathlib/ssemath.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_entity_spatial_index( "sv_entity_spatial_index", "1", 0, "Answer UTIL_EntitiesInBox/InSphere queries from the game side entity grid instead of the engine partition" );
+ConVar sv_entity_query_cache( "sv_entity_query_cache", "0", 0, "Reuse the results of identical UTIL_EntitiesInBox/InSphere queries within a tick" );
+
+#define SPATIAL_INDEX_CELL_SIZE		512
+#define SPATIAL_INDEX_GRID_SIZE		( ( 2 * MAX_COORD_INTEGER ) / SPATIAL_INDEX_CELL_SIZE )
+#define SPATIAL_INDEX_MAX_CELLS		16		// entities covering more cells than this go in the oversized list
+
+#define QUERY_CACHE_ENTRIES			16
+#define QUERY_CACHE_MAX_RESULTS		128
+
+struct SpatialIndexEntry_t
+{
+	Vector	m_vecMins;
+	int		m_nSlot;
+	Vector	m_vecMaxs;
+	int		m_nPad;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+class CEntitySpatialIndex : public CAutoGameSystem
+{
+public:
+	CEntitySpatialIndex( char const *name ) : CAutoGameSystem( name )
+	{
+		Q_memset( m_Slots, 0, sizeof( m_Slots ) );
+		m_nQueryStamp = 0;
+		m_nModificationCount = 0;
+		m_nNextCacheEntry = 0;
+		ClearQueryCache();
+	}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		for ( int i = 0; i < MAX_EDICTS; i++ )
+		{
+			Unlink( i );
+			m_Slots[i].m_pEntity = NULL;
+			m_Slots[i].m_bMember = false;
+			m_Slots[i].m_bHasBounds = false;
+		}
+		ClearQueryCache();
+	}
+
+	void SetMember( CBaseEntity *pEntity, bool bMember );
+	void ElementMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+	void Remove( CBaseEntity *pEntity );
+
+	bool CanQuery() const
+	{
+		return sv_entity_spatial_index.GetBool() && ThreadInMainThread();
+	}
+
+	void EnumerateInBox( const Vector &vecMins, const Vector &vecMaxs, IPartitionEnumerator *pEnum );
+	void EnumerateInSphere( const Vector &vecCenter, float flRadius, IPartitionEnumerator *pEnum );
+
+private:
+	enum QueryType_t
+	{
+		QUERY_BOX = 0,
+		QUERY_SPHERE,
+	};
+
+	struct EntitySlot_t
+	{
+		CBaseEntity		*m_pEntity;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		short			m_nCellMinX;
+		short			m_nCellMinY;
+		short			m_nCellMaxX;
+		short			m_nCellMaxY;
+		bool			m_bMember;
+		bool			m_bHasBounds;
+		bool			m_bLinked;
+		bool			m_bOversized;
+		unsigned int	m_nQueryStamp;
+	};
+
+	struct QueryCacheEntry_t
+	{
+		int				m_nType;
+		Vector			m_vecA;
+		Vector			m_vecB;
+		int				m_nTick;
+		unsigned int	m_nModificationCount;
+		int				m_nCount;
+		CBaseEntity		*m_pResults[ QUERY_CACHE_MAX_RESULTS ];
+	};
+
+	typedef CUtlVectorFixedGrowable< CBaseEntity *, 256 > CandidateList_t;
+
+	static int CellCoord( float flValue )
+	{
+		int nCell = (int)floor( ( flValue + MAX_COORD_INTEGER ) * ( 1.0f / SPATIAL_INDEX_CELL_SIZE ) );
+		return clamp( nCell, 0, SPATIAL_INDEX_GRID_SIZE - 1 );
+	}
+
+	CUtlVector< SpatialIndexEntry_t > &Cell( int x, int y ) { return m_Cells[ y * SPATIAL_INDEX_GRID_SIZE + x ]; }
+
+	EntitySlot_t *GetSlot( CBaseEntity *pEntity )
+	{
+		int nSlot = pEntity->entindex();
+		if ( nSlot <= 0 || nSlot >= MAX_EDICTS )
+			return NULL;
+		return &m_Slots[ nSlot ];
+	}
+
+	void Link( int nSlot );
+	void Unlink( int nSlot );
+	void Relink( int nSlot );
+	void UpdateEntry( CUtlVector< SpatialIndexEntry_t > &list, int nSlot );
+	void RemoveEntry( CUtlVector< SpatialIndexEntry_t > &list, int nSlot );
+
+	template < class TEST >
+	void Gather( int nCellMinX, int nCellMinY, int nCellMaxX, int nCellMaxY, const TEST &test, CandidateList_t &candidates );
+	template < class TEST >
+	void GatherList( const CUtlVector< SpatialIndexEntry_t > &list, const TEST &test, CandidateList_t &candidates );
+
+	QueryCacheEntry_t *FindCachedQuery( int nType, const Vector &vecA, const Vector &vecB );
+	void CacheQuery( int nType, const Vector &vecA, const Vector &vecB, const CandidateList_t &candidates );
+	void ClearQueryCache()
+	{
+		for ( int i = 0; i < QUERY_CACHE_ENTRIES; i++ )
+		{
+			m_QueryCache[i].m_nTick = -1;
+		}
+	}
+
+	void RunEnumerator( CBaseEntity * const *ppEntities, int nCount, IPartitionEnumerator *pEnum );
+
+	EntitySlot_t		m_Slots[ MAX_EDICTS ];
+	CUtlVector< SpatialIndexEntry_t > m_Cells[ SPATIAL_INDEX_GRID_SIZE * SPATIAL_INDEX_GRID_SIZE ];
+	CUtlVector< SpatialIndexEntry_t > m_Oversized;
+
+	unsigned int		m_nQueryStamp;
+	unsigned int		m_nModificationCount;	// bumped whenever anything is linked, moved or unlinked
+
+	QueryCacheEntry_t	m_QueryCache[ QUERY_CACHE_ENTRIES ];
+	int					m_nNextCacheEntry;
+};
+
+static CEntitySpatialIndex g_EntitySpatialIndex( "CEntitySpatialIndex" );
+
+
+//-----------------------------------------------------------------------------
+// Membership and bounds, mirroring what CCollisionProperty tells the engine
+//-----------------------------------------------------------------------------
+void CEntitySpatialIndex::SetMember( CBaseEntity *pEntity, bool bMember )
+{
+	EntitySlot_t *pSlot = GetSlot( pEntity );
+	if ( !pSlot )
+		return;
+
+	if ( pSlot->m_pEntity != pEntity )
+	{
+		Unlink( pEntity->entindex() );
+		pSlot->m_pEntity = pEntity;
+		pSlot->m_bHasBounds = false;
+	}
+
+	pSlot->m_bMember = bMember;
+	Relink( pEntity->entindex() );
+}
+
+void CEntitySpatialIndex::ElementMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	EntitySlot_t *pSlot = GetSlot( pEntity );
+	if ( !pSlot )
+		return;
+
+	if ( pSlot->m_pEntity != pEntity )
+	{
+		Unlink( pEntity->entindex() );
+		pSlot->m_pEntity = pEntity;
+		pSlot->m_bMember = false;
+	}
+
+	pSlot->m_vecMins = vecMins;
+	pSlot->m_vecMaxs = vecMaxs;
+	pSlot->m_bHasBounds = true;
+	Relink( pEntity->entindex() );
+}
+
+void CEntitySpatialIndex::Remove( CBaseEntity *pEntity )
+{
+	EntitySlot_t *pSlot = GetSlot( pEntity );
+	if ( !pSlot || pSlot->m_pEntity != pEntity )
+		return;
+
+	Unlink( pEntity->entindex() );
+	pSlot->m_pEntity = NULL;
+	pSlot->m_bMember = false;
+	pSlot->m_bHasBounds = false;
+}
+
+void CEntitySpatialIndex::Relink( int nSlot )
+{
+	EntitySlot_t &slot = m_Slots[ nSlot ];
+	++m_nModificationCount;
+
+	if ( !slot.m_bMember || !slot.m_bHasBounds )
+	{
+		Unlink( nSlot );
+		return;
+	}
+
+	if ( !slot.m_bLinked )
+	{
+		Link( nSlot );
+		return;
+	}
+
+	int nCellMinX = CellCoord( slot.m_vecMins.x );
+	int nCellMinY = CellCoord( slot.m_vecMins.y );
+	int nCellMaxX = CellCoord( slot.m_vecMaxs.x );
+	int nCellMaxY = CellCoord( slot.m_vecMaxs.y );
+	bool bOversized = ( nCellMaxX - nCellMinX + 1 ) * ( nCellMaxY - nCellMinY + 1 ) > SPATIAL_INDEX_MAX_CELLS;
+
+	// Refit in place if it still covers the same cells, which is the common case
+	if ( bOversized == slot.m_bOversized && ( bOversized ||
+		 ( nCellMinX == slot.m_nCellMinX && nCellMinY == slot.m_nCellMinY && nCellMaxX == slot.m_nCellMaxX && nCellMaxY == slot.m_nCellMaxY ) ) )
+	{
+		if ( bOversized )
+		{
+			UpdateEntry( m_Oversized, nSlot );
+		}
+		else
+		{
+			for ( int y = nCellMinY; y <= nCellMaxY; y++ )
+			{
+				for ( int x = nCellMinX; x <= nCellMaxX; x++ )
+				{
+					UpdateEntry( Cell( x, y ), nSlot );
+				}
+			}
+		}
+		return;
+	}
+
+	Unlink( nSlot );
+	Link( nSlot );
+}
+
+void CEntitySpatialIndex::Link( int nSlot )
+{
+	EntitySlot_t &slot = m_Slots[ nSlot ];
+	Assert( !slot.m_bLinked );
+
+	SpatialIndexEntry_t entry;
+	entry.m_vecMins = slot.m_vecMins;
+	entry.m_vecMaxs = slot.m_vecMaxs;
+	entry.m_nSlot = nSlot;
+	entry.m_nPad = 0;
+
+	slot.m_nCellMinX = CellCoord( slot.m_vecMins.x );
+	slot.m_nCellMinY = CellCoord( slot.m_vecMins.y );
+	slot.m_nCellMaxX = CellCoord( slot.m_vecMaxs.x );
+	slot.m_nCellMaxY = CellCoord( slot.m_vecMaxs.y );
+	slot.m_bOversized = ( slot.m_nCellMaxX - slot.m_nCellMinX + 1 ) * ( slot.m_nCellMaxY - slot.m_nCellMinY + 1 ) > SPATIAL_INDEX_MAX_CELLS;
+	slot.m_bLinked = true;
+
+	if ( slot.m_bOversized )
+	{
+		m_Oversized.AddToTail( entry );
+		return;
+	}
+
+	for ( int y = slot.m_nCellMinY; y <= slot.m_nCellMaxY; y++ )
+	{
+		for ( int x = slot.m_nCellMinX; x <= slot.m_nCellMaxX; x++ )
+		{
+			Cell( x, y ).AddToTail( entry );
+		}
+	}
+}
+
+void CEntitySpatialIndex::Unlink( int nSlot )
+{
+	EntitySlot_t &slot = m_Slots[ nSlot ];
+	if ( !slot.m_bLinked )
+		return;
+
+	if ( slot.m_bOversized )
+	{
+		RemoveEntry( m_Oversized, nSlot );
+	}
+	else
+	{
+		for ( int y = slot.m_nCellMinY; y <= slot.m_nCellMaxY; y++ )
+		{
+			for ( int x = slot.m_nCellMinX; x <= slot.m_nCellMaxX; x++ )
+			{
+				RemoveEntry( Cell( x, y ), nSlot );
+			}
+		}
+	}
+
+	slot.m_bLinked = false;
+	++m_nModificationCount;
+}
+
+void CEntitySpatialIndex::UpdateEntry( CUtlVector< SpatialIndexEntry_t > &list, int nSlot )
+{
+	for ( int i = 0; i < list.Count(); i++ )
+	{
+		if ( list[i].m_nSlot == nSlot )
+		{
+			list[i].m_vecMins = m_Slots[ nSlot ].m_vecMins;
+			list[i].m_vecMaxs = m_Slots[ nSlot ].m_vecMaxs;
+			return;
+		}
+	}
+	Assert( 0 );
+}
+
+void CEntitySpatialIndex::RemoveEntry( CUtlVector< SpatialIndexEntry_t > &list, int nSlot )
+{
+	for ( int i = 0; i < list.Count(); i++ )
+	{
+		if ( list[i].m_nSlot == nSlot )
+		{
+			list.FastRemove( i );
+			return;
+		}
+	}
+	Assert( 0 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Overlap tests, four entries at a time.  Both match the engine's non-coarse
+// tests against the partition bounds: touching counts as overlapping.
+//-----------------------------------------------------------------------------
+class CSpatialIndexBoxTest
+{
+public:
+	CSpatialIndexBoxTest( const Vector &vecMins, const Vector &vecMaxs )
+	{
+		m_Mins.DuplicateVector( vecMins );
+		m_Maxs.DuplicateVector( vecMaxs );
+	}
+
+	FORCEINLINE int Test( const FourVectors &mins, const FourVectors &maxs ) const
+	{
+		fltx4 x = AndSIMD( CmpLeSIMD( mins.x, m_Maxs.x ), CmpGeSIMD( maxs.x, m_Mins.x ) );
+		fltx4 y = AndSIMD( CmpLeSIMD( mins.y, m_Maxs.y ), CmpGeSIMD( maxs.y, m_Mins.y ) );
+		fltx4 z = AndSIMD( CmpLeSIMD( mins.z, m_Maxs.z ), CmpGeSIMD( maxs.z, m_Mins.z ) );
+		return TestSignSIMD( AndSIMD( AndSIMD( x, y ), z ) );
+	}
+
+private:
+	FourVectors m_Mins;
+	FourVectors m_Maxs;
+};
+
+class CSpatialIndexSphereTest
+{
+public:
+	CSpatialIndexSphereTest( const Vector &vecCenter, float flRadius )
+	{
+		m_Center.DuplicateVector( vecCenter );
+		m_RadiusSqr = ReplicateX4( flRadius * flRadius );
+	}
+
+	FORCEINLINE int Test( const FourVectors &mins, const FourVectors &maxs ) const
+	{
+		// distance from the center to the closest point in each box
+		FourVectors delta;
+		delta.x = SubSIMD( MinSIMD( MaxSIMD( m_Center.x, mins.x ), maxs.x ), m_Center.x );
+		delta.y = SubSIMD( MinSIMD( MaxSIMD( m_Center.y, mins.y ), maxs.y ), m_Center.y );
+		delta.z = SubSIMD( MinSIMD( MaxSIMD( m_Center.z, mins.z ), maxs.z ), m_Center.z );
+		return TestSignSIMD( CmpLeSIMD( delta.length2(), m_RadiusSqr ) );
+	}
+
+private:
+	FourVectors m_Center;
+	fltx4 m_RadiusSqr;
+};
+
+template < class TEST >
+void CEntitySpatialIndex::GatherList( const CUtlVector< SpatialIndexEntry_t > &list, const TEST &test, CandidateList_t &candidates )
+{
+	int nCount = list.Count();
+	const SpatialIndexEntry_t *pEntries = list.Base();
+	for ( int i = 0; i < nCount; i += 4 )
+	{
+		const SpatialIndexEntry_t &e0 = pEntries[ i ];
+		const SpatialIndexEntry_t &e1 = pEntries[ MIN( i + 1, nCount - 1 ) ];
+		const SpatialIndexEntry_t &e2 = pEntries[ MIN( i + 2, nCount - 1 ) ];
+		const SpatialIndexEntry_t &e3 = pEntries[ MIN( i + 3, nCount - 1 ) ];
+
+		FourVectors mins, maxs;
+		mins.LoadAndSwizzle( e0.m_vecMins, e1.m_vecMins, e2.m_vecMins, e3.m_vecMins );
+		maxs.LoadAndSwizzle( e0.m_vecMaxs, e1.m_vecMaxs, e2.m_vecMaxs, e3.m_vecMaxs );
+
+		int mask = test.Test( mins, maxs );
+		if ( !mask )
+			continue;
+
+		int nLanes = MIN( 4, nCount - i );
+		for ( int j = 0; j < nLanes; j++ )
+		{
+			if ( !( mask & ( 1 << j ) ) )
+				continue;
+
+			// Entities spanning several cells show up once per cell
+			EntitySlot_t &slot = m_Slots[ pEntries[ i + j ].m_nSlot ];
+			if ( slot.m_nQueryStamp == m_nQueryStamp )
+				continue;
+
+			slot.m_nQueryStamp = m_nQueryStamp;
+			candidates.AddToTail( slot.m_pEntity );
+		}
+	}
+}
+
+template < class TEST >
+void CEntitySpatialIndex::Gather( int nCellMinX, int nCellMinY, int nCellMaxX, int nCellMaxY, const TEST &test, CandidateList_t &candidates )
+{
+	++m_nQueryStamp;
+
+	for ( int y = nCellMinY; y <= nCellMaxY; y++ )
+	{
+		for ( int x = nCellMinX; x <= nCellMaxX; x++ )
+		{
+			GatherList( Cell( x, y ), test, candidates );
+		}
+	}
+
+	GatherList( m_Oversized, test, candidates );
+}
+
+
+//-----------------------------------------------------------------------------
+// Per-tick cache of identical queries.  The candidates are stored before the
+// enumerator sees them, so filters on entity state are still applied each time.
+//-----------------------------------------------------------------------------
+CEntitySpatialIndex::QueryCacheEntry_t *CEntitySpatialIndex::FindCachedQuery( int nType, const Vector &vecA, const Vector &vecB )
+{
+	if ( !sv_entity_query_cache.GetBool() )
+		return NULL;
+
+	for ( int i = 0; i < QUERY_CACHE_ENTRIES; i++ )
+	{
+		QueryCacheEntry_t &entry = m_QueryCache[i];
+		if ( entry.m_nTick != gpGlobals->tickcount || entry.m_nModificationCount != m_nModificationCount || entry.m_nType != nType )
+			continue;
+
+		if ( entry.m_vecA != vecA || entry.m_vecB != vecB )
+			continue;
+
+		return &entry;
+	}
+
+	return NULL;
+}
+
+void CEntitySpatialIndex::CacheQuery( int nType, const Vector &vecA, const Vector &vecB, const CandidateList_t &candidates )
+{
+	if ( !sv_entity_query_cache.GetBool() || candidates.Count() > QUERY_CACHE_MAX_RESULTS )
+		return;
+
+	QueryCacheEntry_t &entry = m_QueryCache[ m_nNextCacheEntry ];
+	m_nNextCacheEntry = ( m_nNextCacheEntry + 1 ) % QUERY_CACHE_ENTRIES;
+
+	entry.m_nType = nType;
+	entry.m_vecA = vecA;
+	entry.m_vecB = vecB;
+	entry.m_nTick = gpGlobals->tickcount;
+	entry.m_nModificationCount = m_nModificationCount;
+	entry.m_nCount = candidates.Count();
+	Q_memcpy( entry.m_pResults, candidates.Base(), candidates.Count() * sizeof( CBaseEntity * ) );
+}
+
+void CEntitySpatialIndex::RunEnumerator( CBaseEntity * const *ppEntities, int nCount, IPartitionEnumerator *pEnum )
+{
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( pEnum->EnumElement( ppEntities[i] ) == ITERATION_STOP )
+			break;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Queries
+//-----------------------------------------------------------------------------
+void CEntitySpatialIndex::EnumerateInBox( const Vector &vecMins, const Vector &vecMaxs, IPartitionEnumerator *pEnum )
+{
+	VPROF_BUDGET( "CEntitySpatialIndex::EnumerateInBox", VPROF_BUDGETGROUP_OTHER_UNACCOUNTED );
+
+	// Same lazy update the engine partition does before a query
+	UpdateDirtySpatialPartitionEntities();
+
+	QueryCacheEntry_t *pCached = FindCachedQuery( QUERY_BOX, vecMins, vecMaxs );
+	if ( pCached )
+	{
+		VPROF_INCREMENT_COUNTER( "Entity query cache hits", 1 );
+
+		// Copy, the enumerator may run queries of its own
+		CBaseEntity *pResults[ QUERY_CACHE_MAX_RESULTS ];
+		int nCount = pCached->m_nCount;
+		Q_memcpy( pResults, pCached->m_pResults, nCount * sizeof( CBaseEntity * ) );
+		RunEnumerator( pResults, nCount, pEnum );
+		return;
+	}
+
+	// Gather everything before calling the enumerator, it may move entities or run queries of its own
+	CandidateList_t candidates;
+	CSpatialIndexBoxTest test( vecMins, vecMaxs );
+	Gather( CellCoord( vecMins.x ), CellCoord( vecMins.y ), CellCoord( vecMaxs.x ), CellCoord( vecMaxs.y ), test, candidates );
+	CacheQuery( QUERY_BOX, vecMins, vecMaxs, candidates );
+
+	RunEnumerator( candidates.Base(), candidates.Count(), pEnum );
+}
+
+void CEntitySpatialIndex::EnumerateInSphere( const Vector &vecCenter, float flRadius, IPartitionEnumerator *pEnum )
+{
+	VPROF_BUDGET( "CEntitySpatialIndex::EnumerateInSphere", VPROF_BUDGETGROUP_OTHER_UNACCOUNTED );
+
+	UpdateDirtySpatialPartitionEntities();
+
+	Vector vecRadius( flRadius, 0, 0 );
+	QueryCacheEntry_t *pCached = FindCachedQuery( QUERY_SPHERE, vecCenter, vecRadius );
+	if ( pCached )
+	{
+		VPROF_INCREMENT_COUNTER( "Entity query cache hits", 1 );
+
+		CBaseEntity *pResults[ QUERY_CACHE_MAX_RESULTS ];
+		int nCount = pCached->m_nCount;
+		Q_memcpy( pResults, pCached->m_pResults, nCount * sizeof( CBaseEntity * ) );
+		RunEnumerator( pResults, nCount, pEnum );
+		return;
+	}
+
+	CandidateList_t candidates;
+	CSpatialIndexSphereTest test( vecCenter, flRadius );
+	Gather( CellCoord( vecCenter.x - flRadius ), CellCoord( vecCenter.y - flRadius ),
+		CellCoord( vecCenter.x + flRadius ), CellCoord( vecCenter.y + flRadius ), test, candidates );
+	CacheQuery( QUERY_SPHERE, vecCenter, vecRadius, candidates );
+
+	RunEnumerator( candidates.Base(), candidates.Count(), pEnum );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose:
+//-----------------------------------------------------------------------------
+void EntitySpatialIndex_SetMember( CBaseEntity *pEntity, bool bMember )
+{
+	g_EntitySpatialIndex.SetMember( pEntity, bMember );
+}
+
+void EntitySpatialIndex_ElementMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs )
+{
+	g_EntitySpatialIndex.ElementMoved( pEntity, vecMins, vecMaxs );
+}
+
+void EntitySpatialIndex_Remove( CBaseEntity *pEntity )
+{
+	g_EntitySpatialIndex.Remove( pEntity );
+}
+
+bool EntitySpatialIndex_EnumerateInBox( const Vector &vecMins, const Vector &vecMaxs, IPartitionEnumerator *pEnum )
+{
+	if ( !g_EntitySpatialIndex.CanQuery() )
+		return false;
+
+	g_EntitySpatialIndex.EnumerateInBox( vecMins, vecMaxs, pEnum );
+	return true;
+}
+
+bool EntitySpatialIndex_EnumerateInSphere( const Vector &vecCenter, float flRadius, IPartitionEnumerator *pEnum )
+{
+	if ( !g_EntitySpatialIndex.CanQuery() )
+		return false;
+
+	g_EntitySpatialIndex.EnumerateInSphere( vecCenter, flRadius, pEnum );
+	return true;
+}
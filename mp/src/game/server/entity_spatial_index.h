@@ -0,0 +1,31 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side copy of the engine's non-static edict partition list.
+//			Serves UTIL_EntitiesInBox / UTIL_EntitiesInSphere without going
+//			through the engine, and optionally caches identical queries
+//			within a tick.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef ENTITY_SPATIAL_INDEX_H
+#define ENTITY_SPATIAL_INDEX_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBaseEntity;
+class IPartitionEnumerator;
+
+// Kept in sync with PARTITION_ENGINE_NON_STATIC_EDICTS by CCollisionProperty
+void EntitySpatialIndex_SetMember( CBaseEntity *pEntity, bool bMember );
+void EntitySpatialIndex_ElementMoved( CBaseEntity *pEntity, const Vector &vecMins, const Vector &vecMaxs );
+void EntitySpatialIndex_Remove( CBaseEntity *pEntity );
+
+// Enumerates the same entities as the engine partition would for PARTITION_ENGINE_NON_STATIC_EDICTS,
+// in a different order.  Returns false if the index can't be used (disabled, or called off the main
+// thread), in which case the caller should query the engine.
+bool EntitySpatialIndex_EnumerateInBox( const Vector &vecMins, const Vector &vecMaxs, IPartitionEnumerator *pEnum );
+bool EntitySpatialIndex_EnumerateInSphere( const Vector &vecCenter, float flRadius, IPartitionEnumerator *pEnum );
+
+#endif // ENTITY_SPATIAL_INDEX_H
@@ -17,6 +17,7 @@
 #include "ai_initutils.h"
 #include "globalstate.h"
 #include "datacache/imdlcache.h"
+#include "parallel_think.h"
 
 #ifdef HL2_DLL
 #include "npc_playercompanion.h"
@@ -127,12 +128,32 @@ void AimTarget_ForceRepopulateList()
 // NOTE: This is usually a small subset of the global entity list, so it's
 // an optimization to maintain this list incrementally rather than polling each
 // frame.
+//
+// Entities that only think are also filed into a wheel of tick buckets so that
+// the per-tick pass only visits the ones that are due.  Entities that simulate
+// game physics are due every tick and stay on the carry list until they stop.
+ConVar sv_simthink_scheduler( "sv_simthink_scheduler", "1", 0, "Only visit entities whose think or simulation is due this tick (0 = scan the whole sim/think list)" );
+
+#define SIMTHINK_WHEEL_SIZE			128		// must be a power of two
+#define SIMTHINK_WHEEL_MASK			(SIMTHINK_WHEEL_SIZE-1)
+#define SIMTHINK_NOT_SCHEDULED		-2		// not in any bucket and not carried
+#define SIMTHINK_CARRIED			-1		// was due on the last pass and hasn't been rescheduled since
+
 struct simthinkentry_t
 {
 	unsigned short	entEntry;
 	unsigned short	unused0;
 	int				nextThinkTick;
+	int				scheduledTick;
 };
+
+struct simthinkbucketentry_t
+{
+	unsigned short	entEntry;
+	unsigned short	unused0;
+	int				tick;
+};
+
 class CSimThinkManager : public IEntityListener
 {
 public:
@@ -147,6 +168,15 @@ public:
 		{
 			m_entinfoIndex[i] = 0xFFFF;
 		}
+		for ( int i = 0; i < ARRAYSIZE(m_buckets); i++ )
+		{
+			m_buckets[i].Purge();
+		}
+		m_carryList.Purge();
+		m_dueList.Purge();
+		m_nLastScheduledTick = -1;
+		m_nVisitedLastTick = 0;
+		m_nListCountLastTick = 0;
 	}
 	void LevelInitPreEntity()
 	{
@@ -172,6 +202,7 @@ public:
 	{
 		int listHandle = m_entinfoIndex[index];
 		// If this guy is in the active list, remove him
+		// NOTE: Stale bucket and carry entries are dropped lazily when they come due
 		if ( listHandle != 0xFFFF )
 		{
 			Assert(m_simThinkList[listHandle].entEntry == index);
@@ -212,6 +243,81 @@ public:
 		return out;
 	}
 
+	// Same output as ListCopy() (same entities, same order) but only touches the
+	// entities that are due this tick.  Consumes the due buckets, so only the
+	// per-tick think loop should call this.
+	int ListCopyScheduled( CBaseEntity *pList[], int listMax )
+	{
+		int tick = gpGlobals->tickcount;
+		m_nListCountLastTick = ListCount();
+
+		if ( !sv_simthink_scheduler.GetBool() )
+		{
+			m_nVisitedLastTick = ListCopy( pList, listMax );
+			return m_nVisitedLastTick;
+		}
+
+		// list indices of everything due, sorted below to preserve list order
+		CUtlVector<unsigned short> &due = m_dueList;
+		due.RemoveAll();
+
+		// Anything still carried from the last pass hasn't been rescheduled, so it is still due
+		int carryCount = m_carryList.Count();
+		for ( int i = 0; i < carryCount; i++ )
+		{
+			int listHandle = m_entinfoIndex[m_carryList[i]];
+			if ( listHandle != 0xFFFF && m_simThinkList[listHandle].scheduledTick == SIMTHINK_CARRIED )
+			{
+				due.AddToTail( listHandle );
+			}
+		}
+
+		if ( tick > m_nLastScheduledTick )
+		{
+			// drain every bucket between the last pass and now (all of them if we fell a full lap behind)
+			int firstTick = MAX( m_nLastScheduledTick + 1, tick - SIMTHINK_WHEEL_MASK );
+			if ( m_nLastScheduledTick < 0 )
+			{
+				firstTick = tick - SIMTHINK_WHEEL_MASK;
+			}
+			for ( int t = firstTick; t <= tick; t++ )
+			{
+				DrainBucket( m_buckets[t & SIMTHINK_WHEEL_MASK], tick, due );
+			}
+			m_nLastScheduledTick = tick;
+		}
+
+		due.Sort( CompareListHandles );
+
+		MEM_ALLOC_CREDIT();
+		m_carryList.RemoveAll();
+		int out = 0;
+		int lastHandle = -1;
+		for ( int i = 0; i < due.Count() && out < listMax; i++ )
+		{
+			int listHandle = due[i];
+			if ( listHandle == lastHandle )
+				continue;
+			lastHandle = listHandle;
+
+			simthinkentry_t &entry = m_simThinkList[listHandle];
+			Assert( entry.nextThinkTick <= tick && entry.nextThinkTick >= 0 );
+			entry.scheduledTick = SIMTHINK_CARRIED;
+			m_carryList.AddToTail( entry.entEntry );
+
+			const CEntInfo *pInfo = gEntList.GetEntInfoPtrByIndex( entry.entEntry );
+			pList[out] = (CBaseEntity *)pInfo->m_pEntity;
+			Assert( entry.nextThinkTick==0 || pList[out]->GetFirstThinkTick()==entry.nextThinkTick );
+			Assert( gEntList.IsEntityPtr( pList[out] ) );
+			out++;
+		}
+
+		m_nVisitedLastTick = out;
+		VPROF_INCREMENT_COUNTER( "SimThink visited", out );
+		VPROF_INCREMENT_COUNTER( "SimThink skipped", m_nListCountLastTick - out );
+		return out;
+	}
+
 	void EntityChanged( CBaseEntity *pEntity )
 	{
 		// might change after deletion, don't put back into the list
@@ -236,6 +342,7 @@ public:
 				m_entinfoIndex[index] = m_simThinkList.AddToTail();
 				m_simThinkList[m_entinfoIndex[index]].entEntry = (unsigned short)index;
 				m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
+				m_simThinkList[m_entinfoIndex[index]].scheduledTick = SIMTHINK_NOT_SCHEDULED;
 				if ( pEntity->IsEFlagSet(EFL_NO_GAME_PHYSICS_SIMULATION) )
 				{
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = pEntity->GetFirstThinkTick();
@@ -255,12 +362,76 @@ public:
 					m_simThinkList[m_entinfoIndex[index]].nextThinkTick = 0;
 				}
 			}
+			Schedule( m_simThinkList[m_entinfoIndex[index]] );
 		}
 	}
 
+	void GetStats( int &nVisited, int &nListCount )
+	{
+		nVisited = m_nVisitedLastTick;
+		nListCount = m_nListCountLastTick;
+	}
+
 private:
+	// File the entry into the bucket for the first tick it can run on
+	void Schedule( simthinkentry_t &entry )
+	{
+		int tick = MAX( entry.nextThinkTick, m_nLastScheduledTick + 1 );
+
+		// still carried and still due, the next pass picks it up anyway
+		if ( entry.scheduledTick == SIMTHINK_CARRIED && entry.nextThinkTick <= m_nLastScheduledTick )
+			return;
+
+		if ( entry.scheduledTick == tick )
+			return;
+
+		MEM_ALLOC_CREDIT();
+		int i = m_buckets[tick & SIMTHINK_WHEEL_MASK].AddToTail();
+		m_buckets[tick & SIMTHINK_WHEEL_MASK][i].entEntry = entry.entEntry;
+		m_buckets[tick & SIMTHINK_WHEEL_MASK][i].tick = tick;
+		entry.scheduledTick = tick;
+	}
+
+	// Moves everything due by tick out of the bucket, keeping entries for later laps
+	void DrainBucket( CUtlVector<simthinkbucketentry_t> &bucket, int tick, CUtlVector<unsigned short> &due )
+	{
+		int kept = 0;
+		for ( int i = 0; i < bucket.Count(); i++ )
+		{
+			const simthinkbucketentry_t &bucketEntry = bucket[i];
+			int listHandle = m_entinfoIndex[bucketEntry.entEntry];
+
+			// removed or rescheduled since it was filed here
+			if ( listHandle == 0xFFFF || m_simThinkList[listHandle].scheduledTick != bucketEntry.tick )
+				continue;
+
+			if ( bucketEntry.tick <= tick )
+			{
+				due.AddToTail( listHandle );
+			}
+			else
+			{
+				bucket[kept++] = bucketEntry;
+			}
+		}
+		bucket.SetCountNonDestructively( kept );
+	}
+
+	static int CompareListHandles( const unsigned short *pLeft, const unsigned short *pRight )
+	{
+		return (int)*pLeft - (int)*pRight;
+	}
+
 	unsigned short m_entinfoIndex[NUM_ENT_ENTRIES];
 	CUtlVector<simthinkentry_t>	m_simThinkList;
+
+	CUtlVector<simthinkbucketentry_t> m_buckets[SIMTHINK_WHEEL_SIZE];
+	CUtlVector<unsigned short>	m_carryList;		// entEntry of everything handed out on the last pass
+	CUtlVector<unsigned short>	m_dueList;
+	int							m_nLastScheduledTick;
+
+	int							m_nVisitedLastTick;
+	int							m_nListCountLastTick;
 };
 
 CSimThinkManager g_SimThinkManager;
@@ -275,11 +446,27 @@ int SimThink_ListCopy( CBaseEntity *pList[], int listMax )
 	return g_SimThinkManager.ListCopy( pList, listMax );
 }
 
+int SimThink_ListCopyScheduled( CBaseEntity *pList[], int listMax )
+{
+	return g_SimThinkManager.ListCopyScheduled( pList, listMax );
+}
+
 void SimThink_EntityChanged( CBaseEntity *pEntity )
 {
+	if ( ParallelThink_ShouldDefer() )
+	{
+		ParallelThink_DeferSimThinkChanged( pEntity );
+		return;
+	}
+
 	g_SimThinkManager.EntityChanged( pEntity );
 }
 
+void SimThink_GetStats( int &nVisited, int &nListCount )
+{
+	g_SimThinkManager.GetStats( nVisited, nListCount );
+}
+
 static CBaseEntityClassList *s_pClassLists = NULL;
 CBaseEntityClassList::CBaseEntityClassList()
 {
@@ -1634,3 +1821,13 @@ CON_COMMAND(report_simthinklist, "Lists all simulating/thinking entities")
 	list.ReportEntityList();
 }
 
+CON_COMMAND(report_simthinkstats, "Reports how many simulating/thinking entities were visited last tick")
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nVisited, nListCount;
+	SimThink_GetStats( nVisited, nListCount );
+	Msg( "SimThink: visited %d of %d entities on the sim/think list (scheduler %s)\n", nVisited, nListCount, sv_simthink_scheduler.GetBool() ? "on" : "off" );
+}
+
@@ -359,5 +359,7 @@ void AimTarget_ForceRepopulateList();
 void SimThink_EntityChanged( CBaseEntity *pEntity );
 int SimThink_ListCount();
 int SimThink_ListCopy( CBaseEntity *pList[], int listMax );
+int SimThink_ListCopyScheduled( CBaseEntity *pList[], int listMax );
+void SimThink_GetStats( int &nVisited, int &nListCount );
 
 #endif // ENTITYLIST_H
@@ -7,6 +7,7 @@
 #include "isaverestore.h"
 #include "env_debughistory.h"
 #include "tier0/vprof.h"
+#include "parallel_think.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -304,6 +305,10 @@ void AddDebugHistoryLine( int iCategory, const char *pszLine )
 	if ( g_pGameRules && g_pGameRules->IsMultiplayer() )
 		return;
 
+	// The history entity isn't thread safe, drop lines from parallel thinks
+	if ( ParallelThink_ShouldDefer() )
+		return;
+
 	if ( !GetDebugHistory() )
 	{
 		Warning("Failed to find or create an env_debughistory.\n" );
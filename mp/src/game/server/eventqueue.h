@@ -67,6 +67,7 @@ public:
 	void Dump( void );
 
 private:
+	friend class CEventQueueDeferredAdd;
 
 	void AddEvent( EventQueuePrioritizedEvent_t *event );
 	void RemoveEvent( EventQueuePrioritizedEvent_t *pe );
@@ -130,6 +130,10 @@ extern ConVar tf_mm_servermode;
 #include "replay/ireplaysystem.h"
 #endif
 
+#include "loadprofiler.h"
+#include "checksum_crc.h"
+#include "vstdlib/jobthread.h"
+
 extern IToolFrameworkServer *g_pToolFrameworkServer;
 extern IParticleSystemQuery *g_pParticleSystemQuery;
 
@@ -205,6 +209,9 @@ static ConVar s_UseNetworkVars( "UseNetworkVars", "1", FCVAR_CHEAT, "For profili
 extern ConVar sv_noclipduringpause;
 ConVar sv_massreport( "sv_massreport", "0" );
 ConVar sv_force_transmit_ents( "sv_force_transmit_ents", "0", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Will transmit all entities to client, regardless of PVS conditions (will still skip based on transmit flags, however)." );
+ConVar sv_transmit_pvs_cache( "sv_transmit_pvs_cache", "1", 0, "Share entity PVS results between clients that see the same set of clusters and areas in a tick." );
+ConVar sv_transmit_pvs_cache_parallel( "sv_transmit_pvs_cache_parallel", "1", 0, "Build the shared entity PVS results on the job threads." );
+ConVar sv_transmit_pvs_cache_parallel_min( "sv_transmit_pvs_cache_parallel_min", "512", 0, "Minimum number of PVS checked entities before the shared PVS results are built in parallel." );
 
 ConVar sv_autosave( "sv_autosave", "1", 0, "Set to 1 to autosave game on level transition. Does not affect autosave triggers." );
 ConVar *sv_maxreplay = NULL;
@@ -954,6 +961,10 @@ bool CServerGameDLL::LevelInit( const char *pMapName, char const *pMapEntities,
 {
 	VPROF("CServerGameDLL::LevelInit");
 
+	// Runs until the end of ServerActivate
+	g_LoadProfiler.BeginSession( pMapName );
+	LOAD_PROFILE_SCOPE( "CServerGameDLL::LevelInit" );
+
 #ifdef USES_ECON_ITEMS
 	GameItemSchema_t *pItemSchema = ItemSystem()->GetItemSchema();
 	if ( pItemSchema )
@@ -1097,11 +1108,14 @@ void CServerGameDLL::ServerActivate( edict_t *pEdictList, int edictCount, int cl
 	if ( g_InRestore )
 		return;
 
+	LOAD_PROFILE_SCOPE( "CServerGameDLL::ServerActivate" );
+
 	if ( gEntList.ResetDeleteList() != 0 )
 	{
 		Msg( "%s", "ERROR: Entity delete queue not empty on level start!\n" );
 	}
 
+	int iActivatePhase = g_LoadProfiler.BeginPhase( "Activate entities" );
 	for ( CBaseEntity *pClass = gEntList.FirstEnt(); pClass != NULL; pClass = gEntList.NextEnt(pClass) )
 	{
 		if ( pClass && !pClass->IsDormant() )
@@ -1116,6 +1130,8 @@ void CServerGameDLL::ServerActivate( edict_t *pEdictList, int edictCount, int cl
 		}
 	}
 
+	g_LoadProfiler.EndPhase( iActivatePhase );
+
 	IGameSystem::LevelInitPostEntityAllSystems();
 	// No more precaching after PostEntityAllSystems!!!
 	CBaseEntity::SetAllowPrecache( false );
@@ -1141,6 +1157,8 @@ void CServerGameDLL::ServerActivate( edict_t *pEdictList, int edictCount, int cl
 #ifdef NEXT_BOT
 	TheNextBots().OnMapLoaded();
 #endif
+
+	g_LoadProfiler.EndSession();
 }
 
 //-----------------------------------------------------------------------------
@@ -2448,6 +2466,216 @@ inline void CServerNetworkProperty::CheckTransmit( CCheckTransmitInfo *pInfo )
 	}
 } */
 
+//-----------------------------------------------------------------------------
+// Entity PVS results shared between clients.
+//
+// IsInPVS only depends on the entity and on the client's PVS bytes and
+// networked areas. Clients standing in the same cluster (or spectating from
+// the same spot) get identical answers for every entity, so the first client
+// of a tick with a given PVS evaluates all PVS checked entities in one pass
+// and everybody after it with the same PVS reads the bits back.
+//-----------------------------------------------------------------------------
+#define TRANSMIT_PVS_CACHE_ENTRIES	16
+#define TRANSMIT_PVS_JOB_DWORDS		4		// 128 edicts per job
+
+struct TransmitPVSCacheEntry_t
+{
+	CRC32_t				m_nHash;
+	int					m_nPVSSize;
+	int					m_AreasNetworked;
+	int					m_Areas[MAX_WORLD_AREAS];
+	byte				m_PVS[PAD_NUMBER( MAX_MAP_CLUSTERS,8 ) / 8];
+
+	// IsInPVS() never gets asked about the client's own edict, leave it to the slow path
+	int					m_iClientEdict;
+	CBitVec<MAX_EDICTS>	m_InPVS;
+};
+
+struct TransmitPVSJob_t
+{
+	int m_nFirstDWord;
+	int m_nDWords;
+};
+
+class CTransmitPVSCache
+{
+public:
+	CTransmitPVSCache() : m_nTick( -1 ), m_pEdictIndices( NULL ), m_nEdicts( 0 ), m_nEntries( 0 ) {}
+
+	// Returns NULL if the cache is full for this tick
+	const TransmitPVSCacheEntry_t *Find( const CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts );
+
+	inline bool IsInPVS( const TransmitPVSCacheEntry_t *pEntry, CServerNetworkProperty *pNetProp, int iEdict, const CCheckTransmitInfo *pInfo ) const
+	{
+		if ( pEntry && m_Evaluated.IsBitSet( iEdict ) && iEdict != pEntry->m_iClientEdict )
+			return pEntry->m_InPVS.IsBitSet( iEdict );
+		return pNetProp->IsInPVS( pInfo );
+	}
+
+private:
+	void BeginTick( const unsigned short *pEdictIndices, int nEdicts );
+	void Build( TransmitPVSCacheEntry_t *pEntry, const CCheckTransmitInfo *pInfo );
+
+	static void ProcessJob( TransmitPVSJob_t &job );
+
+	int						m_nTick;
+	const unsigned short	*m_pEdictIndices;
+	int						m_nEdicts;
+
+	// Edicts whose PVS state is held in every entry this tick
+	CBitVec<MAX_EDICTS>		m_Evaluated;
+	int						m_nEvaluated;
+
+	TransmitPVSCacheEntry_t	m_Entries[TRANSMIT_PVS_CACHE_ENTRIES];
+	int						m_nEntries;
+
+	CThreadFastMutex		m_Mutex;
+
+	// state for the build jobs
+	static TransmitPVSCacheEntry_t	*s_pJobEntry;
+	static const CCheckTransmitInfo	*s_pJobInfo;
+	static CTransmitPVSCache		*s_pJobCache;
+};
+
+TransmitPVSCacheEntry_t	*CTransmitPVSCache::s_pJobEntry = NULL;
+const CCheckTransmitInfo *CTransmitPVSCache::s_pJobInfo = NULL;
+CTransmitPVSCache *CTransmitPVSCache::s_pJobCache = NULL;
+
+static CTransmitPVSCache g_TransmitPVSCache;
+static CUtlVector<TransmitPVSJob_t> s_TransmitPVSJobs;
+
+void CTransmitPVSCache::BeginTick( const unsigned short *pEdictIndices, int nEdicts )
+{
+	m_nTick = gpGlobals->tickcount;
+	m_pEdictIndices = pEdictIndices;
+	m_nEdicts = nEdicts;
+	m_nEntries = 0;
+	m_nEvaluated = 0;
+	m_Evaluated.ClearAll();
+
+	// Pick out everything that can end up in a PVS test and make sure its
+	// PVS info is current. This has to happen here on the main thread.
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+	for ( int i = 0; i < nEdicts; i++ )
+	{
+		int iEdict = pEdictIndices[i];
+		edict_t *pEdict = &pBaseEdict[iEdict];
+		int nFlags = pEdict->m_fStateFlags;
+		if ( ( nFlags & FL_EDICT_DONTSEND ) || !( nFlags & ( FL_EDICT_PVSCHECK | FL_EDICT_FULLCHECK ) ) )
+			continue;
+
+		CServerNetworkProperty *pNetProp = static_cast<CServerNetworkProperty*>( pEdict->GetNetworkable() );
+		if ( !pNetProp )
+			continue;
+
+		pNetProp->RecomputePVSInformation();
+		m_Evaluated.Set( iEdict );
+		++m_nEvaluated;
+	}
+}
+
+void CTransmitPVSCache::ProcessJob( TransmitPVSJob_t &job )
+{
+	const CCheckTransmitInfo *pInfo = s_pJobInfo;
+	TransmitPVSCacheEntry_t *pEntry = s_pJobEntry;
+	const CBitVec<MAX_EDICTS> &evaluated = s_pJobCache->m_Evaluated;
+	edict_t *pBaseEdict = engine->PEntityOfEntIndex( 0 );
+
+	// Every job owns whole dwords of m_InPVS, so no locking is needed
+	int nEndDWord = job.m_nFirstDWord + job.m_nDWords;
+	for ( int iDWord = job.m_nFirstDWord; iDWord < nEndDWord; iDWord++ )
+	{
+		uint32 nCandidates = evaluated.GetDWord( iDWord );
+		uint32 nInPVS = 0;
+		while ( nCandidates )
+		{
+			int iBit = FirstBitInWord( nCandidates, 0 );
+			nCandidates &= nCandidates - 1;
+
+			int iEdict = iDWord * 32 + iBit;
+			if ( iEdict == pEntry->m_iClientEdict )
+				continue;
+
+			CServerNetworkProperty *pNetProp = static_cast<CServerNetworkProperty*>( pBaseEdict[iEdict].GetNetworkable() );
+			if ( pNetProp->IsInPVS( pInfo ) )
+			{
+				nInPVS |= ( 1u << iBit );
+			}
+		}
+		pEntry->m_InPVS.SetDWord( iDWord, nInPVS );
+	}
+}
+
+void CTransmitPVSCache::Build( TransmitPVSCacheEntry_t *pEntry, const CCheckTransmitInfo *pInfo )
+{
+	VPROF_BUDGET( "CTransmitPVSCache::Build", "CheckTransmit" );
+
+	s_pJobEntry = pEntry;
+	s_pJobInfo = pInfo;
+	s_pJobCache = this;
+
+	int nDWords = m_Evaluated.GetNumDWords();
+	s_TransmitPVSJobs.RemoveAll();
+	for ( int i = 0; i < nDWords; i += TRANSMIT_PVS_JOB_DWORDS )
+	{
+		TransmitPVSJob_t &job = s_TransmitPVSJobs[ s_TransmitPVSJobs.AddToTail() ];
+		job.m_nFirstDWord = i;
+		job.m_nDWords = MIN( TRANSMIT_PVS_JOB_DWORDS, nDWords - i );
+	}
+
+	if ( sv_transmit_pvs_cache_parallel.GetBool() && m_nEvaluated >= sv_transmit_pvs_cache_parallel_min.GetInt() )
+	{
+		ParallelProcess( "CTransmitPVSCache::Build", s_TransmitPVSJobs.Base(), s_TransmitPVSJobs.Count(), &ProcessJob );
+	}
+	else
+	{
+		for ( int i = 0; i < s_TransmitPVSJobs.Count(); i++ )
+		{
+			ProcessJob( s_TransmitPVSJobs[i] );
+		}
+	}
+
+	s_pJobEntry = NULL;
+	s_pJobInfo = NULL;
+	s_pJobCache = NULL;
+}
+
+const TransmitPVSCacheEntry_t *CTransmitPVSCache::Find( const CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
+{
+	AUTO_LOCK( m_Mutex );
+
+	if ( m_nTick != gpGlobals->tickcount || m_pEdictIndices != pEdictIndices || m_nEdicts != nEdicts )
+	{
+		BeginTick( pEdictIndices, nEdicts );
+	}
+
+	CRC32_t nHash = CRC32_ProcessSingleBuffer( pInfo->m_PVS, pInfo->m_nPVSSize );
+	for ( int i = 0; i < m_nEntries; i++ )
+	{
+		const TransmitPVSCacheEntry_t &entry = m_Entries[i];
+		if ( entry.m_nHash != nHash || entry.m_nPVSSize != pInfo->m_nPVSSize || entry.m_AreasNetworked != pInfo->m_AreasNetworked )
+			continue;
+		if ( memcmp( entry.m_Areas, pInfo->m_Areas, pInfo->m_AreasNetworked * sizeof( int ) ) )
+			continue;
+		if ( memcmp( entry.m_PVS, pInfo->m_PVS, pInfo->m_nPVSSize ) )
+			continue;
+		return &entry;
+	}
+
+	if ( m_nEntries == TRANSMIT_PVS_CACHE_ENTRIES )
+		return NULL;
+
+	TransmitPVSCacheEntry_t *pEntry = &m_Entries[ m_nEntries++ ];
+	pEntry->m_nHash = nHash;
+	pEntry->m_nPVSSize = pInfo->m_nPVSSize;
+	pEntry->m_AreasNetworked = pInfo->m_AreasNetworked;
+	memcpy( pEntry->m_Areas, pInfo->m_Areas, pInfo->m_AreasNetworked * sizeof( int ) );
+	memcpy( pEntry->m_PVS, pInfo->m_PVS, pInfo->m_nPVSSize );
+	pEntry->m_iClientEdict = engine->IndexOfEdict( pInfo->m_pClientEnt );
+	Build( pEntry, pInfo );
+	return pEntry;
+}
+
 void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned short *pEdictIndices, int nEdicts )
 {
 	// NOTE: for speed's sake, this assumes that all networkables are CBaseEntities and that the edict list
@@ -2476,6 +2704,18 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 		    bIsReplay == ( pInfo->m_pTransmitAlways != NULL) );
 #endif
 
+	// HLTV and Replay don't cull against the PVS, so they have no use for the shared results
+	const TransmitPVSCacheEntry_t *pPVSCache = NULL;
+	if ( sv_transmit_pvs_cache.GetBool() )
+	{
+#ifndef _X360
+		if ( !bIsHLTV && !bIsReplay )
+#endif
+		{
+			pPVSCache = g_TransmitPVSCache.Find( pInfo, pEdictIndices, nEdicts );
+		}
+	}
+
 	for ( int i=0; i < nEdicts; i++ )
 	{
 		int iEdict = pEdictIndices[i];
@@ -2570,7 +2810,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			continue;
 		}
 
-		bool bInPVS = netProp->IsInPVS( pInfo );
+		bool bInPVS = g_TransmitPVSCache.IsInPVS( pPVSCache, netProp, iEdict, pInfo );
 		if ( bInPVS || sv_force_transmit_ents.GetBool() )
 		{
 			// only send if entity is in PVS
@@ -2625,7 +2865,7 @@ void CServerGameEnts::CheckTransmit( CCheckTransmitInfo *pInfo, const unsigned s
 			{
 				// Check pvs
 				check->RecomputePVSInformation();
-				bool bMoveParentInPVS = check->IsInPVS( pInfo );
+				bool bMoveParentInPVS = g_TransmitPVSCache.IsInPVS( pPVSCache, check, checkIndex, pInfo );
 				if ( bMoveParentInPVS )
 				{
 					orig->SetTransmit( pInfo, true );
@@ -31,6 +31,7 @@ public:
 
 	virtual int	Save( ISave &save );
 	virtual int	Restore( IRestore &restore );
+	virtual bool IsSaveThreadSafe() const { return false; }
 
 protected:
 
@@ -18,6 +18,8 @@
 #include "datacache/imdlcache.h"
 #include "world.h"
 #include "toolframework/iserverenginetools.h"
+#include "parallel_think.h"
+#include "loadprofiler.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -35,6 +37,14 @@ extern edict_t *g_pForceAttachEdict;
 // creates an entity by string name, but does not spawn it
 CBaseEntity *CreateEntityByName( const char *className, int iForceEdictIndex )
 {
+	if ( ParallelThink_ShouldDefer() )
+	{
+		// The entity list and edicts belong to the main thread
+		AssertMsg( false, "Creating an entity from a parallel think, use ParallelThink_DeferCreate\n" );
+		Warning( "CreateEntityByName( %s ) called from a parallel think, use ParallelThink_DeferCreate\n", className );
+		return NULL;
+	}
+
 	if ( iForceEdictIndex != -1 )
 	{
 		g_pForceAttachEdict = engine->CreateEdict( iForceEdictIndex );
@@ -310,6 +320,7 @@ void SpawnAllEntities( int nEntities, HierarchicalSpawn_t *pSpawnList, bool bAct
 void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter, bool bActivateEntities)
 {
 	VPROF("MapEntity_ParseAllEntities");
+	LOAD_PROFILE_SCOPE( "MapEntity_ParseAllEntities" );
 
 	HierarchicalSpawnMapData_t *pSpawnMapData = new HierarchicalSpawnMapData_t[NUM_ENT_ENTRIES];
 	HierarchicalSpawn_t *pSpawnList = new HierarchicalSpawn_t[NUM_ENT_ENTRIES];
@@ -481,7 +492,10 @@ void MapEntity_ParseAllEntities(const char *pMapData, IMapEntityFilter *pFilter,
 		pPointTemplate->FinishBuildingTemplates();
 	}
 
-	SpawnHierarchicalList( nEntities, pSpawnList, bActivateEntities );
+	{
+		LOAD_PROFILE_SCOPE( "SpawnHierarchicalList" );
+		SpawnHierarchicalList( nEntities, pSpawnList, bActivateEntities );
+	}
 
 	delete [] pSpawnMapData;
 	delete [] pSpawnList;
@@ -19,6 +19,7 @@
 #endif
 
 #include "tier1/lzmaDecoder.h"
+#include "loadprofiler.h"
 
 #ifdef CSTRIKE_DLL
 #include "cs_shareddefs.h"
@@ -1382,6 +1383,7 @@ const CUtlVector< Place > *CNavMesh::GetPlacesFromNavFile( bool *hasUnnamedPlace
 NavErrorType CNavMesh::Load( void )
 {
 	MDLCACHE_CRITICAL_SECTION();
+	LOAD_PROFILE_SCOPE( "CNavMesh::Load" );
 
 	// free previous navigation mesh data
 	Reset();
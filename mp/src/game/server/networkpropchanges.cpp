@@ -0,0 +1,507 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side per-SendProp change tracking. See networkpropchanges.h.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "networkpropchanges.h"
+#include "bitvec.h"
+#include "dt_send.h"
+#include "tier0/vprof.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static void SvNetPropChangesChanged( IConVar *pConVar, const char *pOldValue, float flOldValue );
+
+ConVar sv_netprop_changes( "sv_netprop_changes", "0", 0, "Track which SendProps changed on each edict between packs, beyond the engine's per-edict change offset limit", SvNetPropChangesChanged );
+ConVar sv_netprop_changes_stats( "sv_netprop_changes_stats", "0", 0, "Accumulate per tick stats on how much SendTable encoding the tracked prop changes could skip, tracking changes while on. See sv_netprop_changes_report.", SvNetPropChangesChanged );
+
+// Nothing reads the masks unless asked to, so this is off until one of the convars turns it on
+bool g_bTrackNetworkPropChanges = false;
+
+//-----------------------------------------------------------------------------
+// A ServerClass' SendTable flattened into the props the engine actually sends,
+// sorted by their offset from the start of the entity
+//-----------------------------------------------------------------------------
+struct NetPropMapEntry_t
+{
+	int				m_nStart;
+	int				m_nEnd;
+	int				m_iProp;		// bit index in the changed prop mask
+};
+
+struct NetPropMap_t
+{
+	CUtlVector<const SendProp *>	m_Props;		// indexed by NetPropMapEntry_t::m_iProp
+	CUtlVector<int>					m_PropBits;		// estimated encoded size of each prop
+	CUtlVector<NetPropMapEntry_t>	m_Entries;		// sorted by m_nStart
+	int								m_nMaxSpan;
+	int								m_nTotalBits;
+};
+
+//-----------------------------------------------------------------------------
+// What changed on one edict since the engine last cleared its change state
+//-----------------------------------------------------------------------------
+struct EdictPropChanges_t
+{
+	EdictPropChanges_t() : m_pClass( NULL ), m_pMap( NULL ), m_bAll( true ), m_bQueued( false ) {}
+
+	ServerClass		*m_pClass;
+	NetPropMap_t	*m_pMap;
+	CVarBitVec		m_Changed;
+	bool			m_bAll;
+	bool			m_bQueued;		// in s_ChangedEdicts for the stats pass
+};
+
+struct NetPropChangeStats_t
+{
+	int		m_nTicks;
+	int		m_nChangedEdicts;
+	int		m_nUntrackedEdicts;		// full change, or an offset that didn't map to a prop
+	int		m_nEngineFullEdicts;	// engine fell back to a full encode but we had a prop mask
+	int64	m_nFullBits;			// estimated bits of every prop of every tracked changed edict
+	int64	m_nChangedBits;			// estimated bits of just the changed props
+	int64	m_nAvoidableBits;		// full encode bits the prop mask would have skipped on engine full edicts
+};
+
+static CUtlVector<NetPropMap_t *>	s_NetPropMaps;			// indexed by ServerClass::m_ClassID
+static EdictPropChanges_t			s_EdictChanges[MAX_EDICTS];
+static CUtlVector<int>				s_ChangedEdicts;
+static NetPropChangeStats_t			s_NetPropChangeStats;
+
+static void SvNetPropChangesChanged( IConVar *pConVar, const char *pOldValue, float flOldValue )
+{
+	g_bTrackNetworkPropChanges = sv_netprop_changes.GetBool() || sv_netprop_changes_stats.GetBool();
+
+	// Anything that changed while we weren't looking has to be treated as a full change
+	for ( int i = 0; i < MAX_EDICTS; i++ )
+	{
+		s_EdictChanges[i].m_bAll = true;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Flattening
+//-----------------------------------------------------------------------------
+struct NetPropExclude_t
+{
+	const char	*m_pTableName;
+	const char	*m_pPropName;
+};
+
+static void NetPropMap_GatherExcludes( SendTable *pTable, CUtlVector<NetPropExclude_t> &excludes )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() )
+		{
+			NetPropExclude_t &exclude = excludes[excludes.AddToTail()];
+			exclude.m_pTableName = pProp->GetExcludeDTName();
+			exclude.m_pPropName = pProp->GetName();
+		}
+		else if ( pProp->GetType() == DPT_DataTable && pProp->GetDataTable() )
+		{
+			NetPropMap_GatherExcludes( pProp->GetDataTable(), excludes );
+		}
+	}
+}
+
+static bool NetPropMap_IsExcluded( SendTable *pTable, const SendProp *pProp, const CUtlVector<NetPropExclude_t> &excludes )
+{
+	for ( int i = 0; i < excludes.Count(); i++ )
+	{
+		if ( !Q_stricmp( excludes[i].m_pTableName, pTable->GetName() ) && !Q_stricmp( excludes[i].m_pPropName, pProp->GetName() ) )
+			return true;
+	}
+	return false;
+}
+
+static int NetPropMap_EstimateBits( const SendProp *pProp )
+{
+	int nBits = ( pProp->m_nBits > 0 && pProp->m_nBits <= 32 ) ? pProp->m_nBits : 32;
+	switch ( pProp->GetType() )
+	{
+	case DPT_Vector:
+		return nBits * 3;
+	case DPT_VectorXY:
+		return nBits * 2;
+	case DPT_String:
+		return 16 * 8;
+	case DPT_Array:
+		return pProp->GetArrayProp() ? pProp->GetNumElements() * NetPropMap_EstimateBits( pProp->GetArrayProp() ) : nBits;
+	default:
+		return nBits;
+	}
+}
+
+static int NetPropMap_GetSpan( const SendProp *pProp )
+{
+	switch ( pProp->GetType() )
+	{
+	case DPT_Vector:
+		return sizeof( Vector );
+	case DPT_VectorXY:
+		return sizeof( float ) * 2;
+	case DPT_Array:
+		return MAX( 1, pProp->GetNumElements() * pProp->GetElementStride() );
+	default:
+		// Strings and scalars are matched by their start offset
+		return 1;
+	}
+}
+
+static void NetPropMap_AddTable( NetPropMap_t *pMap, SendTable *pTable, int nBaseOffset, const CUtlVector<NetPropExclude_t> &excludes )
+{
+	for ( int i = 0; i < pTable->GetNumProps(); i++ )
+	{
+		SendProp *pProp = pTable->GetProp( i );
+		if ( pProp->IsExcludeProp() || pProp->IsInsideArray() || NetPropMap_IsExcluded( pTable, pProp, excludes ) )
+			continue;
+
+		if ( pProp->GetType() == DPT_DataTable )
+		{
+			if ( pProp->GetDataTable() )
+			{
+				NetPropMap_AddTable( pMap, pProp->GetDataTable(), nBaseOffset + pProp->GetOffset(), excludes );
+			}
+			continue;
+		}
+
+		int iProp = pMap->m_Props.AddToTail( pProp );
+		int nBits = NetPropMap_EstimateBits( pProp );
+		pMap->m_PropBits.AddToTail( nBits );
+		pMap->m_nTotalBits += nBits;
+
+		NetPropMapEntry_t &entry = pMap->m_Entries[pMap->m_Entries.AddToTail()];
+		entry.m_nStart = nBaseOffset + pProp->GetOffset();
+		entry.m_nEnd = entry.m_nStart + NetPropMap_GetSpan( pProp );
+		entry.m_iProp = iProp;
+		pMap->m_nMaxSpan = MAX( pMap->m_nMaxSpan, entry.m_nEnd - entry.m_nStart );
+	}
+}
+
+static int NetPropMap_SortEntries( const NetPropMapEntry_t *pLeft, const NetPropMapEntry_t *pRight )
+{
+	if ( pLeft->m_nStart != pRight->m_nStart )
+		return pLeft->m_nStart - pRight->m_nStart;
+	return pLeft->m_iProp - pRight->m_iProp;
+}
+
+static NetPropMap_t *NetPropMap_Get( ServerClass *pClass )
+{
+	int iClass = pClass->m_ClassID;
+	if ( iClass >= s_NetPropMaps.Count() )
+	{
+		int nOldCount = s_NetPropMaps.Count();
+		s_NetPropMaps.SetCount( iClass + 1 );
+		for ( int i = nOldCount; i < s_NetPropMaps.Count(); i++ )
+		{
+			s_NetPropMaps[i] = NULL;
+		}
+	}
+
+	if ( !s_NetPropMaps[iClass] )
+	{
+		NetPropMap_t *pMap = new NetPropMap_t;
+		pMap->m_nMaxSpan = 1;
+		pMap->m_nTotalBits = 0;
+
+		CUtlVector<NetPropExclude_t> excludes;
+		NetPropMap_GatherExcludes( pClass->m_pTable, excludes );
+		NetPropMap_AddTable( pMap, pClass->m_pTable, 0, excludes );
+		pMap->m_Entries.Sort( NetPropMap_SortEntries );
+
+		s_NetPropMaps[iClass] = pMap;
+	}
+
+	return s_NetPropMaps[iClass];
+}
+
+// Index of the first entry starting past nOffset
+static int NetPropMap_UpperBound( const NetPropMap_t *pMap, int nOffset )
+{
+	int nLow = 0;
+	int nHigh = pMap->m_Entries.Count();
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) >> 1;
+		if ( pMap->m_Entries[nMid].m_nStart <= nOffset )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+	return nLow;
+}
+
+// Sets every prop covering nOffset, returns false if there weren't any
+static bool NetPropMap_MarkOffset( const NetPropMap_t *pMap, int nOffset, CVarBitVec &changed, bool bOnlyFloats = false )
+{
+	bool bFound = false;
+	for ( int i = NetPropMap_UpperBound( pMap, nOffset ) - 1; i >= 0; i-- )
+	{
+		const NetPropMapEntry_t &entry = pMap->m_Entries[i];
+		if ( entry.m_nStart + pMap->m_nMaxSpan <= nOffset )
+			break;
+
+		if ( nOffset >= entry.m_nEnd )
+			continue;
+
+		const SendProp *pProp = pMap->m_Props[entry.m_iProp];
+		if ( bOnlyFloats && pProp->GetType() != DPT_Float )
+			continue;
+
+		changed.Set( entry.m_iProp );
+		bFound = true;
+
+		// Vectors are reported at their start offset but are sometimes sent a
+		// component at a time, or as XY plus a separate Z. Take the components
+		// along, marking too much only costs the engine a redundant compare.
+		if ( entry.m_nStart == nOffset && !bOnlyFloats )
+		{
+			if ( pProp->GetType() == DPT_Float )
+			{
+				NetPropMap_MarkOffset( pMap, nOffset + 4, changed, true );
+				NetPropMap_MarkOffset( pMap, nOffset + 8, changed, true );
+			}
+			else if ( pProp->GetType() == DPT_VectorXY )
+			{
+				NetPropMap_MarkOffset( pMap, nOffset + 8, changed, true );
+			}
+		}
+	}
+	return bFound;
+}
+
+//-----------------------------------------------------------------------------
+// Returns the record for this edict, starting it over if the engine has
+// consumed the changes it held
+//-----------------------------------------------------------------------------
+static EdictPropChanges_t *NetPropChanges_GetRecord( CServerNetworkProperty *pProp )
+{
+	edict_t *pEdict = pProp->edict();
+	if ( !pEdict )
+		return NULL;
+
+	int iEdict = pProp->entindex();
+	EdictPropChanges_t &record = s_EdictChanges[iEdict];
+	ServerClass *pClass = pProp->GetServerClass();
+
+	// The engine clears FL_EDICT_CHANGED when it packs the edict, so if it
+	// isn't set the record is left over from before that
+	bool bPacked = !( pEdict->m_fStateFlags & FL_EDICT_CHANGED );
+	if ( bPacked || record.m_pClass != pClass )
+	{
+		// A different entity took over an edict the engine hasn't packed yet, don't trust either's changes
+		record.m_bAll = !bPacked || !pClass;
+		record.m_pClass = pClass;
+		record.m_pMap = pClass ? NetPropMap_Get( pClass ) : NULL;
+		if ( record.m_pMap )
+		{
+			record.m_Changed.Resize( record.m_pMap->m_Props.Count(), true );
+		}
+
+		if ( !record.m_bQueued )
+		{
+			record.m_bQueued = true;
+			s_ChangedEdicts.AddToTail( iEdict );
+		}
+	}
+
+	return &record;
+}
+
+void NetworkPropChanges_Mark( CServerNetworkProperty *pProp, unsigned short nOffset )
+{
+	EdictPropChanges_t *pRecord = NetPropChanges_GetRecord( pProp );
+	if ( !pRecord || pRecord->m_bAll )
+		return;
+
+	if ( !NetPropMap_MarkOffset( pRecord->m_pMap, nOffset, pRecord->m_Changed ) )
+	{
+		// Not something we know how to map (a proxied table, a var that isn't sent at all)
+		pRecord->m_bAll = true;
+	}
+}
+
+void NetworkPropChanges_MarkAll( CServerNetworkProperty *pProp )
+{
+	EdictPropChanges_t *pRecord = NetPropChanges_GetRecord( pProp );
+	if ( pRecord )
+	{
+		pRecord->m_bAll = true;
+	}
+}
+
+bool NetworkPropChanges_GetChangedProps( CBaseEntity *pEntity, CUtlVector<const SendProp*> &props )
+{
+	props.RemoveAll();
+
+	if ( !g_bTrackNetworkPropChanges || !pEntity || !pEntity->edict() )
+		return false;
+
+	edict_t *pEdict = pEntity->edict();
+	if ( !( pEdict->m_fStateFlags & FL_EDICT_CHANGED ) )
+		return true;
+
+	const EdictPropChanges_t &record = s_EdictChanges[pEntity->entindex()];
+	if ( record.m_bAll || record.m_pClass != pEntity->NetworkProp()->GetServerClass() )
+		return false;
+
+	for ( int i = record.m_Changed.FindNextSetBit( 0 ); i != -1; i = record.m_Changed.FindNextSetBit( i + 1 ) )
+	{
+		props.AddToTail( record.m_pMap->m_Props[i] );
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Stats pass right before the engine packs, and cleanup between levels
+//-----------------------------------------------------------------------------
+class CNetworkPropChangesSystem : public CAutoGameSystemPerFrame
+{
+public:
+	CNetworkPropChangesSystem() : CAutoGameSystemPerFrame( "CNetworkPropChangesSystem" ) {}
+
+	virtual void LevelShutdownPostEntity()
+	{
+		for ( int i = 0; i < MAX_EDICTS; i++ )
+		{
+			s_EdictChanges[i].m_pClass = NULL;
+			s_EdictChanges[i].m_pMap = NULL;
+			s_EdictChanges[i].m_bAll = true;
+			s_EdictChanges[i].m_bQueued = false;
+		}
+		s_ChangedEdicts.Purge();
+
+		// Class IDs can be handed out differently next level
+		s_NetPropMaps.PurgeAndDeleteElements();
+	}
+
+	virtual void PreClientUpdate()
+	{
+		if ( sv_netprop_changes_stats.GetBool() && g_bTrackNetworkPropChanges )
+		{
+			VPROF_BUDGET( "NetworkPropChanges_Stats", VPROF_BUDGETGROUP_OTHER_NETWORKING );
+			GatherStats();
+		}
+
+		for ( int i = 0; i < s_ChangedEdicts.Count(); i++ )
+		{
+			s_EdictChanges[s_ChangedEdicts[i]].m_bQueued = false;
+		}
+		s_ChangedEdicts.RemoveAll();
+	}
+
+private:
+	void GatherStats()
+	{
+		NetPropChangeStats_t &stats = s_NetPropChangeStats;
+		stats.m_nTicks++;
+
+		for ( int i = 0; i < s_ChangedEdicts.Count(); i++ )
+		{
+			int iEdict = s_ChangedEdicts[i];
+			edict_t *pEdict = INDEXENT( iEdict );
+			if ( !pEdict || pEdict->IsFree() || !( pEdict->m_fStateFlags & FL_EDICT_CHANGED ) )
+				continue;
+
+			const EdictPropChanges_t &record = s_EdictChanges[iEdict];
+			stats.m_nChangedEdicts++;
+			if ( record.m_bAll )
+			{
+				stats.m_nUntrackedEdicts++;
+				continue;
+			}
+
+			int nChangedBits = 0;
+			for ( int iProp = record.m_Changed.FindNextSetBit( 0 ); iProp != -1; iProp = record.m_Changed.FindNextSetBit( iProp + 1 ) )
+			{
+				nChangedBits += record.m_pMap->m_PropBits[iProp];
+			}
+
+			stats.m_nFullBits += record.m_pMap->m_nTotalBits;
+			stats.m_nChangedBits += nChangedBits;
+
+			if ( pEdict->m_fStateFlags & FL_FULL_EDICT_CHANGED )
+			{
+				stats.m_nEngineFullEdicts++;
+				stats.m_nAvoidableBits += record.m_pMap->m_nTotalBits - nChangedBits;
+			}
+		}
+	}
+};
+
+static CNetworkPropChangesSystem g_NetworkPropChangesSystem;
+
+CON_COMMAND( sv_netprop_changes_report, "Print what sv_netprop_changes_stats gathered. Pass 'reset' to clear." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		memset( &s_NetPropChangeStats, 0, sizeof( s_NetPropChangeStats ) );
+		return;
+	}
+
+	const NetPropChangeStats_t &stats = s_NetPropChangeStats;
+	if ( !stats.m_nTicks )
+	{
+		Msg( "No stats gathered, set sv_netprop_changes_stats 1\n" );
+		return;
+	}
+
+	float flTicks = (float)stats.m_nTicks;
+	Msg( "ticks              : %d\n", stats.m_nTicks );
+	Msg( "changed edicts     : %.1f / tick\n", stats.m_nChangedEdicts / flTicks );
+	Msg( "  untracked        : %.1f / tick\n", stats.m_nUntrackedEdicts / flTicks );
+	Msg( "  engine full      : %.1f / tick (exact prop mask available)\n", stats.m_nEngineFullEdicts / flTicks );
+	Msg( "tracked sendtables : %.1f KB / tick, changed props %.1f KB / tick\n", stats.m_nFullBits / ( flTicks * 8192.0f ), stats.m_nChangedBits / ( flTicks * 8192.0f ) );
+	Msg( "avoidable encoding : %.1f KB / tick on engine full edicts\n", stats.m_nAvoidableBits / ( flTicks * 8192.0f ) );
+}
+
+CON_COMMAND( sv_netprop_changes_dump, "Print the SendProps changed on an edict since it was last packed. Arguments: <entindex>" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: sv_netprop_changes_dump <entindex>\n" );
+		return;
+	}
+
+	if ( !g_bTrackNetworkPropChanges )
+	{
+		Msg( "Prop changes aren't being tracked, set sv_netprop_changes 1\n" );
+		return;
+	}
+
+	CBaseEntity *pEntity = UTIL_EntityByIndex( atoi( args[1] ) );
+	if ( !pEntity || !pEntity->edict() )
+	{
+		Msg( "No networked entity at index %s\n", args[1] );
+		return;
+	}
+
+	CUtlVector<const SendProp*> props;
+	if ( !NetworkPropChanges_GetChangedProps( pEntity, props ) )
+	{
+		Msg( "%s (%d): full state change\n", pEntity->GetClassname(), pEntity->entindex() );
+		return;
+	}
+
+	Msg( "%s (%d): %d props changed\n", pEntity->GetClassname(), pEntity->entindex(), props.Count() );
+	for ( int i = 0; i < props.Count(); i++ )
+	{
+		Msg( "  %s\n", props[i]->GetName() );
+	}
+}
@@ -0,0 +1,39 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Game side per-SendProp change tracking.
+//
+//			The engine only remembers MAX_CHANGE_OFFSETS changed offsets per
+//			edict, and only MAX_EDICT_CHANGE_INFOS edicts per frame get any at
+//			all. Everything past that is flagged FL_FULL_EDICT_CHANGED and the
+//			whole SendTable gets re-encoded and delta compared. This keeps an
+//			exact bitmask of changed props for every edict, indexed by the
+//			entity's flattened SendTable, which stays valid until the engine
+//			clears the edict's change state after packing.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef NETWORKPROPCHANGES_H
+#define NETWORKPROPCHANGES_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+
+class CBaseEntity;
+class CServerNetworkProperty;
+class SendProp;
+
+extern bool g_bTrackNetworkPropChanges;
+
+// Called by CServerNetworkProperty as state changes come in
+void NetworkPropChanges_Mark( CServerNetworkProperty *pProp, unsigned short nOffset );
+void NetworkPropChanges_MarkAll( CServerNetworkProperty *pProp );
+
+// Fills out the props that changed on this entity since the engine last packed it.
+// Returns false if every prop has to be treated as changed (a full state change
+// happened or a change came in at an offset that doesn't map to a prop).
+bool NetworkPropChanges_GetChangedProps( CBaseEntity *pEntity, CUtlVector<const SendProp*> &props );
+
+#endif // NETWORKPROPCHANGES_H
@@ -0,0 +1,458 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Parallel think phase for entities that declare thread safe thinks.
+//			See parallel_think.h.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "parallel_think.h"
+#include "entitylist.h"
+#include "tier0/vprof.h"
+#include "vstdlib/jobthread.h"
+#include "datacache/imdlcache.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+ConVar sv_parallel_think( "sv_parallel_think", "0", 0, "Run the thinks of thread safe entity classes as parallel jobs before the serial think pass" );
+ConVar sv_parallel_think_min_entities( "sv_parallel_think_min_entities", "16", 0, "Don't bother with jobs unless at least this many thread safe entities are due to think" );
+
+bool g_bParallelThinkActive = false;
+
+//-----------------------------------------------------------------------------
+// One job per thread safe entity; the command buffer is only ever touched by
+// the thread running that entity's think, so no locking is needed.
+//-----------------------------------------------------------------------------
+struct ParallelThinkStateChange_t
+{
+	CServerNetworkProperty	*m_pProp;
+	unsigned short			m_nOffset;
+};
+
+struct ParallelThinkJob_t
+{
+	CBaseEntity									*m_pEntity;
+	CUtlVector<ParallelThinkStateChange_t>		m_StateChanges;
+	CUtlVector<IParallelThinkCommand *>			m_Commands;
+};
+
+static CUtlVector<ParallelThinkJob_t>	s_ParallelThinkJobs;
+static CTHREADLOCALPTR( ParallelThinkJob_t ) s_pCurrentJob;
+
+bool ParallelThink_IsDeferring()
+{
+	return ( GETLOCAL( s_pCurrentJob ) != NULL );
+}
+
+void ParallelThink_Defer( IParallelThinkCommand *pCommand )
+{
+	ParallelThinkJob_t *pJob = GETLOCAL( s_pCurrentJob );
+	Assert( pJob );
+	if ( !pJob )
+	{
+		// Not in a parallel think, nothing to wait for
+		pCommand->Execute();
+		delete pCommand;
+		return;
+	}
+
+	pJob->m_Commands.AddToTail( pCommand );
+}
+
+//-----------------------------------------------------------------------------
+// Deferred commands
+//-----------------------------------------------------------------------------
+class CParallelThinkCreateCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkCreateCommand( const char *pszClassName, const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner ) :
+		m_vecOrigin( vecOrigin ), m_vecAngles( vecAngles ), m_hOwner( pOwner )
+	{
+		Q_strncpy( m_szClassName, pszClassName, sizeof( m_szClassName ) );
+	}
+
+	virtual void Execute()
+	{
+		CBaseEntity::Create( m_szClassName, m_vecOrigin, m_vecAngles, m_hOwner );
+	}
+
+private:
+	char		m_szClassName[64];
+	Vector		m_vecOrigin;
+	QAngle		m_vecAngles;
+	EHANDLE		m_hOwner;
+};
+
+class CParallelThinkRemoveCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkRemoveCommand( CBaseEntity *pEntity ) : m_hEntity( pEntity ) {}
+
+	virtual void Execute()
+	{
+		UTIL_Remove( m_hEntity.Get() );
+	}
+
+private:
+	EHANDLE		m_hEntity;
+};
+
+class CParallelThinkSimThinkCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkSimThinkCommand( CBaseEntity *pEntity ) : m_hEntity( pEntity ) {}
+
+	virtual void Execute()
+	{
+		if ( m_hEntity.Get() )
+		{
+			SimThink_EntityChanged( m_hEntity.Get() );
+		}
+	}
+
+private:
+	EHANDLE		m_hEntity;
+};
+
+class CParallelThinkSoundCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkSoundCommand( CBaseEntity *pEntity, const char *pszSoundName, float flSoundTime, bool bStop ) :
+		m_hEntity( pEntity ), m_flSoundTime( flSoundTime ), m_bStop( bStop )
+	{
+		Q_strncpy( m_szSoundName, pszSoundName, sizeof( m_szSoundName ) );
+	}
+
+	virtual void Execute()
+	{
+		CBaseEntity *pEntity = m_hEntity.Get();
+		if ( !pEntity )
+			return;
+
+		if ( m_bStop )
+		{
+			pEntity->StopSound( m_szSoundName );
+		}
+		else
+		{
+			pEntity->EmitSound( m_szSoundName, m_flSoundTime );
+		}
+	}
+
+private:
+	EHANDLE		m_hEntity;
+	char		m_szSoundName[MAX_PATH];
+	float		m_flSoundTime;
+	bool		m_bStop;
+};
+
+class CParallelThinkAmbientSoundCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkAmbientSoundCommand( int iEntIndex, const Vector &vecOrigin, const char *pszSample, float flVolume, soundlevel_t soundlevel, int fFlags, int iPitch, float flSoundTime ) :
+		m_iEntIndex( iEntIndex ), m_vecOrigin( vecOrigin ), m_flVolume( flVolume ), m_SoundLevel( soundlevel ),
+		m_fFlags( fFlags ), m_iPitch( iPitch ), m_flSoundTime( flSoundTime )
+	{
+		Q_strncpy( m_szSample, pszSample, sizeof( m_szSample ) );
+	}
+
+	virtual void Execute()
+	{
+		UTIL_EmitAmbientSound( m_iEntIndex, m_vecOrigin, m_szSample, m_flVolume, m_SoundLevel, m_fFlags, m_iPitch, m_flSoundTime );
+	}
+
+private:
+	int				m_iEntIndex;
+	Vector			m_vecOrigin;
+	char			m_szSample[MAX_PATH];
+	float			m_flVolume;
+	soundlevel_t	m_SoundLevel;
+	int				m_fFlags;
+	int				m_iPitch;
+	float			m_flSoundTime;
+};
+
+//-----------------------------------------------------------------------------
+// Filtered EmitSound: the caller's filter and params live on its stack, so
+// copy the recipients and everything the params point at.
+//-----------------------------------------------------------------------------
+class CParallelThinkFilteredSoundCommand : public IParallelThinkCommand
+{
+public:
+	CParallelThinkFilteredSoundCommand( IRecipientFilter &filter, int iEntIndex, const EmitSound_t &params ) :
+		m_iEntIndex( iEntIndex )
+	{
+		for ( int i = 0; i < filter.GetRecipientCount(); i++ )
+		{
+			CBasePlayer *pPlayer = UTIL_PlayerByIndex( filter.GetRecipientIndex( i ) );
+			if ( pPlayer )
+			{
+				m_Filter.AddRecipient( pPlayer );
+			}
+		}
+		if ( filter.IsReliable() )
+		{
+			m_Filter.MakeReliable();
+		}
+
+		// EmitSound_t can't be copied as a whole (its origin vector isn't copyable)
+		m_Params.m_nChannel = params.m_nChannel;
+		m_Params.m_flVolume = params.m_flVolume;
+		m_Params.m_SoundLevel = params.m_SoundLevel;
+		m_Params.m_nFlags = params.m_nFlags;
+		m_Params.m_nPitch = params.m_nPitch;
+		m_Params.m_nSpecialDSP = params.m_nSpecialDSP;
+		m_Params.m_flSoundTime = params.m_flSoundTime;
+		m_Params.m_bEmitCloseCaption = params.m_bEmitCloseCaption;
+		m_Params.m_bWarnOnMissingCloseCaption = params.m_bWarnOnMissingCloseCaption;
+		m_Params.m_bWarnOnDirectWaveReference = params.m_bWarnOnDirectWaveReference;
+		m_Params.m_nSpeakerEntity = params.m_nSpeakerEntity;
+
+		m_szSoundName[0] = 0;
+		if ( params.m_pSoundName )
+		{
+			Q_strncpy( m_szSoundName, params.m_pSoundName, sizeof( m_szSoundName ) );
+		}
+		m_Params.m_pSoundName = m_szSoundName;
+
+		if ( params.m_pOrigin )
+		{
+			m_vecOrigin = *params.m_pOrigin;
+			m_Params.m_pOrigin = &m_vecOrigin;
+		}
+
+		// The caller's duration pointer won't be around when this runs, the caller filled it in already
+	}
+
+	virtual void Execute()
+	{
+		CBaseEntity::EmitSound( m_Filter, m_iEntIndex, m_Params );
+	}
+
+private:
+	CRecipientFilter	m_Filter;
+	int					m_iEntIndex;
+	EmitSound_t			m_Params;
+	char				m_szSoundName[MAX_PATH];
+	Vector				m_vecOrigin;
+};
+
+void ParallelThink_DeferCreate( const char *pszClassName, const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner )
+{
+	ParallelThink_Defer( new CParallelThinkCreateCommand( pszClassName, vecOrigin, vecAngles, pOwner ) );
+}
+
+void ParallelThink_DeferRemove( CBaseEntity *pEntity )
+{
+	ParallelThink_Defer( new CParallelThinkRemoveCommand( pEntity ) );
+}
+
+void ParallelThink_DeferSimThinkChanged( CBaseEntity *pEntity )
+{
+	ParallelThink_Defer( new CParallelThinkSimThinkCommand( pEntity ) );
+}
+
+void ParallelThink_DeferEmitSound( CBaseEntity *pEntity, const char *pszSoundName, float flSoundTime )
+{
+	ParallelThink_Defer( new CParallelThinkSoundCommand( pEntity, pszSoundName, flSoundTime, false ) );
+}
+
+void ParallelThink_DeferStopSound( CBaseEntity *pEntity, const char *pszSoundName )
+{
+	ParallelThink_Defer( new CParallelThinkSoundCommand( pEntity, pszSoundName, 0.0f, true ) );
+}
+
+void ParallelThink_DeferEmitAmbientSound( int iEntIndex, const Vector &vecOrigin, const char *pszSample, float flVolume, soundlevel_t soundlevel, int fFlags, int iPitch, float flSoundTime )
+{
+	ParallelThink_Defer( new CParallelThinkAmbientSoundCommand( iEntIndex, vecOrigin, pszSample, flVolume, soundlevel, fFlags, iPitch, flSoundTime ) );
+}
+
+void ParallelThink_DeferEmitSoundFiltered( IRecipientFilter &filter, int iEntIndex, const EmitSound_t &params )
+{
+	ParallelThink_Defer( new CParallelThinkFilteredSoundCommand( filter, iEntIndex, params ) );
+}
+
+void ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp, unsigned short offset )
+{
+	ParallelThinkJob_t *pJob = GETLOCAL( s_pCurrentJob );
+	Assert( pJob );
+	if ( !pJob )
+	{
+		pProp->NetworkStateChanged( offset );
+		return;
+	}
+
+	int i = pJob->m_StateChanges.AddToTail();
+	pJob->m_StateChanges[i].m_pProp = pProp;
+	pJob->m_StateChanges[i].m_nOffset = offset;
+}
+
+//-----------------------------------------------------------------------------
+// Job callbacks
+//-----------------------------------------------------------------------------
+static void PreParallelThink()
+{
+	mdlcache->BeginLock();
+}
+
+static void PostParallelThink()
+{
+	mdlcache->EndLock();
+}
+
+static void RunParallelThink( ParallelThinkJob_t &job )
+{
+	s_pCurrentJob = &job;
+	job.m_pEntity->PhysicsSimulate();
+	s_pCurrentJob = NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Can this entity's turn in Physics_SimulateEntity be run as a job?
+//-----------------------------------------------------------------------------
+static bool CanThinkInParallel( CBaseEntity *pEntity )
+{
+	if ( !pEntity || !pEntity->IsThinkThreadSafe() || !pEntity->edict() )
+		return false;
+
+	// Only plain thinkers: anything that moves, follows a parent or is driven by a player goes serial
+	if ( !pEntity->IsEFlagSet( EFL_NO_GAME_PHYSICS_SIMULATION ) || pEntity->IsPlayerSimulated() )
+		return false;
+
+#if !defined( NO_ENTITY_PREDICTION )
+	// Physics_SimulateEntity suppresses host events to the owner of predicted entities. That
+	// filter is a single global, so these can't be simulated side by side; leave them serial.
+	if ( pEntity->m_PredictableID->IsActive() )
+		return false;
+#endif
+
+	return ( pEntity->GetMoveType() == MOVETYPE_NONE && !pEntity->GetMoveParent() );
+}
+
+int ParallelThink_Run( CBaseEntity **pList, int nCount, bool *pbRanJobs )
+{
+	if ( pbRanJobs )
+	{
+		*pbRanJobs = false;
+	}
+
+	if ( !sv_parallel_think.GetBool() )
+		return nCount;
+
+	VPROF_BUDGET( "ParallelThink_Run", VPROF_BUDGETGROUP_GAME );
+
+	int nParallel = 0;
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( CanThinkInParallel( pList[i] ) )
+		{
+			nParallel++;
+		}
+	}
+
+	if ( nParallel < MAX( sv_parallel_think_min_entities.GetInt(), 1 ) )
+		return nCount;
+
+	// Pull the thread safe entities out of the list, keeping the relative order of both halves
+	s_ParallelThinkJobs.EnsureCount( nParallel );
+	int nSerial = 0;
+	int nJob = 0;
+	for ( int i = 0; i < nCount; i++ )
+	{
+		if ( CanThinkInParallel( pList[i] ) )
+		{
+			ParallelThinkJob_t &job = s_ParallelThinkJobs[nJob++];
+			job.m_pEntity = pList[i];
+			job.m_StateChanges.RemoveAll();
+			job.m_Commands.RemoveAll();
+		}
+		else
+		{
+			pList[nSerial++] = pList[i];
+		}
+	}
+
+	{
+		VPROF( "ParallelThink_Run - jobs" );
+		g_bParallelThinkActive = true;
+		ParallelProcess( "ParallelThink_Run", s_ParallelThinkJobs.Base(), nParallel, &RunParallelThink, &PreParallelThink, &PostParallelThink );
+		g_bParallelThinkActive = false;
+	}
+
+	if ( pbRanJobs )
+	{
+		*pbRanJobs = true;
+	}
+
+	// Replay everything in the order the serial pass would have produced it
+	{
+		VPROF( "ParallelThink_Run - replay" );
+		for ( int i = 0; i < nParallel; i++ )
+		{
+			ParallelThinkJob_t &job = s_ParallelThinkJobs[i];
+			for ( int j = 0; j < job.m_StateChanges.Count(); j++ )
+			{
+				job.m_StateChanges[j].m_pProp->NetworkStateChanged( job.m_StateChanges[j].m_nOffset );
+			}
+
+			for ( int j = 0; j < job.m_Commands.Count(); j++ )
+			{
+				job.m_Commands[j]->Execute();
+				delete job.m_Commands[j];
+			}
+			job.m_StateChanges.RemoveAll();
+			job.m_Commands.RemoveAll();
+		}
+	}
+
+	VPROF_INCREMENT_COUNTER( "ParallelThink entities", nParallel );
+	return nSerial;
+}
+
+//-----------------------------------------------------------------------------
+// Serial vs parallel think frame times
+//-----------------------------------------------------------------------------
+struct ParallelThinkTiming_t
+{
+	double	m_flTotal;
+	float	m_flPeak;
+	int		m_nFrames;
+};
+
+static ParallelThinkTiming_t s_ThinkTiming[2];	// [0] serial, [1] parallel
+
+void ParallelThink_RecordFrameTime( float flSeconds, bool bParallel )
+{
+	ParallelThinkTiming_t &timing = s_ThinkTiming[bParallel ? 1 : 0];
+	timing.m_flTotal += flSeconds;
+	timing.m_flPeak = MAX( timing.m_flPeak, flSeconds );
+	timing.m_nFrames++;
+}
+
+CON_COMMAND( sv_parallel_think_report, "Compare Physics_RunThinkFunctions frame times of frames that ran think jobs and frames that didn't. Pass 'reset' to clear." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		memset( s_ThinkTiming, 0, sizeof( s_ThinkTiming ) );
+		return;
+	}
+
+	static const char *s_pModeNames[] = { "serial", "parallel" };
+	float flAverage[2];
+	for ( int i = 0; i < 2; i++ )
+	{
+		const ParallelThinkTiming_t &timing = s_ThinkTiming[i];
+		flAverage[i] = timing.m_nFrames ? ( timing.m_flTotal / timing.m_nFrames ) * 1000.0f : 0.0f;
+		Msg( "%-8s : %6d frames, avg %7.3f ms, peak %7.3f ms\n", s_pModeNames[i], timing.m_nFrames, flAverage[i], timing.m_flPeak * 1000.0f );
+	}
+
+	if ( flAverage[0] > 0.0f && flAverage[1] > 0.0f )
+	{
+		Msg( "speedup  : %.2fx\n", flAverage[0] / flAverage[1] );
+	}
+}
@@ -0,0 +1,70 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Runs the thinks of entities that declare themselves thread safe as
+//			jobs before the regular serial think pass.
+//
+//			While a parallel think is running, anything that touches shared
+//			state (entity creation and removal, the I/O event queue, sounds,
+//			sim/think list updates, per-offset network state changes) is
+//			recorded into a command buffer owned by the thinking entity.  The
+//			buffers are replayed on the main thread in sim/think list order once
+//			all jobs are done, so the result doesn't depend on job scheduling.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef PARALLEL_THINK_H
+#define PARALLEL_THINK_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+class CBaseEntity;
+class CServerNetworkProperty;
+class IRecipientFilter;
+struct EmitSound_t;
+
+//-----------------------------------------------------------------------------
+// A side effect recorded during a parallel think, executed on the main thread
+//-----------------------------------------------------------------------------
+abstract_class IParallelThinkCommand
+{
+public:
+	virtual ~IParallelThinkCommand() {}
+	virtual void Execute() = 0;
+};
+
+// Set while jobs are running, checked before the (slower) thread local test
+extern bool g_bParallelThinkActive;
+
+// Is the current thread running a parallel think whose side effects must be deferred?
+bool ParallelThink_IsDeferring();
+inline bool ParallelThink_ShouldDefer()
+{
+	return g_bParallelThinkActive && ParallelThink_IsDeferring();
+}
+
+// Takes ownership of pCommand and runs it on the main thread after the parallel phase
+void ParallelThink_Defer( IParallelThinkCommand *pCommand );
+
+// Deferred versions of the shared-state operations, for use from thread safe thinks.
+// The regular entry points (UTIL_Remove, CBaseEntity::EmitSound, g_EventQueue.AddEvent...)
+// route here automatically while deferring.
+void ParallelThink_DeferCreate( const char *pszClassName, const Vector &vecOrigin, const QAngle &vecAngles, CBaseEntity *pOwner = NULL );
+void ParallelThink_DeferRemove( CBaseEntity *pEntity );
+void ParallelThink_DeferSimThinkChanged( CBaseEntity *pEntity );
+void ParallelThink_DeferStateChanged( CServerNetworkProperty *pProp, unsigned short offset );
+void ParallelThink_DeferEmitSound( CBaseEntity *pEntity, const char *pszSoundName, float flSoundTime );
+void ParallelThink_DeferStopSound( CBaseEntity *pEntity, const char *pszSoundName );
+void ParallelThink_DeferEmitAmbientSound( int iEntIndex, const Vector &vecOrigin, const char *pszSample, float flVolume, soundlevel_t soundlevel, int fFlags, int iPitch, float flSoundTime );
+void ParallelThink_DeferEmitSoundFiltered( IRecipientFilter &filter, int iEntIndex, const EmitSound_t &params );
+
+// Runs the thread safe thinks in pList as jobs and removes them from the list.
+// Returns the number of entities left for the serial pass; their order is preserved.
+// pbRanJobs is set to whether any jobs actually ran this frame.
+int ParallelThink_Run( CBaseEntity **pList, int nCount, bool *pbRanJobs = NULL );
+
+// Records the time spent in Physics_RunThinkFunctions for sv_parallel_think_report
+void ParallelThink_RecordFrameTime( float flSeconds, bool bParallel );
+
+#endif // PARALLEL_THINK_H
@@ -28,6 +28,7 @@ public:
 	virtual void Spawn( void );
 	virtual void Activate( void );
 	virtual int  UpdateTransmitState(void);
+	virtual bool IsThinkThreadSafe() const { return true; }
 
 	void		StartParticleSystem( void );
 	void		StopParticleSystem( void );
@@ -33,6 +33,7 @@
 #include "vphysicsupdateai.h"
 #include "tier0/vcrmode.h"
 #include "pushentity.h"
+#include "parallel_think.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -2058,7 +2059,14 @@ void Physics_RunThinkFunctions( bool simulating )
 		
 		// UNDONE: This has problems with UTIL_RemoveImmediate() (now disabled during this loop).  
 		// Do we really need UTIL_RemoveImmediate()?
-		int count = SimThink_ListCopy( list, listMax );
+		int count = SimThink_ListCopyScheduled( list, listMax );
+
+		double flStartTime = Plat_FloatTime();
+		bool bParallel;
+
+		// thread safe thinkers run as jobs first and drop out of the list
+		count = ParallelThink_Run( list, count, &bParallel );
+		gpGlobals->curtime = starttime;
 
 		//DevMsg(1, "Count: %d\n", count );
 		for ( int i = 0; i < count; i++ )
@@ -2070,6 +2078,8 @@ void Physics_RunThinkFunctions( bool simulating )
 			Physics_SimulateEntity( list[i] );
 		}
 
+		ParallelThink_RecordFrameTime( Plat_FloatTime() - flStartTime, bParallel );
+
 		stackfree( list );
 		UTIL_EnableRemoveImmediate();
 	}
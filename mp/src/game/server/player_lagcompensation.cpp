@@ -12,6 +12,8 @@
 #include "inetchannelinfo.h"
 #include "utllinkedlist.h"
 #include "BaseAnimatingOverlay.h"
+#include "ai_basenpc.h"
+#include "mathlib/ssemath.h"
 #include "tier0/vprof.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -25,6 +27,8 @@
 #define LC_SIZE_CHANGED		(1<<10)
 #define LC_ANIMATION_CHANGED (1<<11)
 
+extern ConVar sv_threaded_bone_setup;
+
 static ConVar sv_lagcompensation_teleport_dist( "sv_lagcompensation_teleport_dist", "64", FCVAR_DEVELOPMENTONLY | FCVAR_CHEAT, "How far a player got moved by game code before we can't lag compensate their position back" );
 #define LAG_COMPENSATION_EPS_SQR ( 0.1f * 0.1f )
 // Allow 4 units of error ( about 1 / 8 bbox width )
@@ -37,6 +41,12 @@ ConVar sv_showlagcompensation( "sv_showlagcompensation", "0", FCVAR_CHEAT, "Show
 
 ConVar sv_unlag_fixstuck( "sv_unlag_fixstuck", "0", FCVAR_DEVELOPMENTONLY, "Disallow backtracking a player for lag compensation if it will cause them to become stuck" );
 
+ConVar sv_unlag_npcs( "sv_unlag_npcs", "0", 0, "Lag compensate NPCs as well as players" );
+
+ConVar sv_unlag_cull( "sv_unlag_cull", "0", FCVAR_DEVELOPMENTONLY, "Only backtrack entities whose lag compensated bounds are near the shot ray. Off by default, sv_unlag_cull_angle must cover the widest weapon spread and shotgun pellets in the mod" );
+ConVar sv_unlag_cull_angle( "sv_unlag_cull_angle", "10", FCVAR_DEVELOPMENTONLY, "Half angle (degrees) of the cone around the shot ray used by sv_unlag_cull and to pick which hitbox bones sv_threaded_bone_setup poses up front, should cover weapon spread" );
+ConVar sv_unlag_cull_bloat( "sv_unlag_cull_bloat", "24", FCVAR_DEVELOPMENTONLY, "Extra radius added to the lag compensated bounds by the shot cone test, covers hitboxes outside the collision bounds" );
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -123,21 +133,30 @@ public:
 ConVar sv_unlag_debug( "sv_unlag_debug", "0", FCVAR_GAMEDLL | FCVAR_DEVELOPMENTONLY );
 
 float g_flFractionScale = 0.95;
-static void RestorePlayerTo( CBasePlayer *pPlayer, const Vector &vWantedPos )
+static void RestoreEntityTo( CBaseAnimatingOverlay *pEntity, const Vector &vWantedPos )
 {
 	// Try to move to the wanted position from our current position.
 	trace_t tr;
 	VPROF_BUDGET( "RestorePlayerTo", "CLagCompensationManager" );
-	UTIL_TraceEntity( pPlayer, vWantedPos, vWantedPos, MASK_PLAYERSOLID, pPlayer, COLLISION_GROUP_PLAYER_MOVEMENT, &tr );
+
+	unsigned int mask = MASK_PLAYERSOLID;
+	int collisionGroup = COLLISION_GROUP_PLAYER_MOVEMENT;
+	if ( !pEntity->IsPlayer() )
+	{
+		mask = pEntity->PhysicsSolidMaskForEntity();
+		collisionGroup = pEntity->GetCollisionGroup();
+	}
+
+	UTIL_TraceEntity( pEntity, vWantedPos, vWantedPos, mask, pEntity, collisionGroup, &tr );
 	if ( tr.startsolid || tr.allsolid )
 	{
 		if ( sv_unlag_debug.GetBool() )
 		{
 			DevMsg( "RestorePlayerTo() could not restore player position for client \"%s\" ( %.1f %.1f %.1f )\n",
-					pPlayer->GetPlayerName(), vWantedPos.x, vWantedPos.y, vWantedPos.z );
+					pEntity->GetDebugName(), vWantedPos.x, vWantedPos.y, vWantedPos.z );
 		}
 
-		UTIL_TraceEntity( pPlayer, pPlayer->GetLocalOrigin(), vWantedPos, MASK_PLAYERSOLID, pPlayer, COLLISION_GROUP_PLAYER_MOVEMENT, &tr );
+		UTIL_TraceEntity( pEntity, pEntity->GetLocalOrigin(), vWantedPos, mask, pEntity, collisionGroup, &tr );
 		if ( tr.startsolid || tr.allsolid )
 		{
 			// In this case, the guy got stuck back wherever we lag compensated him to. Nasty.
@@ -149,8 +168,8 @@ static void RestorePlayerTo( CBasePlayer *pPlayer, const Vector &vWantedPos )
 		{
 			// We can get to a valid place, but not all the way back to where we were.
 			Vector vPos;
-			VectorLerp( pPlayer->GetLocalOrigin(), vWantedPos, tr.fraction * g_flFractionScale, vPos );
-			UTIL_SetOrigin( pPlayer, vPos, true );
+			VectorLerp( pEntity->GetLocalOrigin(), vWantedPos, tr.fraction * g_flFractionScale, vPos );
+			UTIL_SetOrigin( pEntity, vPos, true );
 
 			if ( sv_unlag_debug.GetBool() )
 				DevMsg( " restore got most of the way\n" );
@@ -159,11 +178,161 @@ static void RestorePlayerTo( CBasePlayer *pPlayer, const Vector &vWantedPos )
 	else
 	{
 		// Cool, the player can go back to whence he came.
-		UTIL_SetOrigin( pPlayer, tr.endpos, true );
+		UTIL_SetOrigin( pEntity, tr.endpos, true );
 	}
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Fixed size history of lag records for one entity.
+//			Depth 0 is the newest record.  Simulation times are kept in their
+//			own array so the binary search in FindRecord stays in a few cache
+//			lines, the (large) records are only touched once we know which
+//			ones we want.
+//-----------------------------------------------------------------------------
+#define LAG_TRACK_SIZE		128		// power of two; covers sv_maxunlag 1.0 up to 128 tick
+#define LAG_TRACK_MASK		( LAG_TRACK_SIZE - 1 )
+
+class ALIGN16 CLagCompensationTrack
+{
+public:
+	CLagCompensationTrack()
+	{
+		Purge();
+	}
+
+	void Purge()
+	{
+		m_nHead = LAG_TRACK_MASK;
+		m_nCount = 0;
+		m_nValidDepth = 0;
+		m_flValidDistSqr = -1.0f;
+		m_nLastUpdateTick = -1;
+		m_hEntity = NULL;
+	}
+
+	int Count() const								{ return m_nCount; }
+	int Slot( int depth ) const						{ return ( m_nHead - depth ) & LAG_TRACK_MASK; }
+	LagRecord &RecordAt( int depth )				{ return m_Records[ Slot( depth ) ]; }
+	float SimulationTimeAt( int depth ) const		{ return m_flSimulationTimes[ Slot( depth ) ]; }
+
+	// Drops the oldest record when the track is full
+	LagRecord &AddToHead( float flSimulationTime, const Vector &vecOrigin, bool bAlive )
+	{
+		float flDistSqr = 0.0f;
+		if ( m_nCount > 0 )
+		{
+			flDistSqr = ( RecordAt( 0 ).m_vecOrigin - vecOrigin ).Length2DSqr();
+		}
+
+		m_nHead = ( m_nHead + 1 ) & LAG_TRACK_MASK;
+		m_nCount = MIN( m_nCount + 1, LAG_TRACK_SIZE );
+		m_flSimulationTimes[ m_nHead ] = flSimulationTime;
+		m_flDistSqrToNewer[ m_nHead ] = 0.0f;
+		if ( m_nCount > 1 )
+		{
+			m_flDistSqrToNewer[ Slot( 1 ) ] = flDistSqr;
+		}
+		m_bAlive[ m_nHead ] = bAlive;
+
+		// Extend the run of usable records from the head
+		if ( !bAlive )
+		{
+			m_nValidDepth = 0;
+		}
+		else if ( m_nCount > 1 && flDistSqr > m_flValidDistSqr )
+		{
+			m_nValidDepth = 1;
+		}
+		else
+		{
+			m_nValidDepth = MIN( m_nValidDepth + 1, m_nCount );
+		}
+
+		return m_Records[ m_nHead ];
+	}
+
+	void RemoveTail()
+	{
+		Assert( m_nCount > 0 );
+		m_nCount--;
+		m_nValidDepth = MIN( m_nValidDepth, m_nCount );
+	}
+
+	// Number of records from the head that are alive and don't teleport relative to the record after them
+	int ValidDepth( float flTeleportDistanceSqr )
+	{
+		if ( flTeleportDistanceSqr != m_flValidDistSqr )
+		{
+			// sv_lagcompensation_teleport_dist changed, rescan
+			m_flValidDistSqr = flTeleportDistanceSqr;
+			m_nValidDepth = 0;
+			while ( m_nValidDepth < m_nCount )
+			{
+				int slot = Slot( m_nValidDepth );
+				if ( !m_bAlive[ slot ] || ( m_nValidDepth > 0 && m_flDistSqrToNewer[ slot ] > flTeleportDistanceSqr ) )
+					break;
+				m_nValidDepth++;
+			}
+		}
+		return m_nValidDepth;
+	}
+
+	// Depth of the newest record at or before flTargetTime, or the oldest record if they're all newer
+	int FindRecord( float flTargetTime ) const
+	{
+		int lo = 0;
+		int hi = m_nCount - 1;
+		while ( lo < hi )
+		{
+			int mid = ( lo + hi ) >> 1;
+			if ( SimulationTimeAt( mid ) <= flTargetTime )
+			{
+				hi = mid;
+			}
+			else
+			{
+				lo = mid + 1;
+			}
+		}
+		return lo;
+	}
+
+	// hot data first
+	float					m_flSimulationTimes[ LAG_TRACK_SIZE ];
+	float					m_flDistSqrToNewer[ LAG_TRACK_SIZE ];	// 2D distance to the next newer record
+	bool					m_bAlive[ LAG_TRACK_SIZE ];
+	int						m_nHead;
+	int						m_nCount;
+	int						m_nValidDepth;
+	float					m_flValidDistSqr;
+	int						m_nLastUpdateTick;
+	EHANDLE					m_hEntity;
+
+	LagRecord				m_Records[ LAG_TRACK_SIZE ];
+
+	LagRecord				m_RestoreData;	// entity data before we moved him back
+	LagRecord				m_ChangeData;	// entity data where we moved him back
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Where an entity would be moved back to, worked out before anything is touched
+//-----------------------------------------------------------------------------
+struct LagCompensationTarget_t
+{
+	CBaseAnimatingOverlay	*m_pEntity;
+	CLagCompensationTrack	*m_pTrack;
+	LagRecord				*m_pRecord;
+	LagRecord				*m_pPrevRecord;
+	float					m_flFrac;
+	Vector					m_vecOrigin;
+	QAngle					m_vecAngles;
+	Vector					m_vecMinsPreScaled;
+	Vector					m_vecMaxsPreScaled;
+	bool					m_bNearShotRay;		// rewound bounds are within the cone around the shot
+};
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 //-----------------------------------------------------------------------------
@@ -173,6 +342,9 @@ public:
 	CLagCompensationManager( char const *name ) : CAutoGameSystemPerFrame( name ), m_flTeleportDistanceSqr( 64 *64 )
 	{
 		m_isCurrentlyDoingCompensation = false;
+		m_pCurrentPlayer = NULL;
+		m_bNeedToRestore = false;
+		Q_memset( m_pTracks, 0, sizeof( m_pTracks ) );
 	}
 
 	// IServerSystem stuff
@@ -198,23 +370,40 @@ public:
 	bool			IsCurrentlyDoingLagCompensation() const OVERRIDE { return m_isCurrentlyDoingCompensation; }
 
 private:
-	void			BacktrackPlayer( CBasePlayer *player, float flTargetTime );
+	void			RecordEntity( CBaseAnimatingOverlay *pEntity, float flDeadtime );
+	bool			FindBacktrackTarget( CBaseAnimatingOverlay *pEntity, float flTargetTime, LagCompensationTarget_t &target );
+	int				MarkTargetsNearShotRay( CBasePlayer *player, CUserCmd *cmd );
+	void			BacktrackEntity( LagCompensationTarget_t &target, float flTargetTime );
+	void			RestoreEntity( CBaseAnimatingOverlay *pEntity, CLagCompensationTrack *pTrack );
+
+	CLagCompensationTrack *FindTrack( CBaseEntity *pEntity )
+	{
+		CLagCompensationTrack *pTrack = m_pTracks[ pEntity->entindex() ];
+		return ( pTrack && pTrack->m_hEntity == pEntity ) ? pTrack : NULL;
+	}
+
+	CLagCompensationTrack *FindOrCreateTrack( CBaseEntity *pEntity );
+	void			FreeTrack( int iEntIndex );
 
 	void ClearHistory()
 	{
-		for ( int i=0; i<MAX_PLAYERS; i++ )
-			m_PlayerTrack[i].Purge();
+		while ( m_ActiveTracks.Count() )
+		{
+			FreeTrack( m_ActiveTracks.Tail() );
+		}
 	}
 
-	// keep a list of lag records for each player
-	CUtlFixedLinkedList< LagRecord >	m_PlayerTrack[ MAX_PLAYERS ];
+	// lag records for each compensated entity, indexed by entindex and allocated on demand
+	CLagCompensationTrack	*m_pTracks[ MAX_EDICTS ];
+	CUtlVector< int >		m_ActiveTracks;
 
 	// Scratchpad for determining what needs to be restored
-	CBitVec<MAX_PLAYERS>	m_RestorePlayer;
+	CBitVec<MAX_EDICTS>		m_RestoreEntity;
+	CUtlVector< int >		m_RestoreList;
 	bool					m_bNeedToRestore;
-	
-	LagRecord				m_RestoreData[ MAX_PLAYERS ];	// player data before we moved him back
-	LagRecord				m_ChangeData[ MAX_PLAYERS ];	// player data where we moved him back
+
+	// Entities we want to move back this command, before and after culling
+	CUtlVector< LagCompensationTarget_t >	m_Targets;
 
 	CBasePlayer				*m_pCurrentPlayer;	// The player we are doing lag compensation for
 
@@ -227,6 +416,41 @@ static CLagCompensationManager g_LagCompensationManager( "CLagCompensationManage
 ILagCompensationManager *lagcompensation = &g_LagCompensationManager;
 
 
+CLagCompensationTrack *CLagCompensationManager::FindOrCreateTrack( CBaseEntity *pEntity )
+{
+	int iEntIndex = pEntity->entindex();
+	CLagCompensationTrack *pTrack = m_pTracks[ iEntIndex ];
+	if ( !pTrack )
+	{
+		MEM_ALLOC_CREDIT();
+		pTrack = (CLagCompensationTrack *)MemAlloc_AllocAligned( sizeof( CLagCompensationTrack ), 64 );
+		Construct( pTrack );
+		m_pTracks[ iEntIndex ] = pTrack;
+		m_ActiveTracks.AddToTail( iEntIndex );
+	}
+	else if ( pTrack->m_hEntity != pEntity )
+	{
+		// edict was reused, history belongs to someone else
+		pTrack->Purge();
+	}
+
+	pTrack->m_hEntity = pEntity;
+	return pTrack;
+}
+
+void CLagCompensationManager::FreeTrack( int iEntIndex )
+{
+	CLagCompensationTrack *pTrack = m_pTracks[ iEntIndex ];
+	if ( !pTrack )
+		return;
+
+	Destruct( pTrack );
+	MemAlloc_FreeAligned( pTrack );
+	m_pTracks[ iEntIndex ] = NULL;
+	m_ActiveTracks.FindAndFastRemove( iEntIndex );
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Called once per frame after all entities have had a chance to think
 //-----------------------------------------------------------------------------
@@ -243,85 +467,94 @@ void CLagCompensationManager::FrameUpdatePostEntityThink()
 	VPROF_BUDGET( "FrameUpdatePostEntityThink", "CLagCompensationManager" );
 
 	// remove all records before that time:
-	int flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
+	float flDeadtime = gpGlobals->curtime - sv_maxunlag.GetFloat();
 
 	// Iterate all active players
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
 	{
 		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
+		if ( pPlayer )
+		{
+			RecordEntity( pPlayer, flDeadtime );
+		}
+	}
 
-		CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[i-1];
-
-		if ( !pPlayer )
+	if ( sv_unlag_npcs.GetBool() )
+	{
+		CAI_BaseNPC **ppAIs = g_AI_Manager.AccessAIs();
+		for ( int i = 0; i < g_AI_Manager.NumAIs(); i++ )
 		{
-			if ( track->Count() > 0 )
+			CAI_BaseNPC *pNPC = ppAIs[i];
+			if ( pNPC && pNPC->edict() && !pNPC->IsMarkedForDeletion() )
 			{
-				track->RemoveAll();
+				RecordEntity( pNPC, flDeadtime );
 			}
+		}
+	}
 
-			continue;
+	// Drop the history of anything that went away or wasn't recorded this frame
+	for ( int i = m_ActiveTracks.Count() - 1; i >= 0; i-- )
+	{
+		int iEntIndex = m_ActiveTracks[i];
+		CLagCompensationTrack *pTrack = m_pTracks[ iEntIndex ];
+		if ( !pTrack->m_hEntity.Get() || pTrack->m_nLastUpdateTick != gpGlobals->tickcount )
+		{
+			FreeTrack( iEntIndex );
 		}
+	}
 
-		Assert( track->Count() < 1000 ); // insanity check
+	//Clear the current player.
+	m_pCurrentPlayer = NULL;
+}
 
-		// remove tail records that are too old
-		int tailIndex = track->Tail();
-		while ( track->IsValidIndex( tailIndex ) )
-		{
-			LagRecord &tail = track->Element( tailIndex );
+void CLagCompensationManager::RecordEntity( CBaseAnimatingOverlay *pEntity, float flDeadtime )
+{
+	CLagCompensationTrack *track = FindOrCreateTrack( pEntity );
+	track->m_nLastUpdateTick = gpGlobals->tickcount;
 
-			// if tail is within limits, stop
-			if ( tail.m_flSimulationTime >= flDeadtime )
-				break;
-			
-			// remove tail, get new tail
-			track->Remove( tailIndex );
-			tailIndex = track->Tail();
-		}
+	// remove tail records that are too old
+	while ( track->Count() > 0 && track->SimulationTimeAt( track->Count() - 1 ) < flDeadtime )
+	{
+		track->RemoveTail();
+	}
 
-		// check if head has same simulation time
-		if ( track->Count() > 0 )
-		{
-			LagRecord &head = track->Element( track->Head() );
+	// check if entity changed simulation time since last time updated
+	if ( track->Count() > 0 && track->SimulationTimeAt( 0 ) >= pEntity->GetSimulationTime() )
+		return; // don't add new entry for same or older time
 
-			// check if player changed simulation time since last time updated
-			if ( head.m_flSimulationTime >= pPlayer->GetSimulationTime() )
-				continue; // don't add new entry for same or older time
-		}
+	// add new record to track, overwrites the oldest one if we've got more ticks than sv_maxunlag should allow
+	bool bAlive = pEntity->IsAlive();
+	LagRecord &record = track->AddToHead( pEntity->GetSimulationTime(), pEntity->GetLocalOrigin(), bAlive );
 
-		// add new record to player track
-		LagRecord &record = track->Element( track->AddToHead() );
+	// make sure the run of valid records uses the current teleport distance
+	track->ValidDepth( m_flTeleportDistanceSqr );
 
-		record.m_fFlags = 0;
-		if ( pPlayer->IsAlive() )
-		{
-			record.m_fFlags |= LC_ALIVE;
-		}
+	record.m_fFlags = 0;
+	if ( bAlive )
+	{
+		record.m_fFlags |= LC_ALIVE;
+	}
 
-		record.m_flSimulationTime	= pPlayer->GetSimulationTime();
-		record.m_vecAngles			= pPlayer->GetLocalAngles();
-		record.m_vecOrigin			= pPlayer->GetLocalOrigin();
-		record.m_vecMinsPreScaled	= pPlayer->CollisionProp()->OBBMinsPreScaled();
-		record.m_vecMaxsPreScaled	= pPlayer->CollisionProp()->OBBMaxsPreScaled();
+	record.m_flSimulationTime	= pEntity->GetSimulationTime();
+	record.m_vecAngles			= pEntity->GetLocalAngles();
+	record.m_vecOrigin			= pEntity->GetLocalOrigin();
+	record.m_vecMinsPreScaled	= pEntity->CollisionProp()->OBBMinsPreScaled();
+	record.m_vecMaxsPreScaled	= pEntity->CollisionProp()->OBBMaxsPreScaled();
 
-		int layerCount = pPlayer->GetNumAnimOverlays();
-		for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+	int layerCount = pEntity->GetNumAnimOverlays();
+	for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+	{
+		CAnimationLayer *currentLayer = pEntity->GetAnimOverlay(layerIndex);
+		if( currentLayer )
 		{
-			CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
-			if( currentLayer )
-			{
-				record.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
-				record.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
-				record.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
-				record.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
-			}
+			record.m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
+			record.m_layerRecords[layerIndex].m_order = currentLayer->m_nOrder;
+			record.m_layerRecords[layerIndex].m_sequence = currentLayer->m_nSequence;
+			record.m_layerRecords[layerIndex].m_weight = currentLayer->m_flWeight;
 		}
-		record.m_masterSequence = pPlayer->GetSequence();
-		record.m_masterCycle = pPlayer->GetCycle();
 	}
-
-	//Clear the current player.
-	m_pCurrentPlayer = NULL;
+	record.m_masterSequence = pEntity->GetSequence();
+	record.m_masterCycle = pEntity->GetCycle();
 }
 
 // Called during player movement to set up/restore after lag compensation
@@ -338,8 +571,9 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		return;
 	}
 
-	// Assume no players need to be restored
-	m_RestorePlayer.ClearAll();
+	// Assume no entities need to be restored
+	m_RestoreEntity.ClearAll();
+	m_RestoreList.RemoveAll();
 	m_bNeedToRestore = false;
 
 	m_pCurrentPlayer = player;
@@ -354,8 +588,6 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 
 	// NOTE: Put this here so that it won't show up in single player mode.
 	VPROF_BUDGET( "StartLagCompensation", VPROF_BUDGETGROUP_OTHER_NETWORKING );
-	Q_memset( m_RestoreData, 0, sizeof( m_RestoreData ) );
-	Q_memset( m_ChangeData, 0, sizeof( m_ChangeData ) );
 
 	m_isCurrentlyDoingCompensation = true;
 
@@ -393,7 +625,10 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		// DevMsg("StartLagCompensation: delta too big (%.3f)\n", deltaTime );
 		targettick = gpGlobals->tickcount - TIME_TO_TICKS( correct );
 	}
-	
+
+	float flTargetTime = TICKS_TO_TIME( targettick );
+	m_Targets.RemoveAll();
+
 	// Iterate all active players
 	const CBitVec<MAX_EDICTS> *pEntityTransmitBits = engine->GetEntityTransmitBitsForClient( player->entindex() - 1 );
 	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
@@ -415,80 +650,122 @@ void CLagCompensationManager::StartLagCompensation( CBasePlayer *player, CUserCm
 		if ( !player->WantsLagCompensationOnEntity( pPlayer, cmd, pEntityTransmitBits ) )
 			continue;
 
-		// Move other player back in time
-		BacktrackPlayer( pPlayer, TICKS_TO_TIME( targettick ) );
+		LagCompensationTarget_t target;
+		if ( FindBacktrackTarget( pPlayer, flTargetTime, target ) )
+		{
+			m_Targets.AddToTail( target );
+		}
 	}
-}
-
-void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTargetTime )
-{
-	Vector org;
-	Vector minsPreScaled;
-	Vector maxsPreScaled;
-	QAngle ang;
-
-	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
-	int pl_index = pPlayer->entindex() - 1;
 
-	// get track history of this player
-	CUtlFixedLinkedList< LagRecord > *track = &m_PlayerTrack[ pl_index ];
-
-	// check if we have at leat one entry
-	if ( track->Count() <= 0 )
-		return;
+	// NPCs the player can see
+	if ( sv_unlag_npcs.GetBool() )
+	{
+		for ( int i = 0; i < m_ActiveTracks.Count(); i++ )
+		{
+			CLagCompensationTrack *pTrack = m_pTracks[ m_ActiveTracks[i] ];
+			CBaseEntity *pEntity = pTrack->m_hEntity;
+			if ( !pEntity || pEntity->IsPlayer() || !pEntity->IsAlive() )
+				continue;
 
-	int curr = track->Head();
+			if ( pEntityTransmitBits && !pEntityTransmitBits->Get( pEntity->entindex() ) )
+				continue;
 
-	LagRecord *prevRecord = NULL;
-	LagRecord *record = NULL;
+			LagCompensationTarget_t target;
+			if ( FindBacktrackTarget( assert_cast< CBaseAnimatingOverlay * >( pEntity ), flTargetTime, target ) )
+			{
+				m_Targets.AddToTail( target );
+			}
+		}
+	}
 
-	Vector prevOrg = pPlayer->GetLocalOrigin();
-	
-	// Walk context looking for any invalidating event
-	while( track->IsValidIndex(curr) )
+	// The cone test decides both what gets moved back (with sv_unlag_cull) and what
+	// gets its hitbox bones batched; without it every target stays a candidate.
+	bool bCull = sv_unlag_cull.GetBool();
+	bool bBatchBones = sv_threaded_bone_setup.GetBool();
+	if ( bCull || bBatchBones )
 	{
-		// remember last record
-		prevRecord = record;
+		int nNear = MarkTargetsNearShotRay( player, cmd );
 
-		// get next record
-		record = &track->Element( curr );
-
-		if ( !(record->m_fFlags & LC_ALIVE) )
+		// Don't move anything back that the shot can't hit
+		if ( bCull )
 		{
-			// player most be alive, lost track
-			return;
+			int nSurvivors = 0;
+			for ( int i = 0; i < m_Targets.Count(); i++ )
+			{
+				if ( m_Targets[i].m_bNearShotRay )
+				{
+					m_Targets[ nSurvivors++ ] = m_Targets[i];
+				}
+			}
+
+			VPROF_INCREMENT_COUNTER( "Lag compensation culled", m_Targets.Count() - nSurvivors );
+			Assert( nSurvivors == nNear );
+			m_Targets.SetCountNonDestructively( nSurvivors );
 		}
+	}
 
-		Vector delta = record->m_vecOrigin - prevOrg;
-		if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	// Move them back in time
+	CUtlVectorFixedGrowable< CBaseAnimating *, 64 > nearShot;
+	for ( int i = 0; i < m_Targets.Count(); i++ )
+	{
+		BacktrackEntity( m_Targets[i], flTargetTime );
+		if ( m_Targets[i].m_bNearShotRay && m_RestoreEntity.Get( m_Targets[i].m_pEntity->entindex() ) )
 		{
-			// lost track, too much difference
-			return; 
+			nearShot.AddToTail( m_Targets[i].m_pEntity );
 		}
+	}
 
-		// did we find a context smaller than target time ?
-		if ( record->m_flSimulationTime <= flTargetTime )
-			break; // hurra, stop
+	// Pose what the shot is likely to hit up front rather than one hitbox trace at a time.
+	// Anything outside the cone is left to the lazy SetupBones if a trace does reach it.
+	if ( bBatchBones )
+	{
+		CBaseAnimating::SetupHitboxBonesBatch( nearShot.Base(), nearShot.Count() );
+	}
+}
 
-		prevOrg = record->m_vecOrigin;
+//-----------------------------------------------------------------------------
+// Purpose: Works out where pEntity was at flTargetTime without moving it
+//-----------------------------------------------------------------------------
+bool CLagCompensationManager::FindBacktrackTarget( CBaseAnimatingOverlay *pEntity, float flTargetTime, LagCompensationTarget_t &target )
+{
+	VPROF_BUDGET( "FindBacktrackTarget", "CLagCompensationManager" );
 
-		// go one step back
-		curr = track->Next( curr );
-	}
+	// get track history of this entity
+	CLagCompensationTrack *track = FindTrack( pEntity );
 
-	Assert( record );
+	// check if we have at leat one entry
+	if ( !track || track->Count() <= 0 )
+		return false;
 
-	if ( !record )
-	{
-		if ( sv_unlag_debug.GetBool() )
-		{
-			DevMsg( "No valid positions in history for BacktrackPlayer client ( %s )\n", pPlayer->GetPlayerName() );
-		}
+	// The newest record has to be alive and close to where the entity is now
+	LagRecord *head = &track->RecordAt( 0 );
+	if ( !(head->m_fFlags & LC_ALIVE) )
+		return false;
 
-		return; // that should never happen
+	Vector delta = head->m_vecOrigin - pEntity->GetLocalOrigin();
+	if ( delta.Length2DSqr() > m_flTeleportDistanceSqr )
+	{
+		// lost track, too much difference
+		return false;
 	}
 
-	float frac = 0.0f;
+	// did we find a context smaller than target time ?
+	int depth = track->FindRecord( flTargetTime );
+
+	// every record up to and including that one must be alive and not teleport
+	if ( depth >= track->ValidDepth( m_flTeleportDistanceSqr ) )
+		return false;
+
+	LagRecord *record = &track->RecordAt( depth );
+	LagRecord *prevRecord = depth > 0 ? &track->RecordAt( depth - 1 ) : NULL;
+
+	target.m_pEntity = pEntity;
+	target.m_pTrack = track;
+	target.m_pRecord = record;
+	target.m_pPrevRecord = prevRecord;
+	target.m_flFrac = 0.0f;
+	target.m_bNearShotRay = true;
+
 	if ( prevRecord && 
 		 (record->m_flSimulationTime < flTargetTime) &&
 		 (record->m_flSimulationTime < prevRecord->m_flSimulationTime) )
@@ -500,62 +777,161 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 		Assert( flTargetTime < prevRecord->m_flSimulationTime );
 
 		// calc fraction between both records
-		frac = ( flTargetTime - record->m_flSimulationTime ) / 
+		float frac = ( flTargetTime - record->m_flSimulationTime ) / 
 			( prevRecord->m_flSimulationTime - record->m_flSimulationTime );
 
 		Assert( frac > 0 && frac < 1 ); // should never extrapolate
 
-		ang				= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
-		org				= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
-		minsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
-		maxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
+		target.m_flFrac				= frac;
+		target.m_vecAngles			= Lerp( frac, record->m_vecAngles, prevRecord->m_vecAngles );
+		target.m_vecOrigin			= Lerp( frac, record->m_vecOrigin, prevRecord->m_vecOrigin );
+		target.m_vecMinsPreScaled	= Lerp( frac, record->m_vecMinsPreScaled, prevRecord->m_vecMinsPreScaled );
+		target.m_vecMaxsPreScaled	= Lerp( frac, record->m_vecMaxsPreScaled, prevRecord->m_vecMaxsPreScaled );
 	}
 	else
 	{
 		// we found the exact record or no other record to interpolate with
 		// just copy these values since they are the best we have
-		org				= record->m_vecOrigin;
-		ang				= record->m_vecAngles;
-		minsPreScaled	= record->m_vecMinsPreScaled;
-		maxsPreScaled	= record->m_vecMaxsPreScaled;
+		target.m_vecOrigin			= record->m_vecOrigin;
+		target.m_vecAngles			= record->m_vecAngles;
+		target.m_vecMinsPreScaled	= record->m_vecMinsPreScaled;
+		target.m_vecMaxsPreScaled	= record->m_vecMaxsPreScaled;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Flags the targets whose rewound bounds can be reached by a shot fired
+//			from the player's eyes.  Targets are tested four at a time against
+//			a cone around the view direction, sv_unlag_cull_angle wide.
+//			Returns how many were flagged.
+//-----------------------------------------------------------------------------
+int CLagCompensationManager::MarkTargetsNearShotRay( CBasePlayer *player, CUserCmd *cmd )
+{
+	VPROF_BUDGET( "MarkTargetsNearShotRay", "CLagCompensationManager" );
+
+	int nTargets = m_Targets.Count();
+	if ( !nTargets )
+		return 0;
+
+	Vector vecForward;
+	AngleVectors( cmd->viewangles, &vecForward );
+
+	FourVectors vStart, vDir;
+	vStart.DuplicateVector( player->EyePosition() );
+	vDir.DuplicateVector( vecForward );
+
+	float flSlope = tan( DEG2RAD( clamp( sv_unlag_cull_angle.GetFloat(), 0.0f, 89.0f ) ) );
+	fltx4 fl4Slope = ReplicateX4( flSlope );
+	float flBloat = sv_unlag_cull_bloat.GetFloat();
+
+	int nNear = 0;
+	for ( int i = 0; i < nTargets; i += 4 )
+	{
+		// Bounding sphere of each target's rewound bounds
+		ALIGN16 Vector4D centers[4] ALIGN16_POST;
+		ALIGN16 float radii[4] ALIGN16_POST;
+		for ( int j = 0; j < 4; j++ )
+		{
+			const LagCompensationTarget_t &target = m_Targets[ MIN( i + j, nTargets - 1 ) ];
+			Vector vecCenter = target.m_vecOrigin + ( target.m_vecMinsPreScaled + target.m_vecMaxsPreScaled ) * 0.5f;
+			centers[j].Init( vecCenter.x, vecCenter.y, vecCenter.z, 0.0f );
+			radii[j] = ( target.m_vecMaxsPreScaled - target.m_vecMinsPreScaled ).Length() * 0.5f + flBloat;
+		}
+
+		FourVectors vCenter;
+		vCenter.LoadAndSwizzleAligned( &centers[0].x, &centers[1].x, &centers[2].x, &centers[3].x );
+
+		// distance along the ray of the closest point, behind the eyes counts as at the eyes
+		FourVectors vDelta = vCenter;
+		vDelta -= vStart;
+		fltx4 t = MaxSIMD( vDelta * vDir, Four_Zeros );
+
+		// squared distance from the center to the closest point
+		FourVectors vClosest = vDir;
+		vClosest *= t;
+		vClosest += vStart;
+		vCenter -= vClosest;
+		fltx4 distSqr = vCenter.length2();
+
+		// the cone gets wider further out
+		fltx4 reach = MaddSIMD( t, fl4Slope, LoadAlignedSIMD( radii ) );
+		fltx4 inside = CmpLeSIMD( distSqr, MulSIMD( reach, reach ) );
+		int mask = TestSignSIMD( inside );
+
+		int nLanes = MIN( 4, nTargets - i );
+		for ( int j = 0; j < nLanes; j++ )
+		{
+			bool bNear = ( mask & ( 1 << j ) ) != 0;
+			m_Targets[ i + j ].m_bNearShotRay = bNear;
+			if ( bNear )
+			{
+				nNear++;
+			}
+		}
 	}
 
+	return nNear;
+}
+
+void CLagCompensationManager::BacktrackEntity( LagCompensationTarget_t &target, float flTargetTime )
+{
+	CBaseAnimatingOverlay *pEntity = target.m_pEntity;
+	CLagCompensationTrack *track = target.m_pTrack;
+	LagRecord *record = target.m_pRecord;
+	LagRecord *prevRecord = target.m_pPrevRecord;
+	float frac = target.m_flFrac;
+	Vector org = target.m_vecOrigin;
+	QAngle ang = target.m_vecAngles;
+	Vector minsPreScaled = target.m_vecMinsPreScaled;
+	Vector maxsPreScaled = target.m_vecMaxsPreScaled;
+
+	VPROF_BUDGET( "BacktrackPlayer", "CLagCompensationManager" );
+	int ent_index = pEntity->entindex();
+
+	// Already moved back (by the stuck fixup below)
+	if ( m_RestoreEntity.Get( ent_index ) )
+		return;
+
 	// See if this is still a valid position for us to teleport to
 	if ( sv_unlag_fixstuck.GetBool() )
 	{
+		unsigned int mask = pEntity->IsPlayer() ? MASK_PLAYERSOLID : pEntity->PhysicsSolidMaskForEntity();
+
 		// Try to move to the wanted position from our current position.
 		trace_t tr;
-		UTIL_TraceEntity( pPlayer, org, org, MASK_PLAYERSOLID, &tr );
+		UTIL_TraceEntity( pEntity, org, org, mask, &tr );
 		if ( tr.startsolid || tr.allsolid )
 		{
 			if ( sv_unlag_debug.GetBool() )
-				DevMsg( "WARNING: BackupPlayer trying to back player into a bad position - client %s\n", pPlayer->GetPlayerName() );
+				DevMsg( "WARNING: BackupPlayer trying to back player into a bad position - client %s\n", pEntity->GetDebugName() );
 
-			CBasePlayer *pHitPlayer = dynamic_cast<CBasePlayer *>( tr.m_pEnt );
+			CBaseAnimatingOverlay *pHitEntity = ( tr.m_pEnt && FindTrack( tr.m_pEnt ) ) ? dynamic_cast<CBaseAnimatingOverlay *>( tr.m_pEnt ) : NULL;
 
 			// don't lag compensate the current player
-			if ( pHitPlayer && ( pHitPlayer != m_pCurrentPlayer ) )	
+			if ( pHitEntity && ( pHitEntity != m_pCurrentPlayer ) )	
 			{
-				// If we haven't backtracked this player, do it now
-				// this deliberately ignores WantsLagCompensationOnEntity.
-				if ( !m_RestorePlayer.Get( pHitPlayer->entindex() - 1 ) )
+				// If we haven't backtracked this entity, do it now
+				// this deliberately ignores WantsLagCompensationOnEntity and the shot ray.
+				if ( !m_RestoreEntity.Get( pHitEntity->entindex() ) )
 				{
-					// prevent recursion - save a copy of m_RestorePlayer,
-					// pretend that this player is off-limits
-					int pl_index = pPlayer->entindex() - 1;
-
-					// Temp turn this flag on
-					m_RestorePlayer.Set( pl_index );
+					LagCompensationTarget_t hitTarget;
+					if ( FindBacktrackTarget( pHitEntity, flTargetTime, hitTarget ) )
+					{
+						// prevent recursion - pretend that this entity is off-limits
+						m_RestoreEntity.Set( ent_index );
 
-					BacktrackPlayer( pHitPlayer, flTargetTime );
+						BacktrackEntity( hitTarget, flTargetTime );
 
-					// Remove the temp flag
-					m_RestorePlayer.Clear( pl_index );
+						// Remove the temp flag
+						m_RestoreEntity.Clear( ent_index );
+					}
 				}				
 			}
 
 			// now trace us back as far as we can go
-			UTIL_TraceEntity( pPlayer, pPlayer->GetLocalOrigin(), org, MASK_PLAYERSOLID, &tr );
+			UTIL_TraceEntity( pEntity, pEntity->GetLocalOrigin(), org, mask, &tr );
 
 			if ( tr.startsolid || tr.allsolid )
 			{
@@ -568,7 +944,7 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 			{
 				// We can get to a valid place, but not all the way to the target
 				Vector vPos;
-				VectorLerp( pPlayer->GetLocalOrigin(), org, tr.fraction * g_flFractionScale, vPos );
+				VectorLerp( pEntity->GetLocalOrigin(), org, tr.fraction * g_flFractionScale, vPos );
 				
 				// This is as close as we're going to get
 				org = vPos;
@@ -579,34 +955,36 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 		}
 	}
 	
-	// See if this represents a change for the player
+	// See if this represents a change for the entity
 	int flags = 0;
-	LagRecord *restore = &m_RestoreData[ pl_index ];
-	LagRecord *change  = &m_ChangeData[ pl_index ];
+	LagRecord *restore = &track->m_RestoreData;
+	LagRecord *change  = &track->m_ChangeData;
+	Q_memset( restore, 0, sizeof( *restore ) );
+	Q_memset( change, 0, sizeof( *change ) );
 
-	QAngle angdiff = pPlayer->GetLocalAngles() - ang;
-	Vector orgdiff = pPlayer->GetLocalOrigin() - org;
+	QAngle angdiff = pEntity->GetLocalAngles() - ang;
+	Vector orgdiff = pEntity->GetLocalOrigin() - org;
 
 	// Always remember the pristine simulation time in case we need to restore it.
-	restore->m_flSimulationTime = pPlayer->GetSimulationTime();
+	restore->m_flSimulationTime = pEntity->GetSimulationTime();
 
 	if ( angdiff.LengthSqr() > LAG_COMPENSATION_EPS_SQR )
 	{
 		flags |= LC_ANGLES_CHANGED;
-		restore->m_vecAngles = pPlayer->GetLocalAngles();
-		pPlayer->SetLocalAngles( ang );
+		restore->m_vecAngles = pEntity->GetLocalAngles();
+		pEntity->SetLocalAngles( ang );
 		change->m_vecAngles = ang;
 	}
 
 	// Use absolute equality here
-	if ( minsPreScaled != pPlayer->CollisionProp()->OBBMinsPreScaled() || maxsPreScaled != pPlayer->CollisionProp()->OBBMaxsPreScaled() )
+	if ( minsPreScaled != pEntity->CollisionProp()->OBBMinsPreScaled() || maxsPreScaled != pEntity->CollisionProp()->OBBMaxsPreScaled() )
 	{
 		flags |= LC_SIZE_CHANGED;
 
-		restore->m_vecMinsPreScaled = pPlayer->CollisionProp()->OBBMinsPreScaled();
-		restore->m_vecMaxsPreScaled = pPlayer->CollisionProp()->OBBMaxsPreScaled();
+		restore->m_vecMinsPreScaled = pEntity->CollisionProp()->OBBMinsPreScaled();
+		restore->m_vecMaxsPreScaled = pEntity->CollisionProp()->OBBMaxsPreScaled();
 		
-		pPlayer->SetSize( minsPreScaled, maxsPreScaled );
+		pEntity->SetSize( minsPreScaled, maxsPreScaled );
 		
 		change->m_vecMinsPreScaled = minsPreScaled;
 		change->m_vecMaxsPreScaled = maxsPreScaled;
@@ -616,8 +994,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	if ( orgdiff.LengthSqr() > LAG_COMPENSATION_EPS_SQR )
 	{
 		flags |= LC_ORIGIN_CHANGED;
-		restore->m_vecOrigin = pPlayer->GetLocalOrigin();
-		pPlayer->SetLocalOrigin( org );
+		restore->m_vecOrigin = pEntity->GetLocalOrigin();
+		pEntity->SetLocalOrigin( org );
 		change->m_vecOrigin = org;
 	}
 
@@ -625,8 +1003,8 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	// standing still, but you breathe even on the server.
 	// This is quicker than actually comparing all bazillion floats.
 	flags |= LC_ANIMATION_CHANGED;
-	restore->m_masterSequence = pPlayer->GetSequence();
-	restore->m_masterCycle = pPlayer->GetCycle();
+	restore->m_masterSequence = pEntity->GetSequence();
+	restore->m_masterCycle = pEntity->GetCycle();
 
 	bool interpolationAllowed = false;
 	if( prevRecord && (record->m_masterSequence == prevRecord->m_masterSequence) )
@@ -641,33 +1019,33 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 	if( frac > 0.0f && interpolationAllowed )
 	{
 		interpolatedMasters = true;
-		pPlayer->SetSequence( Lerp( frac, record->m_masterSequence, prevRecord->m_masterSequence ) );
-		pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+		pEntity->SetSequence( Lerp( frac, record->m_masterSequence, prevRecord->m_masterSequence ) );
+		pEntity->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
 
 		if( record->m_masterCycle > prevRecord->m_masterCycle )
 		{
 			// the older record is higher in frame than the newer, it must have wrapped around from 1 back to 0
 			// add one to the newer so it is lerping from .9 to 1.1 instead of .9 to .1, for example.
 			float newCycle = Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle + 1 );
-			pPlayer->SetCycle(newCycle < 1 ? newCycle : newCycle - 1 );// and make sure .9 to 1.2 does not end up 1.05
+			pEntity->SetCycle(newCycle < 1 ? newCycle : newCycle - 1 );// and make sure .9 to 1.2 does not end up 1.05
 		}
 		else
 		{
-			pPlayer->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
+			pEntity->SetCycle( Lerp( frac, record->m_masterCycle, prevRecord->m_masterCycle ) );
 		}
 	}
 	if( !interpolatedMasters )
 	{
-		pPlayer->SetSequence(record->m_masterSequence);
-		pPlayer->SetCycle(record->m_masterCycle);
+		pEntity->SetSequence(record->m_masterSequence);
+		pEntity->SetCycle(record->m_masterCycle);
 	}
 
 	////////////////////////
 	// Now do all the layers
-	int layerCount = pPlayer->GetNumAnimOverlays();
+	int layerCount = pEntity->GetNumAnimOverlays();
 	for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
 	{
-		CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
+		CAnimationLayer *currentLayer = pEntity->GetAnimOverlay(layerIndex);
 		if( currentLayer )
 		{
 			restore->m_layerRecords[layerIndex].m_cycle = currentLayer->m_flCycle;
@@ -717,21 +1095,22 @@ void CLagCompensationManager::BacktrackPlayer( CBasePlayer *pPlayer, float flTar
 		return; // we didn't change anything
 
 	if ( sv_lagflushbonecache.GetBool() )
-		pPlayer->InvalidateBoneCache();
+		pEntity->InvalidateBoneCache();
 
 	/*char text[256]; Q_snprintf( text, sizeof(text), "time %.2f", flTargetTime );
-	pPlayer->DrawServerHitboxes( 10 );
+	pEntity->DrawServerHitboxes( 10 );
 	NDebugOverlay::Text( org, text, false, 10 );
-	NDebugOverlay::EntityBounds( pPlayer, 255, 0, 0, 32, 10 ); */
+	NDebugOverlay::EntityBounds( pEntity, 255, 0, 0, 32, 10 ); */
 
-	m_RestorePlayer.Set( pl_index ); //remember that we changed this player
-	m_bNeedToRestore = true;  // we changed at least one player
+	m_RestoreEntity.Set( ent_index ); //remember that we changed this entity
+	m_RestoreList.AddToTail( ent_index );
+	m_bNeedToRestore = true;  // we changed at least one entity
 	restore->m_fFlags = flags; // we need to restore these flags
 	change->m_fFlags = flags; // we have changed these flags
 
 	if( sv_showlagcompensation.GetInt() == 1 )
 	{
-		pPlayer->DrawServerHitboxes(4, true);
+		pEntity->DrawServerHitboxes(4, true);
 	}
 }
 
@@ -745,103 +1124,110 @@ void CLagCompensationManager::FinishLagCompensation( CBasePlayer *player )
 	if ( !m_bNeedToRestore )
 	{
 		m_isCurrentlyDoingCompensation = false;
-		return; // no player was changed at all
+		return; // no entity was changed at all
 	}
 
-	// Iterate all active players
-	for ( int i = 1; i <= gpGlobals->maxClients; i++ )
+	// Iterate everything we moved
+	for ( int i = 0; i < m_RestoreList.Count(); i++ )
 	{
-		int pl_index = i - 1;
-		
-		if ( !m_RestorePlayer.Get( pl_index ) )
+		int ent_index = m_RestoreList[i];
+		Assert( m_RestoreEntity.Get( ent_index ) );
+
+		CLagCompensationTrack *track = m_pTracks[ ent_index ];
+		if ( !track )
 		{
-			// player wasn't changed by lag compensation
 			continue;
 		}
 
-		CBasePlayer *pPlayer = UTIL_PlayerByIndex( i );
-		if ( !pPlayer )
+		CBaseAnimatingOverlay *pEntity = dynamic_cast< CBaseAnimatingOverlay * >( track->m_hEntity.Get() );
+		if ( !pEntity )
 		{
 			continue;
 		}
 
-		LagRecord *restore = &m_RestoreData[ pl_index ];
-		LagRecord *change  = &m_ChangeData[ pl_index ];
+		RestoreEntity( pEntity, track );
+	}
+
+	m_RestoreList.RemoveAll();
+	m_RestoreEntity.ClearAll();
+	m_bNeedToRestore = false;
+	m_isCurrentlyDoingCompensation = false;
+}
+
+void CLagCompensationManager::RestoreEntity( CBaseAnimatingOverlay *pEntity, CLagCompensationTrack *track )
+{
+	LagRecord *restore = &track->m_RestoreData;
+	LagRecord *change  = &track->m_ChangeData;
+
+	bool restoreSimulationTime = false;
 
-		bool restoreSimulationTime = false;
+	if ( restore->m_fFlags & LC_SIZE_CHANGED )
+	{
+		restoreSimulationTime = true;
 
-		if ( restore->m_fFlags & LC_SIZE_CHANGED )
+		// see if simulation made any changes, if no, then do the restore, otherwise,
+		//  leave new values in
+		if ( pEntity->CollisionProp()->OBBMinsPreScaled() == change->m_vecMinsPreScaled &&
+			pEntity->CollisionProp()->OBBMaxsPreScaled() == change->m_vecMaxsPreScaled )
 		{
-			restoreSimulationTime = true;
-	
-			// see if simulation made any changes, if no, then do the restore, otherwise,
-			//  leave new values in
-			if ( pPlayer->CollisionProp()->OBBMinsPreScaled() == change->m_vecMinsPreScaled &&
-				pPlayer->CollisionProp()->OBBMaxsPreScaled() == change->m_vecMaxsPreScaled )
-			{
-				// Restore it
-				pPlayer->SetSize( restore->m_vecMinsPreScaled, restore->m_vecMaxsPreScaled );
-			}
+			// Restore it
+			pEntity->SetSize( restore->m_vecMinsPreScaled, restore->m_vecMaxsPreScaled );
+		}
 #ifdef STAGING_ONLY
-			else
-			{
-				Warning( "Should we really not restore the size?\n" );
-			}
-#endif
+		else
+		{
+			Warning( "Should we really not restore the size?\n" );
 		}
+#endif
+	}
 
-		if ( restore->m_fFlags & LC_ANGLES_CHANGED )
-		{		   
-			restoreSimulationTime = true;
+	if ( restore->m_fFlags & LC_ANGLES_CHANGED )
+	{		   
+		restoreSimulationTime = true;
 
-			if ( pPlayer->GetLocalAngles() == change->m_vecAngles )
-			{
-				pPlayer->SetLocalAngles( restore->m_vecAngles );
-			}
+		if ( pEntity->GetLocalAngles() == change->m_vecAngles )
+		{
+			pEntity->SetLocalAngles( restore->m_vecAngles );
 		}
+	}
 
-		if ( restore->m_fFlags & LC_ORIGIN_CHANGED )
-		{
-			restoreSimulationTime = true;
+	if ( restore->m_fFlags & LC_ORIGIN_CHANGED )
+	{
+		restoreSimulationTime = true;
 
-			// Okay, let's see if we can do something reasonable with the change
-			Vector delta = pPlayer->GetLocalOrigin() - change->m_vecOrigin;
-			
-			// If it moved really far, just leave the player in the new spot!!!
-			if ( delta.Length2DSqr() < m_flTeleportDistanceSqr )
-			{
-				RestorePlayerTo( pPlayer, restore->m_vecOrigin + delta );
-			}
+		// Okay, let's see if we can do something reasonable with the change
+		Vector delta = pEntity->GetLocalOrigin() - change->m_vecOrigin;
+		
+		// If it moved really far, just leave the player in the new spot!!!
+		if ( delta.Length2DSqr() < m_flTeleportDistanceSqr )
+		{
+			RestoreEntityTo( pEntity, restore->m_vecOrigin + delta );
 		}
+	}
 
-		if( restore->m_fFlags & LC_ANIMATION_CHANGED )
-		{
-			restoreSimulationTime = true;
+	if( restore->m_fFlags & LC_ANIMATION_CHANGED )
+	{
+		restoreSimulationTime = true;
 
-			pPlayer->SetSequence(restore->m_masterSequence);
-			pPlayer->SetCycle(restore->m_masterCycle);
+		pEntity->SetSequence(restore->m_masterSequence);
+		pEntity->SetCycle(restore->m_masterCycle);
 
-			int layerCount = pPlayer->GetNumAnimOverlays();
-			for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+		int layerCount = pEntity->GetNumAnimOverlays();
+		for( int layerIndex = 0; layerIndex < layerCount; ++layerIndex )
+		{
+			CAnimationLayer *currentLayer = pEntity->GetAnimOverlay(layerIndex);
+			if( currentLayer )
 			{
-				CAnimationLayer *currentLayer = pPlayer->GetAnimOverlay(layerIndex);
-				if( currentLayer )
-				{
-					currentLayer->m_flCycle = restore->m_layerRecords[layerIndex].m_cycle;
-					currentLayer->m_nOrder = restore->m_layerRecords[layerIndex].m_order;
-					currentLayer->m_nSequence = restore->m_layerRecords[layerIndex].m_sequence;
-					currentLayer->m_flWeight = restore->m_layerRecords[layerIndex].m_weight;
-				}
+				currentLayer->m_flCycle = restore->m_layerRecords[layerIndex].m_cycle;
+				currentLayer->m_nOrder = restore->m_layerRecords[layerIndex].m_order;
+				currentLayer->m_nSequence = restore->m_layerRecords[layerIndex].m_sequence;
+				currentLayer->m_flWeight = restore->m_layerRecords[layerIndex].m_weight;
 			}
 		}
-
-		if ( restoreSimulationTime )
-		{
-			pPlayer->SetSimulationTime( restore->m_flSimulationTime );
-		}
 	}
 
-	m_isCurrentlyDoingCompensation = false;
+	if ( restoreSimulationTime )
+	{
+		pEntity->SetSimulationTime( restore->m_flSimulationTime );
+	}
 }
-
-
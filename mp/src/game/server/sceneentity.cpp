@@ -31,6 +31,7 @@
 #include "ichoreoeventcallback.h"
 #include "scenefilecache/ISceneFileCache.h"
 #include "SceneCache.h"
+#include "scenebuffercache.h"
 #include "scripted.h"
 #include "env_debughistory.h"
 
@@ -196,35 +197,6 @@ void LocalScene_Printf( const char *pFormat, ... )
 }
 #endif
 
-//-----------------------------------------------------------------------------
-// Purpose: 
-// Input  : *filename - 
-//			**buffer - 
-// Output : Returns true on success, false on failure.
-//-----------------------------------------------------------------------------
-bool CopySceneFileIntoMemory( char const *pFilename, void **pBuffer, int *pSize )
-{
-	size_t bufSize = scenefilecache->GetSceneBufferSize( pFilename );
-	if ( bufSize > 0 )
-	{
-		*pBuffer = new byte[bufSize];
-		*pSize = bufSize;
-		return scenefilecache->GetSceneData( pFilename, (byte *)(*pBuffer), bufSize );
-	}
-
-	*pBuffer = 0;
-	*pSize = 0;
-	return false;
-}
-
-//-----------------------------------------------------------------------------
-// Purpose: 
-//-----------------------------------------------------------------------------
-void FreeSceneFileMemory( void *buffer )
-{
-	delete[] (byte*) buffer;
-}
-
 //-----------------------------------------------------------------------------
 // Binary compiled VCDs get their strings from a pool
 //-----------------------------------------------------------------------------
@@ -3316,10 +3288,10 @@ CChoreoScene *CSceneEntity::LoadScene( const char *filename, IChoreoEventCallbac
 	Q_SetExtension( loadfile, ".vcd", sizeof( loadfile ) );
 	Q_FixSlashes( loadfile );
 
-	// binary compiled vcd
-	void *pBuffer;
+	// binary compiled vcd, parsed in place out of the cache
+	const byte *pBuffer;
 	int fileSize;
-	if ( !CopySceneFileIntoMemory( loadfile, &pBuffer, &fileSize ) )
+	if ( !GetCachedSceneBuffer( loadfile, &pBuffer, &fileSize ) )
 	{
 		MissingSceneWarning( loadfile );
 		return NULL;
@@ -3339,7 +3311,6 @@ CChoreoScene *CSceneEntity::LoadScene( const char *filename, IChoreoEventCallbac
 		pScene->SetEventCallbackInterface( pCallback );
 	}
 
-	FreeSceneFileMemory( pBuffer );
 	return pScene;
 }
 
@@ -5617,5 +5588,6 @@ CON_COMMAND( scene_flush, "Flush all .vcds from the cache and reload from disk."
 
 	Msg( "Reloading\n" );
 	scenefilecache->Reload();
+	FlushSceneBufferCache();
 	Msg( "   done\n" );
 }
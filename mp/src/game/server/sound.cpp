@@ -171,6 +171,18 @@ public:
 	virtual void SetTransmit( CCheckTransmitInfo *pInfo, bool bAlways );
 	virtual void UpdateOnRemove( void );
 
+	// RampThink only updates m_dpv and re-sends the sound, which gets deferred. SendSound
+	// reads the source entity's origin, so only opt in when we are our own source. The
+	// random LFO draws from the shared random stream, whose order must not depend on threads.
+	virtual bool IsThinkThreadSafe() const
+	{
+		if ( m_dpv.lfotype == LFO_RANDOM )
+			return false;
+
+		CBaseEntity *pSoundSource = m_hSoundSource.Get();
+		return ( !pSoundSource || pSoundSource == this );
+	}
+
 	void ToggleSound();
 	void SendSound( SoundFlags_t flags );
 
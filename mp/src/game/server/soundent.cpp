@@ -21,6 +21,8 @@
 #define SOUNDLISTTYPE_FREE		1
 #define SOUNDLISTTYPE_ACTIVE	2
 
+ConVar ai_sound_index( "ai_sound_index", "1", 0, "Use the spatial sound index for NPC hearing instead of walking the whole active sound list" );
+
 
 
 LINK_ENTITY_TO_CLASS( soundent, CSoundEnt );
@@ -253,6 +255,8 @@ void CSoundEnt::OnRestore()
 		UTIL_Remove( g_pSoundEnt );
 	}
 	g_pSoundEnt = this;
+
+	RebuildSoundIndex();
 }
 
 
@@ -382,6 +386,8 @@ void CSoundEnt::FreeSound ( int iSound, int iPrevious )
 		g_pSoundEnt->m_iActiveSound = g_pSoundEnt->m_SoundPool [ iSound ].m_iNext;
 	}
 
+	g_pSoundEnt->UnindexSound( iSound );
+
 	// make iSound the head of the Free list.
 	g_pSoundEnt->m_SoundPool[ iSound ].m_iNext = g_pSoundEnt->m_iFreeSound;
 	g_pSoundEnt->m_iFreeSound = iSound;
@@ -415,6 +421,8 @@ int CSoundEnt::IAllocSound( void )
 
 	m_iActiveSound = iNewSound;// now make the new sound the top of the active list. You're done.
 
+	m_SoundIndex[ iNewSound ].m_nSerial = m_nNextSoundSerial++;
+
 #ifdef DEBUG
 	m_SoundPool[ iNewSound ].m_iMyIndex = iNewSound;
 #endif // DEBUG
@@ -477,6 +485,9 @@ void CSoundEnt::InsertSound ( int iType, const Vector &vecOrigin, int iVolume, f
 		pSound->m_bHasOwner = false;
 	}
 
+	// Channel sounds get reused in place, so this may move an already indexed sound
+	g_pSoundEnt->IndexSound( iThisSound );
+
 	if( displaysoundlist.GetInt() == 1 )
 	{
 		Msg("  Added Sound! Type:%d  Duration:%f (Time:%f)\n", pSound->SoundType(), flDuration, gpGlobals->curtime );
@@ -520,6 +531,7 @@ void CSoundEnt::Initialize ( void )
 	m_cLastActiveSounds;
 	m_iFreeSound = 0;
 	m_iActiveSound = SOUNDLIST_EMPTY;
+	RebuildSoundIndex();
 
 	// In SP, we should only use the first 64 slots so save/load works right.
 	// In MP, have one for each player and 32 extras.
@@ -554,6 +566,7 @@ void CSoundEnt::Initialize ( void )
 		}
 
 		m_SoundPool[ iSound ].m_bNoExpirationTime = true;
+		IndexSound( iSound );
 	}
 }
 
@@ -668,6 +681,201 @@ int CSoundEnt::ClientSoundIndex ( edict_t *pClient )
 	return iReturn;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Spatial index maintenance
+//-----------------------------------------------------------------------------
+static inline int SoundIndexCell( float flCoord )
+{
+	float flCell = floorf( flCoord * ( 1.0f / SOUNDENT_INDEX_CELL_SIZE ) );
+	return clamp( (int)flCell, -32767, 32767 );
+}
+
+static inline int SoundIndexBucket( int x, int y )
+{
+	return ( ( x * 73856093 ) ^ ( y * 19349663 ) ) & ( SOUNDENT_INDEX_BUCKETS - 1 );
+}
+
+int CSoundEnt::GetSoundBuckets( const SoundIndexEntry_t &entry, int *pBuckets )
+{
+	// Distinct cells can hash to the same bucket, only list each bucket once
+	int nBuckets = 0;
+	for ( int x = entry.m_nCellMins[0]; x <= entry.m_nCellMaxs[0]; x++ )
+	{
+		for ( int y = entry.m_nCellMins[1]; y <= entry.m_nCellMaxs[1]; y++ )
+		{
+			int iBucket = SoundIndexBucket( x, y );
+			int i;
+			for ( i = 0; i < nBuckets; i++ )
+			{
+				if ( pBuckets[i] == iBucket )
+					break;
+			}
+			if ( i == nBuckets )
+			{
+				pBuckets[nBuckets++] = iBucket;
+			}
+		}
+	}
+	return nBuckets;
+}
+
+void CSoundEnt::IndexSound( int iSound )
+{
+	UnindexSound( iSound );
+
+	CSound &sound = m_SoundPool[ iSound ];
+	SoundIndexEntry_t &entry = m_SoundIndex[ iSound ];
+
+	// Client sounds never expire and get moved around by their player every frame
+	if ( sound.m_bNoExpirationTime )
+	{
+		entry.m_bLoose = true;
+		m_LooseSounds.AddToTail( iSound );
+		return;
+	}
+
+	float flRadius = MAX( sound.m_iVolume, 0 );
+	const Vector &vecOrigin = sound.GetSoundOrigin();
+	for ( int i = 0; i < 2; i++ )
+	{
+		entry.m_nCellMins[i] = SoundIndexCell( vecOrigin[i] - flRadius );
+		entry.m_nCellMaxs[i] = SoundIndexCell( vecOrigin[i] + flRadius );
+	}
+
+	int nCells = ( entry.m_nCellMaxs[0] - entry.m_nCellMins[0] + 1 ) * ( entry.m_nCellMaxs[1] - entry.m_nCellMins[1] + 1 );
+	if ( nCells > SOUNDENT_INDEX_MAX_CELLS )
+	{
+		entry.m_bLoose = true;
+		m_LooseSounds.AddToTail( iSound );
+		return;
+	}
+
+	int buckets[SOUNDENT_INDEX_MAX_CELLS];
+	int nBuckets = GetSoundBuckets( entry, buckets );
+	for ( int i = 0; i < nBuckets; i++ )
+	{
+		m_SoundBuckets[ buckets[i] ].AddToTail( iSound );
+	}
+	entry.m_bHashed = true;
+}
+
+void CSoundEnt::UnindexSound( int iSound )
+{
+	SoundIndexEntry_t &entry = m_SoundIndex[ iSound ];
+	if ( entry.m_bLoose )
+	{
+		m_LooseSounds.FindAndFastRemove( iSound );
+		entry.m_bLoose = false;
+	}
+
+	if ( entry.m_bHashed )
+	{
+		int buckets[SOUNDENT_INDEX_MAX_CELLS];
+		int nBuckets = GetSoundBuckets( entry, buckets );
+		for ( int i = 0; i < nBuckets; i++ )
+		{
+			m_SoundBuckets[ buckets[i] ].FindAndFastRemove( iSound );
+		}
+		entry.m_bHashed = false;
+	}
+}
+
+void CSoundEnt::RebuildSoundIndex( void )
+{
+	for ( int i = 0; i < SOUNDENT_INDEX_BUCKETS; i++ )
+	{
+		m_SoundBuckets[i].RemoveAll();
+	}
+	m_LooseSounds.RemoveAll();
+	memset( m_SoundIndex, 0, sizeof( m_SoundIndex ) );
+
+	// Serials aren't saved, hand them out again so they sort the same way the active list runs
+	int nActive = 0;
+	for ( int iSound = m_iActiveSound; iSound != SOUNDLIST_EMPTY; iSound = m_SoundPool[ iSound ].m_iNext )
+	{
+		nActive++;
+	}
+
+	m_nNextSoundSerial = nActive;
+	for ( int iSound = m_iActiveSound; iSound != SOUNDLIST_EMPTY; iSound = m_SoundPool[ iSound ].m_iNext )
+	{
+		m_SoundIndex[ iSound ].m_nSerial = --nActive;
+		IndexSound( iSound );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the active sounds of the given types that reach vecPoint
+//-----------------------------------------------------------------------------
+int CSoundEnt::GetSoundsAtPoint( const Vector &vecPoint, int iSoundMask, float flVolumeScale, int *pSounds, int nMaxSounds, int *pnTested )
+{
+	int nTested = 0;
+	int nSounds = 0;
+
+	if ( g_pSoundEnt )
+	{
+		CSound *pPool = g_pSoundEnt->m_SoundPool;
+
+		// The hash is built from the unscaled volume, louder listeners have to look at everything
+		if ( !ai_sound_index.GetBool() || flVolumeScale > 1.0f )
+		{
+			for ( int iSound = g_pSoundEnt->m_iActiveSound; iSound != SOUNDLIST_EMPTY && nSounds < nMaxSounds; iSound = pPool[ iSound ].m_iNext )
+			{
+				CSound &sound = pPool[ iSound ];
+				nTested++;
+
+				float flHearDistance = sound.Volume() * flVolumeScale;
+				if ( ( iSoundMask & sound.SoundType() ) && sound.GetSoundOrigin().DistToSqr( vecPoint ) <= flHearDistance * flHearDistance )
+				{
+					pSounds[nSounds++] = iSound;
+				}
+			}
+		}
+		else
+		{
+			const CUtlVector<short> &bucket = g_pSoundEnt->m_SoundBuckets[ SoundIndexBucket( SoundIndexCell( vecPoint.x ), SoundIndexCell( vecPoint.y ) ) ];
+			const CUtlVector<short> *lists[2] = { &g_pSoundEnt->m_LooseSounds, &bucket };
+
+			for ( int iList = 0; iList < 2; iList++ )
+			{
+				const CUtlVector<short> &list = *lists[iList];
+				for ( int i = 0; i < list.Count() && nSounds < nMaxSounds; i++ )
+				{
+					int iSound = list[i];
+					CSound &sound = pPool[ iSound ];
+					nTested++;
+
+					float flHearDistance = sound.Volume() * flVolumeScale;
+					if ( ( iSoundMask & sound.SoundType() ) && sound.GetSoundOrigin().DistToSqr( vecPoint ) <= flHearDistance * flHearDistance )
+					{
+						pSounds[nSounds++] = iSound;
+					}
+				}
+			}
+
+			// Hand them back in the order a walk of the active list would have found them
+			const SoundIndexEntry_t *pIndex = g_pSoundEnt->m_SoundIndex;
+			for ( int i = 1; i < nSounds; i++ )
+			{
+				int iSound = pSounds[i];
+				int j = i - 1;
+				while ( j >= 0 && pIndex[ pSounds[j] ].m_nSerial < pIndex[ iSound ].m_nSerial )
+				{
+					pSounds[j + 1] = pSounds[j];
+					j--;
+				}
+				pSounds[j + 1] = iSound;
+			}
+		}
+	}
+
+	if ( pnTested )
+	{
+		*pnTested = nTested;
+	}
+	return nSounds;
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Return the loudest sound of the specified type at "earposition"
 //-----------------------------------------------------------------------------
@@ -85,6 +85,14 @@ enum
 	SOUNDLIST_EMPTY = -1
 };
 
+// Spatial index of active sounds. Each sound is hashed into every XY cell its
+// volume radius touches, so a listener only has to test the sounds in its own
+// cell. Sounds too loud to hash cheaply, and the per-client sounds that players
+// update in place every frame, are kept in a small list that is always tested.
+#define SOUNDENT_INDEX_CELL_SIZE	512.0f
+#define SOUNDENT_INDEX_BUCKETS		1024	// must be a power of two
+#define SOUNDENT_INDEX_MAX_CELLS	64
+
 #define SOUNDENT_VOLUME_MACHINEGUN	1500.0
 #define SOUNDENT_VOLUME_SHOTGUN		1500.0
 #define SOUNDENT_VOLUME_PISTOL		1500.0
@@ -239,16 +247,41 @@ public:
 	static CSound*	GetLoudestSoundOfType( int iType, const Vector &vecEarPosition );
 	static int		ClientSoundIndex ( edict_t *pClient );
 
+	// Fills pSounds with the indices of the active sounds matching iSoundMask whose volume,
+	// scaled by flVolumeScale, reaches vecPoint. Results are in active list order.
+	// pnTested, if passed, gets the number of sounds that had to be distance tested.
+	static int		GetSoundsAtPoint( const Vector &vecPoint, int iSoundMask, float flVolumeScale, int *pSounds, int nMaxSounds, int *pnTested = NULL );
+
 	bool	IsEmpty( void );
 	int		ISoundsInList ( int iListType );
 	int		IAllocSound ( void );
 	int		FindOrAllocateSound( CBaseEntity *pOwner, int soundChannelIndex );
 	
 private:
+	// Spatial index
+	struct SoundIndexEntry_t
+	{
+		int		m_nSerial;		// allocation order, the active list is sorted by this descending
+		bool	m_bLoose;		// always tested instead of hashed
+		bool	m_bHashed;
+		short	m_nCellMins[2];
+		short	m_nCellMaxs[2];
+	};
+
+	void	IndexSound( int iSound );
+	void	UnindexSound( int iSound );
+	void	RebuildSoundIndex( void );
+	int		GetSoundBuckets( const SoundIndexEntry_t &entry, int *pBuckets );
+
 	int		m_iFreeSound;	// index of the first sound in the free sound list
 	int		m_iActiveSound; // indes of the first sound in the active sound list
 	int		m_cLastActiveSounds; // keeps track of the number of active sounds at the last update. (for diagnostic work)
 	CSound	m_SoundPool[ MAX_WORLD_SOUNDS_MP ];
+
+	SoundIndexEntry_t	m_SoundIndex[ MAX_WORLD_SOUNDS_MP ];
+	CUtlVector<short>	m_SoundBuckets[ SOUNDENT_INDEX_BUCKETS ];
+	CUtlVector<short>	m_LooseSounds;
+	int					m_nNextSoundSerial;
 };
 
 
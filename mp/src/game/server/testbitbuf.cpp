@@ -0,0 +1,371 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Checks the bf_write / bf_read array functions against the single
+//			value versions they replace and times the two.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "tier1/bitbuf.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/random.h"
+#include "coordsize.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#define TEST_BITBUF_MAX_VALUES	256
+#define TEST_BITBUF_DWORDS		( ( TEST_BITBUF_MAX_VALUES * 70 + 64 ) / 32 + 2 )
+
+enum BitBufTestKind_t
+{
+	BITBUF_TEST_UBITLONG = 0,
+	BITBUF_TEST_SBITLONG,
+	BITBUF_TEST_COORD,
+	BITBUF_TEST_VEC3COORD,
+	BITBUF_TEST_NORMAL,
+	BITBUF_TEST_VEC3NORMAL,
+
+	BITBUF_TEST_KIND_COUNT
+};
+
+static const char *s_pBitBufTestKindNames[BITBUF_TEST_KIND_COUNT] =
+{
+	"UBitLong",
+	"SBitLong",
+	"BitCoord",
+	"BitVec3Coord",
+	"BitNormal",
+	"BitVec3Normal",
+};
+
+struct BitBufTestValues_t
+{
+	unsigned int	m_Ints[TEST_BITBUF_MAX_VALUES];
+	float			m_Floats[TEST_BITBUF_MAX_VALUES];
+	Vector			m_Vectors[TEST_BITBUF_MAX_VALUES];
+	int				m_nCount;
+	int				m_nBits;
+};
+
+static float RandomTestCoord( CUniformRandomStream &random )
+{
+	switch ( random.RandomInt( 0, 4 ) )
+	{
+	case 0:		return 0.0f;
+	case 1:		return random.RandomFloat( -2.0f * COORD_RESOLUTION, 2.0f * COORD_RESOLUTION );	// around the flag thresholds
+	case 2:		return (float)random.RandomInt( -MAX_COORD_INTEGER, MAX_COORD_INTEGER );		// integers only
+	case 3:		return random.RandomFloat( -1.25f * MAX_COORD_INTEGER, 1.25f * MAX_COORD_INTEGER );	// some out of range
+	default:	return random.RandomFloat( -1.0f, 1.0f );
+	}
+}
+
+static float RandomTestNormal( CUniformRandomStream &random )
+{
+	switch ( random.RandomInt( 0, 3 ) )
+	{
+	case 0:		return 0.0f;
+	case 1:		return random.RandomFloat( -2.0f * NORMAL_RESOLUTION, 2.0f * NORMAL_RESOLUTION );
+	case 2:		return random.RandomInt( 0, 1 ) ? 1.0f : -1.0f;
+	default:	return random.RandomFloat( -1.1f, 1.1f );
+	}
+}
+
+// nBits is only used by the int kinds, 0 picks a random width
+static void RandomTestValues( CUniformRandomStream &random, BitBufTestKind_t kind, int nCount, int nBits, BitBufTestValues_t &values )
+{
+	values.m_nCount = nCount;
+	values.m_nBits = nBits ? nBits : random.RandomInt( 1, 32 );
+
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int nRandom = ( (unsigned int)random.RandomInt( 0, 0xFFFF ) << 16 ) | (unsigned int)random.RandomInt( 0, 0xFFFF );
+		switch ( kind )
+		{
+		case BITBUF_TEST_UBITLONG:
+			values.m_Ints[i] = values.m_nBits < 32 ? ( nRandom & ( ( 1u << values.m_nBits ) - 1 ) ) : nRandom;
+			break;
+
+		case BITBUF_TEST_SBITLONG:
+			// Sign extend from the top bit so the value fits
+			values.m_Ints[i] = (unsigned int)( (int)( nRandom << ( 32 - values.m_nBits ) ) >> ( 32 - values.m_nBits ) );
+			break;
+
+		case BITBUF_TEST_COORD:
+			values.m_Floats[i] = RandomTestCoord( random );
+			break;
+
+		case BITBUF_TEST_VEC3COORD:
+			values.m_Vectors[i].Init( RandomTestCoord( random ), RandomTestCoord( random ), RandomTestCoord( random ) );
+			break;
+
+		case BITBUF_TEST_NORMAL:
+			values.m_Floats[i] = RandomTestNormal( random );
+			break;
+
+		case BITBUF_TEST_VEC3NORMAL:
+			values.m_Vectors[i].Init( RandomTestNormal( random ), RandomTestNormal( random ), RandomTestNormal( random ) );
+			break;
+		}
+	}
+}
+
+static void WriteTestValues( bf_write &buf, BitBufTestKind_t kind, const BitBufTestValues_t &values, bool bArray )
+{
+	int nCount = values.m_nCount;
+	switch ( kind )
+	{
+	case BITBUF_TEST_UBITLONG:
+		if ( bArray )
+			buf.WriteUBitLongArray( values.m_Ints, nCount, values.m_nBits );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteUBitLong( values.m_Ints[i], values.m_nBits );
+		break;
+
+	case BITBUF_TEST_SBITLONG:
+		if ( bArray )
+			buf.WriteSBitLongArray( (const int *)values.m_Ints, nCount, values.m_nBits );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteSBitLong( (int)values.m_Ints[i], values.m_nBits );
+		break;
+
+	case BITBUF_TEST_COORD:
+		if ( bArray )
+			buf.WriteBitCoordArray( values.m_Floats, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteBitCoord( values.m_Floats[i] );
+		break;
+
+	case BITBUF_TEST_VEC3COORD:
+		if ( bArray )
+			buf.WriteBitVec3CoordArray( values.m_Vectors, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteBitVec3Coord( values.m_Vectors[i] );
+		break;
+
+	case BITBUF_TEST_NORMAL:
+		if ( bArray )
+			buf.WriteBitNormalArray( values.m_Floats, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteBitNormal( values.m_Floats[i] );
+		break;
+
+	case BITBUF_TEST_VEC3NORMAL:
+		if ( bArray )
+			buf.WriteBitVec3NormalArray( values.m_Vectors, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.WriteBitVec3Normal( values.m_Vectors[i] );
+		break;
+	}
+}
+
+static void ReadTestValues( bf_read &buf, BitBufTestKind_t kind, BitBufTestValues_t &values, bool bArray )
+{
+	int nCount = values.m_nCount;
+	switch ( kind )
+	{
+	case BITBUF_TEST_UBITLONG:
+		if ( bArray )
+			buf.ReadUBitLongArray( values.m_Ints, nCount, values.m_nBits );
+		else
+			for ( int i = 0; i < nCount; i++ ) values.m_Ints[i] = buf.ReadUBitLong( values.m_nBits );
+		break;
+
+	case BITBUF_TEST_SBITLONG:
+		if ( bArray )
+			buf.ReadSBitLongArray( (int *)values.m_Ints, nCount, values.m_nBits );
+		else
+			for ( int i = 0; i < nCount; i++ ) values.m_Ints[i] = (unsigned int)buf.ReadSBitLong( values.m_nBits );
+		break;
+
+	case BITBUF_TEST_COORD:
+		if ( bArray )
+			buf.ReadBitCoordArray( values.m_Floats, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) values.m_Floats[i] = buf.ReadBitCoord();
+		break;
+
+	case BITBUF_TEST_VEC3COORD:
+		if ( bArray )
+			buf.ReadBitVec3CoordArray( values.m_Vectors, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.ReadBitVec3Coord( values.m_Vectors[i] );
+		break;
+
+	case BITBUF_TEST_NORMAL:
+		if ( bArray )
+			buf.ReadBitNormalArray( values.m_Floats, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) values.m_Floats[i] = buf.ReadBitNormal();
+		break;
+
+	case BITBUF_TEST_VEC3NORMAL:
+		if ( bArray )
+			buf.ReadBitVec3NormalArray( values.m_Vectors, nCount );
+		else
+			for ( int i = 0; i < nCount; i++ ) buf.ReadBitVec3Normal( values.m_Vectors[i] );
+		break;
+	}
+}
+
+static bool CompareTestValues( BitBufTestKind_t kind, const BitBufTestValues_t &a, const BitBufTestValues_t &b )
+{
+	int nCount = a.m_nCount;
+	switch ( kind )
+	{
+	case BITBUF_TEST_UBITLONG:
+	case BITBUF_TEST_SBITLONG:
+		return !V_memcmp( a.m_Ints, b.m_Ints, nCount * sizeof( a.m_Ints[0] ) );
+
+	case BITBUF_TEST_COORD:
+	case BITBUF_TEST_NORMAL:
+		return !V_memcmp( a.m_Floats, b.m_Floats, nCount * sizeof( a.m_Floats[0] ) );
+
+	default:
+		return !V_memcmp( a.m_Vectors, b.m_Vectors, nCount * sizeof( a.m_Vectors[0] ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Writes the same random values both ways into identically filled buffers at a
+// random bit offset, then reads them back both ways. Everything has to match to
+// the bit, including the garbage around what was written and the overflow state
+// when the buffer is cut short.
+//-----------------------------------------------------------------------------
+static int FuzzBitBufArrays( CUniformRandomStream &random, BitBufTestKind_t kind, int nRounds )
+{
+	static uint32 s_Single[TEST_BITBUF_DWORDS];
+	static uint32 s_Array[TEST_BITBUF_DWORDS];
+	static BitBufTestValues_t s_Values, s_SingleRead, s_ArrayRead;
+
+	int nFailures = 0;
+	for ( int iRound = 0; iRound < nRounds; iRound++ )
+	{
+		RandomTestValues( random, kind, random.RandomInt( 1, TEST_BITBUF_MAX_VALUES ), 0, s_Values );
+
+		for ( int i = 0; i < TEST_BITBUF_DWORDS; i++ )
+		{
+			s_Single[i] = s_Array[i] = ( (uint32)random.RandomInt( 0, 0xFFFF ) << 16 ) | (uint32)random.RandomInt( 0, 0xFFFF );
+		}
+
+		// Every so often leave too little room so the overflow fallback gets run
+		int nBufferBits = ( TEST_BITBUF_DWORDS - 1 ) * 32;
+		if ( random.RandomInt( 0, 7 ) == 0 )
+		{
+			nBufferBits = random.RandomInt( 64, nBufferBits );
+		}
+		int iStartBit = random.RandomInt( 0, 63 );
+
+		bf_write single( "FuzzBitBufArrays single", s_Single, sizeof( s_Single ), nBufferBits );
+		bf_write array( "FuzzBitBufArrays array", s_Array, sizeof( s_Array ), nBufferBits );
+		single.SetAssertOnOverflow( false );
+		array.SetAssertOnOverflow( false );
+		single.SeekToBit( iStartBit );
+		array.SeekToBit( iStartBit );
+
+		WriteTestValues( single, kind, s_Values, false );
+		WriteTestValues( array, kind, s_Values, true );
+
+		if ( single.GetNumBitsWritten() != array.GetNumBitsWritten() || single.IsOverflowed() != array.IsOverflowed() ||
+			V_memcmp( s_Single, s_Array, sizeof( s_Single ) ) )
+		{
+			Warning( "bitbuf %s: write mismatch, %d values of %d bits at bit %d\n", s_pBitBufTestKindNames[kind], s_Values.m_nCount, s_Values.m_nBits, iStartBit );
+			nFailures++;
+			continue;
+		}
+
+		bf_read singleRead( "FuzzBitBufArrays single", s_Single, sizeof( s_Single ), nBufferBits );
+		bf_read arrayRead( "FuzzBitBufArrays array", s_Single, sizeof( s_Single ), nBufferBits );
+		singleRead.SetAssertOnOverflow( false );
+		arrayRead.SetAssertOnOverflow( false );
+		singleRead.Seek( iStartBit );
+		arrayRead.Seek( iStartBit );
+
+		s_SingleRead.m_nCount = s_ArrayRead.m_nCount = s_Values.m_nCount;
+		s_SingleRead.m_nBits = s_ArrayRead.m_nBits = s_Values.m_nBits;
+		ReadTestValues( singleRead, kind, s_SingleRead, false );
+		ReadTestValues( arrayRead, kind, s_ArrayRead, true );
+
+		if ( singleRead.GetNumBitsRead() != arrayRead.GetNumBitsRead() || singleRead.IsOverflowed() != arrayRead.IsOverflowed() ||
+			!CompareTestValues( kind, s_SingleRead, s_ArrayRead ) )
+		{
+			Warning( "bitbuf %s: read mismatch, %d values of %d bits at bit %d\n", s_pBitBufTestKindNames[kind], s_Values.m_nCount, s_Values.m_nBits, iStartBit );
+			nFailures++;
+		}
+	}
+
+	return nFailures;
+}
+
+//-----------------------------------------------------------------------------
+// Times writing nRepeats full batches, then reading them back
+//-----------------------------------------------------------------------------
+static void TimeBitBufArrays( BitBufTestKind_t kind, const BitBufTestValues_t &values, int nRepeats, bool bArray, float &flWriteMS, float &flReadMS )
+{
+	static uint32 s_Buffer[TEST_BITBUF_DWORDS];
+	static BitBufTestValues_t s_Read;
+	s_Read.m_nCount = values.m_nCount;
+	s_Read.m_nBits = values.m_nBits;
+
+	CFastTimer timer;
+	timer.Start();
+	for ( int i = 0; i < nRepeats; i++ )
+	{
+		bf_write buf( s_Buffer, sizeof( s_Buffer ) );
+		WriteTestValues( buf, kind, values, bArray );
+	}
+	timer.End();
+	flWriteMS = timer.GetDuration().GetMillisecondsF();
+
+	timer.Start();
+	for ( int i = 0; i < nRepeats; i++ )
+	{
+		bf_read buf( s_Buffer, sizeof( s_Buffer ) );
+		ReadTestValues( buf, kind, s_Read, bArray );
+	}
+	timer.End();
+	flReadMS = timer.GetDuration().GetMillisecondsF();
+}
+
+CON_COMMAND( test_bitbuf_arrays, "Fuzz the bitbuf array functions against the single value ones, then time both. Args: [fuzz rounds] [timing repeats] [seed]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nRounds = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 2000;
+	int nRepeats = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 2000;
+	int nSeed = ( args.ArgC() > 3 ) ? atoi( args[3] ) : 1;
+
+	CUniformRandomStream random;
+	random.SetSeed( nSeed );
+
+	static BitBufTestValues_t s_Values;
+
+	Msg( "bitbuf arrays, %d fuzz rounds, %d x %d values timed (seed %d):\n", nRounds, nRepeats, TEST_BITBUF_MAX_VALUES, nSeed );
+	Msg( "  %-14s %8s   %19s   %19s\n", "", "fuzz", "write single/array", "read single/array" );
+
+	int nTotalFailures = 0;
+	for ( int iKind = 0; iKind < BITBUF_TEST_KIND_COUNT; iKind++ )
+	{
+		BitBufTestKind_t kind = (BitBufTestKind_t)iKind;
+
+		int nFailures = FuzzBitBufArrays( random, kind, nRounds );
+		nTotalFailures += nFailures;
+
+		// Time a typical field width rather than whatever comes up
+		RandomTestValues( random, kind, TEST_BITBUF_MAX_VALUES, 12, s_Values );
+
+		float flSingleWrite, flSingleRead, flArrayWrite, flArrayRead;
+		TimeBitBufArrays( kind, s_Values, nRepeats, false, flSingleWrite, flSingleRead );
+		TimeBitBufArrays( kind, s_Values, nRepeats, true, flArrayWrite, flArrayRead );
+
+		Msg( "  %-14s %8s   %7.2f/%7.2f ms   %7.2f/%7.2f ms\n", s_pBitBufTestKindNames[kind], nFailures ? "FAILED" : "ok",
+			flSingleWrite, flArrayWrite, flSingleRead, flArrayRead );
+	}
+
+	if ( nTotalFailures )
+	{
+		Warning( "bitbuf arrays: %d mismatches\n", nTotalFailures );
+	}
+}
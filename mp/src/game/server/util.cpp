@@ -36,6 +36,8 @@
 #include "datacache/imdlcache.h"
 #include "util.h"
 #include "cdll_int.h"
+#include "parallel_think.h"
+#include "entity_spatial_index.h"
 
 #ifdef PORTAL
 #include "PortalSimulation.h"
@@ -284,6 +286,9 @@ float UTIL_GetSimulationInterval()
 //-----------------------------------------------------------------------------
 int UTIL_EntitiesInBox( const Vector &mins, const Vector &maxs, CFlaggedEntitiesEnum *pEnum )
 {
+	if ( EntitySpatialIndex_EnumerateInBox( mins, maxs, pEnum ) )
+		return pEnum->GetCount();
+
 	partition->EnumerateElementsInBox( PARTITION_ENGINE_NON_STATIC_EDICTS, mins, maxs, false, pEnum );
 	return pEnum->GetCount();
 }
@@ -296,6 +301,9 @@ int UTIL_EntitiesAlongRay( const Ray_t &ray, CFlaggedEntitiesEnum *pEnum )
 
 int UTIL_EntitiesInSphere( const Vector &center, float radius, CFlaggedEntitiesEnum *pEnum )
 {
+	if ( EntitySpatialIndex_EnumerateInSphere( center, radius, pEnum ) )
+		return pEnum->GetCount();
+
 	partition->EnumerateElementsInSphere( PARTITION_ENGINE_NON_STATIC_EDICTS, center, radius, false, pEnum );
 	return pEnum->GetCount();
 }
@@ -460,6 +468,12 @@ void UTIL_Remove( IServerNetworkable *oldObj )
 	if ( !pProp || pProp->IsMarkedForDeletion() )
 		return;
 
+	if ( ParallelThink_ShouldDefer() )
+	{
+		ParallelThink_DeferRemove( oldObj->GetBaseEntity() );
+		return;
+	}
+
 	if ( PhysIsInCallback() )
 	{
 		// This assert means that someone is deleting an entity inside a callback.  That isn't supported so
@@ -27,6 +27,7 @@
 #ifndef CLIENT_DLL
 #include "envmicrophone.h"
 #include "sceneentity.h"
+#include "parallel_think.h"
 #else
 #include <vgui_controls/Controls.h>
 #include <vgui/IVGui.h>
@@ -1162,6 +1163,18 @@ void CBaseEntity::EmitSound( const char *soundname, float soundtime /*= 0.0f*/,
 	//VPROF( "CBaseEntity::EmitSound" );
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
+#if !defined( CLIENT_DLL )
+	if ( ParallelThink_ShouldDefer() )
+	{
+		if ( duration )
+		{
+			*duration = GetSoundDuration( soundname, NULL );
+		}
+		ParallelThink_DeferEmitSound( this, soundname, soundtime );
+		return;
+	}
+#endif
+
 	CPASAttenuationFilter filter( this, soundname );
 
 	EmitSound_t params;
@@ -1181,6 +1194,18 @@ void CBaseEntity::EmitSound( const char *soundname, HSOUNDSCRIPTHANDLE& handle,
 {
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
+#if !defined( CLIENT_DLL )
+	if ( ParallelThink_ShouldDefer() )
+	{
+		if ( duration )
+		{
+			*duration = GetSoundDuration( soundname, NULL );
+		}
+		ParallelThink_DeferEmitSound( this, soundname, soundtime );
+		return;
+	}
+#endif
+
 	// VPROF( "CBaseEntity::EmitSound" );
 	CPASAttenuationFilter filter( this, soundname, handle );
 
@@ -1250,6 +1275,18 @@ void CBaseEntity::EmitSound( IRecipientFilter& filter, int iEntIndex, const Emit
 {
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
+#if !defined( CLIENT_DLL )
+	if ( ParallelThink_ShouldDefer() )
+	{
+		if ( params.m_pflSoundDuration && params.m_pSoundName )
+		{
+			*params.m_pflSoundDuration = GetSoundDuration( params.m_pSoundName, NULL );
+		}
+		ParallelThink_DeferEmitSoundFiltered( filter, iEntIndex, params );
+		return;
+	}
+#endif
+
 #ifdef GAME_DLL
 	CBaseEntity *pEntity = UTIL_EntityByIndex( iEntIndex );
 #else
@@ -1275,6 +1312,19 @@ void CBaseEntity::EmitSound( IRecipientFilter& filter, int iEntIndex, const Emit
 {
 	VPROF_BUDGET( "CBaseEntity::EmitSound", _T( "CBaseEntity::EmitSound" ) );
 
+#if !defined( CLIENT_DLL )
+	if ( ParallelThink_ShouldDefer() )
+	{
+		// The handle belongs to the caller, so the deferred emit looks the script up again
+		if ( params.m_pflSoundDuration && params.m_pSoundName )
+		{
+			*params.m_pflSoundDuration = GetSoundDuration( params.m_pSoundName, NULL );
+		}
+		ParallelThink_DeferEmitSoundFiltered( filter, iEntIndex, params );
+		return;
+	}
+#endif
+
 #ifdef GAME_DLL
 	CBaseEntity *pEntity = UTIL_EntityByIndex( iEntIndex );
 #else
@@ -1303,6 +1353,12 @@ void CBaseEntity::StopSound( const char *soundname )
 		StopSound( GetSoundSourceIndex(), soundname );
 		return;
 	}
+#else
+	if ( ParallelThink_ShouldDefer() )
+	{
+		ParallelThink_DeferStopSound( this, soundname );
+		return;
+	}
 #endif
 
 	StopSound( entindex(), soundname );
@@ -1381,6 +1437,18 @@ void UTIL_EmitAmbientSound( int entindex, const Vector &vecOrigin, const char *s
 	}
 #endif // STAGING_ONLY
 
+#if !defined( CLIENT_DLL )
+	if ( ParallelThink_ShouldDefer() )
+	{
+		if ( duration )
+		{
+			*duration = enginesound->GetSoundDuration( samp );
+		}
+		ParallelThink_DeferEmitAmbientSound( entindex, vecOrigin, samp, vol, soundlevel, fFlags, pitch, soundtime );
+		return;
+	}
+#endif
+
 	if (samp && *samp == '!')
 	{
 		int sentenceIndex = SENTENCEG_Lookup(samp);
@@ -103,6 +103,9 @@ public:
 
 	virtual int ShouldTransmit( const CCheckTransmitInfo *pInfo );
 	virtual int UpdateTransmitState( void );
+
+	// Animate/expand/fade thinks only touch the sprite itself
+	virtual bool IsThinkThreadSafe() const { return true; }
 	
 	void SetAsTemporary( void ) { AddSpawnFlags( SF_SPRITE_TEMPORARY ); }
 	bool IsTemporary( void ) { return ( HasSpawnFlags( SF_SPRITE_TEMPORARY ) ); }
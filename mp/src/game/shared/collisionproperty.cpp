@@ -24,6 +24,7 @@
 #include "baseanimating.h"
 #include "sendproxy.h"
 #include "hierarchy.h"
+#include "entity_spatial_index.h"
 #endif
 
 #include "predictable_entity.h"
@@ -1298,6 +1299,9 @@ void CCollisionProperty::DestroyPartitionHandle()
 	{
 		partition->DestroyHandle( m_Partition );
 		m_Partition = PARTITION_INVALID_HANDLE;
+#ifndef CLIENT_DLL
+		EntitySpatialIndex_Remove( m_pOuter );
+#endif
 	}
 }
 
@@ -1318,7 +1322,10 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 
 	// Don't bother with deleted things
 	if ( !m_pOuter->edict() )
+	{
+		EntitySpatialIndex_SetMember( m_pOuter, false );
 		return;
+	}
 
 	// don't add the world
 	if ( m_pOuter->entindex() == 0 )
@@ -1329,6 +1336,11 @@ void CCollisionProperty::UpdateServerPartitionMask( )
 	if ( bIsSolid || m_pOuter->IsEFlagSet(EFL_USE_PARTITION_WHEN_NOT_SOLID) )
 	{
 		partition->Insert( PARTITION_ENGINE_NON_STATIC_EDICTS, handle );
+		EntitySpatialIndex_SetMember( m_pOuter, true );
+	}
+	else
+	{
+		EntitySpatialIndex_SetMember( m_pOuter, false );
 	}
 
 	if ( !bIsSolid )
@@ -1410,10 +1422,16 @@ void CCollisionProperty::UpdatePartition( )
 				vecSurroundMins -= Vector( 1, 1, 1 );
 				vecSurroundMaxs += Vector( 1, 1, 1 );
 				partition->ElementMoved( GetPartitionHandle(), vecSurroundMins,  vecSurroundMaxs );
+#ifndef CLIENT_DLL
+				EntitySpatialIndex_ElementMoved( m_pOuter, vecSurroundMins, vecSurroundMaxs );
+#endif
 			}
 			else
 			{
 				partition->ElementMoved( GetPartitionHandle(), GetCollisionOrigin(),  GetCollisionOrigin() );
+#ifndef CLIENT_DLL
+				EntitySpatialIndex_ElementMoved( m_pOuter, GetCollisionOrigin(), GetCollisionOrigin() );
+#endif
 			}
 		}
 	}
@@ -64,6 +64,8 @@ ConVar debug_latch_reset_onduck( "debug_latch_reset_onduck", "1", FCVAR_CHEAT );
 // [MD] I'll remove this eventually. For now, I want the ability to A/B the optimizations.
 bool g_bMovementOptimizations = true;
 
+static ConVar sv_movement_trace_cache( "sv_movement_trace_cache", "1", FCVAR_REPLICATED | FCVAR_DEVELOPMENTONLY, "Reuse identical player hull traces within a usercmd" );
+
 // Roughly how often we want to update the info about the ground surface we're on.
 // We don't need to do this very often.
 #define CATEGORIZE_GROUND_SURFACE_INTERVAL			0.3f
@@ -625,6 +627,10 @@ CGameMovement::CGameMovement( void )
 	mv					= NULL;
 
 	memset( m_flStuckCheckTime, 0, sizeof(m_flStuckCheckTime) );
+
+	m_nTraceCacheCount	= 0;
+	m_nTraceCacheNext	= 0;
+	m_bTraceCacheActive	= false;
 }
 
 //-----------------------------------------------------------------------------
@@ -1141,6 +1147,8 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 	gpGlobals->frametime *= pPlayer->GetLaggedMovementValue();
 
 	ResetGetPointContentsCache();
+	ResetTraceCache();
+	m_bTraceCacheActive = sv_movement_trace_cache.GetBool();
 
 	// Cropping movement speed scales mv->m_fForwardSpeed etc. globally
 	// Once we crop, we don't want to recursively crop again, so we set the crop
@@ -1167,6 +1175,9 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 
 	// CheckV( player->CurrentCommandNumber(), "EndPos", mv->GetAbsOrigin() );
 
+	m_bTraceCacheActive = false;
+	ResetTraceCache();
+
 	//This is probably not needed, but just in case.
 	gpGlobals->frametime = flStoreFrametime;
 
@@ -3611,6 +3622,12 @@ void CGameMovement::SetGroundEntity( trace_t *pm )
 	player->SetBaseVelocity( vecBaseVelocity );
 	player->SetGroundEntity( newGround );
 
+	// Landing on or leaving an entity can run game code, don't trust earlier traces
+	if ( newGround != oldGround )
+	{
+		ResetTraceCache();
+	}
+
 	// If we are on something...
 
 	if ( newGround )
@@ -4907,10 +4924,71 @@ void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, uns
 {
 	VPROF( "CGameMovement::TracePlayerBBox" );
 
+	Vector mins = GetPlayerMins();
+	Vector maxs = GetPlayerMaxs();
+	if ( FindCachedTrace( start, end, mins, maxs, fMask, collisionGroup, pm ) )
+		return;
+
 	Ray_t ray;
-	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
+	ray.Init( start, end, mins, maxs );
 	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
 
+	CacheTrace( start, end, mins, maxs, fMask, collisionGroup, pm );
+}
+
+void CGameMovement::ResetTraceCache()
+{
+	m_nTraceCacheCount = 0;
+	m_nTraceCacheNext = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks for an identical trace earlier in this usercmd.  Inputs are
+//			compared bit for bit so a hit is exactly what UTIL_TraceRay would return.
+//-----------------------------------------------------------------------------
+bool CGameMovement::FindCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm )
+{
+	if ( !m_bTraceCacheActive )
+		return false;
+
+	for ( int i = 0; i < m_nTraceCacheCount; i++ )
+	{
+		const MovementTraceCacheEntry_t &entry = m_TraceCache[i];
+		if ( entry.fMask != fMask || entry.collisionGroup != collisionGroup )
+			continue;
+
+		if ( memcmp( &entry.start, &start, sizeof( Vector ) ) ||
+			 memcmp( &entry.end, &end, sizeof( Vector ) ) ||
+			 memcmp( &entry.mins, &mins, sizeof( Vector ) ) ||
+			 memcmp( &entry.maxs, &maxs, sizeof( Vector ) ) )
+			continue;
+
+		VPROF_INCREMENT_COUNTER( "Movement trace cache hits", 1 );
+		pm = entry.trace;
+		return true;
+	}
+
+	VPROF_INCREMENT_COUNTER( "Movement trace cache misses", 1 );
+	return false;
+}
+
+void CGameMovement::CacheTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, const trace_t& pm )
+{
+	if ( !m_bTraceCacheActive )
+		return;
+
+	// Oldest entry goes first once we're full
+	MovementTraceCacheEntry_t &entry = m_TraceCache[ m_nTraceCacheNext ];
+	m_nTraceCacheNext = ( m_nTraceCacheNext + 1 ) % MAX_TRACE_CACHE_ENTRIES;
+	m_nTraceCacheCount = MIN( m_nTraceCacheCount + 1, (int)MAX_TRACE_CACHE_ENTRIES );
+
+	entry.start = start;
+	entry.end = end;
+	entry.mins = mins;
+	entry.maxs = maxs;
+	entry.fMask = fMask;
+	entry.collisionGroup = collisionGroup;
+	entry.trace = pm;
 }
 
 
@@ -4922,8 +5000,13 @@ void  CGameMovement::TryTouchGround( const Vector& start, const Vector& end, con
 {
 	VPROF( "CGameMovement::TryTouchGround" );
 
+	if ( FindCachedTrace( start, end, mins, maxs, fMask, collisionGroup, pm ) )
+		return;
+
 	Ray_t ray;
 	ray.Init( start, end, mins, maxs );
 	UTIL_TraceRay( ray, fMask, mv->m_nPlayerHandle.Get(), collisionGroup, &pm );
+
+	CacheTrace( start, end, mins, maxs, fMask, collisionGroup, pm );
 }
 
@@ -268,6 +268,34 @@ protected:
 	int m_CachedGetPointContents[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];
 	Vector m_CachedGetPointContentsPoint[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];	
 
+	// Cache used to remove redundant hull traces within one usercmd.  Nothing the
+	// traces can hit moves while the command runs, so a hit returns exactly the
+	// trace that would have been computed.
+	enum
+	{
+		MAX_TRACE_CACHE_ENTRIES = 8,
+	};
+
+	struct MovementTraceCacheEntry_t
+	{
+		Vector			start;
+		Vector			end;
+		Vector			mins;
+		Vector			maxs;
+		unsigned int	fMask;
+		int				collisionGroup;
+		trace_t			trace;
+	};
+
+	void			ResetTraceCache();
+	bool			FindCachedTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, trace_t& pm );
+	void			CacheTrace( const Vector& start, const Vector& end, const Vector& mins, const Vector& maxs, unsigned int fMask, int collisionGroup, const trace_t& pm );
+
+	MovementTraceCacheEntry_t m_TraceCache[ MAX_TRACE_CACHE_ENTRIES ];
+	int				m_nTraceCacheCount;
+	int				m_nTraceCacheNext;
+	bool			m_bTraceCacheActive;
+
 	Vector			m_vecProximityMins;		// Used to be globals in sv_user.cpp.
 	Vector			m_vecProximityMaxs;
 
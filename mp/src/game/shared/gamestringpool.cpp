@@ -12,10 +12,221 @@
 #include "igamesystem.h"
 #endif
 #include "gamestringpool.h"
+#include "tier0/threadtools.h"
+#if !defined(CLIENT_DLL) && !defined( GC )
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+#define STRING_POOL_BUCKETS			16384	// chains, not slots, so the pool never has to rehash
+#define STRING_POOL_KEY_BUCKETS		1024
+#define STRING_POOL_BLOCK_SIZE		(64*1024)
+
+//-----------------------------------------------------------------------------
+// Purpose: Append-only interned strings that any thread can look up or add to.
+//			Each bucket is a singly linked chain that only ever grows at the head,
+//			so lookups walk it without locking and inserts publish with one
+//			compare-and-swap. The nodes, strings included, are bump allocated out of
+//			arena blocks that live until FreeAll(), so returned pointers are stable.
+//			FreeAll() itself is not thread safe.
+//-----------------------------------------------------------------------------
+class CThreadSafeStringPool
+{
+public:
+	CThreadSafeStringPool()
+	{
+		m_pBuckets = (PooledString_t * volatile *)calloc( STRING_POOL_BUCKETS, sizeof(PooledString_t *) );
+		m_pKeyBuckets = (KeyedString_t * volatile *)calloc( STRING_POOL_KEY_BUCKETS, sizeof(KeyedString_t *) );
+		m_pBlocks = NULL;
+		m_pCurrentBlock = NULL;
+		m_nStrings = 0;
+	}
+
+	~CThreadSafeStringPool()
+	{
+		FreeAll();
+		free( (void *)m_pBuckets );
+		free( (void *)m_pKeyBuckets );
+	}
+
+	void FreeAll()
+	{
+		memset( (void *)m_pBuckets, 0, STRING_POOL_BUCKETS * sizeof(PooledString_t *) );
+		memset( (void *)m_pKeyBuckets, 0, STRING_POOL_KEY_BUCKETS * sizeof(KeyedString_t *) );
+
+		while ( m_pBlocks )
+		{
+			StringPoolBlock_t *pNext = m_pBlocks->m_pNext;
+			free( m_pBlocks );
+			m_pBlocks = pNext;
+		}
+		m_pCurrentBlock = NULL;
+		m_nStrings = 0;
+	}
+
+	int Count() const { return m_nStrings; }
+
+	const char *Find( const char *pString )
+	{
+		unsigned int nHash = StringHashFunctor()( pString );
+		return FindInChain( m_pBuckets[ nHash & ( STRING_POOL_BUCKETS - 1 ) ], NULL, nHash, pString );
+	}
+
+	const char *Allocate( const char *pString )
+	{
+		unsigned int nHash = StringHashFunctor()( pString );
+		PooledString_t * volatile *pHead = &m_pBuckets[ nHash & ( STRING_POOL_BUCKETS - 1 ) ];
+
+		PooledString_t *pNew = NULL;
+		PooledString_t *pSearched = NULL;
+		for ( ;; )
+		{
+			// Only what went in ahead of the last head we looked at needs searching
+			PooledString_t *pFirst = *pHead;
+			const char *pFound = FindInChain( pFirst, pSearched, nHash, pString );
+			if ( pFound )
+				return pFound;
+
+			if ( !pNew )
+			{
+				int nLength = Q_strlen( pString );
+				pNew = (PooledString_t *)AllocFromArena( offsetof( PooledString_t, m_szString ) + nLength + 1 );
+				pNew->m_nHash = nHash;
+				Q_memcpy( pNew->m_szString, pString, nLength + 1 );
+			}
+
+			pNew->m_pNext = pFirst;
+			if ( ThreadInterlockedAssignPointerIf( (void * volatile *)pHead, pNew, pFirst ) )
+			{
+				ThreadInterlockedIncrement( &m_nStrings );
+				return pNew->m_szString;
+			}
+
+			// Lost a race for the head. If the winner added this same string the node
+			// is simply left unused in the arena.
+			pSearched = pFirst;
+		}
+	}
+
+	const char *AllocateWithKey( const char *pString, const void *pKey )
+	{
+		unsigned int nHash = PointerHashFunctor()( pKey );
+		KeyedString_t * volatile *pHead = &m_pKeyBuckets[ nHash & ( STRING_POOL_KEY_BUCKETS - 1 ) ];
+
+		KeyedString_t *pNew = NULL;
+		KeyedString_t *pSearched = NULL;
+		for ( ;; )
+		{
+			KeyedString_t *pFirst = *pHead;
+			for ( KeyedString_t *pNode = pFirst; pNode != pSearched; pNode = pNode->m_pNext )
+			{
+				if ( pNode->m_pKey == pKey )
+					return pNode->m_pString;
+			}
+
+			if ( !pNew )
+			{
+				pNew = (KeyedString_t *)AllocFromArena( sizeof(KeyedString_t) );
+				pNew->m_pKey = pKey;
+				pNew->m_pString = Allocate( pString );
+			}
+
+			pNew->m_pNext = pFirst;
+			if ( ThreadInterlockedAssignPointerIf( (void * volatile *)pHead, pNew, pFirst ) )
+				return pNew->m_pString;
+
+			pSearched = pFirst;
+		}
+	}
+
+	void GetStrings( CUtlVector<const char *> &strings )
+	{
+		strings.EnsureCapacity( m_nStrings );
+		for ( int i = 0; i < STRING_POOL_BUCKETS; i++ )
+		{
+			for ( PooledString_t *pNode = m_pBuckets[i]; pNode; pNode = pNode->m_pNext )
+			{
+				strings.AddToTail( pNode->m_szString );
+			}
+		}
+	}
+
+private:
+	struct PooledString_t
+	{
+		PooledString_t	*m_pNext;
+		unsigned int	m_nHash;
+		char			m_szString[1];
+	};
+
+	struct KeyedString_t
+	{
+		KeyedString_t	*m_pNext;
+		const void		*m_pKey;
+		const char		*m_pString;
+	};
+
+	struct StringPoolBlock_t
+	{
+		StringPoolBlock_t	*m_pNext;
+		char				*m_pBase;
+		int					m_nSize;
+		int volatile		m_nUsed;
+	};
+
+	static const char *FindInChain( PooledString_t *pNode, PooledString_t *pStop, unsigned int nHash, const char *pString )
+	{
+		for ( ; pNode != pStop; pNode = pNode->m_pNext )
+		{
+			if ( pNode->m_nHash == nHash && !Q_strcmp( pNode->m_szString, pString ) )
+				return pNode->m_szString;
+		}
+		return NULL;
+	}
+
+	void *AllocFromArena( int nBytes )
+	{
+		nBytes = ALIGN_VALUE( nBytes, (int)sizeof(void *) );
+		for ( ;; )
+		{
+			StringPoolBlock_t *pBlock = m_pCurrentBlock;
+			if ( pBlock )
+			{
+				int nOffset = ThreadInterlockedExchangeAdd( &pBlock->m_nUsed, nBytes );
+				if ( nOffset + nBytes <= pBlock->m_nSize )
+					return pBlock->m_pBase + nOffset;
+			}
+
+			// Out of room, whoever gets here first starts the next block
+			AUTO_LOCK( m_BlockMutex );
+			if ( m_pCurrentBlock == pBlock )
+			{
+				int nSize = MAX( nBytes, STRING_POOL_BLOCK_SIZE );
+				StringPoolBlock_t *pNewBlock = (StringPoolBlock_t *)malloc( sizeof(StringPoolBlock_t) + nSize );
+				pNewBlock->m_pNext = m_pBlocks;
+				pNewBlock->m_pBase = (char *)( pNewBlock + 1 );
+				pNewBlock->m_nSize = nSize;
+				pNewBlock->m_nUsed = 0;
+				m_pBlocks = pNewBlock;
+
+				ThreadMemoryBarrier();
+				m_pCurrentBlock = pNewBlock;
+			}
+		}
+	}
+
+	PooledString_t * volatile	*m_pBuckets;
+	KeyedString_t * volatile	*m_pKeyBuckets;
+
+	StringPoolBlock_t			*m_pBlocks;
+	StringPoolBlock_t * volatile m_pCurrentBlock;
+	CThreadFastMutex			m_BlockMutex;
+	int volatile				m_nStrings;
+};
+
 //-----------------------------------------------------------------------------
 // Purpose: The actual storage for pooled per-level strings
 //-----------------------------------------------------------------------------
@@ -30,30 +241,20 @@ class CGameStringPool : public CBaseGameSystem
 
 	void FreeAll()
 	{
-#if 0 && _DEBUG
-		m_Strings.DbgCheckIntegrity();
-		m_KeyLookupCache.DbgCheckIntegrity();
-#endif
-		m_Strings.Purge();
-		m_KeyLookupCache.Purge();
+		// Nothing may be running on other threads by now, every string_t handed out dies here
+		m_Strings.FreeAll();
 	}
 
-	CUtlHashtable<CUtlConstString> m_Strings;
-	CUtlHashtable<const void*, const char*> m_KeyLookupCache;
+	CThreadSafeStringPool m_Strings;
 
 public:
 
-	CGameStringPool() : m_Strings(256) { }
-
 	~CGameStringPool() { FreeAll(); }
 
 	void Dump( void )
 	{
 		CUtlVector<const char*> strings( 0, m_Strings.Count() );
-		for (UtlHashHandle_t i = m_Strings.FirstHandle(); i != m_Strings.InvalidHandle(); i = m_Strings.NextHandle(i))
-		{
-			strings.AddToTail( strings[i] );
-		}
+		m_Strings.GetStrings( strings );
 		struct _Local {
 			static int __cdecl F(const char * const *a, const char * const *b) { return strcmp(*a, *b); }
 		};
@@ -69,23 +270,17 @@ public:
 
 	const char *Find(const char *string)
 	{
-		UtlHashHandle_t i = m_Strings.Find( string );
-		return i == m_Strings.InvalidHandle() ? NULL : m_Strings[ i ].Get();
+		return m_Strings.Find( string );
 	}
 
 	const char *Allocate(const char *string)
 	{
-		return m_Strings[ m_Strings.Insert( string ) ].Get();
+		return m_Strings.Allocate( string );
 	}
 
 	const char *AllocateWithKey(const char *string, const void* key)
 	{
-		const char * &cached = m_KeyLookupCache[ m_KeyLookupCache.Insert( key, NULL ) ];
-		if (cached == NULL)
-		{
-			cached = Allocate( string );
-		}
-		return cached;
+		return m_Strings.AllocateWithKey( string, key );
 	}
 };
 
@@ -135,4 +330,124 @@ void CC_DumpGameStringTable( void )
 	g_GameStringPool.Dump();
 }
 static ConCommand dumpgamestringtable("dumpgamestringtable", CC_DumpGameStringTable, "Dump the contents of the game string table to the console.", FCVAR_CHEAT);
+
+//------------------------------------------------------------------------------
+// Purpose: Contended throughput of the pool against the old hashtable behind a
+//			mutex. Runs on private pools, the level's strings aren't touched.
+//------------------------------------------------------------------------------
+class CLockedStringPool
+{
+public:
+	CLockedStringPool() : m_Strings( 256 ) {}
+
+	const char *Find( const char *pString )
+	{
+		AUTO_LOCK( m_Mutex );
+		UtlHashHandle_t i = m_Strings.Find( pString );
+		return i == m_Strings.InvalidHandle() ? NULL : m_Strings[ i ].Get();
+	}
+
+	const char *Allocate( const char *pString )
+	{
+		AUTO_LOCK( m_Mutex );
+		return m_Strings[ m_Strings.Insert( pString ) ].Get();
+	}
+
+private:
+	CThreadFastMutex m_Mutex;
+	CUtlHashtable<CUtlConstString> m_Strings;
+};
+
+struct StringPoolBenchmarkJob_t
+{
+	CThreadSafeStringPool	*m_pPool;
+	CLockedStringPool		*m_pLockedPool;
+	int						m_nOps;
+	unsigned int			m_nSeed;
+};
+
+static CUtlVector<CUtlString> s_StringPoolBenchmarkNames;
+
+// Mostly lookups of strings that are already in, with an allocate mixed in every few ops
+template < class POOL >
+static void RunStringPoolBenchmark( POOL *pPool, StringPoolBenchmarkJob_t &job )
+{
+	unsigned int nSeed = job.m_nSeed;
+	int nNames = s_StringPoolBenchmarkNames.Count();
+	for ( int i = 0; i < job.m_nOps; i++ )
+	{
+		nSeed = nSeed * 1664525 + 1013904223;
+		const char *pName = s_StringPoolBenchmarkNames[ ( nSeed >> 8 ) % nNames ].Get();
+		if ( ( nSeed & 7 ) == 0 || !pPool->Find( pName ) )
+		{
+			pPool->Allocate( pName );
+		}
+	}
+}
+
+static void StringPoolBenchmarkJob( StringPoolBenchmarkJob_t &job )
+{
+	if ( job.m_pPool )
+	{
+		RunStringPoolBenchmark( job.m_pPool, job );
+	}
+	else
+	{
+		RunStringPoolBenchmark( job.m_pLockedPool, job );
+	}
+}
+
+static float TimeStringPoolBenchmark( CThreadSafeStringPool *pPool, CLockedStringPool *pLockedPool, int nThreads, int nOps )
+{
+	CUtlVector<StringPoolBenchmarkJob_t> jobs;
+	jobs.SetCount( nThreads );
+	for ( int i = 0; i < nThreads; i++ )
+	{
+		jobs[i].m_pPool = pPool;
+		jobs[i].m_pLockedPool = pLockedPool;
+		jobs[i].m_nOps = nOps;
+		jobs[i].m_nSeed = i * 7919 + 1;
+	}
+
+	CFastTimer timer;
+	timer.Start();
+	ParallelProcess( "StringPoolBenchmark", jobs.Base(), jobs.Count(), &StringPoolBenchmarkJob );
+	timer.End();
+
+	return timer.GetDuration().GetMillisecondsF();
+}
+
+CON_COMMAND( gamestringpool_benchmark, "Compare contended string pool throughput against a mutex-guarded hashtable. Args: [unique strings] [ops per thread]" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	int nNames = ( args.ArgC() > 1 ) ? MAX( 1, atoi( args[1] ) ) : 20000;
+	int nOps = ( args.ArgC() > 2 ) ? MAX( 1, atoi( args[2] ) ) : 200000;
+	int nThreads = g_pThreadPool ? g_pThreadPool->NumThreads() + 1 : 1;
+
+	s_StringPoolBenchmarkNames.SetCount( nNames );
+	for ( int i = 0; i < nNames; i++ )
+	{
+		char szName[64];
+		Q_snprintf( szName, sizeof(szName), "models/benchmark/prop_%d.mdl", i );
+		s_StringPoolBenchmarkNames[i] = szName;
+	}
+
+	CLockedStringPool *pLockedPool = new CLockedStringPool;
+	float flLocked = TimeStringPoolBenchmark( NULL, pLockedPool, nThreads, nOps );
+	delete pLockedPool;
+
+	CThreadSafeStringPool *pPool = new CThreadSafeStringPool;
+	float flLockFree = TimeStringPoolBenchmark( pPool, NULL, nThreads, nOps );
+	int nPooled = pPool->Count();
+	delete pPool;
+
+	s_StringPoolBenchmarkNames.Purge();
+
+	float flTotalOps = (float)nThreads * nOps;
+	Msg( "String pool, %d threads x %d ops over %d strings:\n", nThreads, nOps, nNames );
+	Msg( "  mutex + hashtable: %8.2f ms, %6.2f Mops/s\n", flLocked, flLocked > 0.0f ? flTotalOps / ( flLocked * 1000.0f ) : 0.0f );
+	Msg( "  lock-free pool:    %8.2f ms, %6.2f Mops/s (%d strings)\n", flLockFree, flLockFree > 0.0f ? flTotalOps / ( flLockFree * 1000.0f ) : 0.0f, nPooled );
+}
 #endif
@@ -3,6 +3,8 @@
 // Purpose: Pool of all per-level strings. Allocates memory for strings, 
 //			consolodating duplicates. The memory is freed on behalf of clients
 //			at level transition. Strings are of type string_t.
+//			Allocating and finding strings is safe from any thread. The
+//			pool is only reset at level shutdown, when no jobs are running.
 //
 // $NoKeywords: $
 //=============================================================================//
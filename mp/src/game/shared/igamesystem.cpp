@@ -11,6 +11,7 @@
 #include "datacache/imdlcache.h"
 #include "utlvector.h"
 #include "vprof.h"
+#include "loadprofiler.h"
 #if defined( _X360 )
 #include "xbox/xbox_console.h"
 #endif
@@ -350,7 +351,9 @@ void IGameSystem::PreClientUpdateAllSystems()
 //-----------------------------------------------------------------------------
 void InvokeMethod( GameSystemFunc_t f, char const *timed /*=0*/ )
 {
-	NOTE_UNUSED( timed );
+	// Level loads get a phase per system when the load profiler is running
+	bool bProfile = timed && g_LoadProfiler.IsActive();
+	int iPhase = bProfile ? g_LoadProfiler.BeginPhase( timed ) : -1;
 
 	int i;
 	int c = s_GameSystems.Count();
@@ -360,8 +363,12 @@ void InvokeMethod( GameSystemFunc_t f, char const *timed /*=0*/ )
 
 		MDLCACHE_CRITICAL_SECTION();
 
+		int iSysPhase = bProfile ? g_LoadProfiler.BeginPhase( sys->Name() ) : -1;
 		(sys->*f)();
+		g_LoadProfiler.EndPhase( iSysPhase );
 	}
+
+	g_LoadProfiler.EndPhase( iPhase );
 }
 
 //-----------------------------------------------------------------------------
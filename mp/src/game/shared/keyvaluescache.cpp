@@ -0,0 +1,64 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Console commands for the parsed file cache KeyValues::LoadFromFile
+//			keeps in each DLL.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "KeyValues.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#ifdef CLIENT_DLL
+#define KEYVALUES_CACHE_DLL "client"
+#else
+#define KEYVALUES_CACHE_DLL "server"
+#endif
+
+//-----------------------------------------------------------------------------
+// Reports on the parsed file cache KeyValues::LoadFromFile keeps in this DLL
+//-----------------------------------------------------------------------------
+static void KeyValuesCacheStats()
+{
+	KeyValuesParsedFileCacheStats_t stats;
+	KeyValues::GetParsedFileCacheStats( stats );
+
+	Msg( "KeyValues parsed file cache (%s): %d files, %.1f KB\n", KEYVALUES_CACHE_DLL, stats.m_nFiles, stats.m_nMemoryBytes / 1024.0f );
+	Msg( "  loads: %d hits, %d misses, %d uncacheable\n", stats.m_nHits, stats.m_nMisses, stats.m_nUncacheable );
+	Msg( "  parsed:   %8.2f ms for %.1f KB of text\n", stats.m_flParseTime * 1000.0, stats.m_nParseBytes / 1024.0 );
+	Msg( "  restored: %8.2f ms for %.1f KB of text\n", stats.m_flRestoreTime * 1000.0, stats.m_nRestoreBytes / 1024.0 );
+
+	if ( stats.m_nParseBytes && stats.m_nRestoreBytes )
+	{
+		// What the hits would have cost at the rate the misses parsed
+		double flParseTime = stats.m_flParseTime * ( (double)stats.m_nRestoreBytes / (double)stats.m_nParseBytes );
+		Msg( "  saved about %.2f ms (%.1fx faster than parsing)\n", ( flParseTime - stats.m_flRestoreTime ) * 1000.0,
+			stats.m_flRestoreTime > 0 ? flParseTime / stats.m_flRestoreTime : 0.0 );
+	}
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_keyvalues_cache_stats, "Report hits and parse time saved by the client's KeyValues file cache" )
+#else
+CON_COMMAND( sv_keyvalues_cache_stats, "Report hits and parse time saved by the server's KeyValues file cache" )
+#endif
+{
+	KeyValuesCacheStats();
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_keyvalues_cache_flush, "Empty the client's KeyValues file cache" )
+#else
+CON_COMMAND( sv_keyvalues_cache_flush, "Empty the server's KeyValues file cache" )
+#endif
+{
+#ifndef CLIENT_DLL
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+#endif
+
+	KeyValues::FlushParsedFileCache();
+}
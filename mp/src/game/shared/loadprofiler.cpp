@@ -0,0 +1,314 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hierarchical timing + allocation profiler for level loads.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "loadprofiler.h"
+#include "igamesystem.h"
+#include "filesystem.h"
+#include "tier0/memalloc.h"
+#include "tier1/utlbuffer.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+#ifdef CLIENT_DLL
+static ConVar cl_load_profile( "cl_load_profile", "0", 0, "Time each client level load phase and write a JSON trace to loadprofile/" );
+#define load_profile cl_load_profile
+#define LOAD_PROFILE_DLL "client"
+#else
+static ConVar sv_load_profile( "sv_load_profile", "0", 0, "Time each server level load phase and write a JSON trace to loadprofile/" );
+#define load_profile sv_load_profile
+#define LOAD_PROFILE_DLL "server"
+#endif
+
+CLoadProfiler g_LoadProfiler;
+
+
+#if !defined(STEAM) && !defined(NO_MALLOC_OVERRIDE)
+
+//-----------------------------------------------------------------------------
+// Sits in front of the tier0 allocator while a session is running and counts
+// what goes through it. This is process wide, so allocations made by other
+// threads during the load are counted too. Linux builds don't route malloc
+// through g_pMemAlloc, so the counts there only see explicit MemAlloc_ calls.
+//
+// The client and server each have one of these but g_pMemAlloc is shared, so
+// only one may be installed at a time: a hook stacked on the other DLL's would
+// call into it after that DLL is gone. Whoever starts second goes without
+// allocation counts.
+//-----------------------------------------------------------------------------
+static CInterlockedInt	s_nLoadAllocCount;
+static CInterlockedInt	s_nLoadFreeCount;
+static int64 volatile	s_nLoadAllocBytes;
+
+class CLoadProfileMemAlloc : public IMemAlloc
+{
+public:
+	// Remember the allocator tier0 gave us, before anybody could have hooked it
+	CLoadProfileMemAlloc() : m_pActual( g_pMemAlloc ), m_bInstalled( false ) {}
+
+	bool Install()
+	{
+		if ( m_bInstalled )
+			return true;
+		if ( g_pMemAlloc != m_pActual )
+		{
+			// The other DLL's profiler (or something else) is hooked in already
+			return false;
+		}
+		g_pMemAlloc = this;
+		m_bInstalled = true;
+		return true;
+	}
+
+	void Uninstall()
+	{
+		if ( !m_bInstalled )
+			return;
+
+		// Nobody can hook in above us, see Install. m_pActual stays valid because
+		// other threads may still be inside one of our calls.
+		Assert( g_pMemAlloc == this );
+		g_pMemAlloc = m_pActual;
+		m_bInstalled = false;
+	}
+
+	void CountAlloc( size_t nSize )
+	{
+		++s_nLoadAllocCount;
+		ThreadInterlockedExchangeAdd64( &s_nLoadAllocBytes, (int64)nSize );
+	}
+
+	virtual void *Alloc( size_t nSize )												{ CountAlloc( nSize ); return m_pActual->Alloc( nSize ); }
+	virtual void *Realloc( void *pMem, size_t nSize )								{ CountAlloc( nSize ); return m_pActual->Realloc( pMem, nSize ); }
+	virtual void Free( void *pMem )													{ if ( pMem ) ++s_nLoadFreeCount; m_pActual->Free( pMem ); }
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize )				{ return m_pActual->Expand_NoLongerSupported( pMem, nSize ); }
+
+	virtual void *Alloc( size_t nSize, const char *pFileName, int nLine )			{ CountAlloc( nSize ); return m_pActual->Alloc( nSize, pFileName, nLine ); }
+	virtual void *Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine )	{ CountAlloc( nSize ); return m_pActual->Realloc( pMem, nSize, pFileName, nLine ); }
+	virtual void  Free( void *pMem, const char *pFileName, int nLine )				{ if ( pMem ) ++s_nLoadFreeCount; m_pActual->Free( pMem, pFileName, nLine ); }
+	virtual void *Expand_NoLongerSupported( void *pMem, size_t nSize, const char *pFileName, int nLine ) { return m_pActual->Expand_NoLongerSupported( pMem, nSize, pFileName, nLine ); }
+
+	virtual size_t GetSize( void *pMem )											{ return m_pActual->GetSize( pMem ); }
+	virtual void PushAllocDbgInfo( const char *pFileName, int nLine )				{ m_pActual->PushAllocDbgInfo( pFileName, nLine ); }
+	virtual void PopAllocDbgInfo()													{ m_pActual->PopAllocDbgInfo(); }
+
+	virtual long CrtSetBreakAlloc( long lNewBreakAlloc )							{ return m_pActual->CrtSetBreakAlloc( lNewBreakAlloc ); }
+	virtual	int CrtSetReportMode( int nReportType, int nReportMode )				{ return m_pActual->CrtSetReportMode( nReportType, nReportMode ); }
+	virtual int CrtIsValidHeapPointer( const void *pMem )							{ return m_pActual->CrtIsValidHeapPointer( pMem ); }
+	virtual int CrtIsValidPointer( const void *pMem, unsigned int size, int access ) { return m_pActual->CrtIsValidPointer( pMem, size, access ); }
+	virtual int CrtCheckMemory( void )												{ return m_pActual->CrtCheckMemory(); }
+	virtual int CrtSetDbgFlag( int nNewFlag )										{ return m_pActual->CrtSetDbgFlag( nNewFlag ); }
+	virtual void CrtMemCheckpoint( _CrtMemState *pState )							{ m_pActual->CrtMemCheckpoint( pState ); }
+
+	virtual void DumpStats()														{ m_pActual->DumpStats(); }
+	virtual void DumpStatsFileBase( char const *pchFileBase )						{ m_pActual->DumpStatsFileBase( pchFileBase ); }
+
+	virtual void* CrtSetReportFile( int nRptType, void* hFile )						{ return m_pActual->CrtSetReportFile( nRptType, hFile ); }
+	virtual void* CrtSetReportHook( void* pfnNewHook )								{ return m_pActual->CrtSetReportHook( pfnNewHook ); }
+	virtual int CrtDbgReport( int nRptType, const char * szFile, int nLine, const char * szModule, const char * pMsg ) { return m_pActual->CrtDbgReport( nRptType, szFile, nLine, szModule, pMsg ); }
+
+	virtual int heapchk()															{ return m_pActual->heapchk(); }
+	virtual bool IsDebugHeap()														{ return m_pActual->IsDebugHeap(); }
+
+	virtual void GetActualDbgInfo( const char *&pFileName, int &nLine )				{ m_pActual->GetActualDbgInfo( pFileName, nLine ); }
+	virtual void RegisterAllocation( const char *pFileName, int nLine, int nLogicalSize, int nActualSize, unsigned nTime )	{ m_pActual->RegisterAllocation( pFileName, nLine, nLogicalSize, nActualSize, nTime ); }
+	virtual void RegisterDeallocation( const char *pFileName, int nLine, int nLogicalSize, int nActualSize, unsigned nTime )	{ m_pActual->RegisterDeallocation( pFileName, nLine, nLogicalSize, nActualSize, nTime ); }
+
+	virtual int GetVersion()														{ return m_pActual->GetVersion(); }
+	virtual void CompactHeap()														{ m_pActual->CompactHeap(); }
+	virtual MemAllocFailHandler_t SetAllocFailHandler( MemAllocFailHandler_t pfn )	{ return m_pActual->SetAllocFailHandler( pfn ); }
+	virtual void DumpBlockStats( void *p )											{ m_pActual->DumpBlockStats( p ); }
+
+#if defined( _MEMTEST )
+	virtual void SetStatsExtraInfo( const char *pMapName, const char *pComment )	{ m_pActual->SetStatsExtraInfo( pMapName, pComment ); }
+#endif
+
+	virtual size_t MemoryAllocFailed()												{ return m_pActual->MemoryAllocFailed(); }
+
+	virtual uint32 GetDebugInfoSize()												{ return m_pActual->GetDebugInfoSize(); }
+	virtual void SaveDebugInfo( void *pvDebugInfo )									{ m_pActual->SaveDebugInfo( pvDebugInfo ); }
+	virtual void RestoreDebugInfo( const void *pvDebugInfo )						{ m_pActual->RestoreDebugInfo( pvDebugInfo ); }
+	virtual void InitDebugInfo( void *pvDebugInfo, const char *pchRootFileName, int nLine ) { m_pActual->InitDebugInfo( pvDebugInfo, pchRootFileName, nLine ); }
+
+	virtual void GlobalMemoryStatus( size_t *pUsedMemory, size_t *pFreeMemory )		{ m_pActual->GlobalMemoryStatus( pUsedMemory, pFreeMemory ); }
+
+private:
+	IMemAlloc	*m_pActual;
+	bool		m_bInstalled;
+};
+
+static CLoadProfileMemAlloc s_LoadProfileMemAlloc;
+
+#define LOAD_PROFILE_HOOK_ALLOCATOR()	s_LoadProfileMemAlloc.Install()
+#define LOAD_PROFILE_UNHOOK_ALLOCATOR()	s_LoadProfileMemAlloc.Uninstall()
+#define LOAD_PROFILE_ALLOC_COUNT()		( (int)s_nLoadAllocCount )
+#define LOAD_PROFILE_ALLOC_BYTES()		( s_nLoadAllocBytes )
+#define LOAD_PROFILE_FREE_COUNT()		( (int)s_nLoadFreeCount )
+
+#else
+
+#define LOAD_PROFILE_HOOK_ALLOCATOR()	true
+#define LOAD_PROFILE_UNHOOK_ALLOCATOR()	((void)0)
+#define LOAD_PROFILE_ALLOC_COUNT()		0
+#define LOAD_PROFILE_ALLOC_BYTES()		0
+#define LOAD_PROFILE_FREE_COUNT()		0
+
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Makes sure a session never outlives the level or the DLL, the allocator
+// hook must be gone before we are unloaded.
+//-----------------------------------------------------------------------------
+class CLoadProfilerSystem : public CAutoGameSystem
+{
+public:
+	CLoadProfilerSystem() : CAutoGameSystem( "CLoadProfilerSystem" ) {}
+
+	virtual void LevelShutdownPreEntity()
+	{
+		g_LoadProfiler.EndSession( false );
+	}
+
+	virtual void Shutdown()
+	{
+		g_LoadProfiler.EndSession( false );
+	}
+};
+
+static CLoadProfilerSystem s_LoadProfilerSystem;
+
+
+CLoadProfiler::CLoadProfiler()
+{
+	m_szMapName[0] = 0;
+	m_flSessionStart = 0;
+	m_bActive = false;
+}
+
+void CLoadProfiler::BeginSession( const char *pMapName )
+{
+	EndSession( false );
+
+	if ( !load_profile.GetBool() )
+		return;
+
+	Q_FileBase( pMapName, m_szMapName, sizeof( m_szMapName ) );
+	m_Phases.RemoveAll();
+	m_PhaseStack.RemoveAll();
+	m_flSessionStart = Plat_FloatTime();
+	m_bActive = true;
+
+	if ( !LOAD_PROFILE_HOOK_ALLOCATOR() )
+	{
+		Warning( "Level load profile (%s): another allocator hook is installed, allocations won't be counted\n", LOAD_PROFILE_DLL );
+	}
+}
+
+void CLoadProfiler::EndSession( bool bWriteTrace )
+{
+	if ( !m_bActive )
+		return;
+
+	while ( m_PhaseStack.Count() )
+	{
+		EndPhase( m_PhaseStack.Tail() );
+	}
+
+	LOAD_PROFILE_UNHOOK_ALLOCATOR();
+	m_bActive = false;
+
+	if ( bWriteTrace )
+	{
+		WriteTrace();
+	}
+}
+
+int CLoadProfiler::BeginPhase( const char *pName )
+{
+	if ( !m_bActive )
+		return -1;
+
+	int iPhase = m_Phases.AddToTail();
+	LoadProfilePhase_t &phase = m_Phases[iPhase];
+	phase.m_pName = pName;
+	phase.m_nParent = m_PhaseStack.Count() ? m_PhaseStack.Tail() : -1;
+	phase.m_nDepth = m_PhaseStack.Count();
+	phase.m_flStartTime = Plat_FloatTime() - m_flSessionStart;
+	phase.m_flDuration = 0;
+
+	// Hold the counters at the start, EndPhase turns them into deltas
+	phase.m_nAllocCount = LOAD_PROFILE_ALLOC_COUNT();
+	phase.m_nAllocBytes = LOAD_PROFILE_ALLOC_BYTES();
+	phase.m_nFreeCount = LOAD_PROFILE_FREE_COUNT();
+
+	m_PhaseStack.AddToTail( iPhase );
+	return iPhase;
+}
+
+void CLoadProfiler::EndPhase( int iPhase )
+{
+	// The session may have ended (and even restarted) under an open scope
+	if ( !m_bActive || iPhase < 0 || !m_PhaseStack.Count() )
+		return;
+
+	// Closing an outer phase closes anything left open inside it
+	int iStack = m_PhaseStack.Find( iPhase );
+	if ( iStack == m_PhaseStack.InvalidIndex() )
+		return;
+
+	while ( m_PhaseStack.Count() > iStack )
+	{
+		LoadProfilePhase_t &phase = m_Phases[ m_PhaseStack.Tail() ];
+		phase.m_flDuration = Plat_FloatTime() - m_flSessionStart - phase.m_flStartTime;
+		phase.m_nAllocCount = LOAD_PROFILE_ALLOC_COUNT() - phase.m_nAllocCount;
+		phase.m_nAllocBytes = LOAD_PROFILE_ALLOC_BYTES() - phase.m_nAllocBytes;
+		phase.m_nFreeCount = LOAD_PROFILE_FREE_COUNT() - phase.m_nFreeCount;
+		m_PhaseStack.RemoveMultipleFromTail( 1 );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Writes the phases in the chrome://tracing "complete event" format, with the
+// hierarchy repeated in args so scripts don't have to rebuild it from times.
+//-----------------------------------------------------------------------------
+void CLoadProfiler::WriteTrace()
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	buf.Printf( "{\n\t\"map\": \"%s\",\n\t\"dll\": \"%s\",\n\t\"traceEvents\": [\n", m_szMapName, LOAD_PROFILE_DLL );
+
+	double flTotal = 0;
+	for ( int i = 0; i < m_Phases.Count(); i++ )
+	{
+		const LoadProfilePhase_t &phase = m_Phases[i];
+		if ( phase.m_nDepth == 0 )
+		{
+			flTotal += phase.m_flDuration;
+		}
+
+		buf.Printf( "\t\t{ \"name\": \"%s\", \"cat\": \"load\", \"ph\": \"X\", \"pid\": 0, \"tid\": \"%s\", \"ts\": %.0f, \"dur\": %.0f, "
+			"\"args\": { \"id\": %d, \"parent\": %d, \"depth\": %d, \"allocs\": %d, \"alloc_bytes\": %lld, \"frees\": %d } }%s\n",
+			phase.m_pName, LOAD_PROFILE_DLL, phase.m_flStartTime * 1e6, phase.m_flDuration * 1e6,
+			i, phase.m_nParent, phase.m_nDepth, phase.m_nAllocCount, (long long)phase.m_nAllocBytes, phase.m_nFreeCount,
+			( i + 1 < m_Phases.Count() ) ? "," : "" );
+	}
+
+	buf.Printf( "\t]\n}\n" );
+
+	char szFileName[MAX_PATH];
+	Q_snprintf( szFileName, sizeof( szFileName ), "loadprofile/%s_%s.json", m_szMapName, LOAD_PROFILE_DLL );
+	filesystem->CreateDirHierarchy( "loadprofile", "DEFAULT_WRITE_PATH" );
+	if ( filesystem->WriteFile( szFileName, "DEFAULT_WRITE_PATH", buf ) )
+	{
+		Msg( "Level load profile (%s): %.3f seconds in %d phases, wrote %s\n", LOAD_PROFILE_DLL, flTotal, m_Phases.Count(), szFileName );
+	}
+	else
+	{
+		Warning( "Level load profile (%s): couldn't write %s\n", LOAD_PROFILE_DLL, szFileName );
+	}
+}
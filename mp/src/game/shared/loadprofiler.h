@@ -0,0 +1,90 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Hierarchical timing + allocation profiler for level loads.
+//
+//			A session runs from the start of a level load to the point where the
+//			level is ready to play. LOAD_PROFILE_SCOPE() marks a phase inside it,
+//			phases nest. When the session ends the phases are written out as a
+//			chrome://tracing compatible JSON file, one per DLL:
+//
+//				loadprofile/<map>_server.json
+//				loadprofile/<map>_client.json
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef LOADPROFILER_H
+#define LOADPROFILER_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+
+//-----------------------------------------------------------------------------
+// One timed phase of a level load
+//-----------------------------------------------------------------------------
+struct LoadProfilePhase_t
+{
+	const char	*m_pName;			// must outlive the session, use literals
+	int			m_nParent;			// index of the enclosing phase, -1 for top level
+	int			m_nDepth;
+	double		m_flStartTime;		// seconds since the session began
+	double		m_flDuration;
+	int			m_nAllocCount;		// allocations made while the phase was open, children included
+	int64		m_nAllocBytes;
+	int			m_nFreeCount;
+};
+
+class CLoadProfiler
+{
+public:
+	CLoadProfiler();
+
+	// Starts a new session, discarding any that was left open
+	void BeginSession( const char *pMapName );
+
+	// Closes any open phases, writes the trace and stops counting allocations
+	void EndSession( bool bWriteTrace = true );
+
+	bool IsActive() const { return m_bActive; }
+
+	// Returns the phase index to hand to EndPhase, or -1 when no session is running
+	int BeginPhase( const char *pName );
+	void EndPhase( int iPhase );
+
+private:
+	void WriteTrace();
+
+	CUtlVector<LoadProfilePhase_t>	m_Phases;
+	CUtlVector<int>					m_PhaseStack;
+	char							m_szMapName[MAX_PATH];
+	double							m_flSessionStart;
+	bool							m_bActive;
+};
+
+extern CLoadProfiler g_LoadProfiler;
+
+//-----------------------------------------------------------------------------
+// Times the enclosing block as a load phase
+//-----------------------------------------------------------------------------
+class CLoadProfileScope
+{
+public:
+	CLoadProfileScope( const char *pName )
+	{
+		m_iPhase = g_LoadProfiler.BeginPhase( pName );
+	}
+
+	~CLoadProfileScope()
+	{
+		g_LoadProfiler.EndPhase( m_iPhase );
+	}
+
+private:
+	int m_iPhase;
+};
+
+#define LOAD_PROFILE_SCOPE( name )	CLoadProfileScope _loadProfileScope( name )
+
+#endif // LOADPROFILER_H
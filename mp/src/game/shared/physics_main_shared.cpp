@@ -18,6 +18,9 @@
 #include "igamesystem.h"
 #include "utlmultilist.h"
 #include "tier1/callqueue.h"
+#if !defined( CLIENT_DLL )
+#include "parallel_think.h"
+#endif
 
 #ifdef PORTAL
 	#include "portal_util_shared.h"
@@ -2109,7 +2112,10 @@ bool CBaseEntity::PhysicsRunSpecificThink( int nContextIndex, BASEPTR thinkFunc
 	
 	// Only do this on the game server
 #if !defined( CLIENT_DLL )
-	g_ThinkChecker.EntityThinking( gpGlobals->tickcount, this, thinktime, m_nNextThinkTick );
+	if ( !ParallelThink_ShouldDefer() )
+	{
+		g_ThinkChecker.EntityThinking( gpGlobals->tickcount, this, thinktime, m_nNextThinkTick );
+	}
 #endif
 
 	SetNextThink( nContextIndex, TICK_NEVER_THINK );
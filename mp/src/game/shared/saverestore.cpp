@@ -24,6 +24,8 @@
 #include "vphysics/object_hash.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier0/fasttimer.h"
+#include "vstdlib/jobthread.h"
 
 #if !defined( CLIENT_DLL )
 
@@ -191,7 +193,9 @@ inputfunc_t *UTIL_FunctionFromName( datamap_t *pMap, const char *pName )
 CSave::CSave( CSaveRestoreData *pdata )
  :	m_pData(pdata),
 	m_pGameInfo( pdata ),
-	m_bAsync( pdata->bAsync )
+	m_bAsync( pdata->bAsync ),
+	m_pSymbolFixups( NULL ),
+	m_bOverflowed( false )
 {
 	m_BlockStartStack.EnsureCapacity( 32 );
 
@@ -199,6 +203,18 @@ CSave::CSave( CSaveRestoreData *pdata )
 	m_hLogFile = NULL;
 }
 
+CSave::CSave( CSaveRestoreSegment *pSegment, CGameSaveRestoreInfo *pGameInfo, bool bAsync, CUtlVector<SaveSymbolFixup_t> *pSymbolFixups )
+ :	m_pData( pSegment ),
+	m_pGameInfo( pGameInfo ),
+	m_bAsync( bAsync ),
+	m_pSymbolFixups( pSymbolFixups ),
+	m_bOverflowed( false )
+{
+	m_BlockStartStack.EnsureCapacity( 32 );
+
+	m_hLogFile = NULL;
+}
+
 //-------------------------------------
 
 inline int CSave::DataEmpty( const char *pdata, int size )
@@ -376,7 +392,12 @@ int CSave::GetWritePos() const
 
 void CSave::SetWritePos(int pos)
 {
-	m_pData->Seek(pos); 
+	if ( !m_pData->Seek(pos) && m_pSymbolFixups )
+	{
+		// Seek() won't go to the very end of the buffer, so an EndBlock() that lands
+		// there has to be treated as running out of room too
+		m_bOverflowed = true;
+	}
 }
 
 //-------------------------------------
@@ -930,7 +951,6 @@ void CSave::BufferField( const char *pname, int size, const char *pdata )
 void CSave::WriteHeader( const char *pname, int size )
 {
 	short shortSize = size;
-	short hashvalue = m_pData->FindCreateSymbol( pname );
 	if ( size > SHRT_MAX || size < 0 )
 	{
 		Warning( "CSave::WriteHeader() size parameter exceeds 'short'!\n" );
@@ -938,6 +958,19 @@ void CSave::WriteHeader( const char *pname, int size )
 	}
 
 	BufferData( (const char *)&shortSize, sizeof(short) );
+
+	if ( m_pSymbolFixups )
+	{
+		// The symbol table belongs to the main thread, it gets patched in when this is spliced
+		SaveSymbolFixup_t fixup = { m_pData->GetCurPos(), pname };
+		m_pSymbolFixups->AddToTail( fixup );
+
+		short placeholder = 0;
+		BufferData( (const char *)&placeholder, sizeof(short) );
+		return;
+	}
+
+	short hashvalue = m_pData->FindCreateSymbol( pname );
 	BufferData( (const char *)&hashvalue, sizeof(short) );
 }
 
@@ -950,6 +983,12 @@ void CSave::BufferData( const char *pdata, int size )
 
 	if ( !m_pData->Write( pdata, size ) )
 	{
+		if ( m_pSymbolFixups )
+		{
+			m_bOverflowed = true;
+			return;
+		}
+
 		Warning( "Save/Restore overflow!\n" );
 		Assert(0);
 	}
@@ -1270,7 +1309,9 @@ bool CSave::WriteGameField( const char *pname, void *pData, datamap_t *pRootMap,
 				const model_t *pModel = modelinfo->GetModel( nModelIndex );
 				if ( pModel )
 				{
-					strModelName = AllocPooledString( modelinfo->GetModelName( pModel ) );
+					// The string pool isn't thread safe, and the name only has to last for this write
+					const char *pModelName = modelinfo->GetModelName( pModel );
+					strModelName = m_pSymbolFixups ? MAKE_STRING( pModelName ) : AllocPooledString( pModelName );
 				}
 				WriteString( pField->fieldName, (string_t *)&strModelName, pField->fieldSize );
 			}
@@ -1496,6 +1537,149 @@ bool CRestore::ShouldReadField( typedescription_t *pField )
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Save symbol -> field index cache
+//
+// The symbols in a save file index its own symbol table, so they only mean
+// something for the duration of one restore. Rather than tie the cache to a
+// table the engine owns, every hit is confirmed with a single name compare
+// against the field it points at, and a stale or missing entry just falls
+// back to the linear FindField() search and gets overwritten. Field arrays
+// come from the engine as well as from our own datamaps, so the caches are
+// kept here keyed by the field array instead of inside datamap_t.
+//-----------------------------------------------------------------------------
+ConVar save_field_lookup_cache( "save_field_lookup_cache", "1", 0, "Resolve restored fields through a per-datamap save symbol cache instead of searching the field names" );
+
+class CSaveFieldSymbolCache
+{
+public:
+	CSaveFieldSymbolCache() : m_nUsed( 0 ) {}
+
+	int Find( int symbol ) const
+	{
+		if ( !m_Slots.Count() )
+			return -1;
+
+		int nMask = m_Slots.Count() - 1;
+		for ( int i = Hash( symbol ) & nMask; ; i = ( i + 1 ) & nMask )
+		{
+			const Slot_t &slot = m_Slots[i];
+			if ( slot.m_nSymbol == symbol )
+				return slot.m_nField;
+			if ( slot.m_nSymbol < 0 )
+				return -1;
+		}
+	}
+
+	void Insert( int symbol, int iField )
+	{
+		if ( ( m_nUsed + 1 ) * 2 > m_Slots.Count() )
+		{
+			Grow();
+		}
+
+		int nMask = m_Slots.Count() - 1;
+		for ( int i = Hash( symbol ) & nMask; ; i = ( i + 1 ) & nMask )
+		{
+			Slot_t &slot = m_Slots[i];
+			if ( slot.m_nSymbol == symbol )
+			{
+				slot.m_nField = iField;
+				return;
+			}
+			if ( slot.m_nSymbol < 0 )
+			{
+				slot.m_nSymbol = symbol;
+				slot.m_nField = iField;
+				m_nUsed++;
+				return;
+			}
+		}
+	}
+
+private:
+	struct Slot_t
+	{
+		int		m_nSymbol;		// -1 for an empty slot
+		int		m_nField;
+	};
+
+	static unsigned Hash( int symbol )
+	{
+		return (unsigned)symbol * 2654435761u >> 8;
+	}
+
+	void Grow()
+	{
+		CUtlVector<Slot_t> oldSlots;
+		oldSlots.Swap( m_Slots );
+
+		m_Slots.SetCount( MAX( 16, oldSlots.Count() * 2 ) );
+		for ( int i = 0; i < m_Slots.Count(); i++ )
+		{
+			m_Slots[i].m_nSymbol = -1;
+		}
+
+		m_nUsed = 0;
+		for ( int i = 0; i < oldSlots.Count(); i++ )
+		{
+			if ( oldSlots[i].m_nSymbol >= 0 )
+			{
+				Insert( oldSlots[i].m_nSymbol, oldSlots[i].m_nField );
+			}
+		}
+	}
+
+	CUtlVector<Slot_t>	m_Slots;	// power of two sized, open addressed
+	int					m_nUsed;
+};
+
+struct SaveFieldLookupStats_t
+{
+	int64	m_nLookups;
+	int64	m_nCacheHits;
+	int64	m_nSearches;		// fell back to FindField()
+	int		m_nRestores;
+	double	m_flRestoreTime;
+};
+
+static CUtlMap<const typedescription_t *, CSaveFieldSymbolCache *> s_SaveFieldSymbolCaches( DefLessFunc( const typedescription_t * ) );
+static SaveFieldLookupStats_t s_SaveFieldLookupStats;
+
+static CSaveFieldSymbolCache *GetSaveFieldSymbolCache( const typedescription_t *pFields )
+{
+	unsigned short i = s_SaveFieldSymbolCaches.Find( pFields );
+	if ( i == s_SaveFieldSymbolCaches.InvalidIndex() )
+	{
+		i = s_SaveFieldSymbolCaches.Insert( pFields, new CSaveFieldSymbolCache );
+	}
+	return s_SaveFieldSymbolCaches[i];
+}
+
+typedescription_t *CRestore::FindFieldBySymbol( int symbol, CSaveFieldSymbolCache *pCache, typedescription_t *pFields, int fieldCount, int *pCookie )
+{
+	const char *pszFieldName = m_pData->StringFromSymbol( symbol );
+	s_SaveFieldLookupStats.m_nLookups++;
+
+	if ( pCache && pszFieldName )
+	{
+		int iField = pCache->Find( symbol );
+		if ( iField >= 0 && iField < fieldCount && stricmp( pFields[iField].fieldName, pszFieldName ) == 0 )
+		{
+			s_SaveFieldLookupStats.m_nCacheHits++;
+			return &pFields[iField];
+		}
+	}
+
+	s_SaveFieldLookupStats.m_nSearches++;
+	typedescription_t *pField = FindField( pszFieldName, pFields, fieldCount, pCookie );
+	if ( pCache && pField )
+	{
+		pCache->Insert( symbol, pField - pFields );
+	}
+	return pField;
+}
+
 //-------------------------------------
 
 typedescription_t *CRestore::FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pCookie )
@@ -1655,12 +1839,13 @@ int CRestore::ReadFields( const char *pname, void *pBaseData, datamap_t *pRootMa
 	int nFieldsSaved = ReadInt();						// Read field count
 	int searchCookie = 0;								// Make searches faster, most data is read/written in the same order
 	SaveRestoreRecordHeader_t header;
+	CSaveFieldSymbolCache *pCache = save_field_lookup_cache.GetBool() ? GetSaveFieldSymbolCache( pFields ) : NULL;
 
 	for ( i = 0; i < nFieldsSaved; i++ )
 	{
 		ReadHeader( &header );
 
-		typedescription_t *pField = FindField( m_pData->StringFromSymbol( header.symbol ), pFields, fieldCount, &searchCookie);
+		typedescription_t *pField = FindFieldBySymbol( header.symbol, pCache, pFields, fieldCount, &searchCookie );
 		if ( pField && ShouldReadField( pField ) )
 		{
 			ReadField( header, ((char *)pBaseData + pField->fieldOffset[ TD_OFFSET_NORMAL ]), pRootMap, pField );
@@ -2451,12 +2636,370 @@ void CEntitySaveRestoreBlockHandler::PreSave( CSaveRestoreData *pSaveData )
 	SaveInitEntities( pSaveData );
 }
 
+//-----------------------------------------------------------------------------
+// Parallel entity encoding. The engine needs the whole entity block written
+// before Save() returns (compressing and writing the file is its business, see
+// save_async), so the work that can move is the datadesc walk itself. Entities
+// are sorted on the main thread, the ones whose save data is plain fields and
+// pure ops are encoded in batches on the job threads into private buffers, then
+// everything is spliced into the save buffer in entity table order with the
+// record symbols filled in. The result is byte for byte what the serial loop
+// writes.
+//-----------------------------------------------------------------------------
+#if !defined( CLIENT_DLL )
+
+ConVar save_parallel_encode( "save_parallel_encode", "1", 0, "Encode entities with plain save data on the job threads" );
+ConVar save_timings( "save_timings", "0", 0, "Print how long each phase of writing the entity block took" );
+
+#define SAVE_ENCODE_MIN_ENTITIES	64			// not worth spinning up jobs below this
+#define SAVE_ENCODE_BATCH_SIZE		32			// entities per job
+#define SAVE_ENCODE_ARENA_SIZE		(64*1024)
+#define SAVE_ENCODE_MAX_ARENA		(16*1024*1024)	// entities that don't fit in this are encoded on the main thread
+#define SAVE_ENCODE_MAX_CHECKS		32
+
+// A custom field (or embedded pointer) that has to be empty for the entity to be encoded on a job
+struct SaveEncodeCheck_t
+{
+	int					m_nOffset;
+	typedescription_t	*m_pField;
+};
+
+struct SaveEncodeMapInfo_t
+{
+	bool							m_bMainThread;
+	CUtlVector<SaveEncodeCheck_t>	m_Checks;
+};
+
+struct SaveEncodeEntity_t
+{
+	CBaseEntity	*m_pEntity;
+	int			m_iJob;
+	int			m_nStart;			// in the job's arena
+	int			m_nSize;			// -1 if it has to be encoded on the main thread after all
+	int			m_iFirstFixup;
+	int			m_nFixups;
+};
+
+struct SaveEncodeJob_t
+{
+	int								m_iFirst;
+	int								m_nCount;
+	int								m_nUsed;
+	CUtlMemory<char>				m_Arena;
+	CUtlVector<SaveSymbolFixup_t>	m_Fixups;
+};
+
+static CUtlMap<datamap_t *, SaveEncodeMapInfo_t *> s_SaveEncodeMapInfo( DefLessFunc( datamap_t * ) );
+static CUtlVector<SaveEncodeEntity_t> s_SaveEncodeEntities;
+static CUtlVector<int> s_SaveEncodeIndex;		// entity table index -> s_SaveEncodeEntities, or -1
+static CUtlVector<SaveEncodeJob_t> s_SaveEncodeJobs;
+static CGameSaveRestoreInfo *s_pSaveEncodeInfo;
+static bool s_bSaveEncodeAsync;
+
+static SaveEncodeMapInfo_t *GetSaveEncodeMapInfo( datamap_t *pMap );
+
+static void AddSaveEncodeCheck( SaveEncodeMapInfo_t *pInfo, int nOffset, typedescription_t *pField )
+{
+	int i = pInfo->m_Checks.AddToTail();
+	pInfo->m_Checks[i].m_nOffset = nOffset;
+	pInfo->m_Checks[i].m_pField = pField;
+}
+
+static void VetSaveEncodeFields( datamap_t *pMap, int nBaseOffset, SaveEncodeMapInfo_t *pInfo )
+{
+	for ( ; pMap; pMap = pMap->baseMap )
+	{
+		for ( int i = 0; i < pMap->dataNumFields; i++ )
+		{
+			typedescription_t *pField = &pMap->dataDesc[i];
+			if ( !( pField->flags & FTYPEDESC_SAVE ) )
+				continue;
+
+			int nOffset = nBaseOffset + pField->fieldOffset[ TD_OFFSET_NORMAL ];
+
+			if ( pField->fieldType == FIELD_EMBEDDED )
+			{
+				if ( !pField->td )
+					continue;
+
+				if ( pField->flags & FTYPEDESC_PTR )
+				{
+					// Can't see inside until there's an instance, so it's only fine while NULL
+					SaveEncodeMapInfo_t *pTarget = GetSaveEncodeMapInfo( pField->td );
+					if ( pTarget->m_bMainThread || pTarget->m_Checks.Count() )
+					{
+						AddSaveEncodeCheck( pInfo, nOffset, pField );
+					}
+				}
+				else
+				{
+					for ( int j = 0; j < pField->fieldSize; j++ )
+					{
+						VetSaveEncodeFields( pField->td, nOffset + j * pField->fieldSizeInBytes, pInfo );
+					}
+				}
+			}
+			else if ( pField->fieldType == FIELD_CUSTOM )
+			{
+				IThreadSafeSaveOps *pSafeOps = dynamic_cast<IThreadSafeSaveOps *>( pField->pSaveRestoreOps );
+				if ( !pSafeOps )
+				{
+					AddSaveEncodeCheck( pInfo, nOffset, pField );
+					continue;
+				}
+
+				datamap_t *pElementMap = pSafeOps->GetSaveDataMap();
+				if ( pElementMap )
+				{
+					SaveEncodeMapInfo_t *pElements = GetSaveEncodeMapInfo( pElementMap );
+					if ( pElements->m_bMainThread || pElements->m_Checks.Count() )
+					{
+						AddSaveEncodeCheck( pInfo, nOffset, pField );
+					}
+				}
+			}
+		}
+	}
+}
+
+static SaveEncodeMapInfo_t *GetSaveEncodeMapInfo( datamap_t *pMap )
+{
+	unsigned short i = s_SaveEncodeMapInfo.Find( pMap );
+	if ( i != s_SaveEncodeMapInfo.InvalidIndex() )
+		return s_SaveEncodeMapInfo[i];
+
+	// Goes in first as main thread only, in case the map points back at itself
+	SaveEncodeMapInfo_t *pInfo = new SaveEncodeMapInfo_t;
+	pInfo->m_bMainThread = true;
+	s_SaveEncodeMapInfo.Insert( pMap, pInfo );
+
+	SaveEncodeMapInfo_t vetted;
+	vetted.m_bMainThread = false;
+	VetSaveEncodeFields( pMap, 0, &vetted );
+
+	if ( vetted.m_Checks.Count() <= SAVE_ENCODE_MAX_CHECKS )
+	{
+		pInfo->m_Checks.AddVectorToTail( vetted.m_Checks );
+		pInfo->m_bMainThread = false;
+	}
+	return pInfo;
+}
+
+static bool CanEncodeEntityOnJob( CBaseEntity *pEntity )
+{
+	if ( !pEntity->IsSaveThreadSafe() )
+		return false;
+
+	SaveEncodeMapInfo_t *pInfo = GetSaveEncodeMapInfo( pEntity->GetDataDescMap() );
+	if ( pInfo->m_bMainThread )
+		return false;
+
+	// Same test ShouldSaveField() makes, an empty field never reaches its ops
+	for ( int i = 0; i < pInfo->m_Checks.Count(); i++ )
+	{
+		typedescription_t *pField = pInfo->m_Checks[i].m_pField;
+		char *pData = (char *)pEntity + pInfo->m_Checks[i].m_nOffset;
+
+		if ( pField->fieldType == FIELD_EMBEDDED )
+		{
+			if ( *((void **)pData) )
+				return false;
+			continue;
+		}
+
+		SaveRestoreFieldInfo_t fieldInfo =
+		{
+			pData,
+			pData - pField->fieldOffset[ TD_OFFSET_NORMAL ],
+			pField
+		};
+		if ( !pField->pSaveRestoreOps->IsEmpty( fieldInfo ) )
+			return false;
+	}
+
+	return true;
+}
+
+static void EncodeEntitiesJob( SaveEncodeJob_t &job )
+{
+	job.m_nUsed = 0;
+	job.m_Arena.EnsureCapacity( SAVE_ENCODE_ARENA_SIZE );
+
+	for ( int i = job.m_iFirst; i < job.m_iFirst + job.m_nCount; i++ )
+	{
+		SaveEncodeEntity_t &entity = s_SaveEncodeEntities[i];
+		entity.m_iFirstFixup = job.m_Fixups.Count();
+		entity.m_nStart = job.m_nUsed;
+
+		for ( ;; )
+		{
+			CSaveRestoreSegment segment;
+			segment.Init( job.m_Arena.Base() + job.m_nUsed, job.m_Arena.NumAllocated() - job.m_nUsed );
+
+			CSave save( &segment, s_pSaveEncodeInfo, s_bSaveEncodeAsync, &job.m_Fixups );
+			entity.m_pEntity->Save( save );
+
+			if ( !save.Overflowed() )
+			{
+				entity.m_nSize = segment.GetCurPos();
+				break;
+			}
+
+			// Throw the partial entity away and go again with more room
+			job.m_Fixups.SetCountNonDestructively( entity.m_iFirstFixup );
+			if ( job.m_Arena.NumAllocated() >= SAVE_ENCODE_MAX_ARENA )
+			{
+				entity.m_nSize = -1;
+				break;
+			}
+			job.m_Arena.Grow( job.m_Arena.NumAllocated() );
+		}
+
+		entity.m_nFixups = job.m_Fixups.Count() - entity.m_iFirstFixup;
+		if ( entity.m_nSize > 0 )
+		{
+			job.m_nUsed += entity.m_nSize;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Sorts the entity table and encodes what it can on the job threads. Returns
+// the number of entities encoded, they're picked up by SpliceEncodedEntity()
+//-----------------------------------------------------------------------------
+static int EncodeEntitiesInParallel( ISave *pSave, float *pflGatherTime )
+{
+	VPROF( "EncodeEntitiesInParallel" );
+
+	CFastTimer timer;
+	timer.Start();
+
+	CGameSaveRestoreInfo *pSaveData = pSave->GetGameSaveRestoreInfo();
+	int nEntities = pSaveData->NumEntities();
+
+	s_SaveEncodeEntities.RemoveAll();
+	s_SaveEncodeIndex.SetCount( nEntities );
+
+	for ( int i = 0; i < nEntities; i++ )
+	{
+		s_SaveEncodeIndex[i] = -1;
+
+		CBaseEntity *pEnt = pSaveData->GetEntityInfo( i )->hEnt;
+		if ( !pEnt || ( pEnt->ObjectCaps() & FCAP_DONT_SAVE ) || !CanEncodeEntityOnJob( pEnt ) )
+			continue;
+
+		s_SaveEncodeIndex[i] = s_SaveEncodeEntities.AddToTail();
+		s_SaveEncodeEntities.Tail().m_pEntity = pEnt;
+	}
+
+	timer.End();
+	*pflGatherTime = timer.GetDuration().GetMillisecondsF();
+
+	int nEncode = s_SaveEncodeEntities.Count();
+	if ( nEncode < SAVE_ENCODE_MIN_ENTITIES )
+	{
+		s_SaveEncodeEntities.RemoveAll();
+		s_SaveEncodeIndex.RemoveAll();
+		return 0;
+	}
+
+	int nJobs = ( nEncode + SAVE_ENCODE_BATCH_SIZE - 1 ) / SAVE_ENCODE_BATCH_SIZE;
+	s_SaveEncodeJobs.SetCount( nJobs );
+	for ( int i = 0; i < nJobs; i++ )
+	{
+		SaveEncodeJob_t &job = s_SaveEncodeJobs[i];
+		job.m_iFirst = i * SAVE_ENCODE_BATCH_SIZE;
+		job.m_nCount = MIN( SAVE_ENCODE_BATCH_SIZE, nEncode - job.m_iFirst );
+		job.m_nUsed = 0;
+		job.m_Fixups.RemoveAll();
+
+		for ( int j = job.m_iFirst; j < job.m_iFirst + job.m_nCount; j++ )
+		{
+			s_SaveEncodeEntities[j].m_iJob = i;
+		}
+	}
+
+	s_pSaveEncodeInfo = pSaveData;
+	s_bSaveEncodeAsync = pSave->IsAsync();
+
+	ParallelProcess( "EncodeEntitiesInParallel", s_SaveEncodeJobs.Base(), nJobs, &EncodeEntitiesJob );
+
+	s_pSaveEncodeInfo = NULL;
+	return nEncode;
+}
+
+//-----------------------------------------------------------------------------
+// Writes an entity encoded by a job into the save, patching in the record
+// symbols. Returns false if the entity has to be saved the usual way.
+//-----------------------------------------------------------------------------
+static bool SpliceEncodedEntity( ISave *pSave, CSaveRestoreSegment *pSymbols, CUtlMap<const void *, unsigned short> &symbolCache, int iEntity )
+{
+	if ( iEntity >= s_SaveEncodeIndex.Count() || s_SaveEncodeIndex[iEntity] == -1 )
+		return false;
+
+	SaveEncodeEntity_t &entity = s_SaveEncodeEntities[ s_SaveEncodeIndex[iEntity] ];
+	if ( entity.m_nSize < 0 )
+		return false;
+
+	SaveEncodeJob_t &job = s_SaveEncodeJobs[ entity.m_iJob ];
+	char *pData = job.m_Arena.Base() + entity.m_nStart;
+
+	// Names come from datadescs and literals, so the same name is nearly always the same pointer
+	for ( int i = entity.m_iFirstFixup; i < entity.m_iFirstFixup + entity.m_nFixups; i++ )
+	{
+		const SaveSymbolFixup_t &fixup = job.m_Fixups[i];
+
+		unsigned short iCache = symbolCache.Find( fixup.m_pName );
+		if ( iCache == symbolCache.InvalidIndex() )
+		{
+			iCache = symbolCache.Insert( fixup.m_pName, pSymbols->FindCreateSymbol( fixup.m_pName ) );
+		}
+
+		short symbol = symbolCache[iCache];
+		Q_memcpy( pData + fixup.m_nOffset, &symbol, sizeof(short) );
+	}
+
+	pSave->WriteData( pData, entity.m_nSize );
+	return true;
+}
+
+static void FinishParallelEncode()
+{
+	s_SaveEncodeEntities.Purge();
+	s_SaveEncodeIndex.Purge();
+	s_SaveEncodeJobs.Purge();
+}
+
+#endif // !CLIENT_DLL
+
 //---------------------------------
 
 void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 {
 	CGameSaveRestoreInfo *pSaveData = pSave->GetGameSaveRestoreInfo();
-	
+
+#if !defined( CLIENT_DLL )
+	CFastTimer totalTimer, encodeTimer, assembleTimer;
+	totalTimer.Start();
+	int nStartPos = pSave->GetWritePos();
+
+	float flGatherTime = 0.0f;
+	int nEncoded = 0;
+
+	encodeTimer.Start();
+	if ( save_parallel_encode.GetBool() )
+	{
+		nEncoded = EncodeEntitiesInParallel( pSave, &flGatherTime );
+	}
+	encodeTimer.End();
+
+	// The engine's save data is both the game info and the segment holding the symbol table
+	CSaveRestoreSegment *pSymbols = static_cast<CSaveRestoreData *>( pSaveData );
+	CUtlMap<const void *, unsigned short> symbolCache( DefLessFunc( const void * ) );
+
+	assembleTimer.Start();
+#endif
+
 	// write entity list that was previously built by SaveInitEntities()
 	for ( int i = 0; i < pSaveData->NumEntities(); i++ )
 	{
@@ -2467,17 +3010,20 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 		CBaseEntity *pEnt = pEntInfo->hEnt;
 		if ( pEnt && !( pEnt->ObjectCaps() & FCAP_DONT_SAVE ) )
 		{
-			MDLCACHE_CRITICAL_SECTION();
 #if !defined( CLIENT_DLL )
 			AssertMsg( !pEnt->edict() || ( pEnt->m_iClassname != NULL_STRING && 
 										   (STRING(pEnt->m_iClassname)[0] != 0) && 
 										   FStrEq( STRING(pEnt->m_iClassname), pEnt->GetClassname()) ), 
 					   "Saving entity with invalid classname" );
-#endif
 
-			pSaveData->SetCurrentEntityContext( pEnt );
-			pEnt->Save( *pSave );
-			pSaveData->SetCurrentEntityContext( NULL );
+			if ( !nEncoded || !SpliceEncodedEntity( pSave, pSymbols, symbolCache, i ) )
+#endif
+			{
+				MDLCACHE_CRITICAL_SECTION();
+				pSaveData->SetCurrentEntityContext( pEnt );
+				pEnt->Save( *pSave );
+				pSaveData->SetCurrentEntityContext( NULL );
+			}
 
 			pEntInfo->size = pSave->GetWritePos() - pEntInfo->location;	// Size of entity block is data size written to block
 
@@ -2495,6 +3041,23 @@ void CEntitySaveRestoreBlockHandler::Save( ISave *pSave )
 #endif
 		}
 	}
+
+#if !defined( CLIENT_DLL )
+	assembleTimer.End();
+	totalTimer.End();
+
+	if ( save_timings.GetBool() )
+	{
+		Msg( "Save entities: %d of %d encoded on jobs. gather %.2f ms, encode %.2f ms, assemble %.2f ms, total %.2f ms (%d bytes)\n",
+			nEncoded, pSaveData->NumEntities(), flGatherTime,
+			encodeTimer.GetDuration().GetMillisecondsF() - flGatherTime,
+			assembleTimer.GetDuration().GetMillisecondsF(),
+			totalTimer.GetDuration().GetMillisecondsF(),
+			pSave->GetWritePos() - nStartPos );
+	}
+
+	FinishParallelEncode();
+#endif
 }
 
 //---------------------------------
@@ -2549,8 +3112,41 @@ void CEntitySaveRestoreBlockHandler::ReadRestoreHeaders( IRestore *pRestore )
 
 #if !defined( CLIENT_DLL )
 
+// Times the entity restore, for comparing save_field_lookup_cache on and off
+class CEntityRestoreTimer
+{
+public:
+	CEntityRestoreTimer() : m_flStart( Plat_FloatTime() ) {}
+	~CEntityRestoreTimer()
+	{
+		s_SaveFieldLookupStats.m_nRestores++;
+		s_SaveFieldLookupStats.m_flRestoreTime += Plat_FloatTime() - m_flStart;
+	}
+
+private:
+	double m_flStart;
+};
+
+CON_COMMAND( save_field_lookup_report, "Report restored field lookups and entity restore times. Pass 'reset' to clear." )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "reset" ) )
+	{
+		memset( &s_SaveFieldLookupStats, 0, sizeof( s_SaveFieldLookupStats ) );
+		return;
+	}
+
+	const SaveFieldLookupStats_t &stats = s_SaveFieldLookupStats;
+	Msg( "field lookups  : %lld, %lld cache hits, %lld name searches (save_field_lookup_cache %d)\n", stats.m_nLookups, stats.m_nCacheHits, stats.m_nSearches, save_field_lookup_cache.GetInt() );
+	Msg( "entity restore : %d restores, avg %.2f ms\n", stats.m_nRestores, stats.m_nRestores ? ( stats.m_flRestoreTime / stats.m_nRestores ) * 1000.0 : 0.0 );
+}
+
 void CEntitySaveRestoreBlockHandler::Restore( IRestore *pRestore, bool createPlayers )
 {
+	CEntityRestoreTimer restoreTimer;
+
 	entitytable_t *pEntInfo;
 	CBaseEntity *pent;
 
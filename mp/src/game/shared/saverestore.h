@@ -23,6 +23,7 @@
 class CSaveRestoreData;
 class CSaveRestoreSegment;
 class CGameSaveRestoreInfo;
+class CSaveFieldSymbolCache;
 struct typedescription_t;
 struct edict_t;
 struct datamap_t;
@@ -35,10 +36,22 @@ struct interval_t;
 //
 //-----------------------------------------------------------------------------
 
+// A record header written before its symbol was assigned
+struct SaveSymbolFixup_t
+{
+	int			m_nOffset;		// of the symbol, from the start of the segment
+	const char	*m_pName;
+};
+
 class CSave : public ISave
 {
 public:
 	CSave( CSaveRestoreData *pdata );
+
+	// Writes into a private segment without touching its symbol table, for encoding
+	// off the main thread. Headers get a zero symbol and an entry in pSymbolFixups.
+	// Running out of room sets Overflowed() instead of warning.
+	CSave( CSaveRestoreSegment *pSegment, CGameSaveRestoreInfo *pGameInfo, bool bAsync, CUtlVector<SaveSymbolFixup_t> *pSymbolFixups );
 	
 	//---------------------------------
 	// Logging
@@ -137,6 +150,8 @@ public:
 
 	CGameSaveRestoreInfo *GetGameSaveRestoreInfo()	{ return m_pGameInfo; }
 
+	bool			Overflowed() const { return m_bOverflowed; }
+
 private:
 
 	//---------------------------------
@@ -179,6 +194,10 @@ private:
 
 	FileHandle_t		m_hLogFile;
 	bool				m_bAsync;
+
+	// Only set for deferred symbol writes
+	CUtlVector<SaveSymbolFixup_t> *m_pSymbolFixups;
+	bool				m_bOverflowed;
 };
 
 //-----------------------------------------------------------------------------
@@ -276,6 +295,7 @@ private:
 	int				DoReadAll( void *pLeafObject, datamap_t *pLeafMap, datamap_t *pCurMap );
 	
 	typedescription_t *FindField( const char *pszFieldName, typedescription_t *pFields, int fieldCount, int *pIterator );
+	typedescription_t *FindFieldBySymbol( int symbol, CSaveFieldSymbolCache *pCache, typedescription_t *pFields, int fieldCount, int *pIterator );
 	void			ReadField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
 	
 	void 			ReadBasicField( const SaveRestoreRecordHeader_t &header, void *pDest, datamap_t *pRootMap, typedescription_t *pField );
@@ -19,7 +19,7 @@
 //-------------------------------------
 
 template <class UTLVECTOR, int FIELD_TYPE>
-class CUtlVectorDataOps : public CDefSaveRestoreOps
+class CUtlVectorDataOps : public CDefSaveRestoreOps, public IThreadSafeSaveOps
 {
 public:
 	CUtlVectorDataOps()
@@ -27,6 +27,11 @@ public:
 		UTLCLASS_SAVERESTORE_VALIDATE_TYPE( FIELD_TYPE );
 	}
 
+	virtual datamap_t *GetSaveDataMap()
+	{
+		return CTypedescDeducer<FIELD_TYPE>::Deduce( (UTLVECTOR *)NULL );
+	}
+
 	virtual void Save( const SaveRestoreFieldInfo_t &fieldInfo, ISave *pSave )
 	{		
 		datamap_t *pArrayTypeDatamap = CTypedescDeducer<FIELD_TYPE>::Deduce( (UTLVECTOR *)NULL );
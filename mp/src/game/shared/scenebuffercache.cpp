@@ -0,0 +1,133 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Level-spanning cache of compiled .vcd buffers.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#include "cbase.h"
+#include "scenebuffercache.h"
+#include "scenefilecache/ISceneFileCache.h"
+#include "filesystem.h"
+#include "igamesystem.h"
+#include "utldict.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+extern ISceneFileCache *scenefilecache;
+
+#define SCENE_BUFFER_CACHE_BUDGET	(16*1024*1024)	// bytes, the whole cache is dropped when it runs past this
+#define SCENE_IMAGE_FILE			"scenes/scenes.image"
+
+//-----------------------------------------------------------------------------
+// Purpose: Scenes are read out of scenes.image, which has to find the entry
+//			and usually LZMA decompress it into a fresh allocation, for every
+//			CChoreoScene that gets loaded. Scripted maps load the same scenes
+//			over and over (every scene entity on playback, every subscene), so
+//			the decompressed buffers are kept here and parsed in place. A scene
+//			that isn't in the image is remembered too, so repeat misses are free.
+//			The image's file time is checked at level start and the cache is
+//			thrown away if it changed.
+//-----------------------------------------------------------------------------
+class CSceneBufferCache : public CAutoGameSystem
+{
+public:
+	CSceneBufferCache() : CAutoGameSystem( "CSceneBufferCache" ), m_Scenes( k_eDictCompareTypeFilenames )
+	{
+		m_nBytes = 0;
+		m_nImageTime = 0;
+	}
+
+	virtual void LevelInitPreEntity()
+	{
+		long nImageTime = g_pFullFileSystem->GetFileTime( SCENE_IMAGE_FILE, "GAME" );
+		if ( nImageTime != m_nImageTime )
+		{
+			Flush();
+			m_nImageTime = nImageTime;
+		}
+	}
+
+	virtual void Shutdown()
+	{
+		Flush();
+	}
+
+	bool Get( const char *pFilename, const byte **ppBuffer, int *pSize )
+	{
+		int i = m_Scenes.Find( pFilename );
+		if ( i == m_Scenes.InvalidIndex() )
+		{
+			i = Load( pFilename );
+		}
+
+		*ppBuffer = m_Scenes[i].m_pBuffer;
+		*pSize = m_Scenes[i].m_nSize;
+		return ( m_Scenes[i].m_pBuffer != NULL );
+	}
+
+	void Flush()
+	{
+		for ( int i = m_Scenes.First(); i != m_Scenes.InvalidIndex(); i = m_Scenes.Next( i ) )
+		{
+			delete[] m_Scenes[i].m_pBuffer;
+		}
+		m_Scenes.Purge();
+		m_nBytes = 0;
+	}
+
+private:
+	struct CachedSceneBuffer_t
+	{
+		byte	*m_pBuffer;		// NULL if the scene isn't in the image
+		int		m_nSize;
+	};
+
+	int Load( const char *pFilename )
+	{
+		CachedSceneBuffer_t scene;
+		scene.m_pBuffer = NULL;
+		scene.m_nSize = 0;
+
+		size_t bufSize = scenefilecache->GetSceneBufferSize( pFilename );
+		if ( bufSize > 0 )
+		{
+			if ( m_nBytes + (int)bufSize > SCENE_BUFFER_CACHE_BUDGET )
+			{
+				Flush();
+			}
+
+			scene.m_pBuffer = new byte[ bufSize + 1 ];
+			if ( scenefilecache->GetSceneData( pFilename, scene.m_pBuffer, bufSize ) )
+			{
+				scene.m_pBuffer[ bufSize ] = 0;
+				scene.m_nSize = (int)bufSize;
+				m_nBytes += (int)bufSize + 1;
+			}
+			else
+			{
+				delete[] scene.m_pBuffer;
+				scene.m_pBuffer = NULL;
+			}
+		}
+
+		return m_Scenes.Insert( pFilename, scene );
+	}
+
+	CUtlDict< CachedSceneBuffer_t, int >	m_Scenes;
+	int										m_nBytes;
+	long									m_nImageTime;
+};
+
+static CSceneBufferCache g_SceneBufferCache;
+
+bool GetCachedSceneBuffer( const char *pFilename, const byte **ppBuffer, int *pSize )
+{
+	return g_SceneBufferCache.Get( pFilename, ppBuffer, pSize );
+}
+
+void FlushSceneBufferCache()
+{
+	g_SceneBufferCache.Flush();
+}
@@ -0,0 +1,23 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps the compiled .vcd buffers that come out of scenes.image, so
+//			a scene that is loaded again gets parsed straight out of memory
+//			instead of being pulled out of the image and decompressed each time.
+//
+// $NoKeywords: $
+//=============================================================================//
+
+#ifndef SCENEBUFFERCACHE_H
+#define SCENEBUFFERCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+// Returns the scene as scenes.image holds it, with a NUL after the end.
+// The buffer belongs to the cache and stays valid until the next call.
+bool GetCachedSceneBuffer( const char *pFilename, const byte **ppBuffer, int *pSize );
+
+// Drops everything, for when scenes.image gets reloaded
+void FlushSceneBufferCache();
+
+#endif // SCENEBUFFERCACHE_H
@@ -18,6 +18,7 @@
 #include "mathlib/ssequaternion.h"
 #include "bitvec.h"
 #include "datamanager.h"
+#include "utlmap.h"
 #include "convar.h"
 #include "tier0/tslist.h"
 #include "vphysics_interface.h"
@@ -28,25 +29,43 @@
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
 
+struct BonePoseArrays_t;
+
 class CBoneSetup
 {
 public:
 	CBoneSetup( const CStudioHdr *pStudioHdr, int boneMask, const float poseParameter[], IPoseDebugger *pPoseDebugger = NULL );
+	~CBoneSetup();
 	void InitPose( Vector pos[], Quaternion q[] );
 	void AccumulatePose( Vector pos[], Quaternion q[], int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
 	void CalcAutoplaySequences(	Vector pos[], Quaternion q[], float flRealTime, CIKContext *pIKContext );
+	void AccumulatePose( CBonePoseSoA &pose, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
+	void CalcAutoplaySequences(	CBonePoseSoA &pose, float flRealTime, CIKContext *pIKContext );
+
+	// Is pos/q the pose held in SoA form by IBoneSetup::InitPoseSoA?
+	bool IsPoseSoA( const Vector pos[], const Quaternion q[] ) const;
+	void ValidatePoseSoA( const char *pszStep, int sequence );
 private:
-	void AddSequenceLayers( Vector pos[], Quaternion q[], mstudioseqdesc_t &seqdesc, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
-	void AddLocalLayers( Vector pos[], Quaternion q[], mstudioseqdesc_t &seqdesc, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
+	void AccumulatePose( BonePoseArrays_t &pose, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
+	template< class POSE > void AccumulateAutoplaySequences( POSE &pose, float flRealTime, CIKContext *pIKContext );
+	template< class POSE > void AddSequenceLayers( POSE &pose, mstudioseqdesc_t &seqdesc, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
+	template< class POSE > void AddLocalLayers( POSE &pose, mstudioseqdesc_t &seqdesc, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
 public:
 	const CStudioHdr *m_pStudioHdr;
 	int m_boneMask;
 	const float *m_flPoseParameter;
 	IPoseDebugger *m_pPoseDebugger;
+
+	// The pose between IBoneSetup::InitPoseSoA and StorePose, and the arrays it stands in for.
+	// With m_bValidatePoseSoA the arrays also get the scalar pose to compare against.
+	CBonePoseSoA *m_pPoseSoA;
+	Vector *m_pPoseSoAPos;
+	Quaternion *m_pPoseSoAQ;
+	bool m_bValidatePoseSoA;
 };
 
 // -----------------------------------------------------------------
-template <typename T>
+template <typename T, int COUNT = MAXSTUDIOBONES>
 class CBoneSetupMemoryPool
 {
 public:
@@ -55,7 +74,7 @@ public:
 		T *p = (T *)m_FreeBlocks.Pop();
 		if ( !p )
 		{
-			p = new T[MAXSTUDIOBONES];
+			p = new T[COUNT];
 			if ( ((size_t)p) % TSLIST_NODE_ALIGNMENT != 0 )
 			{
 				DebuggerBreak();
@@ -77,6 +96,7 @@ private:
 CBoneSetupMemoryPool<Quaternion> g_QaternionPool;
 CBoneSetupMemoryPool<Vector> g_VectorPool;
 CBoneSetupMemoryPool<matrix3x4_t> g_MatrixPool;
+CBoneSetupMemoryPool<CBonePoseSoA, 1> g_BonePoseSoAPool;
 
 // -----------------------------------------------------------------
 CBoneCache *CBoneCache::CreateResource( const bonecacheparams_t &params )
@@ -368,13 +388,392 @@ void ExtractAnimValue( int frame, mstudioanimvalue_t *panimvalue, float scale, f
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Decoded animation value cache.  ExtractAnimValue walks a channel's RLE runs
+// from the first frame on every sample; this keeps decoded copies of recently
+// used animation sections in an LRU so a sample becomes a direct index.
+// Entries are keyed on the section data and the checksum of the model that
+// owns it, so a reloaded model never picks up another model's values.
+//-----------------------------------------------------------------------------
+static void AnimValueCacheSizeChanged( IConVar *var, const char *pOldValue, float flOldValue );
+static ConVar anim_valuecache( "anim_valuecache", "1", FCVAR_REPLICATED, "Cache decoded animation keyframes." );
+static ConVar anim_valuecache_kb( "anim_valuecache_kb", "2048", FCVAR_REPLICATED, "Memory budget of the decoded animation keyframe cache, in KB.", AnimValueCacheSizeChanged );
+
+#define ANIMVALUE_CHANNELS		6		// rotation x,y,z then position x,y,z
+
+class CAnimValueCache;
+
+struct animvaluecacheparams_t
+{
+	CAnimValueCache		*pDecoded;	// from CAnimValueCache::Decode, done before taking the cache lock
+};
+
+class CAnimValueCache
+{
+public:
+	// Decodes the nFrames frame section starting at bone track pAnim
+	static CAnimValueCache *Decode( const mstudioanim_t *pAnim, int nFrames );
+
+	// you must implement these static functions for the ResourceManager
+	// -----------------------------------------------------------
+	static CAnimValueCache *CreateResource( const animvaluecacheparams_t &params );
+	static unsigned int EstimatedSize( const animvaluecacheparams_t &params );
+	// -----------------------------------------------------------
+	// member functions that must be present for the ResourceManager
+	void				DestroyResource();
+	CAnimValueCache		*GetData() { return this; }
+	unsigned int		Size() { return m_size; }
+	// -----------------------------------------------------------
+
+	// Raw values of a channel of the iTrack'th bone track in the section, or NULL if it
+	// has to be read from the stream.  Entry 2k is frame k, 2k+1 the value it blends to.
+	const short			*Values( int iTrack, int iChannel ) const;
+	int					NumTracks() const { return m_nTracks; }
+	int					NumFrames() const { return m_nFrames; }
+
+private:
+	static int			CountTracks( const mstudioanim_t *panim, int *pChannelCount );
+	int					*ChannelOffsets() { return (int *)( this + 1 ); }
+	const int			*ChannelOffsets() const { return (const int *)( this + 1 ); }
+	short				*ValueArray() { return (short *)( ChannelOffsets() + m_nTracks * ANIMVALUE_CHANNELS ); }
+
+	const mstudioanim_t	*m_pAnim;
+	unsigned int		m_size;
+	int					m_nTracks;
+	int					m_nFrames;
+};
+
+static const mstudioanimvalue_t *AnimChannelStream( const mstudioanim_t *panim, int iChannel )
+{
+	if ( iChannel < 3 )
+	{
+		// CalcBoneQuaternion prefers the raw rotations
+		if ( !( panim->flags & STUDIO_ANIM_ANIMROT ) || ( panim->flags & ( STUDIO_ANIM_RAWROT | STUDIO_ANIM_RAWROT2 ) ) )
+			return NULL;
+		return panim->pRotV()->pAnimvalue( iChannel );
+	}
+
+	if ( !( panim->flags & STUDIO_ANIM_ANIMPOS ) || ( panim->flags & STUDIO_ANIM_RAWPOS ) )
+		return NULL;
+	return panim->pPosV()->pAnimvalue( iChannel - 3 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: decode the raw values ExtractAnimValue returns for frames 0..nFrames-1.
+//			Returns false for streams that need ExtractAnimValue's special cases.
+//-----------------------------------------------------------------------------
+static bool DecodeAnimValueStream( const mstudioanimvalue_t *panimvalue, int nFrames, short *pValues )
+{
+	// ExtractAnimValue treats a leading single frame run as a constant
+	if ( ( panimvalue->num.total == 1 ) && ( panimvalue->num.valid == 1 ) )
+		return false;
+
+	int k = 0;
+	for ( int frame = 0; frame < nFrames; frame++, k++ )
+	{
+		while ( panimvalue->num.total <= k )
+		{
+			k -= panimvalue->num.total;
+			panimvalue += panimvalue->num.valid + 1;
+			if ( panimvalue->num.total == 0 )
+				return false;
+		}
+
+		short v1 = ( panimvalue->num.valid > k ) ? panimvalue[k+1].value : panimvalue[panimvalue->num.valid].value;
+		short v2 = v1;
+		if ( panimvalue->num.valid > k + 1 )
+		{
+			// has valid animation blend data
+			v2 = panimvalue[k+2].value;
+		}
+		else if ( panimvalue->num.total <= k + 1 && frame + 1 < nFrames )
+		{
+			// pull blend from first data block in next list.  The last frame has no
+			// next list; Values() callers fall back to ExtractAnimValue for it.
+			v2 = panimvalue[panimvalue->num.valid + 2].value;
+		}
+
+		pValues[frame * 2] = v1;
+		pValues[frame * 2 + 1] = v2;
+	}
+	return true;
+}
+
+int CAnimValueCache::CountTracks( const mstudioanim_t *panim, int *pChannelCount )
+{
+	int nTracks = 0;
+	*pChannelCount = 0;
+	for ( ; panim && panim->bone < 255; panim = panim->pNext() )
+	{
+		nTracks++;
+		for ( int c = 0; c < ANIMVALUE_CHANNELS; c++ )
+		{
+			if ( AnimChannelStream( panim, c ) )
+			{
+				(*pChannelCount)++;
+			}
+		}
+	}
+	return nTracks;
+}
+
+CAnimValueCache *CAnimValueCache::Decode( const mstudioanim_t *pAnim, int nFrames )
+{
+	int nChannels;
+	int nTracks = CountTracks( pAnim, &nChannels );
+	int size = ( sizeof(CAnimValueCache) + nTracks * ANIMVALUE_CHANNELS * sizeof(int) + nChannels * nFrames * 2 * sizeof(short) + 3 ) & ~3;
+
+	CAnimValueCache *pMem = (CAnimValueCache *)malloc( size );
+	pMem->m_pAnim = pAnim;
+	pMem->m_size = size;
+	pMem->m_nTracks = nTracks;
+	pMem->m_nFrames = nFrames;
+
+	int *pOffsets = pMem->ChannelOffsets();
+	short *pValues = pMem->ValueArray();
+	int nOffset = 0;
+	const mstudioanim_t *panim = pAnim;
+	for ( int t = 0; t < nTracks; t++, panim = panim->pNext() )
+	{
+		for ( int c = 0; c < ANIMVALUE_CHANNELS; c++ )
+		{
+			const mstudioanimvalue_t *pStream = AnimChannelStream( panim, c );
+			if ( pStream && DecodeAnimValueStream( pStream, nFrames, pValues + nOffset ) )
+			{
+				pOffsets[t * ANIMVALUE_CHANNELS + c] = nOffset;
+				nOffset += nFrames * 2;
+			}
+			else
+			{
+				pOffsets[t * ANIMVALUE_CHANNELS + c] = -1;
+			}
+		}
+	}
+	return pMem;
+}
+
+unsigned int CAnimValueCache::EstimatedSize( const animvaluecacheparams_t &params )
+{
+	return params.pDecoded->m_size;
+}
+
+CAnimValueCache *CAnimValueCache::CreateResource( const animvaluecacheparams_t &params )
+{
+	return params.pDecoded;
+}
+
+const short *CAnimValueCache::Values( int iTrack, int iChannel ) const
+{
+	Assert( iTrack < m_nTracks );
+	int nOffset = ChannelOffsets()[iTrack * ANIMVALUE_CHANNELS + iChannel];
+	if ( nOffset < 0 )
+		return NULL;
+	return (const short *)( ChannelOffsets() + m_nTracks * ANIMVALUE_CHANNELS ) + nOffset;
+}
+
+struct AnimValueCacheEntry_t
+{
+	memhandle_t			m_hCache;
+	CAnimValueCache		*m_pCache;
+	int					m_nChecksum;
+};
+
+static CDataManager<CAnimValueCache, animvaluecacheparams_t, CAnimValueCache *, CThreadFastMutex> g_AnimValueCache( 2048 * 1024L );
+static CUtlMap< const mstudioanim_t *, AnimValueCacheEntry_t > g_AnimValueCacheIndex( DefLessFunc( const mstudioanim_t * ) );
+static int g_nAnimValueCacheHits;
+static int g_nAnimValueCacheMisses;
+
+static void AnimValueCacheSizeChanged( IConVar *var, const char *pOldValue, float flOldValue )
+{
+	AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+	g_AnimValueCache.SetTargetSize( MAX( anim_valuecache_kb.GetInt(), 0 ) * 1024 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Called when the LRU evicts or flushes a section; drops its index entry
+//			so the index only ever holds sections that are still in the cache.
+//-----------------------------------------------------------------------------
+void CAnimValueCache::DestroyResource()
+{
+	{
+		// The mutex is recursive, evictions from inside our own lock come through here too
+		AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+		unsigned short i = g_AnimValueCacheIndex.Find( m_pAnim );
+		if ( i != g_AnimValueCacheIndex.InvalidIndex() && g_AnimValueCacheIndex[i].m_pCache == this )
+		{
+			g_AnimValueCacheIndex.RemoveAt( i );
+		}
+	}
+	free( this );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Keeps a decoded section locked for the duration of a CalcAnimation
+//-----------------------------------------------------------------------------
+class CAnimValueCacheAccess
+{
+public:
+	CAnimValueCacheAccess( const mstudioanimdesc_t &animdesc, const mstudioanim_t *panim, int nFrames );
+	~CAnimValueCacheAccess();
+
+	// Decoded channels of a bone track, or NULL if the section isn't cached
+	const CAnimValueCache *Cache() const { return m_pCache; }
+
+private:
+	bool				LockCached( const mstudioanim_t *panim, int nChecksum, int nFrames );
+
+	memhandle_t			m_hCache;
+	CAnimValueCache		*m_pCache;
+};
+
+CAnimValueCacheAccess::CAnimValueCacheAccess( const mstudioanimdesc_t &animdesc, const mstudioanim_t *panim, int nFrames )
+{
+	m_hCache = INVALID_MEMHANDLE;
+	m_pCache = NULL;
+
+	if ( !panim || nFrames <= 0 || !anim_valuecache.GetBool() )
+		return;
+
+	int nChecksum = animdesc.pStudiohdr()->checksum;
+
+	{
+		AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+		if ( LockCached( panim, nChecksum, nFrames ) )
+		{
+			g_nAnimValueCacheHits++;
+			return;
+		}
+		g_nAnimValueCacheMisses++;
+	}
+
+	// Decode without the lock so other threads keep sampling cached sections meanwhile
+	animvaluecacheparams_t params;
+	params.pDecoded = CAnimValueCache::Decode( panim, nFrames );
+
+	AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+
+	if ( LockCached( panim, nChecksum, nFrames ) )
+	{
+		// another thread got there first, use theirs
+		params.pDecoded->DestroyResource();
+		return;
+	}
+
+	m_hCache = g_AnimValueCache.CreateResource( params, true );
+	m_pCache = g_AnimValueCache.GetResource_NoLock( m_hCache );
+
+	AnimValueCacheEntry_t &entry = g_AnimValueCacheIndex[ g_AnimValueCacheIndex.Insert( panim ) ];
+	entry.m_hCache = m_hCache;
+	entry.m_pCache = m_pCache;
+	entry.m_nChecksum = nChecksum;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Locks the indexed section for panim if it is still usable, otherwise
+//			drops the stale index entry.  Call with the cache mutex held.
+//-----------------------------------------------------------------------------
+bool CAnimValueCacheAccess::LockCached( const mstudioanim_t *panim, int nChecksum, int nFrames )
+{
+	unsigned short i = g_AnimValueCacheIndex.Find( panim );
+	if ( i == g_AnimValueCacheIndex.InvalidIndex() )
+		return false;
+
+	memhandle_t hCache = g_AnimValueCacheIndex[i].m_hCache;
+
+	// a different checksum means the memory now belongs to a different model
+	if ( g_AnimValueCacheIndex[i].m_nChecksum == nChecksum )
+	{
+		m_pCache = g_AnimValueCache.LockResource( hCache );
+		if ( m_pCache && m_pCache->NumFrames() == nFrames )
+		{
+			m_hCache = hCache;
+			return true;
+		}
+
+		if ( m_pCache )
+		{
+			g_AnimValueCache.UnlockResource( hCache );
+			m_pCache = NULL;
+		}
+	}
+
+	g_AnimValueCacheIndex.RemoveAt( i );
+
+	// Anyone still sampling the old section keeps it until they unlock, the LRU frees it later
+	if ( g_AnimValueCache.LockCount( hCache ) == 0 )
+	{
+		g_AnimValueCache.DestroyResource( hCache );
+	}
+	return false;
+}
+
+CAnimValueCacheAccess::~CAnimValueCacheAccess()
+{
+	if ( m_hCache != INVALID_MEMHANDLE )
+	{
+		AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+		g_AnimValueCache.UnlockResource( m_hCache );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: ExtractAnimValue, reading from the decoded values when there are any
+//-----------------------------------------------------------------------------
+static FORCEINLINE void ExtractAnimValue( int frame, const short *pDecoded, int nDecodedFrames, mstudioanimvalue_t *panimvalue, float scale, float &v1, float &v2 )
+{
+	if ( pDecoded && frame < nDecodedFrames - 1 )
+	{
+		v1 = pDecoded[frame * 2] * scale;
+		v2 = pDecoded[frame * 2 + 1] * scale;
+		return;
+	}
+	ExtractAnimValue( frame, panimvalue, scale, v1, v2 );
+}
+
+static FORCEINLINE void ExtractAnimValue( int frame, const short *pDecoded, int nDecodedFrames, mstudioanimvalue_t *panimvalue, float scale, float &v1 )
+{
+	if ( pDecoded && frame < nDecodedFrames )
+	{
+		v1 = pDecoded[frame * 2] * scale;
+		return;
+	}
+	ExtractAnimValue( frame, panimvalue, scale, v1 );
+}
+
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_anim_valuecache_stats, "Report the decoded animation keyframe cache hit rate and memory. Pass 'reset' to clear the counters, 'flush' to empty the cache." )
+#else
+CON_COMMAND( sv_anim_valuecache_stats, "Report the decoded animation keyframe cache hit rate and memory. Pass 'reset' to clear the counters, 'flush' to empty the cache." )
+#endif
+{
+	AUTO_LOCK( g_AnimValueCache.AccessMutex() );
+
+	if ( args.ArgC() > 1 && !Q_stricmp( args[1], "flush" ) )
+	{
+		g_AnimValueCache.FlushAllUnlocked();
+	}
+	if ( args.ArgC() > 1 && ( !Q_stricmp( args[1], "reset" ) || !Q_stricmp( args[1], "flush" ) ) )
+	{
+		g_nAnimValueCacheHits = 0;
+		g_nAnimValueCacheMisses = 0;
+	}
+
+	int nLookups = g_nAnimValueCacheHits + g_nAnimValueCacheMisses;
+	Msg( "anim value cache: %s, %d lookups, %d hits, %d misses (%.1f%% hit rate)\n",
+		anim_valuecache.GetBool() ? "on" : "off", nLookups, g_nAnimValueCacheHits, g_nAnimValueCacheMisses,
+		nLookups ? 100.0f * g_nAnimValueCacheHits / nLookups : 0.0f );
+	Msg( "                  %d sections known, %.1f KB used of %.1f KB\n",
+		g_AnimValueCacheIndex.Count(), g_AnimValueCache.UsedSize() / 1024.0f, g_AnimValueCache.TargetSize() / 1024.0f );
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: return a sub frame rotation for a single bone
 //-----------------------------------------------------------------------------
 void CalcBoneQuaternion( int frame, float s, 
 						const Quaternion &baseQuat, const RadianEuler &baseRot, const Vector &baseRotScale, 
 						int iBaseFlags, const Quaternion &baseAlignment, 
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CAnimValueCache *pDecoded = NULL, int iTrack = 0 )
 {
 	if ( panim->flags & STUDIO_ANIM_RAWROT )
 	{
@@ -405,14 +804,19 @@ void CalcBoneQuaternion( int frame, float s,
 
 	mstudioanim_valueptr_t *pValuesPtr = panim->pRotV();
 
+	int nDecodedFrames = pDecoded ? pDecoded->NumFrames() : 0;
+	const short *pDecodedX = pDecoded ? pDecoded->Values( iTrack, 0 ) : NULL;
+	const short *pDecodedY = pDecoded ? pDecoded->Values( iTrack, 1 ) : NULL;
+	const short *pDecodedZ = pDecoded ? pDecoded->Values( iTrack, 2 ) : NULL;
+
 	if (s > 0.001f)
 	{
 		QuaternionAligned	q1, q2;
 		RadianEuler			angle1, angle2;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
+		ExtractAnimValue( frame, pDecodedX, nDecodedFrames, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle1.x, angle2.x );
+		ExtractAnimValue( frame, pDecodedY, nDecodedFrames, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle1.y, angle2.y );
+		ExtractAnimValue( frame, pDecodedZ, nDecodedFrames, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle1.z, angle2.z );
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -449,9 +853,9 @@ void CalcBoneQuaternion( int frame, float s,
 	{
 		RadianEuler			angle;
 
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
-		ExtractAnimValue( frame, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
+		ExtractAnimValue( frame, pDecodedX, nDecodedFrames, pValuesPtr->pAnimvalue( 0 ), baseRotScale.x, angle.x );
+		ExtractAnimValue( frame, pDecodedY, nDecodedFrames, pValuesPtr->pAnimvalue( 1 ), baseRotScale.y, angle.y );
+		ExtractAnimValue( frame, pDecodedZ, nDecodedFrames, pValuesPtr->pAnimvalue( 2 ), baseRotScale.z, angle.z );
 
 		if (!(panim->flags & STUDIO_ANIM_DELTA))
 		{
@@ -476,15 +880,16 @@ void CalcBoneQuaternion( int frame, float s,
 inline void CalcBoneQuaternion( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Quaternion &q )
+						const mstudioanim_t *panim, Quaternion &q,
+						const CAnimValueCache *pDecoded = NULL, int iTrack = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q );
+		CalcBoneQuaternion( frame, s, pLinearBones->quat(panim->bone), pLinearBones->rot(panim->bone), pLinearBones->rotscale(panim->bone), pLinearBones->flags(panim->bone), pLinearBones->qalignment(panim->bone), panim, q, pDecoded, iTrack );
 	}
 	else
 	{
-		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q );
+		CalcBoneQuaternion( frame, s, pBone->quat, pBone->rot, pBone->rotscale, pBone->flags, pBone->qAlignment, panim, q, pDecoded, iTrack );
 	}
 }
 
@@ -497,7 +902,8 @@ inline void CalcBoneQuaternion( int frame, float s,
 //-----------------------------------------------------------------------------
 void CalcBonePosition(	int frame, float s,
 						const Vector &basePos, const Vector &baseBoneScale, 
-						const mstudioanim_t *panim, Vector &pos	)
+						const mstudioanim_t *panim, Vector &pos,
+						const CAnimValueCache *pDecoded = NULL, int iTrack = 0 )
 {
 	if (panim->flags & STUDIO_ANIM_RAWPOS)
 	{
@@ -522,12 +928,14 @@ void CalcBonePosition(	int frame, float s,
 	mstudioanim_valueptr_t *pPosV = panim->pPosV();
 	int					j;
 
+	int nDecodedFrames = pDecoded ? pDecoded->NumFrames() : 0;
+
 	if (s > 0.001f)
 	{
 		float v1, v2;
 		for (j = 0; j < 3; j++)
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2 );
+			ExtractAnimValue( frame, pDecoded ? pDecoded->Values( iTrack, 3 + j ) : NULL, nDecodedFrames, pPosV->pAnimvalue( j ), baseBoneScale[j], v1, v2 );
 			pos[j] = v1 * (1.0 - s) + v2 * s;
 		}
 	}
@@ -535,7 +943,7 @@ void CalcBonePosition(	int frame, float s,
 	{
 		for (j = 0; j < 3; j++)
 		{
-			ExtractAnimValue( frame, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j] );
+			ExtractAnimValue( frame, pDecoded ? pDecoded->Values( iTrack, 3 + j ) : NULL, nDecodedFrames, pPosV->pAnimvalue( j ), baseBoneScale[j], pos[j] );
 		}
 	}
 
@@ -553,15 +961,16 @@ void CalcBonePosition(	int frame, float s,
 inline void CalcBonePosition( int frame, float s, 
 						const mstudiobone_t *pBone,
 						const mstudiolinearbone_t *pLinearBones,
-						const mstudioanim_t *panim, Vector &pos )
+						const mstudioanim_t *panim, Vector &pos,
+						const CAnimValueCache *pDecoded = NULL, int iTrack = 0 )
 {
 	if (pLinearBones)
 	{
-		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos );
+		CalcBonePosition( frame, s, pLinearBones->pos(panim->bone), pLinearBones->posscale(panim->bone), panim, pos, pDecoded, iTrack );
 	}
 	else
 	{
-		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos );
+		CalcBonePosition( frame, s, pBone->pos, pBone->posscale, panim, pos, pDecoded, iTrack );
 	}
 }
 
@@ -924,7 +1333,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 	int iLocalFrame = iFrame;
 	float flStall;
-	panim = animdesc.pAnim( &iLocalFrame, flStall );
+	int nSectionFrames;
+	panim = animdesc.pAnim( &iLocalFrame, flStall, &nSectionFrames );
 
 	float *pweight = seqdesc.pBoneweight( 0 );
 	pbone = pStudioHdr->pBone( 0 );
@@ -965,8 +1375,10 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 		return;
 	}
 
+	CAnimValueCacheAccess decoded( animdesc, panim, nSectionFrames );
+
 	// FIXME: change encoding so that bone -1 is never the case
-	while (panim && panim->bone < 255)
+	for ( int iTrack = 0; panim && panim->bone < 255; iTrack++ )
 	{
 		j = pAnimGroup->masterBone[panim->bone];
 		if ( j >= 0 && ( pStudioHdr->boneFlags(j) & boneMask ) )
@@ -975,8 +1387,8 @@ static void CalcVirtualAnimation( virtualmodel_t *pVModel, const CStudioHdr *pSt
 
 			if (k >= 0 && pweight[k] > 0.0f)
 			{
-				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j] );
-				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j] );
+				CalcBoneQuaternion( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, q[j], decoded.Cache(), iTrack );
+				CalcBonePosition  ( iLocalFrame, s, &pAnimbone[panim->bone], pAnimLinearBones, panim, pos[j], decoded.Cache(), iTrack );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 #endif
@@ -1065,7 +1477,8 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 
 	int iLocalFrame = iFrame;
 	float flStall;
-	mstudioanim_t *panim = animdesc.pAnim( &iLocalFrame, flStall );
+	int nSectionFrames;
+	mstudioanim_t *panim = animdesc.pAnim( &iLocalFrame, flStall, &nSectionFrames );
 
 	float *pweight = seqdesc.pBoneweight( 0 );
 
@@ -1096,6 +1509,9 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		return;
 	}
 
+	CAnimValueCacheAccess decoded( animdesc, panim, nSectionFrames );
+	int iTrack = 0;
+
 	// BUGBUG: the sequence, the anim, and the model can have all different bone mappings.
 	for (i = 0; i < pStudioHdr->numbones(); i++, pbone++, pweight++)
 	{
@@ -1103,14 +1519,15 @@ static void CalcAnimation( const CStudioHdr *pStudioHdr,	Vector *pos, Quaternion
 		{
 			if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 			{
-				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i] );
-				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i] );
+				CalcBoneQuaternion( iLocalFrame, s, pbone, pLinearBones, panim, q[i], decoded.Cache(), iTrack );
+				CalcBonePosition  ( iLocalFrame, s, pbone, pLinearBones, panim, pos[i], decoded.Cache(), iTrack );
 #ifdef STUDIO_ENABLE_PERF_COUNTERS
 				pStudioHdr->m_nPerfAnimatedBones++;
 				pStudioHdr->m_nPerfUsedBones++;
 #endif
 			}
 			panim = panim->pNext();
+			iTrack++;
 		}
 		else if (*pweight > 0 && (pStudioHdr->boneFlags(i) & boneMask))
 		{
@@ -1373,81 +1790,497 @@ void WorldSpaceSlerp(
 
 
 //-----------------------------------------------------------------------------
-// Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
-//			0 returns q1, pos1.  1 returns q2, pos2
+// Structure of arrays pose kernels.  These run the same quaternion math as
+// QuaternionSlerp, QuaternionBlend, QuaternionMA etc. four bones at a time, in
+// the same order of operations, so they give the same results as the per bone
+// loops.  IBoneSetup::InitPoseSoA keeps the pose in this form from InitPose
+// until StorePose.  Off by default until validated on the shipping content.
 //-----------------------------------------------------------------------------
-void SlerpBones( 
-	const CStudioHdr *pStudioHdr,
-	Quaternion q1[MAXSTUDIOBONES], 
-	Vector pos1[MAXSTUDIOBONES], 
-	mstudioseqdesc_t &seqdesc,  // source of q2 and pos2
-	int sequence, 
-	const QuaternionAligned q2[MAXSTUDIOBONES], 
-	const Vector pos2[MAXSTUDIOBONES], 
-	float s,
-	int boneMask )
+static ConVar anim_simd_pose( "anim_simd_pose", "0", FCVAR_REPLICATED, "Keep the bone pose in structure of arrays form while it is built and blend four bones at a time." );
+static ConVar anim_simd_pose_validate( "anim_simd_pose_validate", "0", FCVAR_REPLICATED, "Also build the pose with the scalar code and warn when the SIMD pose differs by more than anim_simd_pose_tolerance." );
+static ConVar anim_simd_pose_tolerance( "anim_simd_pose_tolerance", "0", FCVAR_REPLICATED, "Largest per component difference anim_simd_pose_validate accepts." );
+
+struct SoAQuaternion_t
 {
-	if (s <= 0.0f) 
-		return;
-	if (s > 1.0f)
-	{
-		s = 1.0f;		
-	}
+	fltx4 x, y, z, w;
+};
 
-	if (seqdesc.flags & STUDIO_WORLD)
-	{
-		WorldSpaceSlerp( pStudioHdr, q1, pos1, seqdesc, sequence, q2, pos2, s, boneMask );
-		return;
-	}
+template< class QUAT >
+static FORCEINLINE void LoadBonePoseSoA( CBonePoseSoA &pose, const Vector pos[], const QUAT q[], int nBones )
+{
+	Assert( nBones >= 0 && nBones <= MAXSTUDIOBONES );
+	pose.m_nBones = nBones;
 
-	int			i, j;
-	virtualmodel_t *pVModel = pStudioHdr->GetVirtualModel();
-	const virtualgroup_t *pSeqGroup = NULL;
-	if (pVModel)
+	// pad the last group with copies of the last bone
+	int nLast = nBones - 1;
+	int nGroups = pose.NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		pSeqGroup = pVModel->pSeqGroup( sequence );
+		int i0 = g * 4;
+		int i1 = MIN( i0 + 1, nLast );
+		int i2 = MIN( i0 + 2, nLast );
+		int i3 = MIN( i0 + 3, nLast );
+
+		pose.m_Pos[g].LoadAndSwizzle( pos[i0], pos[i1], pos[i2], pos[i3] );
+
+		fltx4 x = LoadUnalignedSIMD( q[i0].Base() );
+		fltx4 y = LoadUnalignedSIMD( q[i1].Base() );
+		fltx4 z = LoadUnalignedSIMD( q[i2].Base() );
+		fltx4 w = LoadUnalignedSIMD( q[i3].Base() );
+		TransposeSIMD( x, y, z, w );
+		pose.m_QuatXYZ[g].x = x;
+		pose.m_QuatXYZ[g].y = y;
+		pose.m_QuatXYZ[g].z = z;
+		pose.m_QuatW[g] = w;
 	}
+}
 
-	// Build weightlist for all bones
-	int nBoneCount = pStudioHdr->numbones();
-	float *pS2 = (float*)stackalloc( nBoneCount * sizeof(float) );
-	for (i = 0; i < nBoneCount; i++)
-	{
-		// skip unused bones
-		if (!(pStudioHdr->boneFlags(i) & boneMask))
-		{
-			pS2[i] = 0.0f;
-			continue;
-		}
+void CBonePoseSoA::Load( const Vector pos[], const Quaternion q[], int nBones )
+{
+	LoadBonePoseSoA( *this, pos, q, nBones );
+}
 
-		if ( !pSeqGroup )
-		{
-			pS2[i] = s * seqdesc.weight( i );	// blend in based on this bones weight
-			continue;
-		}
+void CBonePoseSoA::Load( const Vector pos[], const QuaternionAligned q[], int nBones )
+{
+	LoadBonePoseSoA( *this, pos, q, nBones );
+}
 
-		j = pSeqGroup->boneMap[i];
-		if ( j >= 0 )
-		{
-			pS2[i] = s * seqdesc.weight( j );	// blend in based on this bones weight
-		}
-		else
+void CBonePoseSoA::Store( Vector pos[], Quaternion q[] ) const
+{
+	int nGroups = NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		fltx4 quat[4] = { m_QuatXYZ[g].x, m_QuatXYZ[g].y, m_QuatXYZ[g].z, m_QuatW[g] };
+		TransposeSIMD( quat[0], quat[1], quat[2], quat[3] );
+
+		int nLanes = MIN( 4, m_nBones - g * 4 );
+		for ( int k = 0; k < nLanes; k++ )
 		{
-			pS2[i] = 0.0;
+			StoreUnalignedSIMD( q[g * 4 + k].Base(), quat[k] );
+			pos[g * 4 + k] = m_Pos[g].Vec( k );
 		}
 	}
+}
 
-	float s1, s2;
-	if ( seqdesc.flags & STUDIO_DELTA )
+void CBonePoseSoA::Init( int nBones )
+{
+	Assert( nBones >= 0 && nBones <= MAXSTUDIOBONES );
+	m_nBones = nBones;
+
+	int nGroups = NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
 	{
-		for ( i = 0; i < nBoneCount; i++ )
-		{
-			s2 = pS2[i];
-			if ( s2 <= 0.0f )
-				continue;
+		m_Pos[g].x = m_Pos[g].y = m_Pos[g].z = Four_Zeros;
+		m_QuatXYZ[g].x = m_QuatXYZ[g].y = m_QuatXYZ[g].z = Four_Zeros;
+		m_QuatW[g] = Four_Ones;
+	}
+}
 
-			if ( seqdesc.flags & STUDIO_POST )
-			{
+void CBonePoseSoA::GetBone( int iBone, Vector &pos, Quaternion &q ) const
+{
+	Assert( iBone >= 0 && iBone < m_nBones );
+	int g = iBone >> 2;
+	int k = iBone & 3;
+	pos = m_Pos[g].Vec( k );
+	q.Init( SubFloat( m_QuatXYZ[g].x, k ), SubFloat( m_QuatXYZ[g].y, k ), SubFloat( m_QuatXYZ[g].z, k ), SubFloat( m_QuatW[g], k ) );
+}
+
+void CBonePoseSoA::SetBone( int iBone, const Vector &pos, const Quaternion &q )
+{
+	Assert( iBone >= 0 && iBone < m_nBones );
+	int g = iBone >> 2;
+	int k = iBone & 3;
+	SubFloat( m_Pos[g].x, k ) = pos.x;
+	SubFloat( m_Pos[g].y, k ) = pos.y;
+	SubFloat( m_Pos[g].z, k ) = pos.z;
+	SubFloat( m_QuatXYZ[g].x, k ) = q.x;
+	SubFloat( m_QuatXYZ[g].y, k ) = q.y;
+	SubFloat( m_QuatXYZ[g].z, k ) = q.z;
+	SubFloat( m_QuatW[g], k ) = q.w;
+}
+
+static FORCEINLINE void LoadQuaternionSoA( const CBonePoseSoA &pose, int g, SoAQuaternion_t &q )
+{
+	q.x = pose.m_QuatXYZ[g].x;
+	q.y = pose.m_QuatXYZ[g].y;
+	q.z = pose.m_QuatXYZ[g].z;
+	q.w = pose.m_QuatW[g];
+}
+
+static FORCEINLINE void StoreQuaternionSoA( CBonePoseSoA &pose, int g, const fltx4 &mask, const SoAQuaternion_t &q )
+{
+	pose.m_QuatXYZ[g].x = MaskedAssign( mask, q.x, pose.m_QuatXYZ[g].x );
+	pose.m_QuatXYZ[g].y = MaskedAssign( mask, q.y, pose.m_QuatXYZ[g].y );
+	pose.m_QuatXYZ[g].z = MaskedAssign( mask, q.z, pose.m_QuatXYZ[g].z );
+	pose.m_QuatW[g] = MaskedAssign( mask, q.w, pose.m_QuatW[g] );
+}
+
+static FORCEINLINE void StorePositionSoA( CBonePoseSoA &pose, int g, const fltx4 &mask, const fltx4 &x, const fltx4 &y, const fltx4 &z )
+{
+	pose.m_Pos[g].x = MaskedAssign( mask, x, pose.m_Pos[g].x );
+	pose.m_Pos[g].y = MaskedAssign( mask, y, pose.m_Pos[g].y );
+	pose.m_Pos[g].z = MaskedAssign( mask, z, pose.m_Pos[g].z );
+}
+
+// -a, flipping the sign bit like the scalar negate does (0 - a would turn -0 into +0)
+static FORCEINLINE fltx4 FlipSignSIMD( const fltx4 &a )
+{
+	return XorSIMD( a, LoadAlignedSIMD( g_SIMD_signmask ) );
+}
+
+// QuaternionAlign
+static FORCEINLINE void QuaternionAlignSoA( const SoAQuaternion_t &p, const SoAQuaternion_t &q, SoAQuaternion_t &qt )
+{
+	fltx4 d = SubSIMD( p.x, q.x );
+	fltx4 s = AddSIMD( p.x, q.x );
+	fltx4 a = MulSIMD( d, d );
+	fltx4 b = MulSIMD( s, s );
+	d = SubSIMD( p.y, q.y );
+	s = AddSIMD( p.y, q.y );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+	b = AddSIMD( b, MulSIMD( s, s ) );
+	d = SubSIMD( p.z, q.z );
+	s = AddSIMD( p.z, q.z );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+	b = AddSIMD( b, MulSIMD( s, s ) );
+	d = SubSIMD( p.w, q.w );
+	s = AddSIMD( p.w, q.w );
+	a = AddSIMD( a, MulSIMD( d, d ) );
+	b = AddSIMD( b, MulSIMD( s, s ) );
+
+	fltx4 flip = CmpGtSIMD( a, b );
+	qt.x = MaskedAssign( flip, FlipSignSIMD( q.x ), q.x );
+	qt.y = MaskedAssign( flip, FlipSignSIMD( q.y ), q.y );
+	qt.z = MaskedAssign( flip, FlipSignSIMD( q.z ), q.z );
+	qt.w = MaskedAssign( flip, FlipSignSIMD( q.w ), q.w );
+}
+
+// QuaternionNormalize
+static FORCEINLINE void QuaternionNormalizeSoA( SoAQuaternion_t &q )
+{
+	fltx4 radius = MulSIMD( q.x, q.x );
+	radius = AddSIMD( radius, MulSIMD( q.y, q.y ) );
+	radius = AddSIMD( radius, MulSIMD( q.z, q.z ) );
+	radius = AddSIMD( radius, MulSIMD( q.w, q.w ) );
+
+	fltx4 nonZero = CmpGtSIMD( radius, Four_Zeros );
+	fltx4 iradius = DivSIMD( Four_Ones, MaskedAssign( nonZero, SqrtSIMD( radius ), Four_Ones ) );
+	q.x = MaskedAssign( nonZero, MulSIMD( q.x, iradius ), q.x );
+	q.y = MaskedAssign( nonZero, MulSIMD( q.y, iradius ), q.y );
+	q.z = MaskedAssign( nonZero, MulSIMD( q.z, iradius ), q.z );
+	q.w = MaskedAssign( nonZero, MulSIMD( q.w, iradius ), q.w );
+}
+
+// QuaternionScale
+static FORCEINLINE void QuaternionScaleSoA( const SoAQuaternion_t &p, const fltx4 &t, SoAQuaternion_t &q )
+{
+	fltx4 sinom = MulSIMD( p.x, p.x );
+	sinom = AddSIMD( sinom, MulSIMD( p.y, p.y ) );
+	sinom = AddSIMD( sinom, MulSIMD( p.z, p.z ) );
+	sinom = MinSIMD( SqrtSIMD( sinom ), Four_Ones );
+
+	fltx4 sinsom = SinSIMD( MulSIMD( ArcSinSIMD( sinom ), t ) );
+
+	fltx4 scale = DivSIMD( sinsom, AddSIMD( sinom, ReplicateX4( FLT_EPSILON ) ) );
+	q.x = MulSIMD( p.x, scale );
+	q.y = MulSIMD( p.y, scale );
+	q.z = MulSIMD( p.z, scale );
+
+	// rescale rotation, keeping its sign
+	fltx4 r = SubSIMD( Four_Ones, MulSIMD( sinsom, sinsom ) );
+	r = SqrtSIMD( MaxSIMD( r, Four_Zeros ) );
+	q.w = MaskedAssign( CmpLtSIMD( p.w, Four_Zeros ), FlipSignSIMD( r ), r );
+}
+
+// QuaternionMult, qt = p * q
+static FORCEINLINE void QuaternionMultSoA( const SoAQuaternion_t &p, const SoAQuaternion_t &q, SoAQuaternion_t &qt )
+{
+	SoAQuaternion_t q2;
+	QuaternionAlignSoA( p, q, q2 );
+
+	qt.x = AddSIMD( SubSIMD( AddSIMD( MulSIMD( p.x, q2.w ), MulSIMD( p.y, q2.z ) ), MulSIMD( p.z, q2.y ) ), MulSIMD( p.w, q2.x ) );
+	qt.y = AddSIMD( AddSIMD( SubSIMD( MulSIMD( p.y, q2.w ), MulSIMD( p.x, q2.z ) ), MulSIMD( p.z, q2.x ) ), MulSIMD( p.w, q2.y ) );
+	qt.z = AddSIMD( AddSIMD( SubSIMD( MulSIMD( p.x, q2.y ), MulSIMD( p.y, q2.x ) ), MulSIMD( p.z, q2.w ) ), MulSIMD( p.w, q2.z ) );
+	qt.w = AddSIMD( SubSIMD( FlipSignSIMD( AddSIMD( MulSIMD( p.x, q2.x ), MulSIMD( p.y, q2.y ) ) ), MulSIMD( p.z, q2.z ) ), MulSIMD( p.w, q2.w ) );
+}
+
+// QuaternionSlerpNoAlign.  The rare lanes where p and q are opposite go through the scalar code.
+static FORCEINLINE void QuaternionSlerpNoAlignSoA( const SoAQuaternion_t &p, const SoAQuaternion_t &q, const fltx4 &t, const fltx4 &active, SoAQuaternion_t &qt )
+{
+	fltx4 cosom = MulSIMD( p.x, q.x );
+	cosom = AddSIMD( cosom, MulSIMD( p.y, q.y ) );
+	cosom = AddSIMD( cosom, MulSIMD( p.z, q.z ) );
+	cosom = AddSIMD( cosom, MulSIMD( p.w, q.w ) );
+
+	fltx4 epsilon = ReplicateX4( 0.000001f );
+	fltx4 oneMinusT = SubSIMD( Four_Ones, t );
+	fltx4 sclp = oneMinusT;
+	fltx4 sclq = t;
+
+	fltx4 far = AndSIMD( active, CmpGtSIMD( SubSIMD( Four_Ones, cosom ), epsilon ) );
+	if ( TestSignSIMD( far ) )
+	{
+		fltx4 omega = ArcCosSIMD( cosom );
+		fltx4 sinom = SinSIMD( omega );
+		sclp = MaskedAssign( far, DivSIMD( SinSIMD( MulSIMD( oneMinusT, omega ) ), sinom ), sclp );
+		sclq = MaskedAssign( far, DivSIMD( SinSIMD( MulSIMD( t, omega ) ), sinom ), sclq );
+	}
+
+	qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( sclq, q.x ) );
+	qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( sclq, q.y ) );
+	qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( sclq, q.z ) );
+	qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( sclq, q.w ) );
+
+	int nOpposite = TestSignSIMD( AndNotSIMD( CmpGtSIMD( AddSIMD( Four_Ones, cosom ), epsilon ), active ) );
+	for ( int k = 0; nOpposite; k++, nOpposite >>= 1 )
+	{
+		if ( !( nOpposite & 1 ) )
+			continue;
+
+		Quaternion pk( SubFloat( p.x, k ), SubFloat( p.y, k ), SubFloat( p.z, k ), SubFloat( p.w, k ) );
+		Quaternion qk( SubFloat( q.x, k ), SubFloat( q.y, k ), SubFloat( q.z, k ), SubFloat( q.w, k ) );
+		Quaternion result;
+		QuaternionSlerpNoAlign( pk, qk, SubFloat( t, k ), result );
+		SubFloat( qt.x, k ) = result.x;
+		SubFloat( qt.y, k ) = result.y;
+		SubFloat( qt.z, k ) = result.z;
+		SubFloat( qt.w, k ) = result.w;
+	}
+}
+
+// QuaternionBlendNoAlign
+static FORCEINLINE void QuaternionBlendNoAlignSoA( const SoAQuaternion_t &p, const SoAQuaternion_t &q, const fltx4 &t, SoAQuaternion_t &qt )
+{
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	qt.x = AddSIMD( MulSIMD( sclp, p.x ), MulSIMD( t, q.x ) );
+	qt.y = AddSIMD( MulSIMD( sclp, p.y ), MulSIMD( t, q.y ) );
+	qt.z = AddSIMD( MulSIMD( sclp, p.z ), MulSIMD( t, q.z ) );
+	qt.w = AddSIMD( MulSIMD( sclp, p.w ), MulSIMD( t, q.w ) );
+	QuaternionNormalizeSoA( qt );
+}
+
+// q aligned to p, except in the lanes that have BONE_FIXED_ALIGNMENT
+static FORCEINLINE void QuaternionAlignMaskedSoA( const SoAQuaternion_t &p, const SoAQuaternion_t &q, const fltx4 &noAlign, SoAQuaternion_t &qt )
+{
+	QuaternionAlignSoA( p, q, qt );
+	qt.x = MaskedAssign( noAlign, q.x, qt.x );
+	qt.y = MaskedAssign( noAlign, q.y, qt.y );
+	qt.z = MaskedAssign( noAlign, q.z, qt.z );
+	qt.w = MaskedAssign( noAlign, q.w, qt.w );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SoA version of the non-delta SlerpBones loop
+//-----------------------------------------------------------------------------
+void SlerpBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const float *pWeights, const fltx4 *pNoAlign )
+{
+	Assert( pose1.m_nBones == pose2.m_nBones );
+
+	int nGroups = pose1.NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + g * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( !TestSignSIMD( active ) )
+			continue;
+
+		fltx4 s1 = SubSIMD( Four_Ones, s2 );
+
+		SoAQuaternion_t q1, q2, q1Aligned, q3;
+		LoadQuaternionSoA( pose1, g, q1 );
+		LoadQuaternionSoA( pose2, g, q2 );
+		QuaternionAlignMaskedSoA( q2, q1, pNoAlign[g], q1Aligned );
+		QuaternionSlerpNoAlignSoA( q2, q1Aligned, s1, active, q3 );
+		StoreQuaternionSoA( pose1, g, active, q3 );
+
+		const FourVectors &pos1 = pose1.m_Pos[g];
+		const FourVectors &pos2 = pose2.m_Pos[g];
+		StorePositionSoA( pose1, g, active,
+			AddSIMD( MulSIMD( pos1.x, s1 ), MulSIMD( pos2.x, s2 ) ),
+			AddSIMD( MulSIMD( pos1.y, s1 ), MulSIMD( pos2.y, s2 ) ),
+			AddSIMD( MulSIMD( pos1.z, s1 ), MulSIMD( pos2.z, s2 ) ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SoA version of the STUDIO_DELTA SlerpBones loop
+//-----------------------------------------------------------------------------
+void SlerpDeltaBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const float *pWeights, bool bPost )
+{
+	Assert( pose1.m_nBones == pose2.m_nBones );
+
+	int nGroups = pose1.NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		fltx4 s2 = LoadUnalignedSIMD( pWeights + g * 4 );
+		fltx4 active = CmpGtSIMD( s2, Four_Zeros );
+		if ( !TestSignSIMD( active ) )
+			continue;
+
+		SoAQuaternion_t q1, q2, scaled, q3;
+		LoadQuaternionSoA( pose1, g, q1 );
+		LoadQuaternionSoA( pose2, g, q2 );
+		QuaternionScaleSoA( q2, s2, scaled );
+		if ( bPost )
+		{
+			// QuaternionMA( q1, s2, q2, q1 )
+			QuaternionMultSoA( q1, scaled, q3 );
+		}
+		else
+		{
+			// QuaternionSM( s2, q2, q1, q1 )
+			QuaternionMultSoA( scaled, q1, q3 );
+		}
+		QuaternionNormalizeSoA( q3 );
+		StoreQuaternionSoA( pose1, g, active, q3 );
+
+		const FourVectors &pos1 = pose1.m_Pos[g];
+		const FourVectors &pos2 = pose2.m_Pos[g];
+		StorePositionSoA( pose1, g, active,
+			AddSIMD( pos1.x, MulSIMD( pos2.x, s2 ) ),
+			AddSIMD( pos1.y, MulSIMD( pos2.y, s2 ) ),
+			AddSIMD( pos1.z, MulSIMD( pos2.z, s2 ) ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SoA version of the BlendBones loop
+//-----------------------------------------------------------------------------
+void BlendBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const fltx4 *pActive, const fltx4 *pNoAlign, float s )
+{
+	Assert( pose1.m_nBones == pose2.m_nBones );
+
+	float flS1 = 1.0 - s;
+	fltx4 s1 = ReplicateX4( flS1 );
+	fltx4 s2 = ReplicateX4( s );
+
+	int nGroups = pose1.NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( !TestSignSIMD( pActive[g] ) )
+			continue;
+
+		SoAQuaternion_t q1, q2, q1Aligned, q3;
+		LoadQuaternionSoA( pose1, g, q1 );
+		LoadQuaternionSoA( pose2, g, q2 );
+		QuaternionAlignMaskedSoA( q2, q1, pNoAlign[g], q1Aligned );
+		QuaternionBlendNoAlignSoA( q2, q1Aligned, s1, q3 );
+		StoreQuaternionSoA( pose1, g, pActive[g], q3 );
+
+		const FourVectors &pos1 = pose1.m_Pos[g];
+		const FourVectors &pos2 = pose2.m_Pos[g];
+		StorePositionSoA( pose1, g, pActive[g],
+			AddSIMD( MulSIMD( pos1.x, s1 ), MulSIMD( pos2.x, s2 ) ),
+			AddSIMD( MulSIMD( pos1.y, s1 ), MulSIMD( pos2.y, s2 ) ),
+			AddSIMD( MulSIMD( pos1.z, s1 ), MulSIMD( pos2.z, s2 ) ) );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: SoA version of the ScaleBones loop
+//-----------------------------------------------------------------------------
+void ScaleBonesSoA( CBonePoseSoA &pose1, const fltx4 *pActive, float s )
+{
+	// QuaternionIdentityBlend( q1, 1 - s, q1 )
+	float flS1 = 1.0 - s;
+	fltx4 t = ReplicateX4( flS1 );
+	fltx4 sclp = SubSIMD( Four_Ones, t );
+	fltx4 s2 = ReplicateX4( s );
+
+	int nGroups = pose1.NumGroups();
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		if ( !TestSignSIMD( pActive[g] ) )
+			continue;
+
+		SoAQuaternion_t q1, q3;
+		LoadQuaternionSoA( pose1, g, q1 );
+		q3.x = MulSIMD( q1.x, sclp );
+		q3.y = MulSIMD( q1.y, sclp );
+		q3.z = MulSIMD( q1.z, sclp );
+		q3.w = MulSIMD( q1.w, sclp );
+		q3.w = MaskedAssign( CmpLtSIMD( q1.w, Four_Zeros ), SubSIMD( q3.w, t ), AddSIMD( q3.w, t ) );
+		QuaternionNormalizeSoA( q3 );
+		StoreQuaternionSoA( pose1, g, pActive[g], q3 );
+
+		const FourVectors &pos1 = pose1.m_Pos[g];
+		StorePositionSoA( pose1, g, pActive[g], MulSIMD( pos1.x, s2 ), MulSIMD( pos1.y, s2 ), MulSIMD( pos1.z, s2 ) );
+	}
+}
+
+// Lane masks for the bones whose flags intersect nMask
+static void BuildBoneLaneMasks( fltx4 *pMasks, const int *pBoneFlags, int nMask, int nBones )
+{
+	int nGroups = ( nBones + 3 ) >> 2;
+	for ( int g = 0; g < nGroups; g++ )
+	{
+		for ( int k = 0; k < 4; k++ )
+		{
+			int i = g * 4 + k;
+			SubInt( pMasks[g], k ) = ( i < nBones && ( pBoneFlags[i] & nMask ) ) ? 0xFFFFFFFF : 0;
+		}
+	}
+}
+
+// Largest per component difference between two poses, counting only the bones in boneMask when pBoneFlags is given
+static float BonePoseMaxError( const Quaternion q[], const Vector pos[], const Quaternion qRef[], const Vector posRef[], int nBones, const int *pBoneFlags = NULL, int boneMask = 0, int *pWorstBone = NULL )
+{
+	float flMaxError = 0.0f;
+	int iWorst = -1;
+	for ( int i = 0; i < nBones; i++ )
+	{
+		if ( pBoneFlags && !( pBoneFlags[i] & boneMask ) )
+			continue;
+
+		float flError = 0.0f;
+		for ( int k = 0; k < 4; k++ )
+		{
+			float flDelta = fabs( q[i][k] - qRef[i][k] );
+			flError = ( flDelta <= flError ) ? flError : flDelta;	// NaN counts as an error
+		}
+		for ( int k = 0; k < 3; k++ )
+		{
+			float flDelta = fabs( pos[i][k] - posRef[i][k] );
+			flError = ( flDelta <= flError ) ? flError : flDelta;
+		}
+		if ( !( flError <= flMaxError ) )
+		{
+			flMaxError = flError;
+			iWorst = i;
+		}
+	}
+	if ( pWorstBone )
+	{
+		*pWorstBone = iWorst;
+	}
+	return flMaxError;
+}
+
+//-----------------------------------------------------------------------------
+// Per bone blend loops, used by the scalar path and the benchmark
+//-----------------------------------------------------------------------------
+static void SlerpBonesScalar(
+	Quaternion q1[MAXSTUDIOBONES],
+	Vector pos1[MAXSTUDIOBONES],
+	const QuaternionAligned q2[MAXSTUDIOBONES],
+	const Vector pos2[MAXSTUDIOBONES],
+	const float *pS2,
+	const int *pBoneFlags,
+	int nBoneCount,
+	int seqFlags )
+{
+	int			i;
+	float s1, s2;
+	if ( seqFlags & STUDIO_DELTA )
+	{
+		for ( i = 0; i < nBoneCount; i++ )
+		{
+			s2 = pS2[i];
+			if ( s2 <= 0.0f )
+				continue;
+
+			if ( seqFlags & STUDIO_POST )
+			{
 #ifndef _X360
 				QuaternionMA( q1[i], s2, q2[i], q1[i] );
 #else
@@ -1495,7 +2328,7 @@ void SlerpBones(
 		q1simd = LoadUnalignedSIMD( q1[i].Base() );
 		q2simd = LoadAlignedSIMD( q2[i] );
 #endif
-		if ( pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT )
+		if ( pBoneFlags[i] & BONE_FIXED_ALIGNMENT )
 		{
 #ifndef _X360
 			QuaternionSlerpNoAlign( q2[i], q1[i], s1, q3 );
@@ -1527,27 +2360,80 @@ void SlerpBones(
 	}
 }
 
+static void BlendBonesScalar(
+	Quaternion q1[MAXSTUDIOBONES],
+	Vector pos1[MAXSTUDIOBONES],
+	const Quaternion q2[MAXSTUDIOBONES],
+	const Vector pos2[MAXSTUDIOBONES],
+	const int *pActive,
+	const int *pBoneFlags,
+	int nBoneCount,
+	float s )
+{
+	Quaternion		q3;
+
+	float s2 = s;
+	float s1 = 1.0 - s2;
+
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( !pActive[i] )
+			continue;
+
+		if (pBoneFlags[i] & BONE_FIXED_ALIGNMENT)
+		{
+			QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
+		}
+		else
+		{
+			QuaternionBlend( q2[i], q1[i], s1, q3 );
+		}
+		q1[i][0] = q3[0];
+		q1[i][1] = q3[1];
+		q1[i][2] = q3[2];
+		q1[i][3] = q3[3];
+		pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
+		pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
+		pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
+	}
+}
+
+static void ScaleBonesScalar(
+	Quaternion q1[MAXSTUDIOBONES],
+	Vector pos1[MAXSTUDIOBONES],
+	const int *pActive,
+	int nBoneCount,
+	float s )
+{
+	float s2 = s;
+	float s1 = 1.0 - s2;
+
+	for ( int i = 0; i < nBoneCount; i++ )
+	{
+		if ( !pActive[i] )
+			continue;
+
+		QuaternionIdentityBlend( q1[i], s1, q1[i] );
+		VectorScale( pos1[i], s2, pos1[i] );
+	}
+}
 
 
 //-----------------------------------------------------------------------------
-// Purpose: Inter-animation blend.  Assumes both types are identical.
-//			blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
-//			0 returns q1, pos1.  1 returns q2, pos2
+// Per bone weights and flags for a sequence, shared by the scalar and SoA blends
 //-----------------------------------------------------------------------------
-void BlendBones( 
-	const CStudioHdr *pStudioHdr,
-	Quaternion q1[MAXSTUDIOBONES], 
-	Vector pos1[MAXSTUDIOBONES], 
-	mstudioseqdesc_t &seqdesc, 
-	int sequence,
-	const Quaternion q2[MAXSTUDIOBONES], 
-	const Vector pos2[MAXSTUDIOBONES], 
-	float s,
-	int boneMask )
+static void GetBoneFlags( const CStudioHdr *pStudioHdr, int *pBoneFlags )
 {
-	int			i, j;
-	Quaternion		q3;
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		pBoneFlags[i] = pStudioHdr->boneFlags( i );
+	}
+}
 
+// Weight of each bone in SlerpBones, padded with zeros to a multiple of four bones
+static void SlerpBonesWeights( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, int sequence, float s, int boneMask, float *pS2 )
+{
+	int			i, j;
 	virtualmodel_t *pVModel = pStudioHdr->GetVirtualModel();
 	const virtualgroup_t *pSeqGroup = NULL;
 	if (pVModel)
@@ -1555,45 +2441,53 @@ void BlendBones(
 		pSeqGroup = pVModel->pSeqGroup( sequence );
 	}
 
-	if (s <= 0)
-	{
-		Assert(0); // shouldn't have been called
-		return;
-	}
-	else if (s >= 1.0)
+	int nBoneCount = pStudioHdr->numbones();
+	for (i = 0; i < nBoneCount; i++)
 	{
-		Assert(0); // shouldn't have been called
-		for (i = 0; i < pStudioHdr->numbones(); i++)
+		// skip unused bones
+		if (!(pStudioHdr->boneFlags(i) & boneMask))
 		{
-			// skip unused bones
-			if (!(pStudioHdr->boneFlags(i) & boneMask))
-			{
-				continue;
-			}
+			pS2[i] = 0.0f;
+			continue;
+		}
 
-			if (pSeqGroup)
-			{
-				j = pSeqGroup->boneMap[i];
-			}
-			else
-			{
-				j = i;
-			}
+		if ( !pSeqGroup )
+		{
+			pS2[i] = s * seqdesc.weight( i );	// blend in based on this bones weight
+			continue;
+		}
 
-			if (j >= 0 && seqdesc.weight( j ) > 0.0)
-			{
-				q1[i] = q2[i];
-				pos1[i] = pos2[i];
-			}
+		j = pSeqGroup->boneMap[i];
+		if ( j >= 0 )
+		{
+			pS2[i] = s * seqdesc.weight( j );	// blend in based on this bones weight
 		}
-		return;
+		else
+		{
+			pS2[i] = 0.0;
+		}
+	}
+	for ( ; i & 3; i++ )
+	{
+		pS2[i] = 0.0f;
 	}
+}
 
-	float s2 = s;
-	float s1 = 1.0 - s2;
+// Bones BlendBones and ScaleBones touch: used bones the sequence has a weight for
+static void BlendBonesActive( const CStudioHdr *pStudioHdr, mstudioseqdesc_t &seqdesc, int sequence, int boneMask, int *pActive )
+{
+	int			i, j;
+	virtualmodel_t *pVModel = pStudioHdr->GetVirtualModel();
+	const virtualgroup_t *pSeqGroup = NULL;
+	if (pVModel)
+	{
+		pSeqGroup = pVModel->pSeqGroup( sequence );
+	}
 
 	for (i = 0; i < pStudioHdr->numbones(); i++)
 	{
+		pActive[i] = 0;
+
 		// skip unused bones
 		if (!(pStudioHdr->boneFlags(i) & boneMask))
 		{
@@ -1609,25 +2503,95 @@ void BlendBones(
 			j = i;
 		}
 
-		if (j >= 0 && seqdesc.weight( j ) > 0.0)
+		pActive[i] = (j >= 0 && seqdesc.weight( j ) > 0.0);
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
+//			0 returns q1, pos1.  1 returns q2, pos2
+//-----------------------------------------------------------------------------
+void SlerpBones( 
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	mstudioseqdesc_t &seqdesc,  // source of q2 and pos2
+	int sequence, 
+	const QuaternionAligned q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	float s,
+	int boneMask )
+{
+	if (s <= 0.0f) 
+		return;
+	if (s > 1.0f)
+	{
+		s = 1.0f;		
+	}
+
+	if (seqdesc.flags & STUDIO_WORLD)
+	{
+		WorldSpaceSlerp( pStudioHdr, q1, pos1, seqdesc, sequence, q2, pos2, s, boneMask );
+		return;
+	}
+
+	// Build weightlist for all bones
+	int nBoneCount = pStudioHdr->numbones();
+	float *pS2 = (float*)stackalloc( ( ( nBoneCount + 3 ) & ~3 ) * sizeof(float) );
+	int *pBoneFlags = (int*)stackalloc( nBoneCount * sizeof(int) );
+	SlerpBonesWeights( pStudioHdr, seqdesc, sequence, s, boneMask, pS2 );
+	GetBoneFlags( pStudioHdr, pBoneFlags );
+
+	SlerpBonesScalar( q1, pos1, q2, pos2, pS2, pBoneFlags, nBoneCount, seqdesc.flags );
+}
+
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Inter-animation blend.  Assumes both types are identical.
+//			blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
+//			0 returns q1, pos1.  1 returns q2, pos2
+//-----------------------------------------------------------------------------
+void BlendBones( 
+	const CStudioHdr *pStudioHdr,
+	Quaternion q1[MAXSTUDIOBONES], 
+	Vector pos1[MAXSTUDIOBONES], 
+	mstudioseqdesc_t &seqdesc, 
+	int sequence,
+	const Quaternion q2[MAXSTUDIOBONES], 
+	const Vector pos2[MAXSTUDIOBONES], 
+	float s,
+	int boneMask )
+{
+	if (s <= 0)
+	{
+		Assert(0); // shouldn't have been called
+		return;
+	}
+
+	int nBoneCount = pStudioHdr->numbones();
+	int *pActive = (int*)stackalloc( nBoneCount * sizeof(int) );
+	BlendBonesActive( pStudioHdr, seqdesc, sequence, boneMask, pActive );
+
+	if (s >= 1.0)
+	{
+		Assert(0); // shouldn't have been called
+		for (int i = 0; i < nBoneCount; i++)
 		{
-			if (pStudioHdr->boneFlags(i) & BONE_FIXED_ALIGNMENT)
-			{
-				QuaternionBlendNoAlign( q2[i], q1[i], s1, q3 );
-			}
-			else
+			if (pActive[i])
 			{
-				QuaternionBlend( q2[i], q1[i], s1, q3 );
+				q1[i] = q2[i];
+				pos1[i] = pos2[i];
 			}
-			q1[i][0] = q3[0];
-			q1[i][1] = q3[1];
-			q1[i][2] = q3[2];
-			q1[i][3] = q3[3];
-			pos1[i][0] = pos1[i][0] * s1 + pos2[i][0] * s2;
-			pos1[i][1] = pos1[i][1] * s1 + pos2[i][1] * s2;
-			pos1[i][2] = pos1[i][2] * s1 + pos2[i][2] * s2;
 		}
+		return;
 	}
+
+	int *pBoneFlags = (int*)stackalloc( nBoneCount * sizeof(int) );
+	GetBoneFlags( pStudioHdr, pBoneFlags );
+
+	BlendBonesScalar( q1, pos1, q2, pos2, pActive, pBoneFlags, nBoneCount, s );
 }
 
 
@@ -1643,43 +2607,282 @@ void ScaleBones(
 	float s,
 	int boneMask )
 {
-	int			i, j;
-	Quaternion		q3;
-
 	mstudioseqdesc_t &seqdesc = ((CStudioHdr *)pStudioHdr)->pSeqdesc( sequence );
 
-	virtualmodel_t *pVModel = pStudioHdr->GetVirtualModel();
-	const virtualgroup_t *pSeqGroup = NULL;
-	if (pVModel)
+	int nBoneCount = pStudioHdr->numbones();
+	int *pActive = (int*)stackalloc( nBoneCount * sizeof(int) );
+	BlendBonesActive( pStudioHdr, seqdesc, sequence, boneMask, pActive );
+
+	ScaleBonesScalar( q1, pos1, pActive, nBoneCount, s );
+}
+
+
+
+//-----------------------------------------------------------------------------
+// Purpose: SlerpBones, BlendBones and ScaleBones on poses kept in SoA form
+//-----------------------------------------------------------------------------
+static void SlerpBones( 
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose1,
+	mstudioseqdesc_t &seqdesc,  // source of pose2
+	int sequence, 
+	const CBonePoseSoA &pose2,
+	float s,
+	int boneMask )
+{
+	if (s <= 0.0f) 
+		return;
+	if (s > 1.0f)
 	{
-		pSeqGroup = pVModel->pSeqGroup( sequence );
+		s = 1.0f;		
 	}
 
-	float s2 = s;
-	float s1 = 1.0 - s2;
+	if (seqdesc.flags & STUDIO_WORLD)
+	{
+		// works on bone to world matrices, which need the per bone arrays
+		Vector *pos1 = g_VectorPool.Alloc();
+		Quaternion *q1 = g_QaternionPool.Alloc();
+		Vector *pos2 = g_VectorPool.Alloc();
+		Quaternion *q2 = g_QaternionPool.Alloc();
+		pose1.Store( pos1, q1 );
+		pose2.Store( pos2, q2 );
+		WorldSpaceSlerp( pStudioHdr, q1, pos1, seqdesc, sequence, q2, pos2, s, boneMask );
+		pose1.Load( pos1, q1, pose1.m_nBones );
+		g_VectorPool.Free( pos1 );
+		g_QaternionPool.Free( q1 );
+		g_VectorPool.Free( pos2 );
+		g_QaternionPool.Free( q2 );
+		return;
+	}
 
-	for (i = 0; i < pStudioHdr->numbones(); i++)
+	int nBoneCount = pStudioHdr->numbones();
+	float *pS2 = (float*)stackalloc( ( ( nBoneCount + 3 ) & ~3 ) * sizeof(float) );
+	SlerpBonesWeights( pStudioHdr, seqdesc, sequence, s, boneMask, pS2 );
+
+	if ( seqdesc.flags & STUDIO_DELTA )
 	{
-		// skip unused bones
-		if (!(pStudioHdr->boneFlags(i) & boneMask))
+		SlerpDeltaBonesSoA( pose1, pose2, pS2, ( seqdesc.flags & STUDIO_POST ) != 0 );
+		return;
+	}
+
+	int *pBoneFlags = (int*)stackalloc( nBoneCount * sizeof(int) );
+	GetBoneFlags( pStudioHdr, pBoneFlags );
+
+	fltx4 noAlign[MAXSTUDIOBONEGROUPS];
+	BuildBoneLaneMasks( noAlign, pBoneFlags, BONE_FIXED_ALIGNMENT, nBoneCount );
+	SlerpBonesSoA( pose1, pose2, pS2, noAlign );
+}
+
+static void BlendBones( 
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose1,
+	mstudioseqdesc_t &seqdesc, 
+	int sequence,
+	const CBonePoseSoA &pose2,
+	float s,
+	int boneMask )
+{
+	if (s <= 0)
+	{
+		Assert(0); // shouldn't have been called
+		return;
+	}
+
+	int nBoneCount = pStudioHdr->numbones();
+	int *pActive = (int*)stackalloc( nBoneCount * sizeof(int) );
+	BlendBonesActive( pStudioHdr, seqdesc, sequence, boneMask, pActive );
+
+	fltx4 active[MAXSTUDIOBONEGROUPS];
+	BuildBoneLaneMasks( active, pActive, 1, nBoneCount );
+
+	if (s >= 1.0)
+	{
+		Assert(0); // shouldn't have been called
+		int nGroups = pose1.NumGroups();
+		for ( int g = 0; g < nGroups; g++ )
 		{
-			continue;
+			SoAQuaternion_t q2;
+			LoadQuaternionSoA( pose2, g, q2 );
+			StoreQuaternionSoA( pose1, g, active[g], q2 );
+			StorePositionSoA( pose1, g, active[g], pose2.m_Pos[g].x, pose2.m_Pos[g].y, pose2.m_Pos[g].z );
 		}
+		return;
+	}
 
-		if (pSeqGroup)
+	int *pBoneFlags = (int*)stackalloc( nBoneCount * sizeof(int) );
+	GetBoneFlags( pStudioHdr, pBoneFlags );
+
+	fltx4 noAlign[MAXSTUDIOBONEGROUPS];
+	BuildBoneLaneMasks( noAlign, pBoneFlags, BONE_FIXED_ALIGNMENT, nBoneCount );
+	BlendBonesSoA( pose1, pose2, active, noAlign, s );
+}
+
+static void ScaleBones( 
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose1,
+	int sequence,
+	float s,
+	int boneMask )
+{
+	mstudioseqdesc_t &seqdesc = ((CStudioHdr *)pStudioHdr)->pSeqdesc( sequence );
+
+	int nBoneCount = pStudioHdr->numbones();
+	int *pActive = (int*)stackalloc( nBoneCount * sizeof(int) );
+	BlendBonesActive( pStudioHdr, seqdesc, sequence, boneMask, pActive );
+
+	fltx4 active[MAXSTUDIOBONEGROUPS];
+	BuildBoneLaneMasks( active, pActive, 1, nBoneCount );
+	ScaleBonesSoA( pose1, active, s );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: Times the scalar blend loops against the SoA kernels on a synthetic
+//			100 bone pose and reports the largest difference between them.  The
+//			SoA pose stays resident between blends, as it does after
+//			IBoneSetup::InitPoseSoA; "accumulate" adds the packing of the decoded
+//			animations and the final store that path pays.
+//-----------------------------------------------------------------------------
+#ifdef CLIENT_DLL
+CON_COMMAND( cl_anim_simd_pose_benchmark, "Time the scalar and SIMD bone blends. Arguments: [iterations]" )
+#else
+CON_COMMAND( sv_anim_simd_pose_benchmark, "Time the scalar and SIMD bone blends. Arguments: [iterations]" )
+#endif
+{
+	const int nBones = 100;
+	const int nLayers = 3;
+	int nIterations = ( args.ArgC() > 1 ) ? MAX( atoi( args[1] ), 1 ) : 1000;
+
+	static Quaternion s_q1[MAXSTUDIOBONES], s_qScalar[MAXSTUDIOBONES], s_qSIMD[MAXSTUDIOBONES];
+	static QuaternionAligned s_q2[MAXSTUDIOBONES], s_q3[MAXSTUDIOBONES], s_qTemp[MAXSTUDIOBONES];
+	static Vector s_pos1[MAXSTUDIOBONES], s_pos2[MAXSTUDIOBONES], s_pos3[MAXSTUDIOBONES], s_posTemp[MAXSTUDIOBONES];
+	static Vector s_posScalar[MAXSTUDIOBONES], s_posSIMD[MAXSTUDIOBONES];
+	static CBonePoseSoA s_pose1, s_pose2, s_poseSIMD, s_poseTemp, s_poseTemp2;
+	float weights[ MAXSTUDIOBONEGROUPS * 4 ];
+	int boneFlags[ MAXSTUDIOBONES ];
+	int active[ MAXSTUDIOBONES ];
+
+	// a fixed seed so runs are comparable
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	for ( int i = 0; i < nBones; i++ )
+	{
+		RadianEuler a1( random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ) );
+		RadianEuler a2( random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ) );
+		RadianEuler a3( random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ), random.RandomFloat( -M_PI, M_PI ) );
+		AngleQuaternion( a1, s_q1[i] );
+		AngleQuaternion( a2, s_q2[i] );
+		AngleQuaternion( a3, s_q3[i] );
+		s_pos1[i].Init( random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ) );
+		s_pos2[i].Init( random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ) );
+		s_pos3[i].Init( random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ), random.RandomFloat( -64, 64 ) );
+
+		// leave some bones out, like a sequence with partial bone weights
+		weights[i] = ( random.RandomInt( 0, 7 ) == 0 ) ? 0.0f : random.RandomFloat( 0.05f, 1.0f );
+		active[i] = ( weights[i] > 0.0f );
+		boneFlags[i] = ( random.RandomInt( 0, 15 ) == 0 ) ? BONE_FIXED_ALIGNMENT : 0;
+	}
+	for ( int i = nBones; i < MAXSTUDIOBONEGROUPS * 4; i++ )
+	{
+		weights[i] = 0.0f;
+	}
+
+	fltx4 activeMask[MAXSTUDIOBONEGROUPS], noAlignMask[MAXSTUDIOBONEGROUPS];
+	BuildBoneLaneMasks( activeMask, active, 1, nBones );
+	BuildBoneLaneMasks( noAlignMask, boneFlags, BONE_FIXED_ALIGNMENT, nBones );
+	s_pose1.Load( s_pos1, s_q1, nBones );
+	s_pose2.Load( s_pos2, s_q2, nBones );
+
+	static const char *s_pBlendNames[] = { "slerp", "slerp delta", "slerp delta post", "blend", "scale", "accumulate" };
+	for ( int nBlend = 0; nBlend < ARRAYSIZE( s_pBlendNames ); nBlend++ )
+	{
+		int seqFlags = 0;
+		if ( nBlend == 1 )
 		{
-			j = pSeqGroup->boneMap[i];
+			seqFlags = STUDIO_DELTA;
 		}
-		else
+		else if ( nBlend == 2 )
 		{
-			j = i;
+			seqFlags = STUDIO_DELTA | STUDIO_POST;
 		}
 
-		if (j >= 0 && seqdesc.weight( j ) > 0.0)
+		CFastTimer scalarTimer, simdTimer;
+		scalarTimer.Start();
+		for ( int n = 0; n < nIterations; n++ )
 		{
-			QuaternionIdentityBlend( q1[i], s1, q1[i] );
-			VectorScale( pos1[i], s2, pos1[i] );
+			memcpy( s_qScalar, s_q1, nBones * sizeof(Quaternion) );
+			memcpy( s_posScalar, s_pos1, nBones * sizeof(Vector) );
+			if ( nBlend <= 2 )
+			{
+				SlerpBonesScalar( s_qScalar, s_posScalar, s_q2, s_pos2, weights, boneFlags, nBones, seqFlags );
+			}
+			else if ( nBlend == 3 )
+			{
+				BlendBonesScalar( s_qScalar, s_posScalar, s_q2, s_pos2, active, boneFlags, nBones, 0.35f );
+			}
+			else if ( nBlend == 4 )
+			{
+				ScaleBonesScalar( s_qScalar, s_posScalar, active, nBones, 0.35f );
+			}
+			else
+			{
+				// a two way pose parameter blend slerped in per layer
+				for ( int nLayer = 0; nLayer < nLayers; nLayer++ )
+				{
+					memcpy( s_qTemp, s_q2, nBones * sizeof(Quaternion) );
+					memcpy( s_posTemp, s_pos2, nBones * sizeof(Vector) );
+					BlendBonesScalar( s_qTemp, s_posTemp, s_q3, s_pos3, active, boneFlags, nBones, 0.35f );
+					SlerpBonesScalar( s_qScalar, s_posScalar, s_qTemp, s_posTemp, weights, boneFlags, nBones, 0 );
+				}
+			}
 		}
+		scalarTimer.End();
+
+		simdTimer.Start();
+		for ( int n = 0; n < nIterations; n++ )
+		{
+			s_poseSIMD = s_pose1;
+			if ( nBlend <= 2 )
+			{
+				if ( seqFlags & STUDIO_DELTA )
+				{
+					SlerpDeltaBonesSoA( s_poseSIMD, s_pose2, weights, ( seqFlags & STUDIO_POST ) != 0 );
+				}
+				else
+				{
+					SlerpBonesSoA( s_poseSIMD, s_pose2, weights, noAlignMask );
+				}
+			}
+			else if ( nBlend == 3 )
+			{
+				BlendBonesSoA( s_poseSIMD, s_pose2, activeMask, noAlignMask, 0.35f );
+			}
+			else if ( nBlend == 4 )
+			{
+				ScaleBonesSoA( s_poseSIMD, activeMask, 0.35f );
+			}
+			else
+			{
+				for ( int nLayer = 0; nLayer < nLayers; nLayer++ )
+				{
+					s_poseTemp.Load( s_pos2, s_q2, nBones );
+					s_poseTemp2.Load( s_pos3, s_q3, nBones );
+					BlendBonesSoA( s_poseTemp, s_poseTemp2, activeMask, noAlignMask, 0.35f );
+					SlerpBonesSoA( s_poseSIMD, s_poseTemp, weights, noAlignMask );
+				}
+				s_poseSIMD.Store( s_posSIMD, s_qSIMD );
+			}
+		}
+		simdTimer.End();
+
+		s_poseSIMD.Store( s_posSIMD, s_qSIMD );
+
+		bool bIdentical = !memcmp( s_qSIMD, s_qScalar, nBones * sizeof(Quaternion) ) && !memcmp( s_posSIMD, s_posScalar, nBones * sizeof(Vector) );
+		float flMaxError = BonePoseMaxError( s_qSIMD, s_posSIMD, s_qScalar, s_posScalar, nBones );
+		float flScalarUS = scalarTimer.GetDuration().GetMicrosecondsF() / nIterations;
+		float flSIMDUS = simdTimer.GetDuration().GetMicrosecondsF() / nIterations;
+		Msg( "%-16s scalar %7.2fus  simd %7.2fus  (%.2fx)  max error %g%s\n", s_pBlendNames[nBlend],
+			flScalarUS, flSIMDUS, ( flSIMDUS > 0.0f ) ? flScalarUS / flSIMDUS : 0.0f, flMaxError, bIdentical ? "  bit identical" : "" );
 	}
 }
 
@@ -1811,6 +3014,82 @@ void InitPose(
 		}
 	}
 }
+
+static void InitPose(
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose,
+	int boneMask 
+	)
+{
+	Assert( pose.m_nBones == pStudioHdr->numbones() );
+
+	if (!pStudioHdr->pLinearBones())
+	{
+		for (int i = 0; i < pStudioHdr->numbones(); i++)
+		{
+			if (pStudioHdr->boneFlags(  i ) & boneMask ) 
+			{
+				mstudiobone_t *pbone = pStudioHdr->pBone( i );
+				pose.SetBone( i, pbone->pos, pbone->quat );
+			}
+		}
+	}
+	else
+	{
+		mstudiolinearbone_t *pLinearBones = pStudioHdr->pLinearBones();
+		for (int i = 0; i < pStudioHdr->numbones(); i++)
+		{
+			if (pStudioHdr->boneFlags(  i ) & boneMask ) 
+			{
+				pose.SetBone( i, pLinearBones->pos(i), pLinearBones->quat(i) );
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// The regular per bone arrays as a single pose, so the code that picks and
+// blends animations can be shared with CBonePoseSoA
+//-----------------------------------------------------------------------------
+struct BonePoseArrays_t
+{
+	Vector		*pos;
+	Quaternion	*q;
+};
+
+static FORCEINLINE void CalcAnimation( const CStudioHdr *pStudioHdr, BonePoseArrays_t &pose, mstudioseqdesc_t &seqdesc, int sequence, int animation, float cycle, int boneMask )
+{
+	CalcAnimation( pStudioHdr, pose.pos, pose.q, seqdesc, sequence, animation, cycle, boneMask );
+}
+
+static FORCEINLINE void BlendBones( const CStudioHdr *pStudioHdr, BonePoseArrays_t &pose1, mstudioseqdesc_t &seqdesc, int sequence, const BonePoseArrays_t &pose2, float s, int boneMask )
+{
+	BlendBones( pStudioHdr, pose1.q, pose1.pos, seqdesc, sequence, pose2.q, pose2.pos, s, boneMask );
+}
+
+static FORCEINLINE void ScaleBones( const CStudioHdr *pStudioHdr, BonePoseArrays_t &pose1, int sequence, float s, int boneMask )
+{
+	ScaleBones( pStudioHdr, pose1.q, pose1.pos, sequence, s, boneMask );
+}
+
+// The decoders write one bone at a time, so decode into arrays and pack the result.
+// Bones the animation doesn't write keep their value, unless the pose is unset (m_nBones of 0).
+static void CalcAnimation( const CStudioHdr *pStudioHdr, CBonePoseSoA &pose, mstudioseqdesc_t &seqdesc, int sequence, int animation, float cycle, int boneMask )
+{
+	Vector		*pos = g_VectorPool.Alloc();
+	Quaternion	*q = g_QaternionPool.Alloc();
+
+	if ( pose.m_nBones )
+	{
+		pose.Store( pos, q );
+	}
+	CalcAnimation( pStudioHdr, pos, q, seqdesc, sequence, animation, cycle, boneMask );
+	pose.Load( pos, q, pStudioHdr->numbones() );
+
+	g_VectorPool.Free( pos );
+	g_QaternionPool.Free( q );
+}
 	
 
 inline bool PoseIsAllZeros( 
@@ -1917,12 +3196,15 @@ void Calc3WayBlendIndices( int i0, int i1, float s0, float s1, const mstudioseqd
 
 
 //-----------------------------------------------------------------------------
-// Purpose: calculate a pose for a single sequence
+// Purpose: calculate a pose for a single sequence, into either pose type;
+//			pose2 and pose3 are scratch
 //-----------------------------------------------------------------------------
-bool CalcPoseSingle(
+template< class POSE >
+static bool CalcPoseSingleT(
 	const CStudioHdr *pStudioHdr,
-	Vector pos[], 
-	Quaternion q[], 
+	POSE &pose,
+	POSE &pose2,
+	POSE &pose3,
 	mstudioseqdesc_t &seqdesc,
 	int sequence, 
 	float cycle,
@@ -1930,13 +3212,8 @@ bool CalcPoseSingle(
 	int boneMask,
 	float flTime
 	)
-{
-	bool bResult = true;
-	
-	Vector		*pos2 = g_VectorPool.Alloc();
-	Quaternion	*q2 = g_QaternionPool.Alloc();
-	Vector		*pos3= g_VectorPool.Alloc();
-	Quaternion	*q3 = g_QaternionPool.Alloc();
+{
+	bool bResult = true;
 
 	if (sequence >= pStudioHdr->GetNumSeq()) 
 	{
@@ -1997,18 +3274,18 @@ bool CalcPoseSingle(
 			}
 			else
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  , i1   ), cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  , i1   ), cycle, boneMask );
 			}
 		}
 		else if (s1 > 0.999)
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  , i1+1 ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  , i1+1 ), cycle, boneMask );
 		}
 		else
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  , i1   ), cycle, boneMask );
-			CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0  , i1+1 ), cycle, boneMask );
-			BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s1, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  , i1   ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0  , i1+1 ), cycle, boneMask );
+			BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s1, boneMask );
 		}
 	}
 	else if (s0 > 0.999)
@@ -2021,18 +3298,18 @@ bool CalcPoseSingle(
 			}
 			else
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0+1, i1   ), cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0+1, i1   ), cycle, boneMask );
 			}
 		}
 		else if (s1 > 0.999)
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0+1, i1+1 ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0+1, i1+1 ), cycle, boneMask );
 		}
 		else
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0+1, i1   ), cycle, boneMask );
-			CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0+1, i1+1 ), cycle, boneMask );
-			BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s1, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0+1, i1   ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0+1, i1+1 ), cycle, boneMask );
+			BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s1, boneMask );
 		}
 	}
 	else
@@ -2041,39 +3318,39 @@ bool CalcPoseSingle(
 		{
 			if (PoseIsAllZeros( pStudioHdr, sequence, seqdesc, i0+1, i1 ))
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
-				ScaleBones( pStudioHdr, q, pos, sequence, 1.0 - s0, boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
+				ScaleBones( pStudioHdr, pose, sequence, 1.0 - s0, boneMask );
 			}
 			else if (PoseIsAllZeros( pStudioHdr, sequence, seqdesc, i0, i1 ))
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0+1  ,i1  ), cycle, boneMask );
-				ScaleBones( pStudioHdr, q, pos, sequence, s0, boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0+1  ,i1  ), cycle, boneMask );
+				ScaleBones( pStudioHdr, pose, sequence, s0, boneMask );
 			}
 			else
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
-				CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0+1,i1  ), cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0+1,i1  ), cycle, boneMask );
 
-				BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s0, boneMask );
+				BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s0, boneMask );
 			}
 		}
 		else if (s1 > 0.999)
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  ,i1+1  ), cycle, boneMask );
-			CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0+1,i1+1  ), cycle, boneMask );
-			BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s0, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  ,i1+1  ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0+1,i1+1  ), cycle, boneMask );
+			BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s0, boneMask );
 		}
 		else if ( !anim_3wayblend.GetBool() )
 		{
-			CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
-			CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0+1,i1  ), cycle, boneMask );
-			BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s0, boneMask );
+			CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, seqdesc.anim( i0  ,i1  ), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0+1,i1  ), cycle, boneMask );
+			BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s0, boneMask );
 
-			CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, seqdesc.anim( i0  , i1+1), cycle, boneMask );
-			CalcAnimation( pStudioHdr, pos3, q3, seqdesc, sequence, seqdesc.anim( i0+1, i1+1), cycle, boneMask );
-			BlendBones( pStudioHdr, q2, pos2, seqdesc, sequence, q3, pos3, s0, boneMask );
+			CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, seqdesc.anim( i0  , i1+1), cycle, boneMask );
+			CalcAnimation( pStudioHdr, pose3, seqdesc, sequence, seqdesc.anim( i0+1, i1+1), cycle, boneMask );
+			BlendBones( pStudioHdr, pose2, seqdesc, sequence, pose3, s0, boneMask );
 
-			BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, s1, boneMask );
+			BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, s1, boneMask );
 		}
 		else
 		{
@@ -2091,22 +3368,47 @@ bool CalcPoseSingle(
 			if (weight[1] < 0.001)
 			{
 				// on diagonal
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, iAnimIndices[0], cycle, boneMask );
-				CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, iAnimIndices[2], cycle, boneMask );
-				BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, weight[2] / (weight[0] + weight[2]), boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, iAnimIndices[0], cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, iAnimIndices[2], cycle, boneMask );
+				BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, weight[2] / (weight[0] + weight[2]), boneMask );
 			}
 			else
 			{
-				CalcAnimation( pStudioHdr, pos,  q,  seqdesc, sequence, iAnimIndices[0], cycle, boneMask );
-				CalcAnimation( pStudioHdr, pos2, q2, seqdesc, sequence, iAnimIndices[1], cycle, boneMask );
-				BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, weight[1] / (weight[0] + weight[1]), boneMask );
+				CalcAnimation( pStudioHdr, pose,  seqdesc, sequence, iAnimIndices[0], cycle, boneMask );
+				CalcAnimation( pStudioHdr, pose2, seqdesc, sequence, iAnimIndices[1], cycle, boneMask );
+				BlendBones( pStudioHdr, pose, seqdesc, sequence, pose2, weight[1] / (weight[0] + weight[1]), boneMask );
 
-				CalcAnimation( pStudioHdr, pos3, q3, seqdesc, sequence, iAnimIndices[2], cycle, boneMask );
-				BlendBones( pStudioHdr, q, pos, seqdesc, sequence, q3, pos3, weight[2], boneMask );
+				CalcAnimation( pStudioHdr, pose3, seqdesc, sequence, iAnimIndices[2], cycle, boneMask );
+				BlendBones( pStudioHdr, pose, seqdesc, sequence, pose3, weight[2], boneMask );
 			}
 		}
 	}
 
+	return bResult;
+}
+
+bool CalcPoseSingle(
+	const CStudioHdr *pStudioHdr,
+	Vector pos[], 
+	Quaternion q[], 
+	mstudioseqdesc_t &seqdesc,
+	int sequence, 
+	float cycle,
+	const float poseParameter[],
+	int boneMask,
+	float flTime
+	)
+{
+	Vector		*pos2 = g_VectorPool.Alloc();
+	Quaternion	*q2 = g_QaternionPool.Alloc();
+	Vector		*pos3= g_VectorPool.Alloc();
+	Quaternion	*q3 = g_QaternionPool.Alloc();
+
+	BonePoseArrays_t pose = { pos, q };
+	BonePoseArrays_t pose2 = { pos2, q2 };
+	BonePoseArrays_t pose3 = { pos3, q3 };
+	bool bResult = CalcPoseSingleT( pStudioHdr, pose, pose2, pose3, seqdesc, sequence, cycle, poseParameter, boneMask, flTime );
+
 	g_VectorPool.Free( pos2 );
 	g_QaternionPool.Free( q2 );
 	g_VectorPool.Free( pos3 );
@@ -2115,6 +3417,30 @@ bool CalcPoseSingle(
 	return bResult;
 }
 
+static bool CalcPoseSingle(
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose,
+	mstudioseqdesc_t &seqdesc,
+	int sequence, 
+	float cycle,
+	const float poseParameter[],
+	int boneMask,
+	float flTime
+	)
+{
+	CBonePoseSoA *pPose2 = g_BonePoseSoAPool.Alloc();
+	CBonePoseSoA *pPose3 = g_BonePoseSoAPool.Alloc();
+	pPose2->m_nBones = 0;
+	pPose3->m_nBones = 0;
+
+	bool bResult = CalcPoseSingleT( pStudioHdr, pose, *pPose2, *pPose3, seqdesc, sequence, cycle, poseParameter, boneMask, flTime );
+
+	g_BonePoseSoAPool.Free( pPose2 );
+	g_BonePoseSoAPool.Free( pPose3 );
+
+	return bResult;
+}
+
 
 
 
@@ -2122,9 +3448,9 @@ bool CalcPoseSingle(
 // Purpose: calculate a pose for a single sequence
 //			adds autolayers, runs local ik rukes
 //-----------------------------------------------------------------------------
+template< class POSE >
 void CBoneSetup::AddSequenceLayers(
-   Vector pos[], 
-   Quaternion q[], 
+   POSE &pose,
    mstudioseqdesc_t &seqdesc,
    int sequence, 
    float cycle,
@@ -2206,7 +3532,7 @@ void CBoneSetup::AddSequenceLayers(
 		}
 
 		int iSequence = m_pStudioHdr->iRelativeSeq( sequence, pLayer->iSequence );
-		AccumulatePose( pos, q, iSequence, layerCycle, layerWeight, flTime, pIKContext );
+		AccumulatePose( pose, iSequence, layerCycle, layerWeight, flTime, pIKContext );
 	}
 }
 
@@ -2215,9 +3541,9 @@ void CBoneSetup::AddSequenceLayers(
 // Purpose: calculate a pose for a single sequence
 //			adds autolayers, runs local ik rukes
 //-----------------------------------------------------------------------------
+template< class POSE >
 void CBoneSetup::AddLocalLayers(
-	Vector pos[], 
-	Quaternion q[], 
+	POSE &pose,
 	mstudioseqdesc_t &seqdesc,
 	int sequence, 
 	float cycle,
@@ -2281,7 +3607,7 @@ void CBoneSetup::AddLocalLayers(
 		}
 
 		int iSequence = m_pStudioHdr->iRelativeSeq( sequence, pLayer->iSequence );
-		AccumulatePose( pos, q, iSequence, layerCycle, layerWeight, flTime, pIKContext );
+		AccumulatePose( pose, iSequence, layerCycle, layerWeight, flTime, pIKContext );
 	}
 }
 
@@ -2307,21 +3633,116 @@ void IBoneSetup::InitPose( Vector pos[], Quaternion q[] )
 	::InitPose( m_pBoneSetup->m_pStudioHdr, pos, q, m_pBoneSetup->m_boneMask );
 }
 
+void IBoneSetup::InitPoseSoA( Vector pos[], Quaternion q[] )
+{
+	CBoneSetup *pBoneSetup = m_pBoneSetup;
+	Assert( !pBoneSetup->m_pPoseSoA );
+	if ( !anim_simd_pose.GetBool() || pBoneSetup->m_pPoseSoA )
+	{
+		InitPose( pos, q );
+		return;
+	}
+
+	pBoneSetup->m_pPoseSoA = g_BonePoseSoAPool.Alloc();
+	pBoneSetup->m_pPoseSoAPos = pos;
+	pBoneSetup->m_pPoseSoAQ = q;
+	pBoneSetup->m_bValidatePoseSoA = anim_simd_pose_validate.GetBool();
+
+	pBoneSetup->m_pPoseSoA->Init( pBoneSetup->m_pStudioHdr->numbones() );
+	::InitPose( pBoneSetup->m_pStudioHdr, *pBoneSetup->m_pPoseSoA, pBoneSetup->m_boneMask );
+
+	if ( pBoneSetup->m_bValidatePoseSoA )
+	{
+		::InitPose( pBoneSetup->m_pStudioHdr, pos, q, pBoneSetup->m_boneMask );
+		pBoneSetup->ValidatePoseSoA( "InitPose", -1 );
+	}
+}
+
+// Writes the used bones of a SoA pose to pos/q; InitPose leaves the other bones alone, so this does too.
+static void StoreUsedBones( const CStudioHdr *pStudioHdr, const CBonePoseSoA &pose, Vector pos[], Quaternion q[], int boneMask )
+{
+	for ( int i = 0; i < pStudioHdr->numbones(); i++ )
+	{
+		if ( pStudioHdr->boneFlags( i ) & boneMask )
+		{
+			pose.GetBone( i, pos[i], q[i] );
+		}
+	}
+}
+
+void IBoneSetup::StorePose( Vector pos[], Quaternion q[] )
+{
+	CBoneSetup *pBoneSetup = m_pBoneSetup;
+	if ( !pBoneSetup->m_pPoseSoA )
+		return;
+
+	Assert( pBoneSetup->IsPoseSoA( pos, q ) );
+	StoreUsedBones( pBoneSetup->m_pStudioHdr, *pBoneSetup->m_pPoseSoA, pBoneSetup->m_pPoseSoAPos, pBoneSetup->m_pPoseSoAQ, pBoneSetup->m_boneMask );
+
+	g_BonePoseSoAPool.Free( pBoneSetup->m_pPoseSoA );
+	pBoneSetup->m_pPoseSoA = NULL;
+	pBoneSetup->m_pPoseSoAPos = NULL;
+	pBoneSetup->m_pPoseSoAQ = NULL;
+}
+
 void IBoneSetup::AccumulatePose( Vector pos[], Quaternion q[], int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext )
 {
+	if ( m_pBoneSetup->IsPoseSoA( pos, q ) )
+	{
+		m_pBoneSetup->AccumulatePose( *m_pBoneSetup->m_pPoseSoA, sequence, cycle, flWeight, flTime, pIKContext );
+		if ( m_pBoneSetup->m_bValidatePoseSoA )
+		{
+			// the IK context only collects rules here, which the SIMD pass already added
+			m_pBoneSetup->AccumulatePose( pos, q, sequence, cycle, flWeight, flTime, NULL );
+			m_pBoneSetup->ValidatePoseSoA( "AccumulatePose", sequence );
+		}
+		return;
+	}
+
 	m_pBoneSetup->AccumulatePose( pos, q, sequence, cycle, flWeight, flTime, pIKContext );
 }
 
 void IBoneSetup::CalcAutoplaySequences(	Vector pos[], Quaternion q[], float flRealTime, CIKContext *pIKContext )
 {
+	if ( m_pBoneSetup->IsPoseSoA( pos, q ) )
+	{
+		m_pBoneSetup->CalcAutoplaySequences( *m_pBoneSetup->m_pPoseSoA, flRealTime, pIKContext );
+		if ( m_pBoneSetup->m_bValidatePoseSoA )
+		{
+			if ( pIKContext && m_pBoneSetup->m_pStudioHdr->GetNumIKAutoplayLocks() )
+			{
+				// the autoplay locks can only be solved once per IK context, so take the SIMD result as is
+				StoreUsedBones( m_pBoneSetup->m_pStudioHdr, *m_pBoneSetup->m_pPoseSoA, pos, q, m_pBoneSetup->m_boneMask );
+			}
+			else
+			{
+				m_pBoneSetup->CalcAutoplaySequences( pos, q, flRealTime, NULL );
+				m_pBoneSetup->ValidatePoseSoA( "CalcAutoplaySequences", -1 );
+			}
+		}
+		return;
+	}
+
 	m_pBoneSetup->CalcAutoplaySequences( pos, q, flRealTime, pIKContext );
 }
 
 void CalcBoneAdj( const CStudioHdr *pStudioHdr, Vector pos[], Quaternion q[], const float controllers[], int boneMask );
+static void CalcBoneAdj( const CStudioHdr *pStudioHdr, CBonePoseSoA &pose, const float controllers[], int boneMask );
 
 // takes a "controllers[]" array normalized to 0..1 and adds in the adjustments to pos[], and q[].
 void IBoneSetup::CalcBoneAdj( Vector pos[], Quaternion q[], const float controllers[] )
 {
+	if ( m_pBoneSetup->IsPoseSoA( pos, q ) )
+	{
+		::CalcBoneAdj( m_pBoneSetup->m_pStudioHdr, *m_pBoneSetup->m_pPoseSoA, controllers, m_pBoneSetup->m_boneMask );
+		if ( m_pBoneSetup->m_bValidatePoseSoA )
+		{
+			::CalcBoneAdj( m_pBoneSetup->m_pStudioHdr, pos, q, controllers, m_pBoneSetup->m_boneMask );
+			m_pBoneSetup->ValidatePoseSoA( "CalcBoneAdj", -1 );
+		}
+		return;
+	}
+
 	::CalcBoneAdj( m_pBoneSetup->m_pStudioHdr, pos, q, controllers, m_pBoneSetup->m_boneMask );
 }
 
@@ -2336,6 +3757,61 @@ CBoneSetup::CBoneSetup( const CStudioHdr *pStudioHdr, int boneMask, const float
 	m_boneMask = boneMask;
 	m_flPoseParameter = poseParameter;
 	m_pPoseDebugger = pPoseDebugger;
+	m_pPoseSoA = NULL;
+	m_pPoseSoAPos = NULL;
+	m_pPoseSoAQ = NULL;
+	m_bValidatePoseSoA = false;
+}
+
+CBoneSetup::~CBoneSetup()
+{
+	// InitPoseSoA without a StorePose leaves pos/q unset
+	Assert( !m_pPoseSoA );
+	if ( m_pPoseSoA )
+	{
+		g_BonePoseSoAPool.Free( m_pPoseSoA );
+	}
+}
+
+bool CBoneSetup::IsPoseSoA( const Vector pos[], const Quaternion q[] ) const
+{
+	if ( !m_pPoseSoA )
+		return false;
+
+	if ( pos == m_pPoseSoAPos && q == m_pPoseSoAQ )
+		return true;
+
+	AssertMsg( 0, "IBoneSetup called with a different pose between InitPoseSoA and StorePose\n" );
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: compare the SoA pose against the scalar one built alongside it, then
+//			sync the scalar pose to it so the next step is checked on its own
+//-----------------------------------------------------------------------------
+void CBoneSetup::ValidatePoseSoA( const char *pszStep, int sequence )
+{
+	int nBoneCount = m_pStudioHdr->numbones();
+	Vector *pos = g_VectorPool.Alloc();
+	Quaternion *q = g_QaternionPool.Alloc();
+	int *pBoneFlags = (int*)stackalloc( nBoneCount * sizeof(int) );
+	m_pPoseSoA->Store( pos, q );
+	GetBoneFlags( m_pStudioHdr, pBoneFlags );
+
+	int iWorst;
+	float flMaxError = BonePoseMaxError( q, pos, m_pPoseSoAQ, m_pPoseSoAPos, nBoneCount, pBoneFlags, m_boneMask, &iWorst );
+	if ( !( flMaxError <= anim_simd_pose_tolerance.GetFloat() ) )
+	{
+		Warning( "%s: %s %s: SIMD pose differs from the scalar pose by %g (bone %s)\n",
+			m_pStudioHdr->pszName(), pszStep,
+			( sequence >= 0 ) ? ((CStudioHdr *)m_pStudioHdr)->pSeqdesc( sequence ).pszLabel() : "",
+			flMaxError, ( iWorst >= 0 ) ? m_pStudioHdr->pBone( iWorst )->pszName() : "?" );
+	}
+
+	StoreUsedBones( m_pStudioHdr, *m_pPoseSoA, m_pPoseSoAPos, m_pPoseSoAQ, m_boneMask );
+
+	g_VectorPool.Free( pos );
+	g_QaternionPool.Free( q );
 }
 
 #if 0
@@ -2436,7 +3912,8 @@ void CBoneSetup::AccumulatePose(
 	if (CalcPoseSingle( m_pStudioHdr, pos2, q2, seqdesc, sequence, cycle, m_flPoseParameter, m_boneMask, flTime ))
 	{
 		// this weight is wrong, the IK rules won't composite at the correct intensity
-		AddLocalLayers( pos2, q2, seqdesc, sequence, cycle, 1.0, flTime, pIKContext );
+		BonePoseArrays_t pose2 = { pos2, q2 };
+		AddLocalLayers( pose2, seqdesc, sequence, cycle, 1.0, flTime, pIKContext );
 		SlerpBones( m_pStudioHdr, q, pos, seqdesc, sequence, q2, pos2, flWeight, m_boneMask );
 	}
 
@@ -2446,11 +3923,111 @@ void CBoneSetup::AccumulatePose(
 		pIKContext->AddDependencies( seqdesc, sequence, cycle, m_flPoseParameter, flWeight );
 	}
 
-	AddSequenceLayers( pos, q, seqdesc, sequence, cycle, flWeight, flTime, pIKContext );
+	BonePoseArrays_t pose = { pos, q };
+	AddSequenceLayers( pose, seqdesc, sequence, cycle, flWeight, flTime, pIKContext );
+
+	if (seqdesc.numiklocks)
+	{
+		seq_ik.SolveSequenceLocks( seqdesc, pos, q );
+	}
+}
+
+void CBoneSetup::AccumulatePose( BonePoseArrays_t &pose, int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext )
+{
+	AccumulatePose( pose.pos, pose.q, sequence, cycle, flWeight, flTime, pIKContext );
+}
+
+
+//-----------------------------------------------------------------------------
+// Purpose: accumulate a pose for a single sequence on top of existing animation,
+//			with the poses in SoA form.  The IK locks and the pose debugger only
+//			work on the per bone arrays, so they get a copy.
+//-----------------------------------------------------------------------------
+void CBoneSetup::AccumulatePose(
+	CBonePoseSoA &pose,
+	int sequence, 
+	float cycle,
+	float flWeight,
+	float flTime,
+	CIKContext *pIKContext
+	)
+{
+	Assert( flWeight >= 0.0f && flWeight <= 1.0f );
+	// This shouldn't be necessary, but the Assert should help us catch whoever is screwing this up
+	flWeight = clamp( flWeight, 0.0f, 1.0f );
+
+	if ( sequence < 0 )
+		return;
+
+	mstudioseqdesc_t	&seqdesc = ((CStudioHdr *)m_pStudioHdr)->pSeqdesc( sequence );
+
+	Vector *pos = NULL;
+	Quaternion *q = NULL;
+#ifdef CLIENT_DLL
+	if ( m_pPoseDebugger || seqdesc.numiklocks )
+#else
+	if ( seqdesc.numiklocks )
+#endif
+	{
+		pos = g_VectorPool.Alloc();
+		q = g_QaternionPool.Alloc();
+		pose.Store( pos, q );
+	}
+
+#ifdef CLIENT_DLL
+	// Trigger pose debugger
+	if (m_pPoseDebugger)
+	{
+		m_pPoseDebugger->AccumulatePose( m_pStudioHdr, pIKContext, pos, q, sequence, cycle, m_flPoseParameter, m_boneMask, flWeight, flTime );
+	}
+#endif
+
+	// add any IK locks to prevent extremities from moving
+	CIKContext seq_ik;
+	if (seqdesc.numiklocks)
+	{
+		seq_ik.Init( m_pStudioHdr, vec3_angle, vec3_origin, 0.0, 0, m_boneMask );  // local space relative so absolute position doesn't mater
+		seq_ik.AddSequenceLocks( seqdesc, pos, q );
+	}
+
+	CBonePoseSoA *pPose2 = g_BonePoseSoAPool.Alloc();
+	if (seqdesc.flags & STUDIO_LOCAL)
+	{
+		pPose2->Init( m_pStudioHdr->numbones() );
+		::InitPose( m_pStudioHdr, *pPose2, m_boneMask );
+	}
+	else
+	{
+		pPose2->m_nBones = 0;
+	}
+
+	if (CalcPoseSingle( m_pStudioHdr, *pPose2, seqdesc, sequence, cycle, m_flPoseParameter, m_boneMask, flTime ))
+	{
+		// this weight is wrong, the IK rules won't composite at the correct intensity
+		AddLocalLayers( *pPose2, seqdesc, sequence, cycle, 1.0, flTime, pIKContext );
+		SlerpBones( m_pStudioHdr, pose, seqdesc, sequence, *pPose2, flWeight, m_boneMask );
+	}
+
+	g_BonePoseSoAPool.Free( pPose2 );
+
+	if ( pIKContext )
+	{
+		pIKContext->AddDependencies( seqdesc, sequence, cycle, m_flPoseParameter, flWeight );
+	}
+
+	AddSequenceLayers( pose, seqdesc, sequence, cycle, flWeight, flTime, pIKContext );
 
 	if (seqdesc.numiklocks)
 	{
+		pose.Store( pos, q );
 		seq_ik.SolveSequenceLocks( seqdesc, pos, q );
+		pose.Load( pos, q, pose.m_nBones );
+	}
+
+	if ( pos )
+	{
+		g_VectorPool.Free( pos );
+		g_QaternionPool.Free( q );
 	}
 }
 
@@ -2459,6 +4036,51 @@ void CBoneSetup::AccumulatePose(
 // Purpose: blend together q1,pos1 with q2,pos2.  Return result in q1,pos1.  
 //			0 returns q1, pos1.  1 returns q2, pos2
 //-----------------------------------------------------------------------------
+static void CalcBoneAdj(
+	mstudiobonecontroller_t *pbonecontroller,
+	Vector &pos,
+	Quaternion &q,
+	const float controllers[]
+	)
+{
+	float				value;
+	RadianEuler a0;
+	Quaternion q0;
+
+	value = controllers[pbonecontroller->inputfield];
+	if (value < 0) value = 0;
+	if (value > 1.0) value = 1.0;
+	value = (1.0 - value) * pbonecontroller->start + value * pbonecontroller->end;
+
+	switch(pbonecontroller->type & STUDIO_TYPES)
+	{
+	case STUDIO_XR: 
+		a0.Init( value * (M_PI / 180.0), 0, 0 ); 
+		AngleQuaternion( a0, q0 );
+		QuaternionSM( 1.0, q0, q, q );
+		break;
+	case STUDIO_YR: 
+		a0.Init( 0, value * (M_PI / 180.0), 0 ); 
+		AngleQuaternion( a0, q0 );
+		QuaternionSM( 1.0, q0, q, q );
+		break;
+	case STUDIO_ZR: 
+		a0.Init( 0, 0, value * (M_PI / 180.0) ); 
+		AngleQuaternion( a0, q0 );
+		QuaternionSM( 1.0, q0, q, q );
+		break;
+	case STUDIO_X:	
+		pos.x += value;
+		break;
+	case STUDIO_Y:
+		pos.y += value;
+		break;
+	case STUDIO_Z:
+		pos.z += value;
+		break;
+	}
+}
+
 void CalcBoneAdj(
 	const CStudioHdr *pStudioHdr,
 	Vector pos[], 
@@ -2467,12 +4089,8 @@ void CalcBoneAdj(
 	int boneMask
 	)
 {
-	int					i, j, k;
-	float				value;
+	int					j, k;
 	mstudiobonecontroller_t *pbonecontroller;
-	Vector p0;
-	RadianEuler a0;
-	Quaternion q0;
 	
 	for (j = 0; j < pStudioHdr->numbonecontrollers(); j++)
 	{
@@ -2481,39 +4099,34 @@ void CalcBoneAdj(
 
 		if (pStudioHdr->boneFlags( k ) & boneMask)
 		{
-			i = pbonecontroller->inputfield;
-			value = controllers[i];
-			if (value < 0) value = 0;
-			if (value > 1.0) value = 1.0;
-			value = (1.0 - value) * pbonecontroller->start + value * pbonecontroller->end;
+			CalcBoneAdj( pbonecontroller, pos[k], q[k], controllers );
+		}
+	}
+}
 
-			switch(pbonecontroller->type & STUDIO_TYPES)
-			{
-			case STUDIO_XR: 
-				a0.Init( value * (M_PI / 180.0), 0, 0 ); 
-				AngleQuaternion( a0, q0 );
-				QuaternionSM( 1.0, q0, q[k], q[k] );
-				break;
-			case STUDIO_YR: 
-				a0.Init( 0, value * (M_PI / 180.0), 0 ); 
-				AngleQuaternion( a0, q0 );
-				QuaternionSM( 1.0, q0, q[k], q[k] );
-				break;
-			case STUDIO_ZR: 
-				a0.Init( 0, 0, value * (M_PI / 180.0) ); 
-				AngleQuaternion( a0, q0 );
-				QuaternionSM( 1.0, q0, q[k], q[k] );
-				break;
-			case STUDIO_X:	
-				pos[k].x += value;
-				break;
-			case STUDIO_Y:
-				pos[k].y += value;
-				break;
-			case STUDIO_Z:
-				pos[k].z += value;
-				break;
-			}
+// The controllers only touch a few bones, so they go through the single bone accessors
+static void CalcBoneAdj(
+	const CStudioHdr *pStudioHdr,
+	CBonePoseSoA &pose,
+	const float controllers[],
+	int boneMask
+	)
+{
+	int					j, k;
+	mstudiobonecontroller_t *pbonecontroller;
+	Vector pos;
+	Quaternion q;
+
+	for (j = 0; j < pStudioHdr->numbonecontrollers(); j++)
+	{
+		pbonecontroller = pStudioHdr->pBonecontroller( j );
+		k = pbonecontroller->bone;
+
+		if (pStudioHdr->boneFlags( k ) & boneMask)
+		{
+			pose.GetBone( k, pos, q );
+			CalcBoneAdj( pbonecontroller, pos, q, controllers );
+			pose.SetBone( k, pos, q );
 		}
 	}
 }
@@ -4466,12 +6079,58 @@ void CBoneSetup::CalcAutoplaySequences(
 {
 	//	ASSERT_NO_REENTRY();
 
-	int			i;
 	if ( pIKContext )
 	{
 		pIKContext->AddAutoplayLocks( pos, q );
 	}
 
+	BonePoseArrays_t pose = { pos, q };
+	AccumulateAutoplaySequences( pose, flRealTime, pIKContext );
+
+	if ( pIKContext )
+	{
+		pIKContext->SolveAutoplayLocks( pos, q );
+	}
+}
+
+void CBoneSetup::CalcAutoplaySequences(
+   CBonePoseSoA &pose,
+   float flRealTime,
+   CIKContext *pIKContext
+   )
+{
+	// the locks work on the per bone arrays; without any there is nothing for them to do
+	Vector *pos = NULL;
+	Quaternion *q = NULL;
+	if ( pIKContext && m_pStudioHdr->GetNumIKAutoplayLocks() )
+	{
+		pos = g_VectorPool.Alloc();
+		q = g_QaternionPool.Alloc();
+		pose.Store( pos, q );
+		pIKContext->AddAutoplayLocks( pos, q );
+	}
+
+	AccumulateAutoplaySequences( pose, flRealTime, pIKContext );
+
+	if ( pos )
+	{
+		pose.Store( pos, q );
+		pIKContext->SolveAutoplayLocks( pos, q );
+		pose.Load( pos, q, pose.m_nBones );
+
+		g_VectorPool.Free( pos );
+		g_QaternionPool.Free( q );
+	}
+}
+
+template< class POSE >
+void CBoneSetup::AccumulateAutoplaySequences(
+   POSE &pose,
+   float flRealTime,
+   CIKContext *pIKContext
+   )
+{
+	int			i;
 	unsigned short *pList = NULL;
 	int count = m_pStudioHdr->GetAutoplayList( &pList );
 	for (i = 0; i < count; i++)
@@ -4485,14 +6144,9 @@ void CBoneSetup::CalcAutoplaySequences(
 			cycle = flRealTime * cps;
 			cycle = cycle - (int)cycle;
 
-			AccumulatePose( pos, q, sequenceIndex, cycle, 1.0, flRealTime, pIKContext );
+			AccumulatePose( pose, sequenceIndex, cycle, 1.0, flRealTime, pIKContext );
 		}
 	}
-
-	if ( pIKContext )
-	{
-		pIKContext->SolveAutoplayLocks( pos, q );
-	}
 }
 
 
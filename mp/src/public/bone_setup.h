@@ -15,6 +15,7 @@
 #include "studio.h"
 #include "cmodel.h"
 #include "bitvec.h"
+#include "mathlib/ssemath.h"
 
 
 class CBoneToWorld;
@@ -54,6 +55,11 @@ public:
 	IBoneSetup( const CStudioHdr *pStudioHdr, int boneMask, const float poseParameter[], IPoseDebugger *pPoseDebugger = NULL );
 	~IBoneSetup( void );
 	void InitPose( Vector pos[], Quaternion[] );
+	// Like InitPose, but with anim_simd_pose set the pose stays in CBonePoseSoA form inside the bone setup.
+	// AccumulatePose, CalcAutoplaySequences and CalcBoneAdj on the same pos/q blend it there,
+	// and StorePose writes it back to pos/q once the pose is complete.
+	void InitPoseSoA( Vector pos[], Quaternion q[] );
+	void StorePose( Vector pos[], Quaternion q[] );
 	void AccumulatePose( Vector pos[], Quaternion q[], int sequence, float cycle, float flWeight, float flTime, CIKContext *pIKContext );
 	void CalcAutoplaySequences(	Vector pos[], Quaternion q[], float flRealTime, CIKContext *pIKContext );
 	void CalcBoneAdj( Vector pos[], Quaternion q[], const float controllers[] );
@@ -442,6 +448,43 @@ bool TraceToStudio( class IPhysicsSurfaceProps *pProps, const Ray_t& ray, CStudi
 void QuaternionSM( float s, const Quaternion &p, const Quaternion &q, Quaternion &qt );
 void QuaternionMA( const Quaternion &p, float s, const Quaternion &q, Quaternion &qt );
 
+//-----------------------------------------------------------------------------
+// A bone pose stored four bones at a time, so the blend kernels below can work
+// on four bones per instruction.  Bone i is lane ( i & 3 ) of group ( i >> 2 ).
+//-----------------------------------------------------------------------------
+#define MAXSTUDIOBONEGROUPS		( ( MAXSTUDIOBONES + 3 ) / 4 )
+
+class ALIGN16 CBonePoseSoA
+{
+public:
+	int		NumGroups() const { return ( m_nBones + 3 ) >> 2; }
+
+	// Sets all nBones bones to no rotation and no translation
+	void	Init( int nBones );
+
+	// Conversion from and to the regular pos/q arrays
+	void	Load( const Vector pos[], const Quaternion q[], int nBones );
+	void	Load( const Vector pos[], const QuaternionAligned q[], int nBones );
+	void	Store( Vector pos[], Quaternion q[] ) const;
+
+	// Single bone access, for the code that only touches a few bones
+	void	GetBone( int iBone, Vector &pos, Quaternion &q ) const;
+	void	SetBone( int iBone, const Vector &pos, const Quaternion &q );
+
+	FourVectors		m_Pos[ MAXSTUDIOBONEGROUPS ];
+	FourVectors		m_QuatXYZ[ MAXSTUDIOBONEGROUPS ];
+	fltx4			m_QuatW[ MAXSTUDIOBONEGROUPS ];
+	int				m_nBones;
+} ALIGN16_POST;
+
+// Kernels matching the per bone math in SlerpBones, BlendBones and ScaleBones.
+// Weights are per bone, padded with zeros to a multiple of four; lanes with a weight
+// of zero (or a clear mask) are left untouched.  pNoAlign flags BONE_FIXED_ALIGNMENT lanes.
+void SlerpBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const float *pWeights, const fltx4 *pNoAlign );
+void SlerpDeltaBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const float *pWeights, bool bPost );
+void BlendBonesSoA( CBonePoseSoA &pose1, const CBonePoseSoA &pose2, const fltx4 *pActive, const fltx4 *pNoAlign, float s );
+void ScaleBonesSoA( CBonePoseSoA &pose1, const fltx4 *pActive, float s );
+
 bool Studio_PrefetchSequence( const CStudioHdr *pStudioHdr, int iSequence );
 
 void Studio_RunBoneFlexDrivers( float *pFlexController, const CStudioHdr *pStudioHdr, const Vector *pPositions, const matrix3x4_t *pBoneToWorld, const matrix3x4_t &mRootToWorld );
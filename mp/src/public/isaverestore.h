@@ -356,6 +356,18 @@ public:
 	virtual bool Parse( const SaveRestoreFieldInfo_t &fieldInfo, char const* szValue ) { return false; }
 };
 
+//-----------------------------------------------------------------------------
+// Mixed into ops whose Save() only reads the field and writes through the
+// ISave it's handed, using names that outlive the save. Entities whose custom
+// fields only use these can be encoded off the main thread.
+//-----------------------------------------------------------------------------
+abstract_class IThreadSafeSaveOps
+{
+public:
+	// Datamap of any embedded elements the ops save, NULL if there are none
+	virtual datamap_t *GetSaveDataMap() = 0;
+};
+
 
 //-----------------------------------------------------------------------------
 // Used by ops that deal with pointers
@@ -9,6 +9,8 @@
 
 #include "rope_physics.h"
 #include "tier0/dbg.h"
+#include "tier1/utlvector.h"
+#include "mathlib/ssemath.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -92,10 +94,239 @@ void CBaseRopePhysics::SetDelegate( CSimplePhysics::IHelper *pDelegate )
 }
 
 
+static float g_flRopeEnergy = 0.98;
+
+// Number of spring relaxation passes per timestep.
+// If this is too low, gravity tends to win over the constraint
+// solver and it's impossible to get straight ropes.
+static int g_nRopeSpringIterations = 3;
+
+
 void CBaseRopePhysics::Simulate( float dt )
 {
-	static float flEnergy = 0.98;
-	m_Physics.Simulate( m_pNodes, m_nNodes, this, dt, flEnergy );
+	m_Physics.Simulate( m_pNodes, m_nNodes, this, dt, g_flRopeEnergy );
+}
+
+
+//-----------------------------------------------------------------------------
+// Batched simulation. Each SIMD lane holds one rope, and nodes are stored
+// structure-of-arrays by node index, so node i of four ropes is integrated
+// and constrained in one go. Ropes with fewer nodes or fewer timesteps this
+// frame are masked off in the lanes they don't use.
+//-----------------------------------------------------------------------------
+typedef CUtlVector< FourVectors, CUtlMemoryAligned< FourVectors, 16 > > FourVectorsArray_t;
+typedef CUtlVector< fltx4, CUtlMemoryAligned< fltx4, 16 > > Fltx4Array_t;
+
+static FourVectorsArray_t s_BatchPos;
+static FourVectorsArray_t s_BatchPrevPos;
+static FourVectorsArray_t s_BatchAccel;
+static Fltx4Array_t s_BatchSpringDistSqr;
+
+static void GatherRopeLanes( FourVectors *pDest, CBaseRopePhysics **ppLanes, int nNodes, bool bPrev )
+{
+	for ( int iLane = 0; iLane < 4; ++iLane )
+	{
+		CBaseRopePhysics *pRope = ppLanes[iLane];
+		int nRopeNodes = pRope ? pRope->NumNodes() : 0;
+		for ( int i = 0; i < nNodes; ++i )
+		{
+			Vector v( 0, 0, 0 );
+			if ( i < nRopeNodes )
+			{
+				CSimplePhysics::CNode *pNode = pRope->GetNode( i );
+				v = bPrev ? pNode->m_vPrevPos : pNode->m_vPos;
+			}
+			pDest[i].X( iLane ) = v.x;
+			pDest[i].Y( iLane ) = v.y;
+			pDest[i].Z( iLane ) = v.z;
+		}
+	}
+}
+
+static void ScatterRopeLane( const FourVectors *pSrc, CBaseRopePhysics *pRope, int iLane, bool bPrev )
+{
+	for ( int i = 0; i < pRope->NumNodes(); ++i )
+	{
+		CSimplePhysics::CNode *pNode = pRope->GetNode( i );
+		Vector &v = bPrev ? pNode->m_vPrevPos : pNode->m_vPos;
+		v.Init( pSrc[i].X( iLane ), pSrc[i].Y( iLane ), pSrc[i].Z( iLane ) );
+	}
+}
+
+static void GatherRopeLane( FourVectors *pDest, CBaseRopePhysics *pRope, int iLane )
+{
+	for ( int i = 0; i < pRope->NumNodes(); ++i )
+	{
+		const Vector &v = pRope->GetNode( i )->m_vPos;
+		pDest[i].X( iLane ) = v.x;
+		pDest[i].Y( iLane ) = v.y;
+		pDest[i].Z( iLane ) = v.z;
+	}
+}
+
+void CBaseRopePhysics::SimulateBatch( CBaseRopePhysics **ppRopes, int nRopes, float dt )
+{
+	for ( int iFirst = 0; iFirst < nRopes; iFirst += 4 )
+	{
+		CBaseRopePhysics *pLanes[4] = { NULL, NULL, NULL, NULL };
+		int nSteps[4] = { 0, 0, 0, 0 };
+		int nMaxSteps = 0;
+		int nMaxNodes = 0;
+
+		fltx4 fl4TimeStepMul = Four_Zeros;
+		fltx4 fl4SpringDist = Four_Zeros;
+		for ( int iLane = 0; iLane < 4 && iFirst + iLane < nRopes; ++iLane )
+		{
+			CBaseRopePhysics *pRope = ppRopes[iFirst + iLane];
+			pLanes[iLane] = pRope;
+			nSteps[iLane] = pRope->m_Physics.BeginSimulate( dt );
+			nMaxSteps = MAX( nMaxSteps, nSteps[iLane] );
+			nMaxNodes = MAX( nMaxNodes, pRope->m_nNodes );
+			SubFloat( fl4TimeStepMul, iLane ) = pRope->m_Physics.GetTimeStepMul();
+			SubFloat( fl4SpringDist, iLane ) = pRope->m_flSpringDist;
+		}
+
+		if ( nMaxSteps > 0 && nMaxNodes > 0 )
+		{
+			s_BatchPos.EnsureCount( nMaxNodes );
+			s_BatchPrevPos.EnsureCount( nMaxNodes );
+			s_BatchAccel.EnsureCount( nMaxNodes );
+			s_BatchSpringDistSqr.EnsureCount( nMaxNodes );
+
+			FourVectors *pPos = s_BatchPos.Base();
+			FourVectors *pPrevPos = s_BatchPrevPos.Base();
+			FourVectors *pAccel = s_BatchAccel.Base();
+			fltx4 *pSpringDistSqr = s_BatchSpringDistSqr.Base();
+
+			GatherRopeLanes( pPos, pLanes, nMaxNodes, false );
+			GatherRopeLanes( pPrevPos, pLanes, nMaxNodes, true );
+
+			// Spring thresholds; springs past the end of a rope never fire
+			for ( int i = 0; i < nMaxNodes - 1; ++i )
+			{
+				for ( int iLane = 0; iLane < 4; ++iLane )
+				{
+					CBaseRopePhysics *pRope = pLanes[iLane];
+					float flDistSqr = FLT_MAX;
+					if ( pRope && i < pRope->NumSprings() )
+					{
+						// If we don't have an overall spring distance, use the per-node one
+						flDistSqr = pRope->m_flSpringDistSqr ? pRope->m_flSpringDistSqr : pRope->m_flNodeSpringDistsSqr[i];
+					}
+					SubFloat( pSpringDistSqr[i], iLane ) = flDistSqr;
+				}
+			}
+
+			fltx4 fl4Energy = ReplicateX4( g_flRopeEnergy );
+			fltx4 fl4Half = ReplicateX4( 0.5f );
+			for ( int iStep = 0; iStep < nMaxSteps; ++iStep )
+			{
+				fltx4 fl4StepMask = Four_Zeros;
+				for ( int iLane = 0; iLane < 4; ++iLane )
+				{
+					SubInt( fl4StepMask, iLane ) = ( iStep < nSteps[iLane] ) ? 0xFFFFFFFF : 0;
+				}
+
+				// Apply forces.
+				for ( int iLane = 0; iLane < 4; ++iLane )
+				{
+					CBaseRopePhysics *pRope = pLanes[iLane];
+					int nRopeNodes = ( pRope && iStep < nSteps[iLane] ) ? pRope->m_nNodes : 0;
+					for ( int i = 0; i < nMaxNodes; ++i )
+					{
+						Vector vAccel( 0, 0, 0 );
+						if ( i < nRopeNodes )
+						{
+							pRope->GetNodeForces( pRope->m_pNodes, i, &vAccel );
+							Assert( vAccel.IsValid() );
+						}
+						pAccel[i].X( iLane ) = vAccel.x;
+						pAccel[i].Y( iLane ) = vAccel.y;
+						pAccel[i].Z( iLane ) = vAccel.z;
+					}
+				}
+
+				// Verlet integration
+				for ( int i = 0; i < nMaxNodes; ++i )
+				{
+					FourVectors vPos = pPos[i];
+					FourVectors vVel = vPos;
+					vVel -= pPrevPos[i];
+					vVel *= fl4Energy;
+					FourVectors vNew = vPos;
+					vNew += vVel;
+					FourVectors vAccelStep = pAccel[i];
+					vAccelStep *= fl4TimeStepMul;
+					vNew += vAccelStep;
+
+					pPos[i].x = MaskedAssign( fl4StepMask, vNew.x, vPos.x );
+					pPos[i].y = MaskedAssign( fl4StepMask, vNew.y, vPos.y );
+					pPos[i].z = MaskedAssign( fl4StepMask, vNew.z, vPos.z );
+					pPrevPos[i].x = MaskedAssign( fl4StepMask, vPos.x, pPrevPos[i].x );
+					pPrevPos[i].y = MaskedAssign( fl4StepMask, vPos.y, pPrevPos[i].y );
+					pPrevPos[i].z = MaskedAssign( fl4StepMask, vPos.z, pPrevPos[i].z );
+				}
+
+				// The delegate's constraints look at the previous positions
+				for ( int iLane = 0; iLane < 4; ++iLane )
+				{
+					if ( pLanes[iLane] && pLanes[iLane]->m_pDelegate && iStep < nSteps[iLane] )
+					{
+						ScatterRopeLane( pPrevPos, pLanes[iLane], iLane, true );
+					}
+				}
+
+				// Apply constraints.
+				for ( int iIteration = 0; iIteration < g_nRopeSpringIterations; ++iIteration )
+				{
+					for ( int i = 0; i < nMaxNodes - 1; ++i )
+					{
+						FourVectors vTo = pPos[i];
+						vTo -= pPos[i+1];
+
+						fltx4 fl4DistSqr = vTo * vTo;
+						fltx4 fl4Active = AndSIMD( fl4StepMask, CmpGtSIMD( fl4DistSqr, pSpringDistSqr[i] ) );
+
+						// vTo *= 1 - (m_flSpringDist / flDist), split evenly between the two nodes
+						fltx4 fl4Scale = SubSIMD( Four_Ones, DivSIMD( fl4SpringDist, SqrtSIMD( fl4DistSqr ) ) );
+						fl4Scale = AndSIMD( fl4Active, MulSIMD( fl4Scale, fl4Half ) );
+						vTo *= fl4Scale;
+
+						pPos[i] -= vTo;
+						pPos[i+1] += vTo;
+					}
+
+					for ( int iLane = 0; iLane < 4; ++iLane )
+					{
+						CBaseRopePhysics *pRope = pLanes[iLane];
+						if ( !pRope || !pRope->m_pDelegate || iStep >= nSteps[iLane] )
+							continue;
+
+						ScatterRopeLane( pPos, pRope, iLane, false );
+						pRope->m_pDelegate->ApplyConstraints( pRope->m_pNodes, pRope->m_nNodes );
+						GatherRopeLane( pPos, pRope, iLane );
+					}
+				}
+			}
+
+			for ( int iLane = 0; iLane < 4; ++iLane )
+			{
+				if ( pLanes[iLane] && nSteps[iLane] > 0 )
+				{
+					ScatterRopeLane( pPos, pLanes[iLane], iLane, false );
+					ScatterRopeLane( pPrevPos, pLanes[iLane], iLane, true );
+				}
+			}
+		}
+
+		for ( int iLane = 0; iLane < 4; ++iLane )
+		{
+			if ( pLanes[iLane] )
+			{
+				pLanes[iLane]->m_Physics.EndSimulate( pLanes[iLane]->m_pNodes, pLanes[iLane]->m_nNodes );
+			}
+		}
+	}
 }
 
 
@@ -114,8 +345,7 @@ void CBaseRopePhysics::ApplyConstraints( CSimplePhysics::CNode *pNodes, int nNod
 	//
 	// Iterate multiple times here. If we don't, then gravity tends to
 	// win over the constraint solver and it's impossible to get straight ropes.
-	static int nIterations = 3;
-	for( int iIteration=0; iIteration < nIterations; iIteration++ )
+	for( int iIteration=0; iIteration < g_nRopeSpringIterations; iIteration++ )
 	{
 		for( int i=0; i < NumSprings(); i++ )
 		{
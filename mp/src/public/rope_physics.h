@@ -53,6 +53,12 @@ public:
 	void			SetDelegate( CSimplePhysics::IHelper *pDelegate );
 
 	void			Simulate( float dt );
+
+	// Simulates a set of ropes together. Verlet integration and the spring
+	// constraints run across four ropes at a time with SIMD; forces and the
+	// delegate's constraints are still gathered per rope. Only valid for ropes
+	// that don't override GetNodeForces/ApplyConstraints.
+	static void		SimulateBatch( CBaseRopePhysics **ppRopes, int nRopes, float dt );
 	
 	int						NumNodes()				{ return m_nNodes; }
 	CSimplePhysics::CNode*	GetNode( int iNode )	{ return &m_pNodes[iNode]; }
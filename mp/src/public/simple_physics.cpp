@@ -34,10 +34,7 @@ void CSimplePhysics::Simulate(
 	float dt,
 	float flDamp )
 {
-	// Figure out how many time steps to run.
-	m_flPredictedTime += dt;
-	int newTimeStep = (int)ceil( m_flPredictedTime / m_flTimeStep );
-	int nTimeSteps = newTimeStep - m_iCurTimeStep;
+	int nTimeSteps = BeginSimulate( dt );
 	for( int iTimeStep=0; iTimeStep < nTimeSteps; iTimeStep++ )
 	{
 		// Simulate everything..
@@ -58,8 +55,24 @@ void CSimplePhysics::Simulate(
 		// Apply constraints.
 		pHelper->ApplyConstraints( pNodes, nNodes );
 	}
+
+	EndSimulate( pNodes, nNodes );
+}
+
+
+int CSimplePhysics::BeginSimulate( float dt )
+{
+	// Figure out how many time steps to run.
+	m_flPredictedTime += dt;
+	int newTimeStep = (int)ceil( m_flPredictedTime / m_flTimeStep );
+	int nTimeSteps = newTimeStep - m_iCurTimeStep;
 	m_iCurTimeStep = newTimeStep;
+	return nTimeSteps;
+}
 
+
+void CSimplePhysics::EndSimulate( CSimplePhysics::CNode *pNodes, int nNodes )
+{
 	// Setup predicted positions.
 	float flInterpolant = (m_flPredictedTime - (GetCurTime() - m_flTimeStep)) / m_flTimeStep;
 	for( int iNode=0; iNode < nNodes; iNode++ )
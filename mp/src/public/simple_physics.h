@@ -62,6 +62,15 @@ public:
 		float dt,
 		float flDamp );
 
+	// Simulate() split in two for callers that integrate the nodes themselves
+	// (see CBaseRopePhysics::SimulateBatch). BeginSimulate advances the clock and
+	// returns how many fixed timesteps to run, EndSimulate sets up the predicted positions.
+	int			BeginSimulate( float dt );
+	void		EndSimulate( CNode *pNodes, int nNodes );
+
+	// dt*dt*0.5 for the fixed timestep
+	float		GetTimeStepMul() const	{ return m_flTimeStepMul; }
+
 
 private:
 
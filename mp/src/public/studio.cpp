@@ -72,6 +72,12 @@ mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame ) const
 }
 
 mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall ) const
+{
+	int nNumFrames;
+	return pAnim( piFrame, flStall, &nNumFrames );
+}
+
+mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall, int *piNumFrames ) const
 {
 	mstudioanim_t *panim = NULL;
 
@@ -140,6 +146,15 @@ mstudioanim_t *mstudioanimdesc_t::pAnim( int *piFrame, float &flStall ) const
 		}
 	}
 
+	// frames encoded in this section's data, matching what studiomdl writes
+	*piNumFrames = numframes;
+	if ( sectionframes != 0 )
+	{
+		int iStartFrame = MIN( section * sectionframes, numframes - 1 );
+		int iEndFrame = MIN( ( section + 1 ) * sectionframes, numframes - 1 );
+		*piNumFrames = iEndFrame - iStartFrame + 1;
+	}
+
 	// try to guess a valid stall time interval (tuned for the X360)
 	flStall = 0.0f;
 	if (panim == NULL && section <= 0)
@@ -712,6 +712,7 @@ struct mstudioanimdesc_t
 	int					animindex;	 // non-zero when anim data isn't in sections
 	mstudioanim_t *pAnimBlock( int block, int index ) const; // returns pointer to a specific anim block (local or external)
 	mstudioanim_t *pAnim( int *piFrame, float &flStall ) const; // returns pointer to data and new frame index
+	mstudioanim_t *pAnim( int *piFrame, float &flStall, int *piNumFrames ) const; // also returns the number of frames encoded in the data
 	mstudioanim_t *pAnim( int *piFrame ) const; // returns pointer to data and new frame index
 
 	int					numikrules;
@@ -39,6 +39,24 @@ class CUtlBuffer;
 class Color;
 typedef void * FileHandle_t;
 class CKeyValuesGrowableStringTable;
+class CUtlSymbolTableMT;
+struct KeyValuesCachedNode_t;
+
+//-----------------------------------------------------------------------------
+// Purpose: Counters for the parsed file cache behind KeyValues::LoadFromFile
+//-----------------------------------------------------------------------------
+struct KeyValuesParsedFileCacheStats_t
+{
+	int		m_nFiles;			// files currently held
+	int		m_nMemoryBytes;		// memory held by those files
+	int		m_nHits;			// loads rebuilt from the cache
+	int		m_nMisses;			// loads that went through the tokenizer and were cached
+	int		m_nUncacheable;		// loads that went through the tokenizer and can't be cached
+	double	m_flParseTime;		// seconds spent tokenizing the misses
+	double	m_flRestoreTime;	// seconds spent rebuilding the hits
+	int64	m_nParseBytes;		// text bytes behind the misses
+	int64	m_nRestoreBytes;	// text bytes behind the hits
+};
 
 //-----------------------------------------------------------------------------
 // Purpose: Simple recursive data access class
@@ -78,6 +96,19 @@ public:
 	//	understand the implications before using this.
 	static void SetUseGrowableStringTable( bool bUseGrowableTable );
 
+	//	Same as above, but the table is sharded so that lookups never lock and adds only
+	//	lock one shard. Use this when a module loads KeyValues on several threads at once
+	//	and the shared table's lock shows up. The same rules about sharing KeyValues
+	//	pointers with other modules apply.
+	static void SetUseConcurrentStringTable( bool bUseConcurrentTable );
+
+	//	LoadFromFile remembers the parsed form of the files it loads, keyed by path and
+	//	file contents, so loading an unchanged file again skips the tokenizer. The file
+	//	itself is still read every time. Run with -nokeyvaluesparsecache to turn it off.
+	//	Switching string tables with the calls above empties it.
+	static void GetParsedFileCacheStats( KeyValuesParsedFileCacheStats_t &stats );
+	static void FlushParsedFileCache();
+
 	KeyValues( const char *setName );
 
 	//
@@ -310,6 +341,11 @@ private:
 	void FreeAllocatedValue();
 	void AllocateValueBlock(int size);
 
+	// For the parsed file cache used by LoadFromFile
+	KeyValues( const KeyValuesCachedNode_t *&pNode, const char *pStrings );
+	void RestoreFromParsedFileCache( const KeyValuesCachedNode_t *&pNode, const char *pStrings );
+	bool FlattenForParsedFileCache( CUtlVector< KeyValuesCachedNode_t > &nodes, CUtlVector< char > &strings ) const;
+
 	int m_iKeyName;	// keyname is a symbol defined in KeyValuesSystem
 
 	// These are needed out of the union because the API returns string pointers
@@ -340,6 +376,7 @@ private:
 	static int (*s_pfGetSymbolForString)( const char *name, bool bCreate );
 	static const char *(*s_pfGetStringForSymbol)( int symbol );
 	static CKeyValuesGrowableStringTable *s_pGrowableStringTable;
+	static CUtlSymbolTableMT *s_pConcurrentStringTable;
 
 public:
 	// Functions that invoke the default behavior
@@ -350,6 +387,10 @@ public:
 	static int GetSymbolForStringGrowable( const char *name, bool bCreate = true );
 	static const char *GetStringForSymbolGrowable( int symbol );
 
+	// Functions that use the concurrent string table
+	static int GetSymbolForStringConcurrent( const char *name, bool bCreate = true );
+	static const char *GetStringForSymbolConcurrent( int symbol );
+
 	// Functions to get external access to whichever of the above functions we're going to call.
 	static int CallGetSymbolForString( const char *name, bool bCreate = true ) { return s_pfGetSymbolForString( name, bCreate ); }
 	static const char *CallGetStringForSymbol( int symbol ) { return s_pfGetStringForSymbol( symbol ); }
@@ -217,6 +217,16 @@ public:
 	void			WriteBitVec3Normal( const Vector& fa );
 	void			WriteBitAngles( const QAngle& fa );
 
+	// Write a whole array of values. The bits are identical to calling the single
+	// value versions in a loop, but they're gathered in a 64 bit accumulator and
+	// stored a dword at a time instead of masked into the buffer one by one.
+	void			WriteUBitLongArray( const unsigned int *pData, int nCount, int numbits );
+	void			WriteSBitLongArray( const int *pData, int nCount, int numbits );
+	void			WriteBitCoordArray( const float *pData, int nCount );
+	void			WriteBitVec3CoordArray( const Vector *pData, int nCount );
+	void			WriteBitNormalArray( const float *pData, int nCount );
+	void			WriteBitVec3NormalArray( const Vector *pData, int nCount );
+
 
 // Byte functions.
 public:
@@ -592,6 +602,15 @@ public:
 	void			ReadBitVec3Normal( Vector& fa );
 	void			ReadBitAngles( QAngle& fa );
 
+	// Read back what the bf_write array functions wrote, same results as reading
+	// the values one at a time.
+	void			ReadUBitLongArray( unsigned int *pOut, int nCount, int numbits );
+	void			ReadSBitLongArray( int *pOut, int nCount, int numbits );
+	void			ReadBitCoordArray( float *pOut, int nCount );
+	void			ReadBitVec3CoordArray( Vector *pOut, int nCount );
+	void			ReadBitNormalArray( float *pOut, int nCount );
+	void			ReadBitVec3NormalArray( Vector *pOut, int nCount );
+
 	// Faster for comparisons but do not fully decode float values
 	unsigned int	ReadBitCoordBits();
 	unsigned int	ReadBitCoordMPBits( bool bIntegral, bool bLowPrecision );
@@ -171,44 +171,97 @@ private:
 	friend class CLess;
 };
 
-class CUtlSymbolTableMT : private CUtlSymbolTable
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT:
+// description:
+//    Thread safe symbol table. Strings are spread over shards by hash, and each
+//    shard is a hash table whose chains only ever grow at the head, so Find and
+//    String never take a lock. AddString only locks the one shard the string
+//    hashes to, and only when the string isn't in the table yet. Symbols are
+//    handed out in the order strings are added and stay valid for the life of
+//    the table.
+//
+//    The symbol API is limited to what fits in a CUtlSymbol, the index API
+//    goes up to MAX_SYMBOLS.
+//-----------------------------------------------------------------------------
+class CUtlSymbolTableMT
 {
 public:
-	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false )
-		: CUtlSymbolTable( growSize, initSize, caseInsensitive )
-	{
-	}
+	// growSize and initSize are left over from the tree based table and ignored
+	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlSymbolTableMT();
 
 	CUtlSymbol AddString( const char* pString )
 	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
-		return result;
+		return ToSymbol( AddStringIndex( pString ) );
 	}
 
 	CUtlSymbol Find( const char* pString ) const
 	{
-		m_lock.LockForRead();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockRead();
-		return result;
+		return ToSymbol( FindIndex( pString ) );
 	}
 
 	const char* String( CUtlSymbol id ) const
 	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
+		return id.IsValid() ? StringFromIndex( (UtlSymId_t)id ) : "";
 	}
-	
+
+	// Same as above with int symbols, -1 is invalid
+	int AddStringIndex( const char *pString );
+	int FindIndex( const char *pString ) const;
+	const char *StringFromIndex( int nSymbol ) const;
+
+	int GetNumStrings( void ) const
+	{
+		return m_nSymbols;
+	}
+
+	enum
+	{
+		NUM_SHARDS = 16,
+		BUCKETS_PER_SHARD = 4096,
+		SYMBOLS_PER_PAGE = 4096,
+		MAX_SYMBOL_PAGES = 1024,
+		MAX_SYMBOLS = SYMBOLS_PER_PAGE * MAX_SYMBOL_PAGES,
+	};
+
 private:
-#if defined(WIN32) || defined(_WIN32)
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	struct Entry_t
+	{
+		Entry_t			*m_pNext;
+		unsigned int	m_nHash;
+		int				m_nSymbol;
+		char			m_String[1];
+	};
+
+	struct StringBlock_t
+	{
+		StringBlock_t	*m_pNext;
+		int				m_nSize;
+		int				m_nUsed;
+		// string data follows
+	};
+
+	struct Shard_t
+	{
+		Entry_t				**m_pBuckets;	// allocated on the first add
+		StringBlock_t		*m_pBlocks;		// newest first
+		CThreadFastMutex	m_Mutex;
+	};
+
+	static CUtlSymbol ToSymbol( int nSymbol )
+	{
+		return ( nSymbol >= 0 && nSymbol < UTL_INVAL_SYMBOL ) ? CUtlSymbol( (UtlSymId_t)nSymbol ) : CUtlSymbol();
+	}
+
+	unsigned int HashString( const char *pString ) const;
+	const Entry_t *FindEntry( const Shard_t &shard, unsigned int nHash, const char *pString ) const;
+	Entry_t *AllocEntry( Shard_t &shard, int nLen );
+
+	Shard_t				m_Shards[NUM_SHARDS];
+	const char			**m_pSymbolPages[MAX_SYMBOL_PAGES];	// symbol -> string, allocated as needed
+	volatile int		m_nSymbols;
+	bool				m_bInsensitive;
 };
 
 
@@ -29,6 +29,9 @@
 #include "utlvector.h"
 #include "utlqueue.h"
 #include "UtlSortVector.h"
+#include "utldict.h"
+#include "utlsymbol.h"
+#include "checksum_crc.h"
 #include "convar.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
@@ -40,6 +43,11 @@ static const char * s_LastFileLoadingFrom = "unknown"; // just needed for error
 int (*KeyValues::s_pfGetSymbolForString)( const char *name, bool bCreate ) = &KeyValues::GetSymbolForStringClassic;
 const char *(*KeyValues::s_pfGetStringForSymbol)( int symbol ) = &KeyValues::GetStringForSymbolClassic;
 CKeyValuesGrowableStringTable *KeyValues::s_pGrowableStringTable = NULL;
+CUtlSymbolTableMT *KeyValues::s_pConcurrentStringTable = NULL;
+
+// Bumped whenever the key name string table is switched or recreated; symbols
+// from an older generation don't mean anything in the current table.
+static int s_nStringTableGeneration = 0;
 
 #define KEYVALUES_TOKEN_SIZE	4096
 static char s_pTokenBuf[KEYVALUES_TOKEN_SIZE];
@@ -342,6 +350,42 @@ void KeyValues::SetUseGrowableStringTable( bool bUseGrowableTable )
 		delete s_pGrowableStringTable;
 		s_pGrowableStringTable = NULL;
 	}
+
+	// Parsed files cached under the old table hold its symbols
+	s_nStringTableGeneration++;
+	FlushParsedFileCache();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Sets whether the KeyValues system should use a string table that
+//	can be used from several threads without contention. See the comment in the
+//	header for more info.
+//-----------------------------------------------------------------------------
+void KeyValues::SetUseConcurrentStringTable( bool bUseConcurrentTable )
+{
+	if ( bUseConcurrentTable )
+	{
+		s_pfGetStringForSymbol = &(KeyValues::GetStringForSymbolConcurrent);
+		s_pfGetSymbolForString = &(KeyValues::GetSymbolForStringConcurrent);
+
+		if ( NULL == s_pConcurrentStringTable )
+		{
+			// Key names are case insensitive, like the classic table
+			s_pConcurrentStringTable = new CUtlSymbolTableMT( 0, 32, true );
+		}
+	}
+	else
+	{
+		s_pfGetStringForSymbol = &(KeyValues::GetStringForSymbolClassic);
+		s_pfGetSymbolForString = &(KeyValues::GetSymbolForStringClassic);
+
+		delete s_pConcurrentStringTable;
+		s_pConcurrentStringTable = NULL;
+	}
+
+	// Parsed files cached under the old table hold its symbols
+	s_nStringTableGeneration++;
+	FlushParsedFileCache();
 }
 
 //-----------------------------------------------------------------------------
@@ -368,6 +412,16 @@ const char *KeyValues::GetStringForSymbolGrowable( int symbol )
 	return s_pGrowableStringTable->GetStringForSymbol( symbol );
 }
 
+int KeyValues::GetSymbolForStringConcurrent( const char *name, bool bCreate )
+{
+	return bCreate ? s_pConcurrentStringTable->AddStringIndex( name ) : s_pConcurrentStringTable->FindIndex( name );
+}
+
+const char *KeyValues::GetStringForSymbolConcurrent( int symbol )
+{
+	return s_pConcurrentStringTable->StringFromIndex( symbol );
+}
+
 
 
 //-----------------------------------------------------------------------------
@@ -640,6 +694,302 @@ void KeyValues::UsesConditionals(bool state)
 }
 
 
+//-----------------------------------------------------------------------------
+// Parsed file cache
+//
+// The same files (materials, scripts, resource layouts) get loaded over and over
+// during a session. LoadFromFile still reads the file every time, so pure server
+// checks and pack file overrides see exactly what they always did, but when the
+// bytes match what was parsed last time for that path the tree is rebuilt from a
+// flat preorder copy instead of going through the tokenizer again. Key names are
+// kept as symbols so the rebuild never touches the symbol table.
+//
+// Files that #include or #base other files aren't cached since those can change
+// underneath them, and neither is anything loaded without a path ID.
+//-----------------------------------------------------------------------------
+struct KeyValuesCachedNode_t
+{
+	int		m_iKeyName;
+	int		m_nSubKeys;			// the subkeys' nodes follow this one
+	union
+	{
+		int		m_iValue;
+		float	m_flValue;
+		int		m_nStringOffset;	// TYPE_STRING and TYPE_UINT64 values live in the string block
+	};
+	int		m_nStringLength;	// -1 for a NULL string
+	char	m_iDataType;
+	char	m_bHasEscapeSequences;
+	char	m_bEvaluateConditionals;
+};
+
+struct KeyValuesCachedFile_t
+{
+	int		m_nFileSize;
+	CRC32_t	m_nCRC;
+	int		m_nStringTableGeneration;	// symbols are only good in the table that made them
+	int		m_nRootKeys;
+	CUtlVector< KeyValuesCachedNode_t >	m_Nodes;
+	CUtlVector< char >					m_Strings;
+
+	int GetMemoryUsage() const
+	{
+		return sizeof( *this ) + m_Nodes.Count() * sizeof( KeyValuesCachedNode_t ) + m_Strings.Count();
+	}
+};
+
+#define KEYVALUES_PARSED_FILE_CACHE_BUDGET	( 16 * 1024 * 1024 )
+
+class CKeyValuesParsedFileCache
+{
+public:
+	CKeyValuesParsedFileCache() : m_Files( k_eDictCompareTypeFilenames )
+	{
+		memset( &m_Stats, 0, sizeof( m_Stats ) );
+		m_bDisabled = false;
+		m_bCheckedCommandLine = false;
+	}
+
+	~CKeyValuesParsedFileCache()
+	{
+		m_Files.PurgeAndDeleteElements();
+	}
+
+	bool IsEnabled()
+	{
+		if ( !m_bCheckedCommandLine )
+		{
+			m_bDisabled = !!CommandLine()->FindParm( "-nokeyvaluesparsecache" );
+			m_bCheckedCommandLine = true;
+		}
+		return !m_bDisabled;
+	}
+
+	// Everything below needs the mutex held
+	CThreadFastMutex &GetMutex() { return m_Mutex; }
+	KeyValuesParsedFileCacheStats_t &GetStats() { return m_Stats; }
+
+	const KeyValuesCachedFile_t *Find( const char *pKey, int nFileSize, CRC32_t nCRC, int nStringTableGeneration )
+	{
+		int i = m_Files.Find( pKey );
+		if ( i == m_Files.InvalidIndex() )
+			return NULL;
+
+		const KeyValuesCachedFile_t *pFile = m_Files[i];
+		if ( pFile->m_nFileSize != nFileSize || pFile->m_nCRC != nCRC || pFile->m_nStringTableGeneration != nStringTableGeneration )
+			return NULL;
+
+		return pFile;
+	}
+
+	// Takes ownership of the file
+	void Add( const char *pKey, KeyValuesCachedFile_t *pFile )
+	{
+		int nMemory = pFile->GetMemoryUsage();
+
+		int i = m_Files.Find( pKey );
+		if ( i != m_Files.InvalidIndex() )
+		{
+			m_Stats.m_nMemoryBytes -= m_Files[i]->GetMemoryUsage();
+			delete m_Files[i];
+			m_Files[i] = pFile;
+		}
+		else
+		{
+			// Start over rather than track usage, most of what was in here gets loaded again
+			if ( m_Stats.m_nMemoryBytes + nMemory > KEYVALUES_PARSED_FILE_CACHE_BUDGET )
+			{
+				Flush();
+			}
+			m_Files.Insert( pKey, pFile );
+		}
+
+		m_Stats.m_nMemoryBytes += nMemory;
+		m_Stats.m_nFiles = m_Files.Count();
+	}
+
+	void Flush()
+	{
+		m_Files.PurgeAndDeleteElements();
+		m_Stats.m_nFiles = 0;
+		m_Stats.m_nMemoryBytes = 0;
+	}
+
+private:
+	CThreadFastMutex							m_Mutex;
+	CUtlDict< KeyValuesCachedFile_t *, int >	m_Files;
+	KeyValuesParsedFileCacheStats_t				m_Stats;
+	bool										m_bDisabled;
+	bool										m_bCheckedCommandLine;
+};
+
+static CKeyValuesParsedFileCache s_ParsedFileCache;
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether text read from a file can go through the parsed file cache
+//-----------------------------------------------------------------------------
+static bool CanUseParsedFileCache( const char *pathID, const char *pBuffer, int nFileSize )
+{
+	// A NULL path ID searches every path, so the same name can come back as different files
+	if ( !pathID || !s_ParsedFileCache.IsEnabled() )
+		return false;
+
+	// Unicode files get converted before parsing, not worth scanning
+	if ( nFileSize > 2 && (uint8)pBuffer[0] == 0xFF && (uint8)pBuffer[1] == 0xFE )
+		return false;
+
+	for ( const char *p = strchr( pBuffer, '#' ); p; p = strchr( p + 1, '#' ) )
+	{
+		if ( !Q_strnicmp( p, "#include", 8 ) || !Q_strnicmp( p, "#base", 5 ) )
+			return false;
+	}
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies this key and all its subkeys onto the end of a cached file
+//			Returns false if something in here can't be cached
+//-----------------------------------------------------------------------------
+bool KeyValues::FlattenForParsedFileCache( CUtlVector< KeyValuesCachedNode_t > &nodes, CUtlVector< char > &strings ) const
+{
+	if ( m_pChain || m_wsValue )
+		return false;
+
+	int iNode = nodes.AddToTail();
+	KeyValuesCachedNode_t &node = nodes[iNode];
+	node.m_iKeyName = m_iKeyName;
+	node.m_nSubKeys = 0;
+	node.m_iValue = 0;
+	node.m_nStringLength = -1;
+	node.m_iDataType = m_iDataType;
+	node.m_bHasEscapeSequences = m_bHasEscapeSequences;
+	node.m_bEvaluateConditionals = m_bEvaluateConditionals;
+
+	switch ( m_iDataType )
+	{
+	case TYPE_NONE:
+		break;
+
+	case TYPE_STRING:
+		if ( m_sValue )
+		{
+			node.m_nStringLength = Q_strlen( m_sValue ) + 1;
+			node.m_nStringOffset = strings.AddMultipleToTail( node.m_nStringLength, m_sValue );
+		}
+		break;
+
+	case TYPE_UINT64:
+		if ( !m_sValue )
+			return false;
+		node.m_nStringLength = sizeof( uint64 );
+		node.m_nStringOffset = strings.AddMultipleToTail( sizeof( uint64 ), m_sValue );
+		break;
+
+	case TYPE_INT:
+		node.m_iValue = m_iValue;
+		break;
+
+	case TYPE_FLOAT:
+		node.m_flValue = m_flValue;
+		break;
+
+	default:
+		// The parser never makes anything else
+		return false;
+	}
+
+	// node is invalid from here on, the subkeys may grow the vector
+	int nSubKeys = 0;
+	for ( const KeyValues *pSub = m_pSub; pSub; pSub = pSub->m_pPeer )
+	{
+		if ( !pSub->FlattenForParsedFileCache( nodes, strings ) )
+			return false;
+		++nSubKeys;
+	}
+
+	nodes[iNode].m_nSubKeys = nSubKeys;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Builds a key from the parsed file cache, see RestoreFromParsedFileCache
+//-----------------------------------------------------------------------------
+KeyValues::KeyValues( const KeyValuesCachedNode_t *&pNode, const char *pStrings )
+{
+	TRACK_KV_ADD( this, s_pfGetStringForSymbol( pNode->m_iKeyName ) );
+
+	Init();
+	RestoreFromParsedFileCache( pNode, pStrings );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fills out this key and its subkeys from the parsed file cache,
+//			leaving pNode on the node after the last subkey
+//-----------------------------------------------------------------------------
+void KeyValues::RestoreFromParsedFileCache( const KeyValuesCachedNode_t *&pNode, const char *pStrings )
+{
+	const KeyValuesCachedNode_t &node = *pNode++;
+
+	m_iKeyName = node.m_iKeyName;
+	m_iDataType = node.m_iDataType;
+	m_bHasEscapeSequences = node.m_bHasEscapeSequences;
+	m_bEvaluateConditionals = node.m_bEvaluateConditionals;
+
+	switch ( m_iDataType )
+	{
+	case TYPE_STRING:
+	case TYPE_UINT64:
+		if ( node.m_nStringLength >= 0 )
+		{
+			m_sValue = new char[node.m_nStringLength];
+			Q_memcpy( m_sValue, pStrings + node.m_nStringOffset, node.m_nStringLength );
+		}
+		break;
+
+	case TYPE_INT:
+		m_iValue = node.m_iValue;
+		break;
+
+	case TYPE_FLOAT:
+		m_flValue = node.m_flValue;
+		break;
+	}
+
+	KeyValues *pLastChild = NULL;
+	for ( int i = 0; i < node.m_nSubKeys; i++ )
+	{
+		KeyValues *pChild = new KeyValues( pNode, pStrings );
+		if ( pLastChild )
+		{
+			pLastChild->m_pPeer = pChild;
+		}
+		else
+		{
+			m_pSub = pChild;
+		}
+		pLastChild = pChild;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reports on the parsed file cache
+//-----------------------------------------------------------------------------
+void KeyValues::GetParsedFileCacheStats( KeyValuesParsedFileCacheStats_t &stats )
+{
+	AUTO_LOCK( s_ParsedFileCache.GetMutex() );
+	stats = s_ParsedFileCache.GetStats();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Empties the parsed file cache
+//-----------------------------------------------------------------------------
+void KeyValues::FlushParsedFileCache()
+{
+	AUTO_LOCK( s_ParsedFileCache.GetMutex() );
+	s_ParsedFileCache.Flush();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Load keyValues from disk
 //-----------------------------------------------------------------------------
@@ -718,7 +1068,101 @@ bool KeyValues::LoadFromFile( IBaseFileSystem *filesystem, const char *resourceN
 	{
 		buffer[fileSize] = 0; // null terminate file as EOF
 		buffer[fileSize+1] = 0; // double NULL terminating in case this is a unicode file
-		bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+		// Parsing into keys that already have contents merges with them, so only an
+		// empty KeyValues comes out the same every time
+		const bool bUseParsedFileCache = !m_pSub && !m_pPeer && m_iDataType == TYPE_NONE && CanUseParsedFileCache( pathID, buffer, fileSize );
+
+		char szCacheKey[MAX_PATH * 2];
+		CRC32_t nCRC = 0;
+		bool bRestored = false;
+
+		if ( bUseParsedFileCache )
+		{
+			Q_snprintf( szCacheKey, sizeof( szCacheKey ), "%s|%d%d|%s", pathID, m_bHasEscapeSequences ? 1 : 0, m_bEvaluateConditionals ? 1 : 0, resourceName );
+			nCRC = CRC32_ProcessSingleBuffer( buffer, fileSize );
+
+			if ( !refreshCache )
+			{
+				double flStartTime = Plat_FloatTime();
+
+				AUTO_LOCK( s_ParsedFileCache.GetMutex() );
+				const KeyValuesCachedFile_t *pFile = s_ParsedFileCache.Find( szCacheKey, fileSize, nCRC, s_nStringTableGeneration );
+				if ( pFile )
+				{
+					const KeyValuesCachedNode_t *pNode = pFile->m_Nodes.Base();
+					const char *pStrings = pFile->m_Strings.Base();
+
+					RestoreFromParsedFileCache( pNode, pStrings );
+
+					KeyValues *pLastKey = this;
+					for ( int i = 1; i < pFile->m_nRootKeys; i++ )
+					{
+						KeyValues *pKey = new KeyValues( pNode, pStrings );
+						pLastKey->m_pPeer = pKey;
+						pLastKey = pKey;
+					}
+
+					KeyValuesParsedFileCacheStats_t &stats = s_ParsedFileCache.GetStats();
+					stats.m_nHits++;
+					stats.m_nRestoreBytes += fileSize;
+					stats.m_flRestoreTime += Plat_FloatTime() - flStartTime;
+					bRestored = true;
+				}
+			}
+		}
+
+		if ( !bRestored )
+		{
+			double flStartTime = Plat_FloatTime();
+			int nStringTableGeneration = s_nStringTableGeneration;
+
+			bRetOK = LoadFromBuffer( resourceName, buffer, filesystem );
+
+			double flParseTime = Plat_FloatTime() - flStartTime;
+
+			KeyValuesCachedFile_t *pFile = NULL;
+			if ( bUseParsedFileCache && bRetOK )
+			{
+				pFile = new KeyValuesCachedFile_t;
+				pFile->m_nFileSize = fileSize;
+				pFile->m_nCRC = nCRC;
+				pFile->m_nStringTableGeneration = nStringTableGeneration;
+				pFile->m_nRootKeys = 0;
+
+				for ( const KeyValues *pKey = this; pKey; pKey = pKey->m_pPeer )
+				{
+					if ( !pKey->FlattenForParsedFileCache( pFile->m_Nodes, pFile->m_Strings ) )
+					{
+						delete pFile;
+						pFile = NULL;
+						break;
+					}
+					pFile->m_nRootKeys++;
+				}
+			}
+
+			AUTO_LOCK( s_ParsedFileCache.GetMutex() );
+			if ( pFile && pFile->m_nStringTableGeneration != s_nStringTableGeneration )
+			{
+				// The table was switched while we parsed
+				delete pFile;
+				pFile = NULL;
+			}
+
+			KeyValuesParsedFileCacheStats_t &stats = s_ParsedFileCache.GetStats();
+			if ( pFile )
+			{
+				s_ParsedFileCache.Add( szCacheKey, pFile );
+				stats.m_nMisses++;
+				stats.m_nParseBytes += fileSize;
+				stats.m_flParseTime += flParseTime;
+			}
+			else
+			{
+				stats.m_nUncacheable++;
+			}
+		}
 	}
 	
 	// The cache relies on the KeyValuesSystem string table, which will only be valid if we're
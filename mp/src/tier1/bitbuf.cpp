@@ -716,6 +716,268 @@ void bf_write::WriteBitAngles( const QAngle& fa )
 	WriteBitVec3Coord( tmp );
 }
 
+
+//-----------------------------------------------------------------------------
+// Array writes. Values are packed LSB first into a 64 bit accumulator and the
+// buffer only gets touched when a whole dword is ready, plus once at each end
+// to keep the bits around the written range, exactly like WriteUBitLong does.
+// The encoders below have to match the single value functions above bit for
+// bit; when there might not be room for the worst case the array functions
+// fall back to those so overflow behaves the same too.
+//-----------------------------------------------------------------------------
+#define BITCOORD_MAX_BITS		( 3 + COORD_INTEGER_BITS + COORD_FRACTIONAL_BITS )
+#define BITNORMAL_BITS			( 1 + NORMAL_FRACTIONAL_BITS )
+
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator( bf_write *pBuf ) : m_pBuf( pBuf )
+	{
+		m_iDWord = pBuf->m_iCurBit >> 5;
+		m_nBits = pBuf->m_iCurBit & 31;
+		m_nAccum = m_nBits ? ( LoadLittleDWord( pBuf->m_pData, m_iDWord ) & g_ExtraMasks[m_nBits] ) : 0;
+		m_nWritten = 0;
+	}
+
+	// data must already fit in numbits, numbits <= 32
+	FORCEINLINE void Write( unsigned int data, int numbits )
+	{
+		m_nAccum |= (uint64)data << m_nBits;
+		m_nBits += numbits;
+		m_nWritten += numbits;
+		if ( m_nBits >= 32 )
+		{
+			StoreLittleDWord( m_pBuf->m_pData, m_iDWord++, (unsigned long)(uint32)m_nAccum );
+			m_nAccum >>= 32;
+			m_nBits -= 32;
+		}
+	}
+
+	void Flush()
+	{
+		if ( m_nBits )
+		{
+			unsigned long dword = LoadLittleDWord( m_pBuf->m_pData, m_iDWord );
+			uint32 mask = (uint32)g_ExtraMasks[m_nBits];
+			dword = ( dword & ~(unsigned long)mask ) | ( (uint32)m_nAccum & mask );
+			StoreLittleDWord( m_pBuf->m_pData, m_iDWord, dword );
+		}
+		m_pBuf->m_iCurBit += m_nWritten;
+	}
+
+private:
+	bf_write	*m_pBuf;
+	uint64		m_nAccum;
+	int			m_nBits;
+	int			m_iDWord;
+	int			m_nWritten;
+};
+
+// Same bits WriteSBitLong writes, including for values that don't fit
+static FORCEINLINE unsigned int EncodeSBitLong( int data, int numbits )
+{
+	int nValue = data;
+	int nPreserveBits = ( 0x7FFFFFFF >> ( 32 - numbits ) );
+	int nSignExtension = ( nValue >> 31 ) & ~nPreserveBits;
+	nValue &= nPreserveBits;
+	nValue |= nSignExtension;
+	return (unsigned int)nValue & (uint32)g_ExtraMasks[numbits];
+}
+
+// Same bits WriteBitCoord writes
+static FORCEINLINE void WriteBitCoordAccum( CBitWriteAccumulator &accum, const float f )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	unsigned int bits = ( intval ? 1 : 0 ) | ( fractval ? 2 : 0 );
+	int numbits = 2;
+
+	if ( intval || fractval )
+	{
+		bits |= signbit << 2;
+		numbits = 3;
+
+		if ( intval )
+		{
+			bits |= ( (unsigned int)( intval - 1 ) & ( ( 1 << COORD_INTEGER_BITS ) - 1 ) ) << numbits;
+			numbits += COORD_INTEGER_BITS;
+		}
+
+		if ( fractval )
+		{
+			bits |= (unsigned int)fractval << numbits;
+			numbits += COORD_FRACTIONAL_BITS;
+		}
+	}
+
+	accum.Write( bits, numbits );
+}
+
+// Same bits WriteBitNormal writes
+static FORCEINLINE void WriteBitNormalAccum( CBitWriteAccumulator &accum, float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	accum.Write( signbit | ( fractval << 1 ), BITNORMAL_BITS );
+}
+
+void bf_write::WriteUBitLongArray( const unsigned int *pData, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * numbits > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteUBitLong( pData[i], numbits );
+		return;
+	}
+
+	uint32 mask = (uint32)g_ExtraMasks[numbits];
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		accum.Write( pData[i] & mask, numbits );
+	}
+	accum.Flush();
+}
+
+void bf_write::WriteSBitLongArray( const int *pData, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * numbits > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteSBitLong( pData[i], numbits );
+		return;
+	}
+
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		accum.Write( EncodeSBitLong( pData[i], numbits ), numbits );
+	}
+	accum.Flush();
+}
+
+void bf_write::WriteBitCoordArray( const float *pData, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * BITCOORD_MAX_BITS > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteBitCoord( pData[i] );
+		return;
+	}
+
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		WriteBitCoordAccum( accum, pData[i] );
+	}
+	accum.Flush();
+}
+
+void bf_write::WriteBitVec3CoordArray( const Vector *pData, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * ( 3 + 3 * BITCOORD_MAX_BITS ) > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteBitVec3Coord( pData[i] );
+		return;
+	}
+
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		const Vector &fa = pData[i];
+
+		int xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+		int yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+		int zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+
+		accum.Write( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
+
+		if ( xflag )
+			WriteBitCoordAccum( accum, fa[0] );
+		if ( yflag )
+			WriteBitCoordAccum( accum, fa[1] );
+		if ( zflag )
+			WriteBitCoordAccum( accum, fa[2] );
+	}
+	accum.Flush();
+}
+
+void bf_write::WriteBitNormalArray( const float *pData, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * BITNORMAL_BITS > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteBitNormal( pData[i] );
+		return;
+	}
+
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		WriteBitNormalAccum( accum, pData[i] );
+	}
+	accum.Flush();
+}
+
+void bf_write::WriteBitVec3NormalArray( const Vector *pData, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * ( 3 + 2 * BITNORMAL_BITS ) > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			WriteBitVec3Normal( pData[i] );
+		return;
+	}
+
+	CBitWriteAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		const Vector &fa = pData[i];
+
+		int xflag = (fa[0] >= NORMAL_RESOLUTION) || (fa[0] <= -NORMAL_RESOLUTION);
+		int yflag = (fa[1] >= NORMAL_RESOLUTION) || (fa[1] <= -NORMAL_RESOLUTION);
+
+		accum.Write( xflag | ( yflag << 1 ), 2 );
+
+		if ( xflag )
+			WriteBitNormalAccum( accum, fa[0] );
+		if ( yflag )
+			WriteBitNormalAccum( accum, fa[1] );
+
+		// z sign bit
+		accum.Write( (fa[2] <= -NORMAL_RESOLUTION), 1 );
+	}
+	accum.Flush();
+}
+
 void bf_write::WriteChar(int val)
 {
 	WriteSBitLong(val, sizeof(char) << 3);
@@ -1341,6 +1603,264 @@ void bf_read::ReadBitAngles( QAngle& fa )
 	fa.Init( tmp.x, tmp.y, tmp.z );
 }
 
+
+//-----------------------------------------------------------------------------
+// Array reads, the other half of the bf_write array functions. A dword is only
+// loaded once the accumulator runs short, so nothing past the last dword the
+// single value reads would touch gets loaded either.
+//-----------------------------------------------------------------------------
+class CBitReadAccumulator
+{
+public:
+	CBitReadAccumulator( bf_read *pBuf ) : m_pBuf( pBuf )
+	{
+		m_iDWord = pBuf->m_iCurBit >> 5;
+		int nSkip = pBuf->m_iCurBit & 31;
+		m_nAccum = (uint32)LoadLittleDWord( (unsigned long* RESTRICT)pBuf->m_pData, m_iDWord++ ) >> nSkip;
+		m_nBits = 32 - nSkip;
+		m_nRead = 0;
+	}
+
+	// numbits <= 32
+	FORCEINLINE unsigned int Read( int numbits )
+	{
+		if ( m_nBits < numbits )
+		{
+			m_nAccum |= (uint64)(uint32)LoadLittleDWord( (unsigned long* RESTRICT)m_pBuf->m_pData, m_iDWord++ ) << m_nBits;
+			m_nBits += 32;
+		}
+
+		unsigned int result = (uint32)m_nAccum & (uint32)g_ExtraMasks[numbits];
+		m_nAccum >>= numbits;
+		m_nBits -= numbits;
+		m_nRead += numbits;
+		return result;
+	}
+
+	void Finish()
+	{
+		m_pBuf->m_iCurBit += m_nRead;
+	}
+
+private:
+	bf_read		*m_pBuf;
+	uint64		m_nAccum;
+	int			m_nBits;
+	int			m_iDWord;
+	int			m_nRead;
+};
+
+// Same as ReadBitCoord
+static FORCEINLINE float ReadBitCoordAccum( CBitReadAccumulator &accum )
+{
+	int		intval=0,fractval=0,signbit=0;
+	float	value = 0.0;
+
+	unsigned int flags = accum.Read( 2 );
+	intval = flags & 1;
+	fractval = flags >> 1;
+
+	if ( intval || fractval )
+	{
+		signbit = accum.Read( 1 );
+
+		if ( intval )
+		{
+			intval = accum.Read( COORD_INTEGER_BITS ) + 1;
+		}
+
+		if ( fractval )
+		{
+			fractval = accum.Read( COORD_FRACTIONAL_BITS );
+		}
+
+		value = intval + ((float)fractval * COORD_RESOLUTION);
+
+		if ( signbit )
+			value = -value;
+	}
+
+	return value;
+}
+
+// Same as ReadBitNormal
+static FORCEINLINE float ReadBitNormalAccum( CBitReadAccumulator &accum )
+{
+	int	signbit = accum.Read( 1 );
+	unsigned int fractval = accum.Read( NORMAL_FRACTIONAL_BITS );
+
+	float value = (float)fractval * NORMAL_RESOLUTION;
+
+	if ( signbit )
+		value = -value;
+
+	return value;
+}
+
+void bf_read::ReadUBitLongArray( unsigned int *pOut, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * numbits > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			pOut[i] = ReadUBitLong( numbits );
+		return;
+	}
+
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = accum.Read( numbits );
+	}
+	accum.Finish();
+}
+
+void bf_read::ReadSBitLongArray( int *pOut, int nCount, int numbits )
+{
+	Assert( numbits > 0 && numbits <= 32 );
+
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * numbits > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			pOut[i] = ReadSBitLong( numbits );
+		return;
+	}
+
+	unsigned int s = 1 << (numbits-1);
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		unsigned int r = accum.Read( numbits );
+		if ( r >= s )
+		{
+			r = r - s - s;
+		}
+		pOut[i] = r;
+	}
+	accum.Finish();
+}
+
+void bf_read::ReadBitCoordArray( float *pOut, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * BITCOORD_MAX_BITS > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			pOut[i] = ReadBitCoord();
+		return;
+	}
+
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = ReadBitCoordAccum( accum );
+	}
+	accum.Finish();
+}
+
+void bf_read::ReadBitVec3CoordArray( Vector *pOut, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * ( 3 + 3 * BITCOORD_MAX_BITS ) > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			ReadBitVec3Coord( pOut[i] );
+		return;
+	}
+
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		Vector &fa = pOut[i];
+		fa.Init( 0, 0, 0 );
+
+		unsigned int flags = accum.Read( 3 );
+
+		if ( flags & 1 )
+			fa[0] = ReadBitCoordAccum( accum );
+		if ( flags & 2 )
+			fa[1] = ReadBitCoordAccum( accum );
+		if ( flags & 4 )
+			fa[2] = ReadBitCoordAccum( accum );
+	}
+	accum.Finish();
+}
+
+void bf_read::ReadBitNormalArray( float *pOut, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * BITNORMAL_BITS > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			pOut[i] = ReadBitNormal();
+		return;
+	}
+
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		pOut[i] = ReadBitNormalAccum( accum );
+	}
+	accum.Finish();
+}
+
+void bf_read::ReadBitVec3NormalArray( Vector *pOut, int nCount )
+{
+	if ( nCount <= 0 )
+		return;
+
+	if ( (int64)nCount * ( 3 + 2 * BITNORMAL_BITS ) > GetNumBitsLeft() )
+	{
+		for ( int i = 0; i < nCount; i++ )
+			ReadBitVec3Normal( pOut[i] );
+		return;
+	}
+
+	CBitReadAccumulator accum( this );
+	for ( int i = 0; i < nCount; i++ )
+	{
+		Vector &fa = pOut[i];
+
+		unsigned int flags = accum.Read( 2 );
+
+		if ( flags & 1 )
+			fa[0] = ReadBitNormalAccum( accum );
+		else
+			fa[0] = 0.0f;
+
+		if ( flags & 2 )
+			fa[1] = ReadBitNormalAccum( accum );
+		else
+			fa[1] = 0.0f;
+
+		// The first two imply the third (but not its sign)
+		int znegative = accum.Read( 1 );
+
+		float fafafbfb = fa[0] * fa[0] + fa[1] * fa[1];
+		if (fafafbfb < 1.0f)
+			fa[2] = sqrt( 1.0f - fafafbfb );
+		else
+			fa[2] = 0.0f;
+
+		if (znegative)
+			fa[2] = -fa[2];
+	}
+	accum.Finish();
+}
+
 int64 bf_read::ReadLongLong()
 {
 	int64 retval;
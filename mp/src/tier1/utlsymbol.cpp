@@ -15,6 +15,7 @@
 #include "stringpool.h"
 #include "utlhashtable.h"
 #include "utlstring.h"
+#include "generichash.h"
 
 // Ensure that everybody has the right compiler version installed. The version
 // number can be obtained by looking at the compiler output when you type 'cl'
@@ -288,6 +289,184 @@ void CUtlSymbolTable::RemoveAll()
 }
 
 
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT
+//
+// The low bits of the hash pick the shard and the next ones the bucket. A new
+// entry is completely filled out, string and all, before it goes on the front
+// of its chain and its string goes in the symbol pages, so a reader that finds
+// it never sees it half built. Entries are never removed until the table goes.
+//-----------------------------------------------------------------------------
+#define SYMBOL_SHARD_BITS			4
+#define SYMBOL_STRING_BLOCK_SIZE	( 16 * 1024 )
+
+COMPILE_TIME_ASSERT( CUtlSymbolTableMT::NUM_SHARDS == ( 1 << SYMBOL_SHARD_BITS ) );
+
+CUtlSymbolTableMT::CUtlSymbolTableMT( int growSize, int initSize, bool caseInsensitive ) :
+	m_nSymbols( 0 ), m_bInsensitive( caseInsensitive )
+{
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		m_Shards[i].m_pBuckets = NULL;
+		m_Shards[i].m_pBlocks = NULL;
+	}
+
+	memset( m_pSymbolPages, 0, sizeof( m_pSymbolPages ) );
+}
+
+CUtlSymbolTableMT::~CUtlSymbolTableMT()
+{
+	for ( int i = 0; i < NUM_SHARDS; i++ )
+	{
+		Shard_t &shard = m_Shards[i];
+		free( shard.m_pBuckets );
+
+		StringBlock_t *pNext;
+		for ( StringBlock_t *pBlock = shard.m_pBlocks; pBlock; pBlock = pNext )
+		{
+			pNext = pBlock->m_pNext;
+			free( pBlock );
+		}
+	}
+
+	for ( int i = 0; i < MAX_SYMBOL_PAGES; i++ )
+	{
+		free( m_pSymbolPages[i] );
+	}
+}
+
+unsigned int CUtlSymbolTableMT::HashString( const char *pString ) const
+{
+	return m_bInsensitive ? HashStringCaseless( pString ) : ::HashString( pString );
+}
+
+//-----------------------------------------------------------------------------
+// Walks a chain without locking, see above
+//-----------------------------------------------------------------------------
+const CUtlSymbolTableMT::Entry_t *CUtlSymbolTableMT::FindEntry( const Shard_t &shard, unsigned int nHash, const char *pString ) const
+{
+	Entry_t **pBuckets = shard.m_pBuckets;
+	if ( !pBuckets )
+		return NULL;
+
+	for ( const Entry_t *pEntry = pBuckets[ ( nHash >> SYMBOL_SHARD_BITS ) % BUCKETS_PER_SHARD ]; pEntry; pEntry = pEntry->m_pNext )
+	{
+		if ( pEntry->m_nHash != nHash )
+			continue;
+
+		if ( m_bInsensitive ? !V_stricmp( pEntry->m_String, pString ) : !V_strcmp( pEntry->m_String, pString ) )
+			return pEntry;
+	}
+
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Carves an entry out of the shard's string blocks, the shard must be locked
+//-----------------------------------------------------------------------------
+CUtlSymbolTableMT::Entry_t *CUtlSymbolTableMT::AllocEntry( Shard_t &shard, int nLen )
+{
+	// Keep entries pointer aligned
+	int nSize = ( offsetof( Entry_t, m_String ) + nLen + sizeof( void * ) - 1 ) & ~( sizeof( void * ) - 1 );
+
+	StringBlock_t *pBlock = shard.m_pBlocks;
+	if ( !pBlock || pBlock->m_nSize - pBlock->m_nUsed < nSize )
+	{
+		int nBlockSize = max( nSize, SYMBOL_STRING_BLOCK_SIZE );
+		pBlock = (StringBlock_t *)malloc( sizeof( StringBlock_t ) + nBlockSize );
+		pBlock->m_pNext = shard.m_pBlocks;
+		pBlock->m_nSize = nBlockSize;
+		pBlock->m_nUsed = 0;
+		shard.m_pBlocks = pBlock;
+	}
+
+	Entry_t *pEntry = (Entry_t *)( (byte *)( pBlock + 1 ) + pBlock->m_nUsed );
+	pBlock->m_nUsed += nSize;
+	return pEntry;
+}
+
+int CUtlSymbolTableMT::FindIndex( const char *pString ) const
+{
+	if ( !pString )
+		return -1;
+
+	unsigned int nHash = HashString( pString );
+	const Entry_t *pEntry = FindEntry( m_Shards[ nHash & ( NUM_SHARDS - 1 ) ], nHash, pString );
+	return pEntry ? pEntry->m_nSymbol : -1;
+}
+
+int CUtlSymbolTableMT::AddStringIndex( const char *pString )
+{
+	if ( !pString )
+		return -1;
+
+	unsigned int nHash = HashString( pString );
+	Shard_t &shard = m_Shards[ nHash & ( NUM_SHARDS - 1 ) ];
+
+	const Entry_t *pFound = FindEntry( shard, nHash, pString );
+	if ( pFound )
+		return pFound->m_nSymbol;
+
+	AUTO_LOCK( shard.m_Mutex );
+
+	// Somebody may have added it while we were waiting
+	pFound = FindEntry( shard, nHash, pString );
+	if ( pFound )
+		return pFound->m_nSymbol;
+
+	if ( !shard.m_pBuckets )
+	{
+		Entry_t **pBuckets = (Entry_t **)calloc( BUCKETS_PER_SHARD, sizeof( Entry_t * ) );
+		ThreadMemoryBarrier();
+		shard.m_pBuckets = pBuckets;
+	}
+
+	int nLen = V_strlen( pString ) + 1;
+	Entry_t *pEntry = AllocEntry( shard, nLen );
+	pEntry->m_nHash = nHash;
+	memcpy( pEntry->m_String, pString, nLen );
+
+	// Symbols come from one counter shared by the shards, the page they land on
+	// may be new to every shard at once
+	int nSymbol = ThreadInterlockedIncrement( &m_nSymbols ) - 1;
+	if ( nSymbol >= MAX_SYMBOLS )
+	{
+		Error( "CUtlSymbolTableMT: out of symbols (%d)\n", (int)MAX_SYMBOLS );
+		return -1;
+	}
+	pEntry->m_nSymbol = nSymbol;
+
+	int iPage = nSymbol / SYMBOLS_PER_PAGE;
+	if ( !m_pSymbolPages[iPage] )
+	{
+		const char **pPage = (const char **)calloc( SYMBOLS_PER_PAGE, sizeof( const char * ) );
+		if ( !ThreadInterlockedAssignPointerIf( (void * volatile *)&m_pSymbolPages[iPage], pPage, NULL ) )
+		{
+			free( pPage );
+		}
+	}
+	m_pSymbolPages[iPage][ nSymbol % SYMBOLS_PER_PAGE ] = pEntry->m_String;
+
+	// Publish
+	Entry_t **ppHead = &shard.m_pBuckets[ ( nHash >> SYMBOL_SHARD_BITS ) % BUCKETS_PER_SHARD ];
+	pEntry->m_pNext = *ppHead;
+	ThreadMemoryBarrier();
+	*ppHead = pEntry;
+
+	return nSymbol;
+}
+
+const char *CUtlSymbolTableMT::StringFromIndex( int nSymbol ) const
+{
+	if ( nSymbol < 0 || nSymbol >= m_nSymbols || nSymbol >= MAX_SYMBOLS )
+		return "";
+
+	const char **pPage = m_pSymbolPages[ nSymbol / SYMBOLS_PER_PAGE ];
+	const char *pString = pPage ? pPage[ nSymbol % SYMBOLS_PER_PAGE ] : NULL;
+	return pString ? pString : "";
+}
+
+
 
 class CUtlFilenameSymbolTable::HashTable : public CUtlStableHashtable<CUtlConstString>
 {